@@ -0,0 +1,146 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include "tests.h"
+
+#include <debug.h>
+#include <err.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <kernel/event.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <platform.h>
+
+/* Scheduler wakeup benchmark.
+ *
+ * For each cpu count N from 1 up to the number of active cpus, runs N pairs of
+ * threads ping-ponging through a pair of events. The pinger of pair i is pinned
+ * to cpu i and the ponger to cpu (i + 1) % N, so every wakeup crosses cpus once
+ * there is more than one of them. Reports the aggregate context switch rate
+ * and the average time from signaling a thread to it running.
+ */
+
+#define SCHED_BENCH_DEFAULT_ITER 10000
+
+struct sched_bench_pair {
+    event_t ping;
+    event_t pong;
+    uint iter;
+
+    /* time the last event was signaled, and accumulated wakeup latency */
+    volatile lk_time_t signal_time;
+    lk_time_t latency;
+    uint wakeups;
+};
+
+static event_t sched_bench_start;
+
+static void sched_bench_wakeup(struct sched_bench_pair *pair)
+{
+    pair->latency += current_time() - pair->signal_time;
+    pair->wakeups++;
+}
+
+static int sched_bench_pinger(void *arg)
+{
+    struct sched_bench_pair *pair = arg;
+
+    event_wait(&sched_bench_start);
+
+    for (uint i = 0; i < pair->iter; i++) {
+        pair->signal_time = current_time();
+        event_signal(&pair->pong, true);
+        event_wait(&pair->ping);
+        sched_bench_wakeup(pair);
+    }
+
+    return 0;
+}
+
+static int sched_bench_ponger(void *arg)
+{
+    struct sched_bench_pair *pair = arg;
+
+    for (uint i = 0; i < pair->iter; i++) {
+        event_wait(&pair->pong);
+        sched_bench_wakeup(pair);
+        pair->signal_time = current_time();
+        event_signal(&pair->ping, true);
+    }
+
+    return 0;
+}
+
+static void sched_bench_run(uint cpus, uint iter)
+{
+    struct sched_bench_pair pairs[SMP_MAX_CPUS];
+    thread_t *threads[SMP_MAX_CPUS * 2];
+
+    event_init(&sched_bench_start, false, 0);
+
+    for (uint i = 0; i < cpus; i++) {
+        struct sched_bench_pair *pair = &pairs[i];
+        memset(pair, 0, sizeof(*pair));
+        event_init(&pair->ping, false, EVENT_FLAG_AUTOUNSIGNAL);
+        event_init(&pair->pong, false, EVENT_FLAG_AUTOUNSIGNAL);
+        pair->iter = iter;
+
+        threads[i * 2] = thread_create("sched bench ping", &sched_bench_pinger, pair,
+                                       DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+        threads[i * 2 + 1] = thread_create("sched bench pong", &sched_bench_ponger, pair,
+                                           DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+        thread_set_pinned_cpu(threads[i * 2], i);
+        thread_set_pinned_cpu(threads[i * 2 + 1], (i + 1) % cpus);
+        thread_resume(threads[i * 2]);
+        thread_resume(threads[i * 2 + 1]);
+    }
+
+    /* let everyone get to the starting line */
+    thread_sleep_relative(LK_MSEC(100));
+
+    lk_time_t t = current_time();
+    event_signal(&sched_bench_start, true);
+    for (uint i = 0; i < cpus * 2; i++) {
+        thread_join(threads[i], NULL, INFINITE_TIME);
+    }
+    t = current_time() - t;
+
+    lk_time_t latency = 0;
+    uint64_t wakeups = 0;
+    for (uint i = 0; i < cpus; i++) {
+        latency += pairs[i].latency;
+        wakeups += pairs[i].wakeups;
+        event_destroy(&pairs[i].ping);
+        event_destroy(&pairs[i].pong);
+    }
+    event_destroy(&sched_bench_start);
+
+    printf("%2u cpus: %8" PRIu64 " wakeups in %8" PRIu64 " us, %10" PRIu64
+           " switches/sec, %6" PRIu64 " ns avg wakeup latency\n",
+           cpus, wakeups, t / 1000, t ? wakeups * LK_SEC(1) / t : 0,
+           wakeups ? latency / wakeups : 0);
+}
+
+int sched_bench(int argc, const cmd_args *argv)
+{
+    uint iter = SCHED_BENCH_DEFAULT_ITER;
+    if (argc >= 2)
+        iter = argv[1].u;
+
+    mp_cpu_mask_t active = mp_get_active_mask();
+    uint max_cpus = 0;
+    while (max_cpus < SMP_MAX_CPUS && (active & (1u << max_cpus)))
+        max_cpus++;
+
+    printf("scheduler wakeup benchmark, %u round trips per pair\n", iter);
+    for (uint cpus = 1; cpus <= max_cpus; cpus++) {
+        sched_bench_run(cpus, iter);
+    }
+
+    return NO_ERROR;
+}
@@ -25,10 +25,12 @@ STATIC_COMMAND("thread_tests", "test the scheduler", (console_cmd)&thread_tests)
 STATIC_COMMAND("clock_tests", "test clocks", (console_cmd)&clock_tests)
 STATIC_COMMAND("sleep_tests", "tests sleep", (console_cmd)&sleep_tests)
 STATIC_COMMAND("bench", "miscellaneous benchmarks", (console_cmd)&benchmarks)
+STATIC_COMMAND("sched_bench", "scheduler wakeup latency and context switch benchmark", (console_cmd)&sched_bench)
 STATIC_COMMAND("fibo", "threaded fibonacci", (console_cmd)&fibo)
 STATIC_COMMAND("spinner", "create a spinning thread", (console_cmd)&spinner)
 STATIC_COMMAND("sync_ipi_tests", "test synchronous IPIs", (console_cmd)&sync_ipi_tests)
 STATIC_COMMAND("timer_tests", "tests timers", (console_cmd)&timer_tests)
+STATIC_COMMAND("timer_bench", "timer queue insert, cancel and fire benchmark", (console_cmd)&timer_bench)
 STATIC_COMMAND_END(tests);
 
 #endif
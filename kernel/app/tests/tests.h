@@ -21,6 +21,8 @@ void timer_tests(void);
 void benchmarks(void);
 int fibo(int argc, const cmd_args *argv);
 int spinner(int argc, const cmd_args *argv);
+int sched_bench(int argc, const cmd_args *argv);
+int timer_bench(int argc, const cmd_args *argv);
 int ref_counted_tests(int argc, const cmd_args *argv);
 int ref_ptr_tests(int argc, const cmd_args *argv);
 int unique_ptr_tests(int argc, const cmd_args *argv);
@@ -108,6 +108,107 @@ static int mutex_test(void)
     return 0;
 }
 
+/* priority inheritance test
+ *
+ * A low priority thread takes a mutex and works for a short while with it
+ * held. Meanwhile a high priority thread blocks on the mutex and a medium
+ * priority thread spins for much longer than that, all on the same cpu.
+ * Without priority inheritance the medium thread keeps the holder (and so the
+ * high priority thread) off the cpu until it finishes spinning. With it the
+ * holder runs at the waiter's priority, and the waiter gets the mutex after
+ * about the holder's work time.
+ */
+#define PI_TEST_HOLD_TIME LK_MSEC(10)
+#define PI_TEST_SPIN_TIME LK_MSEC(500)
+
+struct pi_test_state {
+    mutex_t m;
+    event_t held;
+    lk_time_t wait_time;
+    int boosted_priority;
+};
+
+static void pi_test_busy(lk_time_t duration)
+{
+    lk_time_t t = current_time();
+    while (current_time() - t < duration)
+        ;
+}
+
+static int pi_test_low(void *arg)
+{
+    struct pi_test_state *s = arg;
+
+    mutex_acquire(&s->m);
+    event_signal(&s->held, true);
+    pi_test_busy(PI_TEST_HOLD_TIME);
+    s->boosted_priority = get_current_thread()->priority;
+    mutex_release(&s->m);
+
+    return 0;
+}
+
+static int pi_test_medium(void *arg)
+{
+    pi_test_busy(PI_TEST_SPIN_TIME);
+    return 0;
+}
+
+static int pi_test_high(void *arg)
+{
+    struct pi_test_state *s = arg;
+
+    lk_time_t t = current_time();
+    mutex_acquire(&s->m);
+    s->wait_time = current_time() - t;
+    mutex_release(&s->m);
+
+    return 0;
+}
+
+static void pi_test(void)
+{
+    struct pi_test_state s;
+    mutex_init(&s.m);
+    event_init(&s.held, false, 0);
+    s.wait_time = 0;
+    s.boosted_priority = -1;
+
+    printf("testing mutex priority inheritance\n");
+
+    thread_t *low = thread_create("pi low", &pi_test_low, &s, LOW_PRIORITY, DEFAULT_STACK_SIZE);
+    thread_t *medium = thread_create("pi medium", &pi_test_medium, &s, DEFAULT_PRIORITY,
+                                     DEFAULT_STACK_SIZE);
+    thread_t *high = thread_create("pi high", &pi_test_high, &s, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
+
+    /* everyone shares a cpu, so the medium thread really is in the way */
+    uint cpu = arch_curr_cpu_num();
+    thread_set_pinned_cpu(low, cpu);
+    thread_set_pinned_cpu(medium, cpu);
+    thread_set_pinned_cpu(high, cpu);
+
+    thread_resume(low);
+    event_wait(&s.held);
+    thread_resume(medium);
+    thread_resume(high);
+
+    thread_join(high, NULL, INFINITE_TIME);
+    thread_join(medium, NULL, INFINITE_TIME);
+    thread_join(low, NULL, INFINITE_TIME);
+
+    printf("high priority waiter blocked for %" PRIu64 " us (holder works for %" PRIu64
+           " us, medium thread spins for %" PRIu64 " us), holder ran at priority %d\n",
+           s.wait_time / 1000, PI_TEST_HOLD_TIME / 1000, PI_TEST_SPIN_TIME / 1000,
+           s.boosted_priority);
+    if (s.wait_time >= PI_TEST_SPIN_TIME / 2 || s.boosted_priority != HIGH_PRIORITY)
+        printf("FAIL: priority inversion was not bounded\n");
+    else
+        printf("PASS\n");
+
+    event_destroy(&s.held);
+    mutex_destroy(&s.m);
+}
+
 static event_t e;
 
 static int event_signaler(void *arg)
@@ -622,6 +723,7 @@ int thread_tests(void)
     kill_tests();
 
     mutex_test();
+    pi_test();
     event_test();
 
     spinlock_test();
@@ -7,8 +7,10 @@
 #include "tests.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <err.h>
 #include <inttypes.h>
+#include <rand.h>
 #include <kernel/timer.h>
 #include <kernel/event.h>
 #include <kernel/thread.h>
@@ -80,3 +82,128 @@ void timer_tests(void)
     // timer fires on all cpus
     timer_test_all_cpus();
 }
+
+/* Timer queue benchmark.
+ *
+ * Arms a large number of timers with randomly spread deadlines from a single
+ * cpu and reports the average cost of arming and cancelling one. Then lets a
+ * batch of them fire, once with precise deadlines and once with slack, and
+ * reports how many timer interrupts it took and how late the callbacks ran.
+ */
+
+#define TIMER_BENCH_DEFAULT_COUNT 100000
+#define TIMER_BENCH_FIRE_WINDOW LK_MSEC(100)
+#define TIMER_BENCH_SLACK LK_MSEC(1)
+
+struct timer_bench_state {
+    timer_t *timers;
+    uint count;
+
+    /* updated from the timer callbacks, which all run on the benchmark cpu */
+    uint fired;
+    lk_time_t lateness;
+    lk_time_t last_deadline;
+    bool out_of_order;
+    event_t done;
+};
+
+static enum handler_return timer_bench_cb(struct timer *t, lk_time_t now, void *arg)
+{
+    struct timer_bench_state *st = arg;
+
+    /* with no slack the callbacks must come out in deadline order */
+    if (t->latest_time == t->scheduled_time && TIME_LT(t->scheduled_time, st->last_deadline))
+        st->out_of_order = true;
+    st->last_deadline = t->scheduled_time;
+    st->lateness += now - t->scheduled_time;
+
+    if (++st->fired == st->count) {
+        event_signal(&st->done, false);
+        return INT_RESCHEDULE;
+    }
+    return INT_NO_RESCHEDULE;
+}
+
+static void timer_bench_fire(struct timer_bench_state *st, lk_time_t slack)
+{
+    uint cpu = arch_curr_cpu_num();
+
+    st->fired = 0;
+    st->lateness = 0;
+    st->last_deadline = 0;
+    st->out_of_order = false;
+    event_init(&st->done, false, 0);
+
+    ulong ints = thread_stats[cpu].timer_ints;
+    lk_time_t base = current_time() + LK_MSEC(10);
+    for (uint i = 0; i < st->count; i++) {
+        timer_initialize(&st->timers[i]);
+        timer_set_oneshot_slack(&st->timers[i], base + (uint64_t)rand() % TIMER_BENCH_FIRE_WINDOW,
+                                slack, timer_bench_cb, st);
+    }
+    event_wait(&st->done);
+    ints = thread_stats[cpu].timer_ints - ints;
+
+    printf("fire, slack %6" PRIu64 " us: %8lu timer interrupts, %6" PRIu64
+           " ns avg lateness%s\n",
+           slack / 1000, ints, st->lateness / st->count,
+           st->out_of_order ? ", FAIL: fired out of order" : "");
+
+    event_destroy(&st->done);
+}
+
+static int timer_bench_thread(void *arg)
+{
+    struct timer_bench_state *st = arg;
+
+    /* arm far enough out that none of them fire while we're measuring */
+    lk_time_t base = current_time() + LK_SEC(10);
+    lk_time_t t = current_time();
+    for (uint i = 0; i < st->count; i++) {
+        timer_initialize(&st->timers[i]);
+        timer_set_oneshot(&st->timers[i], base + (uint64_t)rand() % LK_SEC(1),
+                          timer_bench_cb, st);
+    }
+    t = current_time() - t;
+    printf("insert: %6" PRIu64 " ns per timer\n", t / st->count);
+
+    t = current_time();
+    for (uint i = 0; i < st->count; i++) {
+        timer_cancel(&st->timers[i]);
+    }
+    t = current_time() - t;
+    printf("cancel: %6" PRIu64 " ns per timer\n", t / st->count);
+
+    timer_bench_fire(st, 0);
+    timer_bench_fire(st, TIMER_BENCH_SLACK);
+
+    return 0;
+}
+
+int timer_bench(int argc, const cmd_args *argv)
+{
+    struct timer_bench_state st = {};
+    st.count = TIMER_BENCH_DEFAULT_COUNT;
+    if (argc >= 2)
+        st.count = argv[1].u;
+    if (st.count == 0)
+        return ERR_INVALID_ARGS;
+
+    st.timers = malloc(st.count * sizeof(timer_t));
+    if (!st.timers) {
+        printf("failed to allocate %u timers\n", st.count);
+        return ERR_NO_MEMORY;
+    }
+
+    printf("timer benchmark, %u timers\n", st.count);
+
+    /* keep every timer on one cpu so all of them land in the same queue */
+    thread_t *t = thread_create("timer bench", &timer_bench_thread, &st,
+                                DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+    thread_set_pinned_cpu(t, 0);
+    thread_resume(t);
+    thread_join(t, NULL, INFINITE_TIME);
+
+    free(st.timers);
+    return NO_ERROR;
+}
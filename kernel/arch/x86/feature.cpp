@@ -201,6 +201,7 @@ void x86_feature_debug(void)
         { X86_FEATURE_TSC_ADJUST, "tsc_adj" },
         { X86_FEATURE_SMEP, "smep" },
         { X86_FEATURE_SMAP, "smap" },
+        { X86_FEATURE_PCID, "pcid" },
         { X86_FEATURE_RDRAND, "rdrand" },
         { X86_FEATURE_RDSEED, "rdseed" },
         { X86_FEATURE_PKU, "pku" },
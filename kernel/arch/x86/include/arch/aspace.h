@@ -33,6 +33,13 @@ struct arch_aspace {
      * actually an mp_cpu_mask_t, but header dependencies. */
     volatile int active_cpus;
 
+    /* unique, never reused identifier used to find this aspace's pcid on a
+     * cpu, and a counter bumped by every tlb invalidation of this aspace.
+     * cpus which are not in active_cpus compare the counter on their next
+     * switch in to decide whether their cached translations are stale. */
+    uint64_t pcid_owner;
+    volatile uint64_t tlb_generation;
+
     /* Pointer to a bitmap::RleBitmap representing the range of ports
      * enabled in this aspace. */
     void *io_bitmap;
@@ -22,9 +22,12 @@
 #define X86_CR4_OSXMMEXPT               0x00000400 /* os supports xmm exception */
 #define X86_CR4_VMXE                    0x00002000 /* enable vmx */
 #define X86_CR4_FSGSBASE                0x00010000 /* enable {rd,wr}{fs,gs}base */
+#define X86_CR4_PCIDE                   0x00020000 /* process-context identifiers */
 #define X86_CR4_OSXSAVE                 0x00040000 /* os supports xsave */
 #define X86_CR4_SMEP                    0x00100000 /* SMEP protection enabling */
 #define X86_CR4_SMAP                    0x00200000 /* SMAP protection enabling */
+#define X86_CR3_PCID_MASK               0x0000000000000fffull /* pcid, when CR4.PCIDE is set */
+#define X86_CR3_NOFLUSH                 0x8000000000000000ull /* keep the pcid's tlb entries */
 #define X86_EFER_SCE                    0x00000001 /* enable SYSCALL */
 #define X86_EFER_LME                    0x00000100 /* long mode enable */
 #define X86_EFER_LMA                    0x00000400 /* long mode active */
@@ -17,6 +17,7 @@
 #include <arch/x86/feature.h>
 #include <arch/x86/mmu.h>
 #include <arch/x86/mmu_mem_types.h>
+#include <kernel/cmdline.h>
 #include <kernel/mp.h>
 #include <kernel/vm.h>
 
@@ -32,6 +33,29 @@ uint8_t g_paddr_width = 32;
 /* True if the system supports 1GB pages */
 static bool supports_huge_pages = false;
 
+/* Process-context identifiers.  Each cpu hands out a small set of pcids to the
+ * user aspaces it runs, so that switching back to a recently run aspace keeps
+ * its TLB entries instead of starting cold.  pcid 0 is left for the kernel page
+ * table.  Slots are recycled round robin; a recycled pcid is flushed by the cr3
+ * load which installs it. */
+#define X86_PCID_SLOTS 8
+
+static bool x86_pcid_enabled = false;
+
+/* source of arch_aspace::pcid_owner; 0 marks an empty slot */
+static uint64_t x86_pcid_next_owner = 1;
+
+struct x86_pcid_cpu_state {
+    struct {
+        uint64_t owner;
+        /* the owner's tlb_generation as of its last switch in on this cpu */
+        uint64_t generation;
+    } slots[X86_PCID_SLOTS];
+    uint next_victim;
+} __ALIGNED(CACHE_LINE);
+
+static x86_pcid_cpu_state pcid_state[SMP_MAX_CPUS];
+
 /* top level kernel page tables, initialized in start.S */
 pt_entry_t pml4[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE);
 pt_entry_t pdp[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE); /* temporary */
@@ -123,53 +147,129 @@ static void x86_tlb_global_invalidate() {
     }
 }
 
-/* Task used for invalidating a TLB entry on each CPU */
-struct tlb_invalidate_page_context {
+/* Pages invalidated one at a time by a single shootdown.  Operations which
+ * touch more pages than this flush the whole TLB instead; past this point the
+ * string of invlpgs costs more than refilling the TLB. */
+#define X86_TLB_MAX_PENDING_PAGES 32
+
+/* Collects the TLB invalidations needed by a single page table operation
+ * (map, unmap or protect) so that they can be issued with one round of IPIs
+ * once all the page table entries have been updated.  Page tables unlinked by
+ * the operation are also held here, and are only freed after the shootdown
+ * since other cpus may still be walking through them until then. */
+struct PendingTlbInvalidation {
+    PendingTlbInvalidation() {
+        list_initialize(&freed_tables);
+    }
+    ~PendingTlbInvalidation() {
+        DEBUG_ASSERT(count == 0 && !full_shootdown);
+        DEBUG_ASSERT(list_is_empty(&freed_tables));
+    }
+
+    void enqueue(vaddr_t vaddr, enum page_table_levels level, bool global_page);
+    void free_table(pt_entry_t* table, vaddr_t vaddr);
+    void clear();
+
+    vaddr_t pages[X86_TLB_MAX_PENDING_PAGES];
+    uint count = 0;
+    bool full_shootdown = false;
+    /* flush global entries too, even on cpus not running in the aspace */
+    bool contains_global = false;
+    /* flush global entries on the cpus running in the aspace */
+    bool flush_global = false;
+    list_node freed_tables;
+};
+
+void PendingTlbInvalidation::enqueue(vaddr_t vaddr, enum page_table_levels level,
+                                     bool global_page) {
+    contains_global |= global_page;
+    if (full_shootdown && flush_global)
+        return;
+
+    /* A top level entry covers 512GB; there's no point in invlpg'ing it */
+    if (level == PML4_L) {
+        full_shootdown = true;
+        flush_global = true;
+        return;
+    }
+    if (count == X86_TLB_MAX_PENDING_PAGES) {
+        full_shootdown = true;
+        return;
+    }
+    pages[count++] = vaddr;
+}
+
+void PendingTlbInvalidation::free_table(pt_entry_t* table, vaddr_t vaddr) {
+    vm_page_t* page = paddr_to_vm_page(X86_VIRT_TO_PHYS(table));
+    DEBUG_ASSERT(page);
+    list_add_tail(&freed_tables, &page->free.node);
+
+    /* A kernel page table may still be held in the paging-structure caches
+     * of every pcid, while invlpg only drops those of the current one.  Flush
+     * all contexts (by toggling CR4.PGE) on every cpu before it is reused. */
+    if (is_kernel_address(vaddr)) {
+        full_shootdown = true;
+        flush_global = true;
+        contains_global = true;
+    }
+}
+
+void PendingTlbInvalidation::clear() {
+    count = 0;
+    full_shootdown = false;
+    contains_global = false;
+    flush_global = false;
+}
+
+/* Task used for invalidating a batch of TLB entries on each CPU */
+struct tlb_invalidate_context {
     ulong target_cr3;
-    vaddr_t vaddr;
-    enum page_table_levels level;
-    bool global_page;
+    const PendingTlbInvalidation* pending;
 };
-static void tlb_invalidate_page_task(void* raw_context) {
+static void tlb_invalidate_task(void* raw_context) {
     DEBUG_ASSERT(arch_ints_disabled());
-    tlb_invalidate_page_context* context = (tlb_invalidate_page_context*)raw_context;
+    tlb_invalidate_context* context = (tlb_invalidate_context*)raw_context;
+    const PendingTlbInvalidation* pending = context->pending;
 
     ulong cr3 = x86_get_cr3();
-    if (context->target_cr3 != cr3 && !context->global_page) {
+    if (context->target_cr3 != (cr3 & X86_PG_FRAME) && !pending->contains_global) {
         /* This invalidation doesn't apply to this CPU, ignore it */
         return;
     }
 
-    switch (context->level) {
-    case PML4_L:
-        x86_tlb_global_invalidate();
-        break;
-    case PDP_L:
-    case PD_L:
-    case PT_L:
-        __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)context->vaddr));
-        break;
+    if (pending->full_shootdown) {
+        if (pending->contains_global || pending->flush_global) {
+            x86_tlb_global_invalidate();
+        } else {
+            /* reloading cr3 drops every non-global entry of the current pcid */
+            x86_set_cr3(cr3);
+        }
+        return;
+    }
+
+    for (uint i = 0; i < pending->count; i++) {
+        __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)pending->pages[i]));
     }
 }
 
 /**
- * @brief Invalidate a single page at a given page table level
+ * @brief Execute a batch of queued TLB invalidations
  *
- * @param aspace The aspace we're invalidating for (if NULL, assume for current one)
- * @param vaddr The virtual address we are invalidating the TLB entry for
- * @param level The page table level that maps this vaddr
- * @param global_page True if we are invalidating a global mapping
+ * Invalidates everything queued in |pending| with a single mp_sync_exec,
+ * frees the page tables the operation unlinked, and resets |pending|.
  *
- * TODO(teisenbe): Optimize this.  This is horribly inefficient.
- * We should also change this to pool invalidations from a single
- * "transaction" and then only execute a single mp_sync_exec for that
- * transaction, rather than one per page.
+ * @param aspace The aspace we're invalidating for (if NULL, assume for current one)
+ * @param pending The invalidations queued while updating the page tables
  */
-void x86_tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, enum page_table_levels level,
-                             bool global_page) {
-    ulong cr3 = aspace ? aspace->pt_phys : x86_get_cr3();
-    struct tlb_invalidate_page_context task_context = {
-        .target_cr3 = cr3, .vaddr = vaddr, .level = level, .global_page = global_page,
+static void x86_tlb_invalidate(arch_aspace_t* aspace, PendingTlbInvalidation* pending) {
+    if (pending->count == 0 && !pending->full_shootdown) {
+        pmm_free(&pending->freed_tables);
+        return;
+    }
+
+    ulong cr3 = aspace ? aspace->pt_phys : (x86_get_cr3() & X86_PG_FRAME);
+    struct tlb_invalidate_context task_context = {
+        .target_cr3 = cr3, .pending = pending,
     };
 
     /* Target only CPUs this aspace is active on.  It may be the case that some
@@ -178,14 +278,25 @@ void x86_tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, enum page_tab
      * the write to the page table, so it will see the change.  In the latter
      * case, it will get a spurious request to flush. */
     mp_cpu_mask_t targets;
-    if (global_page || aspace == nullptr) {
+    if (pending->contains_global || aspace == nullptr) {
         targets = MP_CPU_ALL;
     } else {
+        /* With pcids, cpus outside active_cpus may still hold translations
+         * for this aspace.  Bumping the generation before reading active_cpus
+         * pairs with arch_mmu_context_switch setting its bit before reading
+         * the generation: a cpu either gets the shootdown or sees the new
+         * generation and flushes the pcid on its way in. */
+        if (x86_pcid_enabled) {
+            __atomic_fetch_add(&aspace->tlb_generation, 1, __ATOMIC_SEQ_CST);
+        }
         targets = atomic_load(&aspace->active_cpus);
         static_assert(sizeof(mp_cpu_mask_t) == sizeof(aspace->active_cpus), "err");
     }
 
-    mp_sync_exec(targets, tlb_invalidate_page_task, &task_context);
+    mp_sync_exec(targets, tlb_invalidate_task, &task_context);
+
+    pmm_free(&pending->freed_tables);
+    pending->clear();
 }
 
 template <int Level>
@@ -373,10 +484,11 @@ struct PageTable : PageTableBase<Level> {
     }
 
     /**
-     * @brief Invalidate a single page at a given page table level
+     * @brief Queue the invalidation of a single page at this page table level
      */
-    static void tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, bool global_page) {
-        x86_tlb_invalidate_page(aspace, vaddr, Base::level, global_page);
+    static void tlb_invalidate_page(PendingTlbInvalidation* pending, vaddr_t vaddr,
+                                    bool global_page) {
+        pending->enqueue(vaddr, Base::level, global_page);
     }
 };
 
@@ -424,9 +536,10 @@ struct ExtendedPageTable : PageTableBase<Level> {
     }
 
     /**
-     * @brief Invalidate a single page at a given page table level
+     * @brief Queue the invalidation of a single page at this page table level
      */
-    static void tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, bool global_page) {
+    static void tlb_invalidate_page(PendingTlbInvalidation* pending, vaddr_t vaddr,
+                                    bool global_page) {
         // TODO(abdulla): Implement this.
     }
 };
@@ -504,8 +617,8 @@ struct MappingCursor {
 };
 
 template <typename PageTable>
-static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte, paddr_t paddr,
-                         arch_flags_t flags) {
+static void update_entry(PendingTlbInvalidation* pending, vaddr_t vaddr, pt_entry_t* pte,
+                         paddr_t paddr, arch_flags_t flags) {
     DEBUG_ASSERT(pte);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(paddr));
 
@@ -517,12 +630,12 @@ static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte,
 
     /* attempt to invalidate the page */
     if (IS_PAGE_PRESENT(olde)) {
-        PageTable::tlb_invalidate_page(aspace, vaddr, is_kernel_address(vaddr));
+        PageTable::tlb_invalidate_page(pending, vaddr, is_kernel_address(vaddr));
     }
 }
 
 template <typename PageTable>
-static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte) {
+static void unmap_entry(PendingTlbInvalidation* pending, vaddr_t vaddr, pt_entry_t* pte) {
     DEBUG_ASSERT(pte);
 
     pt_entry_t olde = *pte;
@@ -531,7 +644,7 @@ static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte) {
 
     /* attempt to invalidate the page */
     if (IS_PAGE_PRESENT(olde)) {
-        PageTable::tlb_invalidate_page(aspace, vaddr, is_kernel_address(vaddr));
+        PageTable::tlb_invalidate_page(pending, vaddr, is_kernel_address(vaddr));
     }
 }
 
@@ -555,7 +668,7 @@ static pt_entry_t* _map_alloc_page(void) {
  * @brief Split the given large page into smaller pages
  */
 template <typename PageTable>
-static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte) {
+static status_t x86_mmu_split(PendingTlbInvalidation* pending, vaddr_t vaddr, pt_entry_t* pte) {
     static_assert(PageTable::level != PT_L, "tried splitting PT_L");
     LTRACEF_LEVEL(2, "splitting table %p at level %d\n", pte, PageTable::level);
 
@@ -576,14 +689,14 @@ static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t*
         pt_entry_t* e = m + i;
         // If this is a PDP_L (i.e. huge page), flags will include the
         // PS bit still, so the new PD entries will be large pages.
-        update_entry<typename PageTable::LowerTable>(aspace, new_vaddr, e, new_paddr, flags);
+        update_entry<typename PageTable::LowerTable>(pending, new_vaddr, e, new_paddr, flags);
         new_vaddr += ps;
         new_paddr += ps;
     }
     DEBUG_ASSERT(new_vaddr == vaddr + PageTable::page_size());
 
     flags = PageTable::intermediate_arch_flags();
-    update_entry<PageTable>(aspace, vaddr, pte, X86_VIRT_TO_PHYS(m), flags);
+    update_entry<PageTable>(pending, vaddr, pte, X86_VIRT_TO_PHYS(m), flags);
     return NO_ERROR;
 }
 
@@ -669,7 +782,7 @@ status_t x86_mmu_get_mapping<ExtendedPageTable<PT_L>>(pt_entry_t* table, vaddr_t
  *
  * Level must be MAX_PAGING_LEVEL when invoked.
  *
- * @param aspace The aspace we're updating
+ * @param pending The batch to queue TLB invalidations and freed page tables in
  * @param table The top-level paging structure's virtual address
  * @param start_cursor A cursor describing the range of address space to
  * unmap within table
@@ -679,7 +792,7 @@ status_t x86_mmu_get_mapping<ExtendedPageTable<PT_L>>(pt_entry_t* table, vaddr_t
  * @return true if at least one page was unmapped at this level
  */
 template <typename PageTable>
-static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
+static bool x86_mmu_remove_mapping(PendingTlbInvalidation* pending, pt_entry_t* table,
                                    const MappingCursor& start_cursor, MappingCursor* new_cursor) {
     DEBUG_ASSERT(table);
     LTRACEF("L: %d, %016" PRIxPTR " %016zx\n", PageTable::level, start_cursor.vaddr,
@@ -714,7 +827,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             bool vaddr_level_aligned = PageTable::page_aligned(new_cursor->vaddr);
             // If the request covers the entire large page, just unmap it
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+                unmap_entry<PageTable>(pending, new_cursor->vaddr, e);
                 unmapped = true;
 
                 new_cursor->vaddr += ps;
@@ -724,11 +837,11 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            status_t status = x86_mmu_split<PageTable>(aspace, page_vaddr, e);
+            status_t status = x86_mmu_split<PageTable>(pending, page_vaddr, e);
             if (status != NO_ERROR) {
                 // If split fails, just unmap the whole thing, and let a
                 // subsequent page fault clean it up.
-                unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+                unmap_entry<PageTable>(pending, new_cursor->vaddr, e);
                 unmapped = true;
 
                 const size_t size = (new_cursor->size > ps) ? ps : new_cursor->size;
@@ -741,7 +854,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
         MappingCursor cursor;
         pt_entry_t* next_table = get_next_table_from_entry(*e);
         bool lower_unmapped = x86_mmu_remove_mapping<typename PageTable::LowerTable>(
-            aspace, next_table, *new_cursor, &cursor);
+            pending, next_table, *new_cursor, &cursor);
 
         // If we were requesting to unmap everything in the lower page table,
         // we know we can unmap the lower level page table.  Otherwise, if
@@ -761,8 +874,8 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
         }
         if (unmap_page_table) {
-            unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
-            pmm_free_page(paddr_to_vm_page(X86_VIRT_TO_PHYS(next_table)));
+            unmap_entry<PageTable>(pending, new_cursor->vaddr, e);
+            pending->free_table(next_table, new_cursor->vaddr);
             unmapped = true;
         }
         *new_cursor = cursor;
@@ -776,7 +889,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
 
 // Base case of x86_remove_mapping for smallest page size
 template <typename PageTable>
-static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
+static bool x86_mmu_remove_mapping_l0(PendingTlbInvalidation* pending, pt_entry_t* table,
                                       const MappingCursor& start_cursor,
                                       MappingCursor* new_cursor) {
     static_assert(PageTable::level == PT_L, "x86_mmu_remove_mapping_l0 used with wrong level");
@@ -790,7 +903,7 @@ static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
     for (; index != NO_OF_PT_ENTRIES && new_cursor->size != 0; ++index) {
         pt_entry_t* e = table + index;
         if (IS_PAGE_PRESENT(*e)) {
-            unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+            unmap_entry<PageTable>(pending, new_cursor->vaddr, e);
             unmapped = true;
         }
 
@@ -802,17 +915,18 @@ static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
 }
 
 template <>
-bool x86_mmu_remove_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
+bool x86_mmu_remove_mapping<PageTable<PT_L>>(PendingTlbInvalidation* pending, pt_entry_t* table,
                                              const MappingCursor& start_cursor,
                                              MappingCursor* new_cursor) {
-    return x86_mmu_remove_mapping_l0<PageTable<PT_L>>(aspace, table, start_cursor, new_cursor);
+    return x86_mmu_remove_mapping_l0<PageTable<PT_L>>(pending, table, start_cursor, new_cursor);
 }
 
 template <>
-bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
+bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(PendingTlbInvalidation* pending,
+                                                     pt_entry_t* table,
                                                      const MappingCursor& start_cursor,
                                                      MappingCursor* new_cursor) {
-    return x86_mmu_remove_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, start_cursor,
+    return x86_mmu_remove_mapping_l0<ExtendedPageTable<PT_L>>(pending, table, start_cursor,
                                                               new_cursor);
 }
 
@@ -822,6 +936,7 @@ bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_e
  * Level must be MAX_PAGING_LEVEL when invoked.
  *
  * @param aspace The aspace we're updating
+ * @param pending The batch to queue TLB invalidations and freed page tables in
  * @param table The top-level paging structure's virtual address
  * @param start_cursor A cursor describing the range of address space to
  * act on within table
@@ -833,7 +948,8 @@ bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_e
  * @return ERR_NO_MEMORY if intermediate page tables could not be allocated
  */
 template <typename PageTable>
-static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                    pt_entry_t* table, uint mmu_flags,
                                     const MappingCursor& start_cursor, MappingCursor* new_cursor) {
     DEBUG_ASSERT(table);
     DEBUG_ASSERT(x86_mmu_check_vaddr(start_cursor.vaddr));
@@ -862,7 +978,7 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, ui
         if (level_supports_large_pages && !IS_PAGE_PRESENT(*e) && level_valigned &&
             level_paligned && new_cursor->size >= ps) {
 
-            update_entry<PageTable>(aspace, new_cursor->vaddr, table + index, new_cursor->paddr,
+            update_entry<PageTable>(pending, new_cursor->vaddr, table + index, new_cursor->paddr,
                                     arch_flags | X86_MMU_PG_PS);
 
             new_cursor->paddr += ps;
@@ -880,13 +996,13 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, ui
 
                 LTRACEF_LEVEL(2, "new table %p at level %d\n", m, PageTable::level);
 
-                update_entry<PageTable>(aspace, new_cursor->vaddr, e, X86_VIRT_TO_PHYS(m),
+                update_entry<PageTable>(pending, new_cursor->vaddr, e, X86_VIRT_TO_PHYS(m),
                                         interm_arch_flags);
             }
 
             MappingCursor cursor;
             ret = x86_mmu_add_mapping<typename PageTable::LowerTable>(
-                aspace, get_next_table_from_entry(*e), mmu_flags, *new_cursor, &cursor);
+                aspace, pending, get_next_table_from_entry(*e), mmu_flags, *new_cursor, &cursor);
             *new_cursor = cursor;
             DEBUG_ASSERT(new_cursor->size <= start_cursor.size);
             if (ret != NO_ERROR) {
@@ -902,7 +1018,7 @@ err:
         // new_cursor->size should be how much is left to be mapped still
         cursor.size -= new_cursor->size;
         if (cursor.size > 0) {
-            x86_mmu_remove_mapping<typename PageTable::TopTable>(aspace, table, cursor, &result);
+            x86_mmu_remove_mapping<typename PageTable::TopTable>(pending, table, cursor, &result);
             DEBUG_ASSERT(result.size == 0);
         }
     }
@@ -911,7 +1027,8 @@ err:
 
 // Base case of x86_mmu_add_mapping for smallest page size
 template <typename PageTable>
-static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                       pt_entry_t* table, uint mmu_flags,
                                        const MappingCursor& start_cursor,
                                        MappingCursor* new_cursor) {
     static_assert(PageTable::level == PT_L, "x86_mmu_remove_mapping_l0 used with wrong level");
@@ -928,7 +1045,7 @@ static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
             return ERR_ALREADY_EXISTS;
         }
 
-        update_entry<PageTable>(aspace, new_cursor->vaddr, table + index, new_cursor->paddr,
+        update_entry<PageTable>(pending, new_cursor->vaddr, table + index, new_cursor->paddr,
                                 arch_flags);
 
         new_cursor->paddr += PAGE_SIZE;
@@ -941,20 +1058,22 @@ static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
 }
 
 template <>
-status_t x86_mmu_add_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
+status_t x86_mmu_add_mapping<PageTable<PT_L>>(arch_aspace_t* aspace,
+                                              PendingTlbInvalidation* pending, pt_entry_t* table,
                                               uint mmu_flags, const MappingCursor& start_cursor,
                                               MappingCursor* new_cursor) {
-    return x86_mmu_add_mapping_l0<PageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
+    return x86_mmu_add_mapping_l0<PageTable<PT_L>>(aspace, pending, table, mmu_flags, start_cursor,
                                                    new_cursor);
 }
 
 template <>
-status_t x86_mmu_add_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
-                                                      uint mmu_flags,
+status_t x86_mmu_add_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace,
+                                                      PendingTlbInvalidation* pending,
+                                                      pt_entry_t* table, uint mmu_flags,
                                                       const MappingCursor& start_cursor,
                                                       MappingCursor* new_cursor) {
-    return x86_mmu_add_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
-                                                           new_cursor);
+    return x86_mmu_add_mapping_l0<ExtendedPageTable<PT_L>>(aspace, pending, table, mmu_flags,
+                                                           start_cursor, new_cursor);
 }
 
 /**
@@ -963,6 +1082,7 @@ status_t x86_mmu_add_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_
  * Level must be MAX_PAGING_LEVEL when invoked.
  *
  * @param aspace The aspace we're updating
+ * @param pending The batch to queue TLB invalidations and freed page tables in
  * @param table The top-level paging structure's virtual address
  * @param start_cursor A cursor describing the range of address space to
  * act on within table
@@ -970,7 +1090,8 @@ status_t x86_mmu_add_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_
  * completed.  Must be non-null.
  */
 template <typename PageTable>
-static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                       pt_entry_t* table, uint mmu_flags,
                                        const MappingCursor& start_cursor,
                                        MappingCursor* new_cursor) {
     DEBUG_ASSERT(table);
@@ -1006,8 +1127,8 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             // If the request covers the entire large page, just change the
             // permissions
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                update_entry<PageTable>(aspace, new_cursor->vaddr, e, PageTable::paddr_from_pte(*e),
-                                        arch_flags | X86_MMU_PG_PS);
+                update_entry<PageTable>(pending, new_cursor->vaddr, e,
+                                        PageTable::paddr_from_pte(*e), arch_flags | X86_MMU_PG_PS);
 
                 new_cursor->vaddr += ps;
                 new_cursor->size -= ps;
@@ -1016,7 +1137,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            ret = x86_mmu_split<PageTable>(aspace, page_vaddr, e);
+            ret = x86_mmu_split<PageTable>(pending, page_vaddr, e);
             if (ret != NO_ERROR) {
                 // If we failed to split the table, just unmap it.  Subsequent
                 // page faults will bring it back in.
@@ -1025,7 +1146,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
                 cursor.size = ps;
 
                 MappingCursor tmp_cursor;
-                x86_mmu_remove_mapping<PageTable>(aspace, table, cursor, &tmp_cursor);
+                x86_mmu_remove_mapping<PageTable>(pending, table, cursor, &tmp_cursor);
 
                 const size_t size = (new_cursor->size > ps) ? ps : new_cursor->size;
                 new_cursor->vaddr += size;
@@ -1035,8 +1156,8 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
 
         MappingCursor cursor;
         pt_entry_t* next_table = get_next_table_from_entry(*e);
-        ret = x86_mmu_update_mapping<typename PageTable::LowerTable>(aspace, next_table, mmu_flags,
-                                                                     *new_cursor, &cursor);
+        ret = x86_mmu_update_mapping<typename PageTable::LowerTable>(
+            aspace, pending, next_table, mmu_flags, *new_cursor, &cursor);
         *new_cursor = cursor;
         if (ret != NO_ERROR) {
             // Currently this can't happen
@@ -1055,7 +1176,8 @@ err:
 
 // Base case of x86_update_mapping for smallest page size
 template <typename PageTable>
-static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                          pt_entry_t* table, uint mmu_flags,
                                           const MappingCursor& start_cursor,
                                           MappingCursor* new_cursor) {
     static_assert(PageTable::level == PT_L, "x86_mmu_update_mapping_l0 used with wrong level");
@@ -1071,7 +1193,7 @@ static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, pt_entry_t* tab
         pt_entry_t* e = table + index;
         // Skip unmapped pages (we may encounter these due to demand paging)
         if (IS_PAGE_PRESENT(*e)) {
-            update_entry<PageTable>(aspace, new_cursor->vaddr, e, PageTable::paddr_from_pte(*e),
+            update_entry<PageTable>(pending, new_cursor->vaddr, e, PageTable::paddr_from_pte(*e),
                                     arch_flags);
         }
 
@@ -1083,19 +1205,22 @@ static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, pt_entry_t* tab
 }
 
 template <>
-status_t x86_mmu_update_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
-                                                 uint mmu_flags, const MappingCursor& start_cursor,
+status_t x86_mmu_update_mapping<PageTable<PT_L>>(arch_aspace_t* aspace,
+                                                 PendingTlbInvalidation* pending,
+                                                 pt_entry_t* table, uint mmu_flags,
+                                                 const MappingCursor& start_cursor,
                                                  MappingCursor* new_cursor) {
-    return x86_mmu_update_mapping_l0<PageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
-                                                      new_cursor);
+    return x86_mmu_update_mapping_l0<PageTable<PT_L>>(aspace, pending, table, mmu_flags,
+                                                      start_cursor, new_cursor);
 }
 
 template <>
-status_t x86_mmu_update_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
-                                                         uint mmu_flags,
+status_t x86_mmu_update_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace,
+                                                         PendingTlbInvalidation* pending,
+                                                         pt_entry_t* table, uint mmu_flags,
                                                          const MappingCursor& start_cursor,
                                                          MappingCursor* new_cursor) {
-    return x86_mmu_update_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, mmu_flags,
+    return x86_mmu_update_mapping_l0<ExtendedPageTable<PT_L>>(aspace, pending, table, mmu_flags,
                                                               start_cursor, new_cursor);
 }
 
@@ -1121,8 +1246,10 @@ static status_t mmu_unmap(arch_aspace_t* aspace, vaddr_t vaddr, const size_t cou
     };
 
     MappingCursor result;
-    x86_mmu_remove_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, aspace->pt_virt, start, &result);
+    PendingTlbInvalidation pending;
+    x86_mmu_remove_mapping<PageTable<MAX_PAGING_LEVEL>>(&pending, aspace->pt_virt, start, &result);
     DEBUG_ASSERT(result.size == 0);
+    x86_tlb_invalidate(aspace, &pending);
 
     if (unmapped)
         *unmapped = count;
@@ -1167,8 +1294,10 @@ static status_t mmu_map(arch_aspace_t* aspace, vaddr_t vaddr, paddr_t paddr, con
         .paddr = paddr, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
     MappingCursor result;
-    status_t status = x86_mmu_add_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, aspace->pt_virt,
-                                                                       mmu_flags, start, &result);
+    PendingTlbInvalidation pending;
+    status_t status = x86_mmu_add_mapping<PageTable<MAX_PAGING_LEVEL>>(
+        aspace, &pending, aspace->pt_virt, mmu_flags, start, &result);
+    x86_tlb_invalidate(aspace, &pending);
     if (status != NO_ERROR) {
         dprintf(SPEW, "Add mapping failed with err=%d\n", status);
         return status;
@@ -1215,8 +1344,10 @@ static status_t mmu_protect(arch_aspace_t* aspace, vaddr_t vaddr, size_t count,
         .paddr = 0, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
     MappingCursor result;
+    PendingTlbInvalidation pending;
     status_t status = x86_mmu_update_mapping<PageTable<MAX_PAGING_LEVEL>>(
-        aspace, aspace->pt_virt, mmu_flags, start, &result);
+        aspace, &pending, aspace->pt_virt, mmu_flags, start, &result);
+    x86_tlb_invalidate(aspace, &pending);
     if (status != NO_ERROR) {
         return status;
     }
@@ -1239,7 +1370,9 @@ void x86_mmu_early_init() {
     x86_mmu_percpu_init();
 
     /* unmap the lower identity mapping */
-    unmap_entry<PageTable<PML4_L>>(nullptr, 0, &pml4[0]);
+    PendingTlbInvalidation pending;
+    unmap_entry<PageTable<PML4_L>>(&pending, 0, &pml4[0]);
+    x86_tlb_invalidate(nullptr, &pending);
 
     /* get the address width from the CPU */
     uint8_t vaddr_width = x86_linear_address_width();
@@ -1258,7 +1391,19 @@ void x86_mmu_early_init() {
     LTRACEF("paddr_width %u vaddr_width %u\n", g_paddr_width, g_vaddr_width);
 }
 
-void x86_mmu_init(void) {}
+void x86_mmu_init(void) {
+    /* The command line isn't available at early init, so the boot cpu turns
+     * pcids on here; the secondaries pick it up in x86_mmu_percpu_init.  We
+     * rely on toggling CR4.PGE to flush every pcid at once, so require it. */
+    x86_pcid_enabled = x86_feature_test(X86_FEATURE_PCID) &&
+                       (x86_get_cr4() & X86_CR4_PGE) &&
+                       cmdline_get_bool("x86.pcid", true);
+    if (x86_pcid_enabled) {
+        DEBUG_ASSERT((x86_get_cr3() & X86_CR3_PCID_MASK) == 0);
+        x86_set_cr4(x86_get_cr4() | X86_CR4_PCIDE);
+    }
+    dprintf(INFO, "x86: pcids %s\n", x86_pcid_enabled ? "enabled" : "disabled");
+}
 
 /*
  * Fill in the high level x86 arch aspace structure and allocating a top level page table.
@@ -1303,6 +1448,8 @@ status_t arch_mmu_init_aspace(arch_aspace_t* aspace, vaddr_t base, size_t size,
     }
     aspace->io_bitmap = nullptr;
     aspace->active_cpus = 0;
+    aspace->pcid_owner = __atomic_fetch_add(&x86_pcid_next_owner, 1, __ATOMIC_RELAXED);
+    aspace->tlb_generation = 0;
     spin_lock_init(&aspace->io_bitmap_lock);
 
     return NO_ERROR;
@@ -1377,17 +1524,49 @@ status_t guest_mmu_destroy_paspace(guest_paspace_t* paspace) {
     return mmu_destroy_aspace<ExtendedPageTable>(paspace);
 }
 
+/*
+ * Pick the cr3 value for switching this cpu into |aspace| with pcids enabled.
+ * Reuses the aspace's pcid if this cpu still has one for it, and keeps its TLB
+ * entries if no invalidation of the aspace was missed since it last ran here.
+ */
+static ulong x86_pcid_cr3(arch_aspace_t* aspace) {
+    DEBUG_ASSERT(arch_ints_disabled());
+    x86_pcid_cpu_state* state = &pcid_state[arch_curr_cpu_num()];
+    uint64_t generation = __atomic_load_n(&aspace->tlb_generation, __ATOMIC_SEQ_CST);
+
+    for (uint i = 0; i < X86_PCID_SLOTS; i++) {
+        if (state->slots[i].owner != aspace->pcid_owner) {
+            continue;
+        }
+        ulong cr3 = aspace->pt_phys | (i + 1);
+        if (state->slots[i].generation == generation) {
+            return cr3 | X86_CR3_NOFLUSH;
+        }
+        state->slots[i].generation = generation;
+        return cr3;
+    }
+
+    uint victim = state->next_victim;
+    state->next_victim = (victim + 1) % X86_PCID_SLOTS;
+    state->slots[victim].owner = aspace->pcid_owner;
+    state->slots[victim].generation = generation;
+    return aspace->pt_phys | (victim + 1);
+}
+
 void arch_mmu_context_switch(arch_aspace_t* old_aspace, arch_aspace_t* aspace) {
     mp_cpu_mask_t cpu_bit = 1U << arch_curr_cpu_num();
     if (aspace != nullptr) {
         DEBUG_ASSERT(aspace->magic == ARCH_ASPACE_MAGIC);
         LTRACEF_LEVEL(3, "switching to aspace %p, pt %#" PRIXPTR "\n", aspace, aspace->pt_phys);
-        x86_set_cr3(aspace->pt_phys);
+
+        /* become a shootdown target before sampling the tlb generation, see
+         * x86_tlb_invalidate */
+        atomic_or(&aspace->active_cpus, cpu_bit);
+        x86_set_cr3(x86_pcid_enabled ? x86_pcid_cr3(aspace) : aspace->pt_phys);
 
         if (old_aspace != nullptr) {
             atomic_and(&old_aspace->active_cpus, ~cpu_bit);
         }
-        atomic_or(&aspace->active_cpus, cpu_bit);
     } else {
         LTRACEF_LEVEL(3, "switching to kernel aspace, pt %#" PRIxPTR "\n", kernel_pt_phys);
         x86_set_cr3(kernel_pt_phys);
@@ -1488,6 +1667,9 @@ void x86_mmu_percpu_init(void) {
         cr4 |= X86_CR4_SMEP;
     if (x86_feature_test(X86_FEATURE_SMAP))
         cr4 |= X86_CR4_SMAP;
+    /* only set once x86_mmu_init has run on the boot cpu */
+    if (x86_pcid_enabled)
+        cr4 |= X86_CR4_PCIDE;
     x86_set_cr4(cr4);
 
     /* Set NXE bit in X86_MSR_IA32_EFER*/
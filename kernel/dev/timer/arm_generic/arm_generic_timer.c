@@ -251,6 +251,12 @@ uint64_t ticks_per_second(void)
     return u64_mul_u32_fp32_64(1000 * 1000 * 1000, cntpct_per_ns);
 }
 
+bool platform_get_ns_per_tick(struct fp_32_64* ns_per_tick)
+{
+    // mx_ticks_get() reads the cycle counter rather than this timer's count.
+    return false;
+}
+
 static uint32_t abs_int32(int32_t a)
 {
     return (a > 0) ? a : -a;
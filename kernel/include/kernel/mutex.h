@@ -19,24 +19,31 @@ __BEGIN_CDECLS;
 
 #define MUTEX_MAGIC (0x6D757478)  // 'mutx'
 
+/* set in the owner word when there are threads blocked on the mutex */
+#define MUTEX_FLAG_QUEUED ((uintptr_t)1)
+#define MUTEX_FLAG_MASK   MUTEX_FLAG_QUEUED
+
 typedef struct TA_CAP("mutex") mutex {
     uint32_t magic;
-    thread_t *holder;
-    int count;
+    /* owning thread pointer | MUTEX_FLAG_*, or 0 if unlocked.
+     * Uncontended acquires and releases are a single compare and swap on
+     * this word; the thread_lock is only taken once threads need to block. */
+    uintptr_t val;
     wait_queue_t wait;
 } mutex_t;
 
 #define MUTEX_INITIAL_VALUE(m) \
 { \
     .magic = MUTEX_MAGIC, \
-    .holder = NULL, \
-    .count = 0, \
+    .val = 0, \
     .wait = WAIT_QUEUE_INITIAL_VALUE((m).wait), \
 }
 
 /* Rules for Mutexes:
  * - Mutexes are only safe to use from thread context.
  * - Mutexes are non-recursive.
+ * - A thread blocked on a mutex lends its priority to the holder, and the
+ *   mutex is handed to the highest priority waiter on release.
 */
 void mutex_init(mutex_t *m);
 void mutex_destroy(mutex_t *m);
@@ -46,12 +53,29 @@ void mutex_release(mutex_t *m) TA_REL(m);
 /* special version of the above with the thread lock held */
 void mutex_release_thread_locked(mutex_t *m, bool resched) TA_REL(m);
 
+/* the thread holding the mutex, or NULL */
+static inline thread_t *mutex_holder(const mutex_t *m)
+{
+    return (thread_t *)(__atomic_load_n(&m->val, __ATOMIC_RELAXED) & ~MUTEX_FLAG_MASK);
+}
+
 /* does the current thread hold the mutex? */
 static inline bool is_mutex_held(const mutex_t *m)
 {
-    return m->holder == get_current_thread();
+    return mutex_holder(m) == get_current_thread();
 }
 
+/* contention statistics, summed over all mutexes */
+struct mutex_stats {
+    ulong acquires;          /* total mutex_acquire calls */
+    ulong contended;         /* acquires that found the mutex held */
+    ulong spin_acquires;     /* contended acquires that got it while spinning */
+    ulong blocks;            /* contended acquires that had to block */
+    ulong handoffs;          /* releases that handed the mutex to a waiter */
+};
+
+extern struct mutex_stats mutex_stats[SMP_MAX_CPUS];
+
 __END_CDECLS;
 
 // Include the handy C++ Mutex/AutoLock wrappers from mxtl.  Note, this include
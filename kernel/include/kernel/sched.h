@@ -21,3 +21,6 @@ void sched_unblock_list(struct list_node *list, bool resched);
 
 void sched_yield(void);
 void sched_preempt(void);
+
+/* move a thread to a new effective priority, requeueing it if it's ready */
+void sched_change_priority(thread_t *t, int priority);
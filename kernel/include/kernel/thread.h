@@ -74,7 +74,11 @@ typedef struct thread {
 
     /* active bits */
     struct list_node queue_node;
+    uint run_queue_cpu; /* cpu whose run queue holds the thread while it's ready */
     int priority;
+    /* priority the thread asked for. priority is raised above it while
+     * higher priority threads are blocked on something this thread owns */
+    int base_priority;
     enum thread_state state;
     lk_time_t last_started_running;
     lk_time_t remaining_time_slice;
@@ -104,12 +108,22 @@ typedef struct thread {
     /* if blocked, a pointer to the wait queue */
     struct wait_queue *blocking_wait_queue;
 
+    /* priority inheritance: the threads lending us their priority, and the
+     * thread we're blocked behind and lending ours to, if any */
+    struct list_node pi_waiters;
+    struct list_node pi_waiter_node;
+    struct thread *pi_owner;
+
     /* return code if woken up abnormally from suspend, sleep, or block */
     status_t blocked_status;
 
     /* are we allowed to be interrupted on the current thing we're blocked/sleeping on */
     bool interruptable;
 
+    /* how late past their deadline sleeps and timed waits may be woken, so
+     * that their timers can be coalesced with others */
+    lk_time_t timer_slack;
+
     /* non-NULL if stopped in an exception */
     const struct arch_exception_context *exception_context;
 
@@ -194,6 +208,12 @@ status_t thread_set_real_time(thread_t *t);
 
 void thread_owner_name(thread_t *t, char out_name[THREAD_NAME_LENGTH]);
 
+/* priority inheritance, called with the thread lock held.
+ * Records that |t| is blocked on something |owner| holds, so that owner runs
+ * at no less than t's priority until it's changed again. A NULL owner
+ * withdraws t's priority from whatever it was lent to. */
+void thread_pi_set_owner(thread_t *t, thread_t *owner);
+
 #define THREAD_BACKTRACE_DEPTH 10
 typedef struct thread_backtrace {
     void* pc[THREAD_BACKTRACE_DEPTH];
@@ -272,6 +292,10 @@ void set_current_thread(thread_t *);
 /* the idle thread(s) (statically allocated) */
 extern thread_t idle_threads[SMP_MAX_CPUS];
 
+/* the thread each cpu is running; only compare against these pointers, the
+ * threads may exit once the thread lock is dropped */
+extern thread_t *running_threads[SMP_MAX_CPUS];
+
 /* scheduler lock */
 extern spin_lock_t thread_lock;
 
@@ -292,6 +316,7 @@ struct thread_stats {
     ulong irq_preempts;
     ulong preempts;
     ulong yields;
+    ulong steals; /* threads pulled over from another cpu's run queue */
 
     /* cpu level interrupts and exceptions */
     ulong interrupts; /* hardware interrupts, minus timer interrupts or inter-processor interrupts */
@@ -24,9 +24,18 @@ typedef enum handler_return (*timer_callback)(struct timer *, lk_time_t now, voi
 
 typedef struct timer {
     int magic;
-    struct list_node node;
 
+    /* links in the per cpu pairing heap. prev is the parent for the first
+     * child of a node, otherwise the previous sibling */
+    struct timer *heap_child;
+    struct timer *heap_next;
+    struct timer *heap_prev;
+    int queued_cpu; // <0 if not in a queue
+
+    /* the timer may fire anywhere between scheduled_time and latest_time,
+     * which lets timers with slack share a single timer interrupt */
     lk_time_t scheduled_time;
+    lk_time_t latest_time;
     lk_time_t period;
 
     timer_callback callback;
@@ -39,8 +48,12 @@ typedef struct timer {
 #define TIMER_INITIAL_VALUE(t) \
 { \
     .magic = TIMER_MAGIC, \
-    .node = LIST_INITIAL_CLEARED_VALUE, \
+    .heap_child = NULL, \
+    .heap_next = NULL, \
+    .heap_prev = NULL, \
+    .queued_cpu = -1, \
     .scheduled_time = 0, \
+    .latest_time = 0, \
     .period = 0, \
     .callback = NULL, \
     .arg = NULL, \
@@ -57,6 +70,10 @@ typedef struct timer {
 */
 void timer_initialize(timer_t *);
 void timer_set_oneshot(timer_t *, lk_time_t deadline, timer_callback, void *arg);
+/* like timer_set_oneshot, but the callback may be delayed by up to slack ns past
+ * the deadline so that it can be run together with other timers */
+void timer_set_oneshot_slack(timer_t *, lk_time_t deadline, lk_time_t slack,
+                             timer_callback, void *arg);
 void timer_set_periodic(timer_t *, lk_time_t period, timer_callback, void *arg);
 void timer_cancel(timer_t *);
 
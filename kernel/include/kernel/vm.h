@@ -112,6 +112,8 @@ status_t pmm_add_arena(const pmm_arena_info_t* arena) __NONNULL((1));
 /* flags for allocation routines below */
 #define PMM_ALLOC_FLAG_ANY (0x0)  /* no restrictions on which arena to allocate from */
 #define PMM_ALLOC_FLAG_KMAP (0x1) /* allocate only from arenas marked KMAP */
+#define PMM_ALLOC_FLAG_ZEROED (0x2) /* return zeroed pages, pmm_alloc_page(s) only */
+#define PMM_ALLOC_FLAG_NO_RECLAIM (0x4) /* fail rather than drain the per cpu caches, pmm_alloc_contiguous only */
 
 /* Allocate count pages of physical memory, adding to the tail of the passed list.
  * The list must be initialized.
@@ -167,7 +169,9 @@ void* paddr_to_kvaddr(paddr_t pa);
 paddr_t vaddr_to_paddr(const void* va);
 
 /* vm_page_t to physical address */
-paddr_t vm_page_to_paddr(const vm_page_t* page);
+static inline paddr_t vm_page_to_paddr(const vm_page_t* page) {
+    return page->paddr;
+}
 
 /* paddr to vm_page_t */
 vm_page_t* paddr_to_vm_page(paddr_t addr);
@@ -10,6 +10,7 @@
 #include <list.h>
 #include <magenta/compiler.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #if __cplusplus
 class VmObject;
@@ -25,6 +26,9 @@ typedef struct vm_page {
     };
     uint32_t map_count;
 
+    // physical address of the page, set once when the arena is initialized
+    paddr_t paddr;
+
     union {
         struct {
             // in allocated/just freed state, use a linked list to hold the page in a queue
@@ -38,7 +42,7 @@ typedef struct vm_page {
         } object;
 #endif
 
-        uint8_t pad[24]; // pad out to 32 bytes
+        uint8_t pad[16]; // pad out to 32 bytes
     };
 } vm_page_t;
 
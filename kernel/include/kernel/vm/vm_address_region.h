@@ -41,6 +41,10 @@
 // with execute permissions.  When on a VmMapping, controls whether or not the
 // mapping can gain this permission.
 #define VMAR_FLAG_CAN_MAP_EXECUTE (1 << 6)
+// When a VmMapping in this region takes a page fault, also map any resident
+// pages of the VmObject around the faulting address.  Inherited by every
+// VmAddressRegion and VmMapping created inside the region.
+#define VMAR_FLAG_FAULT_AROUND (1 << 7)
 
 #define VMAR_CAN_RWX_FLAGS (VMAR_FLAG_CAN_MAP_READ |  \
                             VMAR_FLAG_CAN_MAP_WRITE | \
@@ -470,6 +474,18 @@ private:
     // Version of AllocatedPages() that does not acquire the aspace lock
     size_t AllocatedPagesLocked() const override;
 
+    // Opportunistically map the already resident pages of the object in the
+    // fault-around window surrounding |va|.  Called from PageFault() after the
+    // faulting page itself has been mapped.
+    // Should be annotated TA_REQ(object_->lock()), see ActivateLocked().
+    void FaultAroundLocked(vaddr_t va);
+
+    // Map the whole large page aligned window around |va| with a single large page
+    // if the object backs it with one contiguous run.  Returns false, having mapped
+    // nothing, if it can't.
+    // Should be annotated TA_REQ(object_->lock()), see ActivateLocked().
+    bool MapLargePageLocked(vaddr_t va);
+
     void Activate() override;
 
     // Version of Activate that does not take the object_ lock.
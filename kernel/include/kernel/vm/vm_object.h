@@ -123,6 +123,12 @@ public:
         return ERR_NOT_SUPPORTED;
     }
 
+    // get the physical address of the large page at the large page aligned offset,
+    // if the object itself backs it with a single aligned, contiguous run of pages
+    virtual status_t GetLargePageLocked(uint64_t offset, paddr_t* pa) TA_REQ(lock_) {
+        return ERR_NOT_SUPPORTED;
+    }
+
     Mutex* lock() TA_RET_CAP(lock_) { return &lock_; }
     Mutex& lock_ref() TA_RET_CAP(lock_) { return lock_; }
 
@@ -25,7 +25,12 @@
 // the main VM object type, holding a list of pages
 class VmObjectPaged final : public VmObject {
 public:
-    static mxtl::RefPtr<VmObject> Create(uint32_t pmm_alloc_flags, uint64_t size);
+    // options for Create()
+    // back naturally aligned chunks of committed ranges with large page runs
+    static constexpr uint32_t kLargePages = (1u << 0);
+
+    static mxtl::RefPtr<VmObject> Create(uint32_t pmm_alloc_flags, uint64_t size,
+                                         uint32_t options = 0);
 
     static mxtl::RefPtr<VmObject> CreateFromROData(const void* data, size_t size);
 
@@ -67,6 +72,8 @@ public:
         // Calls a Locked method of the parent, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    status_t GetLargePageLocked(uint64_t offset, paddr_t* pa) override TA_REQ(lock_);
+
     status_t CloneCOW(uint64_t offset, uint64_t size,
                       mxtl::RefPtr<VmObject>* clone_vmo) override
         // Calls a Locked method of the child, which confuses analysis.
@@ -78,7 +85,8 @@ public:
 
 private:
     // private constructor (use Create())
-    explicit VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObject> parent);
+    explicit VmObjectPaged(uint32_t options, uint32_t pmm_alloc_flags,
+                           mxtl::RefPtr<VmObject> parent);
 
     // private destructor, only called from refptr
     ~VmObjectPaged() override;
@@ -100,6 +108,15 @@ private:
     // internal page list routine
     void AddPageToArray(size_t index, vm_page_t* p);
 
+    // returns true if the large page sized chunk at |offset| is backed by one aligned,
+    // physically contiguous run, and its base address in |pa| if not null
+    bool IsLargeRunLocked(uint64_t offset, paddr_t* pa) TA_REQ(lock_);
+
+    // back the empty, large page aligned chunks within [offset, offset + len) with
+    // contiguous runs, returning the number of bytes committed. the runs are zeroed
+    // without holding the lock.
+    uint64_t CommitLargeRuns(uint64_t offset, uint64_t len) TA_EXCL(lock_);
+
     // internal read/write routine that takes a templated copy function to help share some code
     template <typename T>
     status_t ReadWriteInternal(uint64_t offset, size_t len, size_t* bytes_copied, bool write,
@@ -112,6 +129,7 @@ private:
     static const uint64_t MAX_SIZE = ROUNDDOWN(UINT64_MAX, PAGE_SIZE);
 
     // members
+    const uint32_t options_;
     uint64_t size_ TA_GUARDED(lock_) = 0;
     uint64_t parent_offset_ TA_GUARDED(lock_) = 0;
     uint32_t pmm_alloc_flags_ TA_GUARDED(lock_) = PMM_ALLOC_FLAG_ANY;
@@ -11,6 +11,7 @@
 #include <mxtl/macros.h>
 #include <mxtl/unique_ptr.h>
 
+struct list_node;
 struct vm_page;
 
 class VmPageListNode final : public mxtl::WAVLTreeContainable<mxtl::unique_ptr<VmPageListNode>> {
@@ -93,6 +94,13 @@ public:
     status_t FreePage(uint64_t offset);
     size_t FreeAllPages();
 
+    // count the page aligned offsets in [start, end) that have no page
+    size_t CountMissingPages(uint64_t start, uint64_t end);
+
+    // hand out pages from |pages|, in order, to every page aligned offset in
+    // [start, end) that has no page; stops early if |pages| runs dry
+    status_t FillRange(uint64_t start, uint64_t end, list_node* pages);
+
 private:
     mxtl::WAVLTree<uint64_t, mxtl::unique_ptr<VmPageListNode>> list_;
 };
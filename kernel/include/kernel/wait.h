@@ -55,6 +55,18 @@ status_t wait_queue_block(wait_queue_t *, lk_time_t deadline);
 int wait_queue_wake_one(wait_queue_t *, bool reschedule, status_t wait_queue_error);
 int wait_queue_wake_all(wait_queue_t *, bool reschedule, status_t wait_queue_error);
 
+/*
+ * return the highest priority thread in the wait queue, the oldest one if
+ * several share that priority, or NULL if the queue is empty.
+ */
+struct thread *wait_queue_peek_highest(wait_queue_t *);
+
+/*
+ * release a specific thread blocked in the wait queue.
+ */
+void wait_queue_wake_thread(wait_queue_t *, struct thread *t, bool reschedule,
+                            status_t wait_queue_error);
+
 /*
  * remove the thread from whatever wait queue it's in.
  * return an error if the thread is not currently blocked (or is the current thread)
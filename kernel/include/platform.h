@@ -39,6 +39,12 @@ lk_time_t current_time(void);
 /* high-precision timer ticks per second */
 uint64_t ticks_per_second(void);
 
+/* if current_time() is derived from the counter that mx_ticks_get() reads
+ * in user mode, sets *ns_per_tick to the factor which converts counter
+ * values to current_time() nanoseconds and returns true */
+struct fp_32_64;
+bool platform_get_ns_per_tick(struct fp_32_64* ns_per_tick);
+
 /* super early platform initialization, before almost everything */
 void platform_early_init(void);
 
@@ -86,6 +86,9 @@ static int cmd_threadstats(int argc, const cmd_args *argv, uint32_t flags)
         printf("\tcontext_switches: %lu\n", thread_stats[i].context_switches);
         printf("\tpreempts: %lu\n", thread_stats[i].preempts);
         printf("\tyields: %lu\n", thread_stats[i].yields);
+#if WITH_SMP
+        printf("\tsteals: %lu\n", thread_stats[i].steals);
+#endif
         printf("\tinterrupts: %lu\n", thread_stats[i].interrupts);
         printf("\ttimer interrupts: %lu\n", thread_stats[i].timer_ints);
         printf("\ttimers: %lu\n", thread_stats[i].timers);
@@ -19,7 +19,32 @@
 #include <debug.h>
 #include <assert.h>
 #include <err.h>
+#include <inttypes.h>
+#include <string.h>
+#include <kernel/mp.h>
 #include <kernel/thread.h>
+#include <lib/console.h>
+
+/* upper bound on polls of the owner word, in case the holder keeps running
+ * without releasing the mutex */
+#define MUTEX_SPIN_MAX 1000
+
+struct mutex_stats mutex_stats[SMP_MAX_CPUS];
+
+#define MUTEX_STATS_INC(name) \
+    do { __atomic_fetch_add(&mutex_stats[arch_curr_cpu_num()].name, 1u, __ATOMIC_RELAXED); } while (0)
+
+static inline bool mutex_cmpxchg(mutex_t *m, uintptr_t *oldval, uintptr_t newval)
+{
+    return __atomic_compare_exchange_n(&m->val, oldval, newval, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline bool mutex_cmpxchg_release(mutex_t *m, uintptr_t *oldval, uintptr_t newval)
+{
+    return __atomic_compare_exchange_n(&m->val, oldval, newval, false,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
 
 /**
  * @brief  Initialize a mutex_t
@@ -42,19 +67,66 @@ void mutex_destroy(mutex_t *m)
 
     THREAD_LOCK(state);
 #if LK_DEBUGLEVEL > 0
-    if (unlikely(m->count > 0)) {
+    if (unlikely(__atomic_load_n(&m->val, __ATOMIC_RELAXED) != 0)) {
+        thread_t *holder = mutex_holder(m);
         panic("mutex_destroy: thread %p (%s) tried to destroy locked mutex %p,"
               " locked by %p (%s)\n",
               get_current_thread(), get_current_thread()->name, m,
-              m->holder, m->holder->name);
+              holder, holder->name);
     }
 #endif
     m->magic = 0;
-    m->count = 0;
+    m->val = 0;
     wait_queue_destroy(&m->wait);
     THREAD_UNLOCK(state);
 }
 
+/* Is the thread running on some cpu? The thread may release the mutex and
+ * exit at any moment, so it is only compared against the cpus' running
+ * threads, never dereferenced. */
+static bool mutex_holder_running(thread_t *holder)
+{
+    for (uint cpu = 0; cpu < arch_max_num_cpus(); cpu++) {
+        if (__atomic_load_n(&running_threads[cpu], __ATOMIC_RELAXED) == holder)
+            return true;
+    }
+    return false;
+}
+
+/* Spin for a short while in the hope that the holder drops the mutex before
+ * we'd finish blocking. Returns true if we acquired it.
+ *
+ * Spinning only pays while the holder is running; once it has been switched
+ * out it won't release the mutex any time soon, so give up and block.
+ */
+static bool mutex_spin(mutex_t *m, thread_t *current_thread)
+{
+    /* nobody else can be running the holder */
+    if (arch_max_num_cpus() == 1)
+        return false;
+
+    for (uint i = 0; i < MUTEX_SPIN_MAX; i++) {
+        uintptr_t oldval = __atomic_load_n(&m->val, __ATOMIC_RELAXED);
+        if (oldval == 0) {
+            if (mutex_cmpxchg(m, &oldval, (uintptr_t)current_thread))
+                return true;
+            continue;
+        }
+
+        /* once there are waiters, ownership is handed off on release, so
+         * there's no point spinning for it */
+        if (oldval & MUTEX_FLAG_QUEUED)
+            return false;
+
+        if (!mutex_holder_running((thread_t *)(oldval & ~MUTEX_FLAG_MASK)))
+            return false;
+
+        arch_spinloop_pause();
+    }
+
+    return false;
+}
+
 /**
  * @brief  Acquire the mutex
  *
@@ -65,48 +137,124 @@ void mutex_acquire(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
     DEBUG_ASSERT(m->magic == MUTEX_MAGIC);
     DEBUG_ASSERT(!arch_in_int_handler());
 
+    thread_t *current_thread = get_current_thread();
+
 #if LK_DEBUGLEVEL > 0
-    if (unlikely(get_current_thread() == m->holder))
+    if (unlikely(current_thread == mutex_holder(m)))
         panic("mutex_acquire: thread %p (%s) tried to acquire mutex %p it already owns.\n",
-              get_current_thread(), get_current_thread()->name, m);
+              current_thread, current_thread->name, m);
 #endif
 
+    MUTEX_STATS_INC(acquires);
+
+    /* fast path: the mutex is free */
+    uintptr_t oldval = 0;
+    if (likely(mutex_cmpxchg(m, &oldval, (uintptr_t)current_thread)))
+        return;
+
+    MUTEX_STATS_INC(contended);
+
+    /* the holder may be just about to drop it */
+    if (mutex_spin(m, current_thread)) {
+        MUTEX_STATS_INC(spin_acquires);
+        return;
+    }
+
     THREAD_LOCK(state);
-    if (unlikely(++m->count > 1)) {
-        status_t ret = wait_queue_block(&m->wait, INFINITE_TIME);
-        if (unlikely(ret < NO_ERROR)) {
-            /* mutexes are not interruptable and cannot time out, so it
-             * is illegal to return with any error state.
-             */
-            panic("mutex_acquire: wait_queue_block returns with error %d m %p, thr %p, sp %p\n",
-                   ret, m, get_current_thread(), __GET_FRAME());
+
+    /* with the thread lock held, either grab the mutex if it was released in
+     * the meantime, or flag it as queued so that the release path will come
+     * and wake us */
+    oldval = __atomic_load_n(&m->val, __ATOMIC_RELAXED);
+    for (;;) {
+        if (oldval == 0) {
+            if (mutex_cmpxchg(m, &oldval, (uintptr_t)current_thread)) {
+                THREAD_UNLOCK(state);
+                return;
+            }
+        } else if (oldval & MUTEX_FLAG_QUEUED) {
+            break;
+        } else if (mutex_cmpxchg(m, &oldval, oldval | MUTEX_FLAG_QUEUED)) {
+            break;
         }
     }
 
-    m->holder = get_current_thread();
+    MUTEX_STATS_INC(blocks);
+
+    /* make sure whoever holds it runs at least at our priority until it
+     * hands the mutex over, so a thread of middling priority can't keep
+     * both of us off the cpu */
+    thread_pi_set_owner(current_thread, mutex_holder(m));
+
+    status_t ret = wait_queue_block(&m->wait, INFINITE_TIME);
+    if (unlikely(ret < NO_ERROR)) {
+        /* mutexes are not interruptable and cannot time out, so it
+         * is illegal to return with any error state.
+         */
+        panic("mutex_acquire: wait_queue_block returns with error %d m %p, thr %p, sp %p\n",
+               ret, m, current_thread, __GET_FRAME());
+    }
+
+    /* the releasing thread handed ownership directly to us */
+    DEBUG_ASSERT(mutex_holder(m) == current_thread);
+    DEBUG_ASSERT(current_thread->pi_owner == NULL);
+
     THREAD_UNLOCK(state);
 }
 
+/* hand the mutex to the highest priority waiter, with the thread lock held */
+static void mutex_release_slow(mutex_t *m, bool reschedule)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(__atomic_load_n(&m->val, __ATOMIC_RELAXED) & MUTEX_FLAG_QUEUED);
+
+    thread_t *t = wait_queue_peek_highest(&m->wait);
+    DEBUG_ASSERT(t);
+
+    uintptr_t newval = (uintptr_t)t;
+    if (m->wait.count > 1)
+        newval |= MUTEX_FLAG_QUEUED;
+    __atomic_store_n(&m->val, newval, __ATOMIC_RELEASE);
+
+    MUTEX_STATS_INC(handoffs);
+
+    /* the new owner stops lending us its priority, and the threads still
+     * waiting lend theirs to it instead. dropping the last of them puts us
+     * back at our own priority. */
+    thread_pi_set_owner(t, NULL);
+    thread_t *waiter;
+    list_for_every_entry(&m->wait.list, waiter, thread_t, queue_node) {
+        if (waiter != t)
+            thread_pi_set_owner(waiter, t);
+    }
+
+    wait_queue_wake_thread(&m->wait, t, reschedule, NO_ERROR);
+}
 
 void mutex_release(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
 {
     DEBUG_ASSERT(m->magic == MUTEX_MAGIC);
     DEBUG_ASSERT(!arch_in_int_handler());
 
+    thread_t *current_thread = get_current_thread();
+
 #if LK_DEBUGLEVEL > 0
-    if (unlikely(get_current_thread() != m->holder)) {
+    if (unlikely(current_thread != mutex_holder(m))) {
+        thread_t *holder = mutex_holder(m);
         panic("mutex_release: thread %p (%s) tried to release mutex %p it doesn't own. owned by %p (%s)\n",
-              get_current_thread(), get_current_thread()->name, m, m->holder, m->holder ? m->holder->name : "none");
+              current_thread, current_thread->name, m, holder, holder ? holder->name : "none");
     }
 #endif
 
-    THREAD_LOCK(state);
-    m->holder = 0;
+    /* fast path: nobody is waiting */
+    uintptr_t oldval = (uintptr_t)current_thread;
+    if (likely(mutex_cmpxchg_release(m, &oldval, 0)))
+        return;
 
-    if (unlikely(--m->count >= 1)) {
-        /* release a thread */
-        wait_queue_wake_one(&m->wait, true, NO_ERROR);
-    }
+    /* the queued flag can only be set, and only be cleared by us, so it
+     * stays set until we hand off */
+    THREAD_LOCK(state);
+    mutex_release_slow(m, true);
     THREAD_UNLOCK(state);
 }
 
@@ -117,19 +265,53 @@ void mutex_release_thread_locked(mutex_t *m, bool reschedule) TA_NO_THREAD_SAFET
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
+    thread_t *current_thread = get_current_thread();
+
 #if LK_DEBUGLEVEL > 0
-    if (unlikely(get_current_thread() != m->holder)) {
+    if (unlikely(current_thread != mutex_holder(m))) {
+        thread_t *holder = mutex_holder(m);
         panic("mutex_release_thread_locked: thread %p (%s) tried to release mutex %p it doesn't own. "
               "owned by %p (%s)\n",
-              get_current_thread(), get_current_thread()->name, m, m->holder,
-              m->holder ? m->holder->name : "none");
+              current_thread, current_thread->name, m, holder,
+              holder ? holder->name : "none");
     }
 #endif
 
-    m->holder = 0;
+    uintptr_t oldval = (uintptr_t)current_thread;
+    if (likely(mutex_cmpxchg_release(m, &oldval, 0)))
+        return;
+
+    mutex_release_slow(m, reschedule);
+}
+
+static int cmd_mutex(int argc, const cmd_args *argv, uint32_t flags)
+{
+    bool reset = (argc >= 2 && !strcmp(argv[1].str, "reset"));
 
-    if (unlikely(--m->count >= 1)) {
-        /* release a thread */
-        wait_queue_wake_one(&m->wait, reschedule, NO_ERROR);
+    if (argc >= 2 && !reset) {
+        printf("usage:\n");
+        printf("%s         : dump mutex contention stats\n", argv[0].str);
+        printf("%s reset   : reset mutex contention stats\n", argv[0].str);
+        return ERR_INTERNAL;
     }
+
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (!mp_is_cpu_active(i))
+            continue;
+
+        struct mutex_stats *s = &mutex_stats[i];
+        if (reset) {
+            memset(s, 0, sizeof(*s));
+            continue;
+        }
+
+        printf("cpu %u: acquires %lu contended %lu spin acquires %lu blocks %lu handoffs %lu\n",
+               i, s->acquires, s->contended, s->spin_acquires, s->blocks, s->handoffs);
+    }
+
+    return NO_ERROR;
 }
+
+STATIC_COMMAND_START
+STATIC_COMMAND("mutexstats", "mutex contention statistics", &cmd_mutex)
+STATIC_COMMAND_END(mutex);
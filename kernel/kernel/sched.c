@@ -19,13 +19,47 @@
 /* legacy implementation that just broadcast ipis for every reschedule */
 #define BROADCAST_RESCHEDULE 0
 
-/* the run queue */
-static struct list_node run_queue[NUM_PRIORITIES];
-static uint32_t run_queue_bitmap;
+/* per cpu run queues
+ *
+ * Each cpu has its own set of priority queues and bitmap. Threads are placed
+ * on the queue of the cpu they last ran on when possible, to keep their cache
+ * footprint warm, and a cpu whose own queue has nothing it can run pulls work
+ * over from the other queues before going idle.
+ *
+ * All of the queues are protected by the thread_lock.
+ */
+struct run_queue {
+    struct list_node queue[NUM_PRIORITIES];
+    uint32_t bitmap;
+};
+
+static struct run_queue run_queues[SMP_MAX_CPUS];
 
 /* make sure the bitmap is large enough to cover our number of priorities */
-static_assert(NUM_PRIORITIES <= sizeof(run_queue_bitmap) * CHAR_BIT, "");
+static_assert(NUM_PRIORITIES <= sizeof(run_queues[0].bitmap) * CHAR_BIT, "");
 
+/* return the highest priority with a thread queued, or -1 if empty */
+static inline int run_queue_top_priority(const struct run_queue *rq)
+{
+    if (rq->bitmap == 0)
+        return -1;
+
+    return HIGHEST_PRIORITY - __builtin_clz(rq->bitmap)
+           - (sizeof(rq->bitmap) * CHAR_BIT - NUM_PRIORITIES);
+}
+
+static inline void run_queue_set_bit(struct run_queue *rq, int priority)
+{
+    rq->bitmap |= (1u << priority);
+}
+
+static inline void run_queue_clear_bit_if_empty(struct run_queue *rq, int priority)
+{
+    if (list_is_empty(&rq->queue[priority]))
+        rq->bitmap &= ~(1u << priority);
+}
+
+#if WITH_SMP
 /* pick a 'random' cpu */
 static mp_cpu_mask_t rand_cpu(const mp_cpu_mask_t mask)
 {
@@ -52,53 +86,72 @@ static mp_cpu_mask_t rand_cpu(const mp_cpu_mask_t mask)
             return (1u << rot);
     }
 }
+#endif
 
-/* find a cpu to wake up */
-static mp_cpu_mask_t find_cpu(thread_t *t)
+/* find a cpu run queue to put a newly ready thread in, and the set of cpus
+ * to send a reschedule ipi to so that it gets noticed */
+static uint find_cpu(thread_t *t, mp_cpu_mask_t *reschedule_mask)
 {
+    uint curr_cpu = arch_curr_cpu_num();
+
 #if BROADCAST_RESCHEDULE
-    return MP_CPU_ALL_BUT_LOCAL;
+    *reschedule_mask = MP_CPU_ALL_BUT_LOCAL;
+    return curr_cpu;
 #elif WITH_SMP
-    /* get the last cpu the thread ran on */
-    mp_cpu_mask_t last_ran_cpu_mask = (1u << thread_last_cpu(t));
+    /* pinned threads only ever go in their own cpu's queue */
+    if (unlikely(thread_pinned_cpu(t) >= 0)) {
+        uint pinned_cpu = thread_pinned_cpu(t);
+        *reschedule_mask = (pinned_cpu == curr_cpu) ? 0 : (1u << pinned_cpu);
+        return pinned_cpu;
+    }
 
-    /* the current cpu */
-    mp_cpu_mask_t curr_cpu_mask = (1u << arch_curr_cpu_num());
+    /* get the last cpu the thread ran on, if it's still around */
+    uint last_cpu = thread_last_cpu(t);
+    if (!mp_is_cpu_active(last_cpu))
+        last_cpu = curr_cpu;
 
     /* get a list of idle cpus */
     mp_cpu_mask_t idle_cpu_mask = mp_get_idle_mask();
     if (idle_cpu_mask != 0) {
-        if (idle_cpu_mask & curr_cpu_mask) {
+        if (idle_cpu_mask & (1u << curr_cpu)) {
             /* the current cpu is idle, so run it here */
-            return 0;
+            *reschedule_mask = 0;
+            return curr_cpu;
         }
 
-        if (last_ran_cpu_mask & idle_cpu_mask) {
+        if (idle_cpu_mask & (1u << last_cpu)) {
             /* the last core it ran on is idle and isn't the current cpu */
-            return last_ran_cpu_mask;
+            *reschedule_mask = 1u << last_cpu;
+            return last_cpu;
         }
 
         /* pick an idle_cpu */
-        return rand_cpu(idle_cpu_mask);
+        mp_cpu_mask_t idle_cpu = rand_cpu(idle_cpu_mask);
+        if (idle_cpu != 0) {
+            *reschedule_mask = idle_cpu;
+            return __builtin_ctz(idle_cpu);
+        }
     }
 
-    /* no idle cpus */
-    if (last_ran_cpu_mask == curr_cpu_mask) {
-        /* the last cpu it ran on is us */
-        /* pick a random cpu that isn't the current one */
-        return rand_cpu(mp_get_online_mask() & ~(curr_cpu_mask));
+    /* no idle cpus, queue it where it last ran to keep it cache affine */
+    if (last_cpu == curr_cpu) {
+        /* the last cpu it ran on is us. poke a random cpu that isn't the
+         * current one, it'll steal the thread if it has nothing better to do */
+        *reschedule_mask = rand_cpu(mp_get_online_mask() & ~(1u << curr_cpu));
     } else {
-        /* pick the last cpu it ran on */
-        return last_ran_cpu_mask;
+        /* poke the last cpu it ran on */
+        *reschedule_mask = 1u << last_cpu;
     }
+    return last_cpu;
 #else /* !WITH_SMP */
     /* no smp, dont send an IPI */
-    return 0;
+    *reschedule_mask = 0;
+    return curr_cpu;
 #endif
 }
 
 /* run queue manipulation */
-static void insert_in_run_queue_head(thread_t *t)
+static void insert_in_run_queue_head(uint cpu, thread_t *t)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(t->state == THREAD_READY);
@@ -106,11 +159,13 @@ static void insert_in_run_queue_head(thread_t *t)
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-    list_add_head(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+    struct run_queue *rq = &run_queues[cpu];
+    list_add_head(&rq->queue[t->priority], &t->queue_node);
+    run_queue_set_bit(rq, t->priority);
+    t->run_queue_cpu = cpu;
 }
 
-static void insert_in_run_queue_tail(thread_t *t)
+static void insert_in_run_queue_tail(uint cpu, thread_t *t)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(t->state == THREAD_READY);
@@ -118,29 +173,35 @@ static void insert_in_run_queue_tail(thread_t *t)
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-    list_add_tail(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+    struct run_queue *rq = &run_queues[cpu];
+    list_add_tail(&rq->queue[t->priority], &t->queue_node);
+    run_queue_set_bit(rq, t->priority);
+    t->run_queue_cpu = cpu;
 }
 
-thread_t *sched_get_top_thread(uint cpu)
+/* pull the first thread at or above min_priority out of a run queue that is
+ * allowed to run on cpu */
+static thread_t *run_queue_dequeue(struct run_queue *rq, uint cpu, int min_priority)
 {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
     thread_t *newthread;
-    uint32_t local_run_queue_bitmap = run_queue_bitmap;
+    uint32_t local_run_queue_bitmap = rq->bitmap;
 
     while (local_run_queue_bitmap) {
         /* find the first (remaining) queue with a thread in it */
-        uint next_queue = HIGHEST_PRIORITY - __builtin_clz(local_run_queue_bitmap)
-                          - (sizeof(run_queue_bitmap) * CHAR_BIT - NUM_PRIORITIES);
+        int next_queue = HIGHEST_PRIORITY - __builtin_clz(local_run_queue_bitmap)
+                         - (sizeof(rq->bitmap) * CHAR_BIT - NUM_PRIORITIES);
+        if (next_queue < min_priority)
+            break;
 
-        list_for_every_entry(&run_queue[next_queue], newthread, thread_t, queue_node) {
+        list_for_every_entry(&rq->queue[next_queue], newthread, thread_t, queue_node) {
 #if WITH_SMP
             if (likely(newthread->pinned_cpu < 0) || (uint)newthread->pinned_cpu == cpu)
 #endif
             {
                 list_delete(&newthread->queue_node);
-
-                if (list_is_empty(&run_queue[next_queue]))
-                    run_queue_bitmap &= ~(1<<next_queue);
+                run_queue_clear_bit_if_empty(rq, next_queue);
 
                 return newthread;
             }
@@ -148,6 +209,65 @@ thread_t *sched_get_top_thread(uint cpu)
 
         local_run_queue_bitmap &= ~(1<<next_queue);
     }
+
+    return NULL;
+}
+
+#if WITH_SMP
+/* steal the highest priority thread sitting in another cpu's run queue, if
+ * there is one that's allowed to run here */
+static thread_t *steal_thread(uint cpu)
+{
+    const uint max_cpus = arch_max_num_cpus();
+    mp_cpu_mask_t tried = 1u << cpu;
+
+    for (;;) {
+        /* find the queue with the best thread to offer, starting at the next
+         * cpu over so stealing spreads around */
+        uint best_cpu = cpu;
+        int best_priority = -1;
+        for (uint i = 1; i < max_cpus; i++) {
+            uint c = (cpu + i) % max_cpus;
+            if (tried & (1u << c))
+                continue;
+            int priority = run_queue_top_priority(&run_queues[c]);
+            if (priority > best_priority) {
+                best_cpu = c;
+                best_priority = priority;
+            }
+        }
+
+        if (best_cpu == cpu)
+            return NULL;
+
+        thread_t *t = run_queue_dequeue(&run_queues[best_cpu], cpu, LOWEST_PRIORITY);
+        if (t) {
+            THREAD_STATS_INC(steals);
+            return t;
+        }
+
+        /* everything there was pinned elsewhere; try the other queues */
+        tried |= 1u << best_cpu;
+    }
+}
+#endif
+
+thread_t *sched_get_top_thread(uint cpu)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    thread_t *newthread = run_queue_dequeue(&run_queues[cpu], cpu, LOWEST_PRIORITY);
+    if (newthread)
+        return newthread;
+
+#if WITH_SMP
+    /* nothing in our own queue can run here, so rather than going idle take
+     * the best thread waiting on another cpu */
+    newthread = steal_thread(cpu);
+    if (newthread)
+        return newthread;
+#endif
+
     /* no threads to run, select the idle thread for this cpu */
     return &idle_threads[cpu];
 }
@@ -179,14 +299,17 @@ void sched_unblock(thread_t *t, bool resched)
         thread_t *current_thread = get_current_thread();
 
         current_thread->state = THREAD_READY;
-        insert_in_run_queue_head(current_thread);
+        insert_in_run_queue_head(arch_curr_cpu_num(), current_thread);
     }
 
     /* stuff the new thread in the run queue */
+    mp_cpu_mask_t reschedule_mask;
+    uint cpu = find_cpu(t, &reschedule_mask);
+
     t->state = THREAD_READY;
-    insert_in_run_queue_head(t);
+    insert_in_run_queue_head(cpu, t);
 
-    mp_reschedule(find_cpu(t), 0);
+    mp_reschedule(reschedule_mask, 0);
 
     if (resched)
         thread_resched();
@@ -205,7 +328,7 @@ void sched_unblock_list(struct list_node *list, bool resched)
         thread_t *current_thread = get_current_thread();
 
         current_thread->state = THREAD_READY;
-        insert_in_run_queue_head(current_thread);
+        insert_in_run_queue_head(arch_curr_cpu_num(), current_thread);
     }
 
     /* pop the list of threads and shove into the scheduler */
@@ -215,10 +338,13 @@ void sched_unblock_list(struct list_node *list, bool resched)
         DEBUG_ASSERT(!thread_is_idle(t));
 
         /* stuff the new thread in the run queue */
+        mp_cpu_mask_t reschedule_mask;
+        uint cpu = find_cpu(t, &reschedule_mask);
+
         t->state = THREAD_READY;
-        insert_in_run_queue_head(t);
+        insert_in_run_queue_head(cpu, t);
 
-        mp_reschedule(find_cpu(t), 0);
+        mp_reschedule(reschedule_mask, 0);
     }
 
     if (resched)
@@ -234,7 +360,7 @@ void sched_yield(void)
     current_thread->state = THREAD_READY;
     current_thread->remaining_time_slice = 0;
     if (likely(!thread_is_idle(current_thread))) { /* idle thread doesn't go in the run queue */
-        insert_in_run_queue_tail(current_thread);
+        insert_in_run_queue_tail(arch_curr_cpu_num(), current_thread);
     }
     thread_resched();
 }
@@ -246,18 +372,51 @@ void sched_preempt(void)
     /* we are being preempted, so we get to go back into the front of the run queue if we have quantum left */
     current_thread->state = THREAD_READY;
     if (likely(!thread_is_idle(current_thread))) { /* idle thread doesn't go in the run queue */
+        uint cpu = arch_curr_cpu_num();
         if (current_thread->remaining_time_slice > 0)
-            insert_in_run_queue_head(current_thread);
+            insert_in_run_queue_head(cpu, current_thread);
         else
-            insert_in_run_queue_tail(current_thread); /* if we're out of quantum, go to the tail of the queue */
+            insert_in_run_queue_tail(cpu, current_thread); /* if we're out of quantum, go to the tail of the queue */
     }
     sched_block();
 }
 
+void sched_change_priority(thread_t *t, int priority)
+{
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(!thread_is_idle(t));
+
+    if (t->priority == priority)
+        return;
+
+    if (t->state != THREAD_READY) {
+        /* running threads pick up the new priority the next time they're
+         * queued, blocked ones when they're woken */
+        t->priority = priority;
+        return;
+    }
+
+    /* pull it out of the run queue it's in, and clean up the bitmap bit it
+     * may have been the last user of */
+    list_delete(&t->queue_node);
+    run_queue_clear_bit_if_empty(&run_queues[t->run_queue_cpu], t->priority);
+
+    t->priority = priority;
+
+    mp_cpu_mask_t reschedule_mask;
+    uint cpu = find_cpu(t, &reschedule_mask);
+    insert_in_run_queue_head(cpu, t);
+
+    mp_reschedule(reschedule_mask, 0);
+}
+
 void sched_init_early(void)
 {
     /* initialize the run queues */
-    for (int i=0; i < NUM_PRIORITIES; i++)
-        list_initialize(&run_queue[i]);
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        for (int i=0; i < NUM_PRIORITIES; i++)
+            list_initialize(&run_queues[cpu].queue[i]);
+    }
 }
 
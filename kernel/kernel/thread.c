@@ -59,6 +59,9 @@ spin_lock_t thread_lock = SPIN_LOCK_INITIAL_VALUE;
 /* the idle thread(s) (statically allocated) */
 thread_t idle_threads[SMP_MAX_CPUS];
 
+/* the thread running on each cpu, written under the thread lock */
+thread_t *running_threads[SMP_MAX_CPUS];
+
 /* local routines */
 void thread_resched(void);
 static int idle_thread_routine(void *) __NO_RETURN;
@@ -79,6 +82,7 @@ static void init_thread_struct(thread_t *t, const char *name)
     thread_set_pinned_cpu(t, -1);
     strlcpy(t->name, name, sizeof(t->name));
     wait_queue_init(&t->retcode_wait_queue);
+    list_initialize(&t->pi_waiters);
 }
 
 static void initial_thread_func(void) __NO_RETURN;
@@ -147,6 +151,7 @@ thread_t *thread_create_etc(
     t->entry = entry;
     t->arg = arg;
     t->priority = priority;
+    t->base_priority = priority;
     t->state = THREAD_INITIAL;
     t->signals = 0;
     t->blocking_wait_queue = NULL;
@@ -427,8 +432,79 @@ status_t thread_detach(thread_t *t)
     }
 }
 
+/* how far down a chain of blocked threads priority is passed along, to keep
+ * the time spent with the thread lock held bounded (and to not spin forever
+ * on a deadlock cycle) */
+#define THREAD_PI_MAX_CHAIN 16
+
+/* recompute a thread's priority from its base priority and the threads lending
+ * it theirs, and pass any change on to the thread it is itself blocked behind */
+static void thread_pi_update(thread_t *t)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    for (int depth = 0; t && depth < THREAD_PI_MAX_CHAIN; depth++) {
+        if (thread_is_idle(t))
+            break;
+
+        int priority = t->base_priority;
+        thread_t *waiter;
+        list_for_every_entry(&t->pi_waiters, waiter, thread_t, pi_waiter_node) {
+            if (waiter->priority > priority)
+                priority = waiter->priority;
+        }
+
+        if (priority == t->priority)
+            break;
+
+        sched_change_priority(t, priority);
+        t = t->pi_owner;
+    }
+}
+
+/**
+ * @brief  Lend a blocked thread's priority to the thread it's waiting on
+ *
+ * Used by the blocking primitives that know who holds what they're blocked
+ * on (mutexes, priority inheriting futexes). While |t| is recorded as waiting
+ * on |owner|, owner and anything owner is itself waiting on run at no less
+ * than t's priority. Passing a NULL owner takes the boost back.
+ *
+ * Must be called with the thread lock held.
+ */
+void thread_pi_set_owner(thread_t *t, thread_t *owner)
+{
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    if (t->pi_owner == owner)
+        return;
+
+    thread_t *old_owner = t->pi_owner;
+    if (old_owner) {
+        list_delete(&t->pi_waiter_node);
+        t->pi_owner = NULL;
+        thread_pi_update(old_owner);
+    }
+
+    /* an exiting owner has already dropped everything it held */
+    if (owner && owner != t && owner->state != THREAD_DEATH) {
+        DEBUG_ASSERT(owner->magic == THREAD_MAGIC);
+        t->pi_owner = owner;
+        list_add_tail(&owner->pi_waiters, &t->pi_waiter_node);
+        thread_pi_update(owner);
+    }
+}
+
 __NO_RETURN static void thread_exit_locked(thread_t *current_thread, int retcode)
 {
+    /* stop lending or borrowing priority */
+    thread_pi_set_owner(current_thread, NULL);
+    thread_t *waiter;
+    while ((waiter = list_remove_head_type(&current_thread->pi_waiters, thread_t, pi_waiter_node)))
+        waiter->pi_owner = NULL;
+    current_thread->priority = current_thread->base_priority;
+
     /* enter the dead state */
     current_thread->state = THREAD_DEATH;
     current_thread->retcode = retcode;
@@ -705,6 +781,7 @@ void thread_resched(void)
 
     /* mark the cpu ownership of the threads */
     thread_set_last_cpu(newthread, cpu);
+    __atomic_store_n(&running_threads[cpu], newthread, __ATOMIC_RELAXED);
 
     /* set the cpu state based on the new thread we've picked */
     if (thread_is_idle(newthread)) {
@@ -944,7 +1021,8 @@ status_t thread_sleep_etc(lk_time_t deadline, bool interruptable)
 
     if (deadline != INFINITE_TIME) {
         /* set a one shot timer to wake us up and reschedule */
-        timer_set_oneshot(&timer, deadline, thread_sleep_handler, (void *)current_thread);
+        timer_set_oneshot_slack(&timer, deadline, current_thread->timer_slack,
+                                thread_sleep_handler, (void *)current_thread);
     }
     current_thread->state = THREAD_SLEEPING;
     current_thread->blocked_status = NO_ERROR;
@@ -1009,6 +1087,7 @@ void thread_construct_first(thread_t *t, const char *name)
 
     init_thread_struct(t, name);
     t->priority = HIGHEST_PRIORITY;
+    t->base_priority = HIGHEST_PRIORITY;
     t->state = THREAD_RUNNING;
     t->flags = THREAD_FLAG_DETACHED;
     t->signals = 0;
@@ -1020,6 +1099,7 @@ void thread_construct_first(thread_t *t, const char *name)
     THREAD_LOCK(state);
     list_add_head(&thread_list, &t->thread_list_node);
     set_current_thread(t);
+    __atomic_store_n(&running_threads[cpu], t, __ATOMIC_RELAXED);
     THREAD_UNLOCK(state);
 }
 
@@ -1087,7 +1167,8 @@ void thread_set_priority(int priority)
         priority = IDLE_PRIORITY + 1;
     if (priority > HIGHEST_PRIORITY)
         priority = HIGHEST_PRIORITY;
-    current_thread->priority = priority;
+    current_thread->base_priority = priority;
+    thread_pi_update(current_thread);
 
     sched_preempt();
 
@@ -1113,6 +1194,7 @@ void thread_become_idle(void)
 
     /* mark ourself as idle */
     t->priority = IDLE_PRIORITY;
+    t->base_priority = IDLE_PRIORITY;
     t->flags |= THREAD_FLAG_IDLE;
     thread_set_pinned_cpu(t, arch_curr_cpu_num());
 
@@ -1383,7 +1465,8 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t deadline)
     /* if the deadline is nonzero or noninfinite, set a callback to yank us out of the queue */
     if (deadline != INFINITE_TIME) {
         timer_initialize(&timer);
-        timer_set_oneshot(&timer, deadline, wait_queue_timeout_handler, (void *)current_thread);
+        timer_set_oneshot_slack(&timer, deadline, current_thread->timer_slack,
+                                wait_queue_timeout_handler, (void *)current_thread);
     }
 
     sched_block();
@@ -1396,6 +1479,55 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t deadline)
     return current_thread->blocked_status;
 }
 
+/**
+ * @brief  Return the highest priority thread sleeping on a wait queue
+ *
+ * @param wait  The wait queue to look at
+ *
+ * @return  The highest priority waiter, the one that has waited longest if
+ * several share that priority, or NULL if the queue is empty
+ */
+thread_t *wait_queue_peek_highest(wait_queue_t *wait)
+{
+    DEBUG_ASSERT(wait->magic == WAIT_QUEUE_MAGIC);
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    thread_t *highest = NULL;
+    thread_t *t;
+    list_for_every_entry(&wait->list, t, thread_t, queue_node) {
+        if (!highest || t->priority > highest->priority)
+            highest = t;
+    }
+
+    return highest;
+}
+
+/**
+ * @brief  Wake a specific thread sleeping on a wait queue
+ *
+ * @param wait  The wait queue |t| is blocked on
+ * @param t  The thread to wake
+ * @param reschedule  If true, the newly-woken thread will run immediately.
+ * @param wait_queue_error  The return value which the thread will receive
+ * from wait_queue_block().
+ */
+void wait_queue_wake_thread(wait_queue_t *wait, thread_t *t, bool reschedule,
+                            status_t wait_queue_error)
+{
+    DEBUG_ASSERT(wait->magic == WAIT_QUEUE_MAGIC);
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(t->state == THREAD_BLOCKED);
+    DEBUG_ASSERT(t->blocking_wait_queue == wait);
+
+    list_delete(&t->queue_node);
+    wait->count--;
+    t->blocked_status = wait_queue_error;
+    t->blocking_wait_queue = NULL;
+
+    sched_unblock(t, reschedule);
+}
+
 /**
  * @brief  Wake up one thread sleeping on a wait queue
  *
@@ -35,8 +35,17 @@
 
 spin_lock_t timer_lock;
 
+/* Each cpu keeps its pending timers in a pairing heap ordered by the latest
+ * time each timer may fire. Inserting and melding are O(1), removing the
+ * head or cancelling an arbitrary timer is O(log n) amortized, and none of it
+ * needs memory beyond the links embedded in the timer itself.
+ *
+ * The hardware timer is programmed for the head's latest_time. When it goes
+ * off every timer whose scheduled_time has passed is run, so timers armed with
+ * slack are coalesced into whichever interrupt comes first.
+ */
 struct timer_state {
-    struct list_node timer_queue;
+    timer_t *heap;
 } __CPU_ALIGN;
 
 static struct timer_state timers[SMP_MAX_CPUS];
@@ -51,33 +60,116 @@ void timer_initialize(timer_t *timer)
     *timer = (timer_t)TIMER_INITIAL_VALUE(*timer);
 }
 
-static void insert_timer_in_queue(uint cpu, timer_t *timer)
+/* meld two detached heaps, returning the new root */
+static timer_t *timer_heap_meld(timer_t *a, timer_t *b)
 {
-    timer_t *entry;
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+
+    if (TIME_LT(b->latest_time, a->latest_time)) {
+        timer_t *tmp = a;
+        a = b;
+        b = tmp;
+    }
 
+    /* b becomes the first child of a */
+    b->heap_prev = a;
+    b->heap_next = a->heap_child;
+    if (a->heap_child)
+        a->heap_child->heap_prev = b;
+    a->heap_child = b;
+
+    return a;
+}
+
+/* standard two pass pairing of a list of siblings, done iteratively since
+ * the list may be arbitrarily long */
+static timer_t *timer_heap_merge_pairs(timer_t *first)
+{
+    /* first pass: meld adjacent pairs left to right, stacking up the results */
+    timer_t *pairs = NULL;
+    while (first) {
+        timer_t *a = first;
+        timer_t *b = a->heap_next;
+        first = b ? b->heap_next : NULL;
+
+        a->heap_next = a->heap_prev = NULL;
+        if (b)
+            b->heap_next = b->heap_prev = NULL;
+
+        a = timer_heap_meld(a, b);
+        a->heap_next = pairs;
+        pairs = a;
+    }
+
+    /* second pass: meld the pairs together right to left */
+    timer_t *root = NULL;
+    while (pairs) {
+        timer_t *p = pairs;
+        pairs = p->heap_next;
+        p->heap_next = NULL;
+        root = timer_heap_meld(root, p);
+    }
+
+    return root;
+}
+
+static inline timer_t *timer_queue_head(uint cpu)
+{
+    return timers[cpu].heap;
+}
+
+static void insert_timer_in_queue(uint cpu, timer_t *timer)
+{
     DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(timer->queued_cpu < 0);
 
-    LTRACEF("timer %p, cpu %u, scheduled %" PRIu64 ", periodic %" PRIu64 "\n", timer, cpu, timer->scheduled_time, timer->period);
+    LTRACEF("timer %p, cpu %u, scheduled %" PRIu64 ", latest %" PRIu64 ", periodic %" PRIu64 "\n",
+            timer, cpu, timer->scheduled_time, timer->latest_time, timer->period);
 
-    list_for_every_entry(&timers[cpu].timer_queue, entry, timer_t, node) {
-        if (TIME_GT(entry->scheduled_time, timer->scheduled_time)) {
-            list_add_before(&entry->node, &timer->node);
-            return;
-        }
+    timer->heap_child = timer->heap_next = timer->heap_prev = NULL;
+    timer->queued_cpu = cpu;
+    timers[cpu].heap = timer_heap_meld(timers[cpu].heap, timer);
+}
+
+static void remove_timer_from_queue(timer_t *timer)
+{
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(timer->queued_cpu >= 0);
+
+    struct timer_state *ts = &timers[timer->queued_cpu];
+    timer_t *children = timer_heap_merge_pairs(timer->heap_child);
+
+    if (ts->heap == timer) {
+        ts->heap = children;
+    } else {
+        /* unlink it from its parent or sibling and meld its children back in */
+        if (timer->heap_prev->heap_child == timer)
+            timer->heap_prev->heap_child = timer->heap_next;
+        else
+            timer->heap_prev->heap_next = timer->heap_next;
+        if (timer->heap_next)
+            timer->heap_next->heap_prev = timer->heap_prev;
+
+        ts->heap = timer_heap_meld(ts->heap, children);
     }
 
-    /* walked off the end of the list */
-    list_add_tail(&timers[cpu].timer_queue, &timer->node);
+    timer->heap_child = timer->heap_next = timer->heap_prev = NULL;
+    timer->queued_cpu = -1;
 }
 
-static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, timer_callback callback, void *arg)
+static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t slack, lk_time_t period,
+                      timer_callback callback, void *arg)
 {
-    LTRACEF("timer %p, deadline %" PRIu64 ", period %" PRIu64 ", callback %p, arg %p\n", timer, deadline, period, callback, arg);
+    LTRACEF("timer %p, deadline %" PRIu64 ", slack %" PRIu64 ", period %" PRIu64 ", callback %p, arg %p\n",
+            timer, deadline, slack, period, callback, arg);
 
     DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
 
-    if (list_in_list(&timer->node)) {
-        panic("timer %p already in list\n", timer);
+    if (timer->queued_cpu >= 0) {
+        panic("timer %p already in queue\n", timer);
     }
 
     spin_lock_saved_state_t state;
@@ -95,6 +187,9 @@ static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, time
 
     /* set up the structure */
     timer->scheduled_time = deadline;
+    timer->latest_time = deadline + slack;
+    if (TIME_LT(timer->latest_time, deadline))
+        timer->latest_time = INFINITE_TIME;
     timer->period = period;
     timer->callback = callback;
     timer->arg = arg;
@@ -106,10 +201,10 @@ static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, time
     insert_timer_in_queue(cpu, timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    if (list_peek_head_type(&timers[cpu].timer_queue, timer_t, node) == timer) {
+    if (timer_queue_head(cpu) == timer) {
         /* we just modified the head of the timer queue */
-        LTRACEF("setting new timer for %" PRIu64 " nsecs\n", deadline);
-        platform_set_oneshot_timer(timer_tick, NULL, deadline);
+        LTRACEF("setting new timer for %" PRIu64 " nsecs\n", timer->latest_time);
+        platform_set_oneshot_timer(timer_tick, NULL, timer->latest_time);
     }
 #endif
 
@@ -133,7 +228,27 @@ out:
  */
 void timer_set_oneshot(timer_t *timer, lk_time_t deadline, timer_callback callback, void *arg)
 {
-    timer_set(timer, deadline, 0, callback, arg);
+    timer_set(timer, deadline, 0, 0, callback, arg);
+}
+
+/**
+ * @brief  Set up a timer that executes once, some time after its deadline
+ *
+ * Like timer_set_oneshot(), but the callback may run as late as |slack| ns
+ * past the deadline. Timers whose windows overlap are run out of the same
+ * timer interrupt, so callers that don't need precise wakeups should pass
+ * whatever slack they can tolerate.
+ *
+ * @param  timer The timer to use
+ * @param  deadline The deadline, in ns, after which the timer is executed
+ * @param  slack  How long past the deadline, in ns, the timer may be delayed
+ * @param  callback  The function to call when the timer expires
+ * @param  arg  The argument to pass to the callback
+ */
+void timer_set_oneshot_slack(timer_t *timer, lk_time_t deadline, lk_time_t slack,
+                             timer_callback callback, void *arg)
+{
+    timer_set(timer, deadline, slack, 0, callback, arg);
 }
 
 /**
@@ -154,7 +269,7 @@ void timer_set_periodic(timer_t *timer, lk_time_t period, timer_callback callbac
 {
     if (period == 0)
         period = 1;
-    timer_set(timer, current_time() + period, period, callback, arg);
+    timer_set(timer, current_time() + period, 0, period, callback, arg);
 }
 
 /**
@@ -189,24 +304,24 @@ void timer_cancel(timer_t *timer)
     }
 
     /* if the timer is in a queue, remove it and adjust hardware timers if needed */
-    if (list_in_list(&timer->node)) {
+    if (timer->queued_cpu >= 0) {
 #if PLATFORM_HAS_DYNAMIC_TIMER
-        timer_t *oldhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        timer_t *oldhead = timer_queue_head(cpu);
 #endif
 
         /* remove it from the queue */
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
         /* see if we've just modified the head of this cpu's timer queue */
         /* if we modified another cpu's queue, we'll just let it fire and sort itself out */
-        timer_t *newhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        timer_t *newhead = timer_queue_head(cpu);
         if (newhead == NULL) {
             LTRACEF("clearing old hw timer, nothing in the queue\n");
             platform_stop_timer();
         } else if (newhead != oldhead) {
-            LTRACEF("setting new timer to %" PRIu64 "\n", newhead->scheduled_time);
-            platform_set_oneshot_timer(timer_tick, NULL, newhead->scheduled_time);
+            LTRACEF("setting new timer to %" PRIu64 "\n", newhead->latest_time);
+            platform_set_oneshot_timer(timer_tick, NULL, newhead->latest_time);
         }
 #endif
     }
@@ -241,8 +356,10 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
     spin_lock(&timer_lock);
 
     for (;;) {
-        /* see if there's an event to process */
-        timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        /* see if there's an event to process. anything at the head of the
+         * queue whose deadline has passed is run, even if it could have
+         * waited longer, so that timers with slack get batched together */
+        timer = timer_queue_head(cpu);
         if (likely(timer == 0))
             break;
         LTRACEF("next item on timer queue %p at %" PRIu64 " now %" PRIu64 " (%p, arg %p)\n", timer, timer->scheduled_time, now, timer->callback, timer->arg);
@@ -254,7 +371,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
         DEBUG_ASSERT_MSG(timer && timer->magic == TIMER_MAGIC,
                 "ASSERT: timer failed magic check: timer %p, magic 0x%x\n",
                 timer, (uint)timer->magic);
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
         /* mark the timer busy */
         timer->active_cpu = cpu;
@@ -290,9 +407,10 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
             /* if it is a periodic timer and it hasn't been requeued
              * by the callback put it back in the list
              */
-            if (timer->period > 0 && !list_in_list(&timer->node)) {
+            if (timer->period > 0 && timer->queued_cpu < 0) {
                 LTRACEF("periodic timer, period %" PRIu64 "\n", timer->period);
                 timer->scheduled_time = now + timer->period;
+                timer->latest_time = timer->scheduled_time;
                 insert_timer_in_queue(cpu, timer);
             }
         }
@@ -300,14 +418,14 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
     /* reset the timer to the next event */
-    timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer = timer_queue_head(cpu);
     if (timer) {
         /* has to be the case or it would have fired already */
         DEBUG_ASSERT(TIME_GT(timer->scheduled_time, now));
 
-        LTRACEF("setting new timer for %" PRIu64 " nsecs for event %p\n", timer->scheduled_time,
+        LTRACEF("setting new timer for %" PRIu64 " nsecs for event %p\n", timer->latest_time,
                 timer);
-        platform_set_oneshot_timer(timer_tick, NULL, timer->scheduled_time);
+        platform_set_oneshot_timer(timer_tick, NULL, timer->latest_time);
     }
 
     /* we're done manipulating the timer queue */
@@ -349,21 +467,21 @@ void timer_transition_off_cpu(uint old_cpu)
     spin_lock_irqsave(&timer_lock, state);
     uint cpu = arch_curr_cpu_num();
 
-    timer_t *old_head = list_peek_head_type(&timers[old_cpu].timer_queue, timer_t, node);
+    timer_t *old_head = timer_queue_head(cpu);
 
-    timer_t *entry = NULL, *tmp_entry = NULL;
     /* Move all timers from old_cpu to this cpu */
-    list_for_every_entry_safe(&timers[old_cpu].timer_queue, entry, tmp_entry, timer_t, node) {
-        list_delete(&entry->node);
+    timer_t *entry;
+    while ((entry = timer_queue_head(old_cpu)) != NULL) {
+        remove_timer_from_queue(entry);
         insert_timer_in_queue(cpu, entry);
     }
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    timer_t *new_head = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer_t *new_head = timer_queue_head(cpu);
     if (new_head != NULL && new_head != old_head) {
         /* we just modified the head of the timer queue */
-        LTRACEF("setting new timer for %" PRIu64 " nsecs\n", new_head->scheduled_time);
-        platform_set_oneshot_timer(timer_tick, NULL, new_head->scheduled_time);
+        LTRACEF("setting new timer for %" PRIu64 " nsecs\n", new_head->latest_time);
+        platform_set_oneshot_timer(timer_tick, NULL, new_head->latest_time);
     }
 #endif
 
@@ -380,10 +498,10 @@ void timer_thaw_percpu(void)
 
     uint cpu = arch_curr_cpu_num();
 
-    timer_t *t = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer_t *t = timer_queue_head(cpu);
     if (t) {
-        LTRACEF("rescheduling timer for %" PRIu64 " nsecs\n", t->scheduled_time);
-        platform_set_oneshot_timer(timer_tick, NULL, t->scheduled_time);
+        LTRACEF("rescheduling timer for %" PRIu64 " nsecs\n", t->latest_time);
+        platform_set_oneshot_timer(timer_tick, NULL, t->latest_time);
     }
 
     spin_unlock(&timer_lock);
@@ -394,7 +512,7 @@ void timer_init(void)
 {
     timer_lock = SPIN_LOCK_INITIAL_VALUE;
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
-        list_initialize(&timers[i].timer_queue);
+        timers[i].heap = NULL;
     }
 #if !PLATFORM_HAS_DYNAMIC_TIMER
     /* register for a periodic timer tick */
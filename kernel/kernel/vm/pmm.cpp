@@ -6,12 +6,17 @@
 // https://opensource.org/licenses/MIT
 
 #include "vm_priv.h"
+#include <arch/ops.h>
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/auto_lock.h>
+#include <kernel/cmdline.h>
+#include <kernel/event.h>
 #include <kernel/mp.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/vm.h>
 #include <lib/console.h>
@@ -35,6 +40,70 @@ static Mutex arena_lock;
 static mxtl::DoublyLinkedList<PmmArena*> arena_list TA_GUARDED(arena_lock);
 static size_t arena_cumulative_size TA_GUARDED(arena_lock);
 
+// All of the arenas sorted by base address, for translating physical addresses
+// to pages without walking the arena list. Only written during early boot.
+#define PMM_MAX_ARENAS 16
+static PmmArena* arena_table[PMM_MAX_ARENAS];
+static size_t arena_table_count;
+
+// Per cpu page caches, sitting in front of the arena lock.
+//
+// Single page allocations and frees are satisfied out of the current cpu's
+// cache, which is refilled from the arenas in batches of |low_water| pages when
+// it runs dry and drained back down to |low_water| pages once it grows past
+// |high_water|. Pages sitting in a cache are in the ALLOC state as far as the
+// arenas are concerned.
+//
+// Each cache is protected by its own spinlock, taken with interrupts disabled
+// so that it may be drained from any cpu when the arenas run out of pages.
+// The caches are disabled (high water of 0) until pmm_pcpu_cache_init runs.
+#define PMM_PCPU_CACHE_DEFAULT_HIGH_WATER 128u
+#define PMM_PCPU_CACHE_DEFAULT_LOW_WATER 32u
+
+struct pmm_pcpu_cache {
+    spin_lock_t lock;
+    list_node free_list;
+    size_t count;
+
+    // stats
+    uint64_t alloc_hits;
+    uint64_t alloc_misses;
+    uint64_t free_hits;
+    uint64_t refills;
+    uint64_t drains;
+};
+
+static pmm_pcpu_cache pcpu_caches[SMP_MAX_CPUS];
+static volatile size_t pcpu_cache_high_water = 0;
+static volatile size_t pcpu_cache_low_water = 0;
+
+// Pool of pre-zeroed pages.
+//
+// A thread running just above idle priority pulls pages out of the arenas,
+// zeroes them while the system has nothing better to do and parks them here
+// until the pool holds |zero_pool_target| pages. Allocations passing
+// PMM_ALLOC_FLAG_ZEROED are served out of the pool first and only zero pages
+// inline when it runs dry. Pages in the pool are in the ALLOC state as far as
+// the arenas are concerned.
+//
+// The thread is woken whenever the pool drops below half of its target, and
+// stops short of taking the last free pages in the system.
+#define PMM_ZERO_POOL_DEFAULT_TARGET 1024u
+#define PMM_ZERO_POOL_BATCH 16u
+#define PMM_ZERO_POOL_RESERVE_FACTOR 4u
+
+static spin_lock_t zero_pool_lock = SPIN_LOCK_INITIAL_VALUE;
+static list_node zero_pool_list = LIST_INITIAL_VALUE(zero_pool_list);
+static size_t zero_pool_count;
+static volatile size_t zero_pool_target = 0;
+static event_t zero_pool_event =
+    EVENT_INITIAL_VALUE(zero_pool_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+// stats
+static uint64_t zero_pool_hits;
+static uint64_t zero_pool_misses;
+static uint64_t zero_pool_zeroed;
+
 #if PMM_ENABLE_FREE_FILL
 static void pmm_enforce_fill(uint level) {
     for (auto& a : arena_list) {
@@ -44,28 +113,30 @@ static void pmm_enforce_fill(uint level) {
 LK_INIT_HOOK(pmm_fill, &pmm_enforce_fill, LK_INIT_LEVEL_VM);
 #endif
 
-// We don't need to hold the arena lock while executing this, since it is
-// only accesses values that are set once during system initialization.
-paddr_t vm_page_to_paddr(const vm_page_t* page) TA_NO_THREAD_SAFETY_ANALYSIS {
-    for (const auto& a : arena_list) {
-        // LTRACEF("testing page %p against arena %p\n", page, &a);
-        if (a.page_belongs_to_arena(page)) {
-            return a.page_address_from_arena(page);
-        }
-    }
-    return -1;
-}
-
 // We don't need to hold the arena lock while executing this, since it is
 // only accesses values that are set once during system initialization.
 vm_page_t* paddr_to_vm_page(paddr_t addr) TA_NO_THREAD_SAFETY_ANALYSIS {
-    for (auto& a : arena_list) {
-        if (a.address_in_arena(addr)) {
-            size_t index = (addr - a.base()) / PAGE_SIZE;
-            return a.get_page(index);
+    // binary search the address sorted arena table for the last arena
+    // starting at or below the address
+    size_t low = 0;
+    size_t high = arena_table_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (arena_table[mid]->base() <= addr) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
     }
-    return nullptr;
+    if (low == 0)
+        return nullptr;
+
+    PmmArena* a = arena_table[low - 1];
+    if (!a->address_in_arena(addr))
+        return nullptr;
+
+    size_t index = (addr - a->base()) / PAGE_SIZE;
+    return a->get_page(index);
 }
 
 // We disable thread safety analysis here, since this function is only called
@@ -82,6 +153,12 @@ status_t pmm_add_arena(const pmm_arena_info_t* info) TA_NO_THREAD_SAFETY_ANALYSI
     DEBUG_ASSERT(IS_PAGE_ALIGNED(info->size));
     DEBUG_ASSERT(info->size > 0);
 
+    if (arena_table_count == countof(arena_table)) {
+        printf("PMM: too many arenas, dropping arena '%s' base %#" PRIxPTR " size %#zx\n",
+               info->name, info->base, info->size);
+        return ERR_NO_MEMORY;
+    }
+
     // allocate a c++ arena object
     PmmArena* arena = new (boot_alloc_mem(sizeof(PmmArena))) PmmArena(info);
 
@@ -97,6 +174,14 @@ status_t pmm_add_arena(const pmm_arena_info_t* info) TA_NO_THREAD_SAFETY_ANALYSI
     arena_list.push_back(arena);
 
 done_add:
+    // insert it into the address sorted table
+    size_t i;
+    for (i = arena_table_count; i > 0 && arena_table[i - 1]->base() > arena->base(); i--) {
+        arena_table[i] = arena_table[i - 1];
+    }
+    arena_table[i] = arena;
+    arena_table_count++;
+
     // tell the arena to allocate a page array
     arena->BootAllocArray();
 
@@ -105,10 +190,8 @@ done_add:
     return NO_ERROR;
 }
 
-vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
-    AutoLock al(&arena_lock);
-
-    /* walk the arenas in order until we find one with a free page */
+// walk the arenas in order until we find one with a free page
+static vm_page_t* pmm_alloc_page_locked(uint alloc_flags, paddr_t* pa) TA_REQ(arena_lock) {
     for (auto& a : arena_list) {
         /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
         if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
@@ -122,22 +205,12 @@ vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
             return page;
     }
 
-    LTRACEF("failed to allocate page\n");
     return nullptr;
 }
 
-size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
-    LTRACEF("count %zu\n", count);
-
-    /* list must be initialized prior to calling this */
-    DEBUG_ASSERT(list);
-
-    if (count == 0)
-        return 0;
-
-    AutoLock al(&arena_lock);
-
-    /* walk the arenas in order, allocating as many pages as we can from each */
+// walk the arenas in order, allocating as many pages as we can from each
+static size_t pmm_alloc_pages_locked(size_t count, uint alloc_flags, struct list_node* list)
+    TA_REQ(arena_lock) {
     size_t allocated = 0;
     for (auto& a : arena_list) {
         DEBUG_ASSERT(count > allocated);
@@ -158,6 +231,465 @@ size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
     return allocated;
 }
 
+// return a list of pages to the arenas they belong to
+static size_t pmm_free_locked(struct list_node* list) TA_REQ(arena_lock) {
+    size_t count = 0;
+    while (!list_is_empty(list)) {
+        vm_page_t* page = list_remove_head_type(list, vm_page_t, free.node);
+
+        DEBUG_ASSERT(!page_is_free(page));
+
+        /* see which arena this page belongs to and add it */
+        for (auto& a : arena_list) {
+            if (a.FreePage(page) >= 0) {
+                count++;
+                break;
+            }
+        }
+    }
+
+    return count;
+}
+
+// Lock the current cpu's page cache. Interrupts are disabled for the duration,
+// which also keeps us from migrating while looking at our cpu number.
+static pmm_pcpu_cache* pmm_pcpu_cache_lock(spin_lock_saved_state_t* state) {
+    arch_interrupt_save(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    pmm_pcpu_cache* cache = &pcpu_caches[arch_curr_cpu_num()];
+    spin_lock(&cache->lock);
+    return cache;
+}
+
+static void pmm_pcpu_cache_unlock(pmm_pcpu_cache* cache, spin_lock_saved_state_t state) {
+    spin_unlock_restore(&cache->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+// Move up to |count| pages from the front of |from| to the tail of |to|.
+static size_t pmm_move_pages(struct list_node* from, struct list_node* to, size_t count) {
+    size_t moved = 0;
+    while (moved < count) {
+        list_node* node = list_remove_head(from);
+        if (!node)
+            break;
+        list_add_tail(to, node);
+        moved++;
+    }
+    return moved;
+}
+
+// Try to allocate |count| pages out of the current cpu's cache, refilling
+// it from the arenas in a single batch if it comes up short.
+// Returns the number of pages added to the tail of |list|.
+static size_t pmm_pcpu_cache_alloc(size_t count, struct list_node* list) {
+    size_t low_water = pcpu_cache_low_water;
+    if (pcpu_cache_high_water == 0 || count > low_water)
+        return 0;
+
+    spin_lock_saved_state_t state;
+    pmm_pcpu_cache* cache = pmm_pcpu_cache_lock(&state);
+    if (cache->count >= count) {
+        pmm_move_pages(&cache->free_list, list, count);
+        cache->count -= count;
+        cache->alloc_hits++;
+        pmm_pcpu_cache_unlock(cache, state);
+        return count;
+    }
+    cache->alloc_misses++;
+    pmm_pcpu_cache_unlock(cache, state);
+
+    // grab a batch from the arenas without holding the cache lock
+    list_node refill = LIST_INITIAL_VALUE(refill);
+    size_t refilled;
+    {
+        AutoLock al(&arena_lock);
+        refilled = pmm_alloc_pages_locked(low_water + count, PMM_ALLOC_FLAG_ANY, &refill);
+    }
+
+    size_t allocated = pmm_move_pages(&refill, list, count);
+    refilled -= allocated;
+
+    // we may have migrated while refilling, which is fine, stash the rest
+    // wherever we are now
+    if (refilled > 0) {
+        cache = pmm_pcpu_cache_lock(&state);
+        pmm_move_pages(&refill, &cache->free_list, refilled);
+        cache->count += refilled;
+        cache->refills++;
+        pmm_pcpu_cache_unlock(cache, state);
+    }
+
+    return allocated;
+}
+
+// Stash up to |high_water| pages from |list| in the current cpu's cache. If the
+// cache fills up it is trimmed back to the low water mark, with the excess put
+// back on |list| for the caller to return to the arenas.
+// Returns the number of pages taken off |list|.
+static size_t pmm_pcpu_cache_free(struct list_node* list) {
+    size_t high_water = pcpu_cache_high_water;
+    if (high_water == 0)
+        return 0;
+
+    size_t low_water = pcpu_cache_low_water;
+    size_t cached = 0;
+    list_node drain = LIST_INITIAL_VALUE(drain);
+
+    spin_lock_saved_state_t state;
+    pmm_pcpu_cache* cache = pmm_pcpu_cache_lock(&state);
+    while (cached < high_water) {
+        vm_page_t* page = list_remove_head_type(list, vm_page_t, free.node);
+        if (!page)
+            break;
+
+        DEBUG_ASSERT(!page_is_free(page));
+
+        if (cache->count >= high_water) {
+            cache->count -= pmm_move_pages(&cache->free_list, &drain, cache->count - low_water);
+            cache->drains++;
+        }
+
+        page->state = VM_PAGE_STATE_ALLOC;
+        list_add_head(&cache->free_list, &page->free.node);
+        cache->count++;
+        cached++;
+    }
+    cache->free_hits++;
+    pmm_pcpu_cache_unlock(cache, state);
+
+    pmm_move_pages(&drain, list, SIZE_MAX);
+    return cached;
+}
+
+// Return every page held in every cpu's cache to the arenas.
+// Used when the arenas themselves come up short.
+static size_t pmm_pcpu_cache_drain_all() {
+    list_node drain = LIST_INITIAL_VALUE(drain);
+
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        pmm_pcpu_cache* cache = &pcpu_caches[i];
+
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&cache->lock, state);
+        if (cache->count > 0) {
+            pmm_move_pages(&cache->free_list, &drain, cache->count);
+            cache->count = 0;
+            cache->drains++;
+        }
+        spin_unlock_irqrestore(&cache->lock, state);
+    }
+
+    if (list_is_empty(&drain))
+        return 0;
+
+    AutoLock al(&arena_lock);
+    return pmm_free_locked(&drain);
+}
+
+static size_t pmm_pcpu_cache_count() {
+    size_t count = 0;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        count += pcpu_caches[i].count;
+    }
+    return count;
+}
+
+static void pmm_pcpu_cache_set_water(size_t low_water, size_t high_water) {
+    if (low_water > high_water)
+        low_water = high_water;
+
+    pcpu_cache_high_water = high_water;
+    pcpu_cache_low_water = low_water;
+
+    if (high_water == 0)
+        pmm_pcpu_cache_drain_all();
+}
+
+static void pmm_pcpu_cache_init(uint level) {
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        pmm_pcpu_cache* cache = &pcpu_caches[i];
+        spin_lock_init(&cache->lock);
+        list_initialize(&cache->free_list);
+    }
+
+    pmm_pcpu_cache_set_water(
+        cmdline_get_uint32("pmm.pcpu_cache_low", PMM_PCPU_CACHE_DEFAULT_LOW_WATER),
+        cmdline_get_uint32("pmm.pcpu_cache_high", PMM_PCPU_CACHE_DEFAULT_HIGH_WATER));
+}
+LK_INIT_HOOK(pmm_pcpu_cache, &pmm_pcpu_cache_init, LK_INIT_LEVEL_VM);
+
+static void pmm_pcpu_cache_dump() {
+    printf("pmm per cpu page cache: low water %zu high water %zu\n",
+           pcpu_cache_low_water, pcpu_cache_high_water);
+
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        const pmm_pcpu_cache* cache = &pcpu_caches[i];
+        uint64_t allocs = cache->alloc_hits + cache->alloc_misses;
+        if (allocs == 0 && cache->free_hits == 0)
+            continue;
+
+        printf("\tcpu %u: cached %zu alloc hit %" PRIu64 " miss %" PRIu64 " (%" PRIu64
+               "%% hit) free %" PRIu64 " refill %" PRIu64 " drain %" PRIu64 "\n",
+               i, cache->count, cache->alloc_hits, cache->alloc_misses,
+               allocs ? cache->alloc_hits * 100 / allocs : 0,
+               cache->free_hits, cache->refills, cache->drains);
+    }
+}
+
+// Take up to |count| pages out of the zero pool, adding them to the tail of |list|.
+// Returns the number of pages taken.
+static size_t pmm_zero_pool_alloc(size_t count, struct list_node* list) {
+    size_t target = zero_pool_target;
+    if (target == 0)
+        return 0;
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&zero_pool_lock, state);
+    size_t before = zero_pool_count;
+    size_t taken = pmm_move_pages(&zero_pool_list, list, count);
+    zero_pool_count -= taken;
+    zero_pool_hits += taken;
+    bool wake = before >= target / 2 && zero_pool_count < target / 2;
+    spin_unlock_irqrestore(&zero_pool_lock, state);
+
+    if (wake)
+        event_signal(&zero_pool_event, false);
+
+    return taken;
+}
+
+// Zero every page on |list| and count them as zero pool misses.
+static void pmm_zero_pages_inline(struct list_node* list) {
+    size_t count = 0;
+    vm_page_t* page;
+    list_for_every_entry (list, page, vm_page_t, free.node) {
+        arch_zero_page(paddr_to_kvaddr(vm_page_to_paddr(page)));
+        count++;
+    }
+    __atomic_fetch_add(&zero_pool_misses, count, __ATOMIC_RELAXED);
+}
+
+// Return every page in the zero pool to the arenas.
+static size_t pmm_zero_pool_drain() {
+    list_node drain = LIST_INITIAL_VALUE(drain);
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&zero_pool_lock, state);
+    zero_pool_count -= pmm_move_pages(&zero_pool_list, &drain, zero_pool_count);
+    spin_unlock_irqrestore(&zero_pool_lock, state);
+
+    if (list_is_empty(&drain))
+        return 0;
+
+    AutoLock al(&arena_lock);
+    return pmm_free_locked(&drain);
+}
+
+// Put every page parked in a per cpu cache or the zero pool back in the arenas.
+// Used when the arenas themselves come up short.
+static size_t pmm_reclaim_cached_pages() {
+    return pmm_pcpu_cache_drain_all() + pmm_zero_pool_drain();
+}
+
+static size_t pmm_arena_free_count_locked() TA_REQ(arena_lock) {
+    size_t free = 0;
+    for (const auto& a : arena_list) {
+        free += a.free_count();
+    }
+    return free;
+}
+
+// Top the zero pool up to its target, a batch at a time.
+static void pmm_zero_pool_fill() {
+    for (;;) {
+        size_t target = zero_pool_target;
+
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&zero_pool_lock, state);
+        size_t count = zero_pool_count;
+        spin_unlock_irqrestore(&zero_pool_lock, state);
+
+        if (count >= target)
+            return;
+
+        // grab a batch straight from the arenas, leaving plenty behind for
+        // everyone else
+        list_node batch = LIST_INITIAL_VALUE(batch);
+        size_t allocated = 0;
+        {
+            AutoLock al(&arena_lock);
+            if (pmm_arena_free_count_locked() > target * PMM_ZERO_POOL_RESERVE_FACTOR) {
+                allocated = pmm_alloc_pages_locked(mxtl::min<size_t>(target - count, PMM_ZERO_POOL_BATCH),
+                                                   PMM_ALLOC_FLAG_ANY, &batch);
+            }
+        }
+        if (allocated == 0)
+            return;
+
+        vm_page_t* page;
+        list_for_every_entry (&batch, page, vm_page_t, free.node) {
+            arch_zero_page(paddr_to_kvaddr(vm_page_to_paddr(page)));
+        }
+
+        spin_lock_irqsave(&zero_pool_lock, state);
+        zero_pool_count += pmm_move_pages(&batch, &zero_pool_list, allocated);
+        zero_pool_zeroed += allocated;
+        spin_unlock_irqrestore(&zero_pool_lock, state);
+    }
+}
+
+static int pmm_zero_thread(void* arg) {
+    for (;;) {
+        event_wait(&zero_pool_event);
+        if (zero_pool_target == 0) {
+            pmm_zero_pool_drain();
+        } else {
+            pmm_zero_pool_fill();
+        }
+    }
+    return 0;
+}
+
+static void pmm_zero_pool_set_target(size_t target) {
+    zero_pool_target = target;
+    event_signal(&zero_pool_event, false);
+}
+
+static void pmm_zero_pool_init(uint level) {
+    size_t target = cmdline_get_uint32("pmm.zero_pool_pages", PMM_ZERO_POOL_DEFAULT_TARGET);
+
+    thread_t* t = thread_create("pmm zero", &pmm_zero_thread, nullptr, IDLE_PRIORITY + 1,
+                                DEFAULT_STACK_SIZE);
+    if (!t) {
+        printf("PMM: failed to create zeroing thread\n");
+        return;
+    }
+    thread_detach_and_resume(t);
+
+    pmm_zero_pool_set_target(target);
+}
+LK_INIT_HOOK(pmm_zero_pool, &pmm_zero_pool_init, LK_INIT_LEVEL_THREADING);
+
+static void pmm_zero_pool_dump() {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&zero_pool_lock, state);
+    size_t count = zero_pool_count;
+    uint64_t hits = zero_pool_hits;
+    uint64_t zeroed = zero_pool_zeroed;
+    spin_unlock_irqrestore(&zero_pool_lock, state);
+    uint64_t misses = __atomic_load_n(&zero_pool_misses, __ATOMIC_RELAXED);
+
+    printf("pmm zero pool: %zu of %zu pages, %" PRIu64 " zeroed by thread\n",
+           count, zero_pool_target, zeroed);
+    printf("\tzeroed allocs: %" PRIu64 " from pool, %" PRIu64 " zeroed inline (%" PRIu64
+           "%% from pool)\n",
+           hits, misses, (hits + misses) ? hits * 100 / (hits + misses) : 0);
+}
+
+static vm_page_t* pmm_alloc_page_unzeroed(uint alloc_flags, paddr_t* pa) {
+    // only unrestricted allocations can come out of the per cpu caches, since
+    // they hold pages from any arena
+    if (alloc_flags == PMM_ALLOC_FLAG_ANY) {
+        list_node list = LIST_INITIAL_VALUE(list);
+        if (pmm_pcpu_cache_alloc(1, &list) == 1) {
+            vm_page_t* page = list_remove_head_type(&list, vm_page_t, free.node);
+            if (pa)
+                *pa = vm_page_to_paddr(page);
+            return page;
+        }
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        {
+            AutoLock al(&arena_lock);
+            vm_page_t* page = pmm_alloc_page_locked(alloc_flags, pa);
+            if (page)
+                return page;
+        }
+
+        // pages may be hiding in the per cpu caches, put them back and retry
+        if (pmm_reclaim_cached_pages() == 0)
+            break;
+    }
+
+    LTRACEF("failed to allocate page\n");
+    return nullptr;
+}
+
+vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
+    // the zero pool holds pages from any arena
+    if (alloc_flags == PMM_ALLOC_FLAG_ZEROED) {
+        list_node list = LIST_INITIAL_VALUE(list);
+        if (pmm_zero_pool_alloc(1, &list) == 1) {
+            vm_page_t* page = list_remove_head_type(&list, vm_page_t, free.node);
+            if (pa)
+                *pa = vm_page_to_paddr(page);
+            return page;
+        }
+    }
+
+    vm_page_t* page = pmm_alloc_page_unzeroed(alloc_flags & ~PMM_ALLOC_FLAG_ZEROED, pa);
+    if (page && (alloc_flags & PMM_ALLOC_FLAG_ZEROED)) {
+        arch_zero_page(paddr_to_kvaddr(vm_page_to_paddr(page)));
+        __atomic_fetch_add(&zero_pool_misses, 1, __ATOMIC_RELAXED);
+    }
+    return page;
+}
+
+static size_t pmm_alloc_pages_unzeroed(size_t count, uint alloc_flags, struct list_node* list) {
+    // small unrestricted allocations are served by the per cpu caches
+    size_t allocated = 0;
+    if (alloc_flags == PMM_ALLOC_FLAG_ANY) {
+        allocated = pmm_pcpu_cache_alloc(count, list);
+        if (allocated == count)
+            return count;
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        {
+            AutoLock al(&arena_lock);
+            allocated += pmm_alloc_pages_locked(count - allocated, alloc_flags, list);
+            if (allocated == count)
+                break;
+        }
+
+        // pages may be hiding in the per cpu caches, put them back and retry
+        if (pmm_reclaim_cached_pages() == 0)
+            break;
+    }
+
+    return allocated;
+}
+
+size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
+    LTRACEF("count %zu\n", count);
+
+    /* list must be initialized prior to calling this */
+    DEBUG_ASSERT(list);
+
+    if (count == 0)
+        return 0;
+
+    // the zero pool holds pages from any arena
+    size_t allocated = 0;
+    if (alloc_flags == PMM_ALLOC_FLAG_ZEROED) {
+        allocated = pmm_zero_pool_alloc(count, list);
+        if (allocated == count)
+            return count;
+    }
+
+    if (!(alloc_flags & PMM_ALLOC_FLAG_ZEROED))
+        return pmm_alloc_pages_unzeroed(count, alloc_flags, list);
+
+    // zero whatever the pool could not cover before handing it out
+    list_node unzeroed = LIST_INITIAL_VALUE(unzeroed);
+    size_t remaining = pmm_alloc_pages_unzeroed(count - allocated,
+                                                alloc_flags & ~PMM_ALLOC_FLAG_ZEROED, &unzeroed);
+    pmm_zero_pages_inline(&unzeroed);
+    pmm_move_pages(&unzeroed, list, remaining);
+
+    return allocated + remaining;
+}
+
 size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list) {
     LTRACEF("address %#" PRIxPTR ", count %zu\n", address, count);
 
@@ -167,6 +699,9 @@ size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list) {
 
     address = ROUNDDOWN(address, PAGE_SIZE);
 
+    // any of the pages we're after may be sitting in a per cpu cache or the zero pool
+    pmm_reclaim_cached_pages();
+
     AutoLock al(&arena_lock);
 
     /* walk through the arenas, looking to see if the physical page belongs to it */
@@ -199,20 +734,28 @@ size_t pmm_alloc_contiguous(size_t count, uint alloc_flags, uint8_t alignment_lo
     if (alignment_log2 < PAGE_SIZE_SHIFT)
         alignment_log2 = PAGE_SIZE_SHIFT;
 
-    AutoLock al(&arena_lock);
-
-    for (auto& a : arena_list) {
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        {
+            AutoLock al(&arena_lock);
+
+            for (auto& a : arena_list) {
+                /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
+                if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
+                    if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
+                        continue;
+                }
+
+                size_t allocated = a.AllocContiguous(count, alignment_log2, pa, list);
+                if (allocated > 0) {
+                    DEBUG_ASSERT(allocated == count);
+                    return allocated;
+                }
+            }
         }
 
-        size_t allocated = a.AllocContiguous(count, alignment_log2, pa, list);
-        if (allocated > 0) {
-            DEBUG_ASSERT(allocated == count);
-            return allocated;
-        }
+        // the per cpu caches may be breaking up a run, put them back and retry
+        if ((alloc_flags & PMM_ALLOC_FLAG_NO_RECLAIM) || pmm_reclaim_cached_pages() == 0)
+            break;
     }
 
     LTRACEF("couldn't find run\n");
@@ -293,24 +836,14 @@ size_t pmm_free(struct list_node* list) {
 
     DEBUG_ASSERT(list);
 
-    AutoLock al(&arena_lock);
-
-    uint count = 0;
-    while (!list_is_empty(list)) {
-        vm_page_t* page = list_remove_head_type(list, vm_page_t, free.node);
-
-        DEBUG_ASSERT(!page_is_free(page));
+    size_t count = pmm_pcpu_cache_free(list);
 
-        /* see which arena this page belongs to and add it */
-        for (auto& a : arena_list) {
-            if (a.FreePage(page) >= 0) {
-                count++;
-                break;
-            }
-        }
+    if (!list_is_empty(list)) {
+        AutoLock al(&arena_lock);
+        count += pmm_free_locked(list);
     }
 
-    LTRACEF("returning count %u\n", count);
+    LTRACEF("returning count %zu\n", count);
 
     return count;
 }
@@ -325,7 +858,7 @@ size_t pmm_free_page(vm_page_t* page) {
 }
 
 void pmm_dump_free() TA_REQ(arena_lock) {
-    size_t free = 0u;
+    size_t free = pmm_pcpu_cache_count() + zero_pool_count;
     for (const auto& a : arena_list) {
         free += a.free_count();
     }
@@ -334,7 +867,7 @@ void pmm_dump_free() TA_REQ(arena_lock) {
 }
 
 size_t pmm_count_free_pages() {
-    size_t free = 0u;
+    size_t free = pmm_pcpu_cache_count() + zero_pool_count;
     AutoLock al(&arena_lock);
     for (const auto& a : arena_list) {
         free += a.free_count();
@@ -381,6 +914,11 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
             printf("%s dump_alloced\n", argv[0].str);
             printf("%s free_alloced\n", argv[0].str);
             printf("%s free\n", argv[0].str);
+            printf("%s cache\n", argv[0].str);
+            printf("%s cache_water <low> <high>\n", argv[0].str);
+            printf("%s cache_drain\n", argv[0].str);
+            printf("%s zero\n", argv[0].str);
+            printf("%s zero_target <pages>\n", argv[0].str);
         }
         return ERR_INTERNAL;
     }
@@ -393,6 +931,25 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
         // No other operations will work during a panic.
         printf("Only the \"arenas\" command is available during a panic.\n");
         goto usage;
+    } else if (!strcmp(argv[1].str, "cache")) {
+        pmm_pcpu_cache_dump();
+    } else if (!strcmp(argv[1].str, "cache_water")) {
+        if (argc < 4)
+            goto notenoughargs;
+
+        pmm_pcpu_cache_set_water(argv[2].u, argv[3].u);
+        pmm_pcpu_cache_dump();
+    } else if (!strcmp(argv[1].str, "cache_drain")) {
+        size_t count = pmm_pcpu_cache_drain_all();
+        printf("drained %zu pages\n", count);
+    } else if (!strcmp(argv[1].str, "zero")) {
+        pmm_zero_pool_dump();
+    } else if (!strcmp(argv[1].str, "zero_target")) {
+        if (argc < 3)
+            goto notenoughargs;
+
+        pmm_zero_pool_set_target(argv[2].u);
+        pmm_zero_pool_dump();
     } else if (!strcmp(argv[1].str, "free")) {
         static bool show_mem = false;
         static timer_t timer;
@@ -63,6 +63,7 @@ void PmmArena::BootAllocArray() {
     for (size_t i = 0; i < page_count; i++) {
         auto& p = page_array_[i];
 
+        p.paddr = info_.base + i * PAGE_SIZE;
         list_add_tail(&free_list_, &p.free.node);
     }
 
@@ -288,6 +288,8 @@ static int cmd_vm(int argc, const cmd_args* argv, uint32_t flags) {
         printf("%s virt2phys <address>\n", argv[0].str);
         printf("%s map <phys> <virt> <count> <flags>\n", argv[0].str);
         printf("%s unmap <virt> <count>\n", argv[0].str);
+        printf("%s faultstats [reset]\n", argv[0].str);
+        printf("%s largepages [reset]\n", argv[0].str);
         return ERR_INTERNAL;
     }
 
@@ -347,6 +349,14 @@ static int cmd_vm(int argc, const cmd_args* argv, uint32_t flags) {
         size_t unmapped;
         auto err = arch_mmu_unmap(&aspace->arch_aspace(), argv[2].u, (uint)argv[3].u, &unmapped);
         printf("arch_mmu_unmap returns %d, unmapped %zu\n", err, unmapped);
+    } else if (!strcmp(argv[1].str, "faultstats")) {
+        vm_fault_stats_dump();
+        if (argc >= 3 && !strcmp(argv[2].str, "reset"))
+            vm_fault_stats_reset();
+    } else if (!strcmp(argv[1].str, "largepages")) {
+        vm_large_page_stats_dump();
+        if (argc >= 3 && !strcmp(argv[2].str, "reset"))
+            vm_large_page_stats_reset();
     } else {
         printf("unknown command\n");
         goto usage;
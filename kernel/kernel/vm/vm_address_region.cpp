@@ -109,6 +109,9 @@ status_t VmAddressRegion::CreateSubVmarInternal(size_t offset, size_t size, uint
         return ERR_INVALID_ARGS;
     }
 
+    // Fault-around is inherited by everything created inside the region
+    vmar_flags |= flags_ & VMAR_FLAG_FAULT_AROUND;
+
     vaddr_t new_base = -1;
     if (is_specific) {
         new_base = base_ + offset;
@@ -128,7 +131,17 @@ status_t VmAddressRegion::CreateSubVmarInternal(size_t offset, size_t size, uint
         }
     } else {
         // If we're not mapping to a specific place, search for an opening.
-        status_t status = AllocSpotLocked(size, align_pow2, arch_mmu_flags, &new_base);
+        // Mappings of whole large pages of an object try for a large page
+        // aligned spot first, so the object's large page runs can be mapped
+        // with large pages.
+        status_t status = ERR_NO_MEMORY;
+        if (vmo && vm_large_pages_enabled && size >= VM_LARGE_PAGE_SIZE &&
+            IS_ALIGNED(vmo_offset, VM_LARGE_PAGE_SIZE) && align_pow2 < VM_LARGE_PAGE_SHIFT) {
+            status = AllocSpotLocked(size, VM_LARGE_PAGE_SHIFT, arch_mmu_flags, &new_base);
+        }
+        if (status != NO_ERROR) {
+            status = AllocSpotLocked(size, align_pow2, arch_mmu_flags, &new_base);
+        }
         if (status != NO_ERROR) {
             return status;
         }
@@ -184,7 +197,8 @@ status_t VmAddressRegion::CreateSubVmar(size_t offset, size_t size, uint8_t alig
     }
 
     // Check that only allowed flags have been set
-    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_CAN_MAP_SPECIFIC | VMAR_FLAG_COMPACT | VMAR_CAN_RWX_FLAGS)) {
+    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_CAN_MAP_SPECIFIC | VMAR_FLAG_COMPACT |
+                       VMAR_FLAG_FAULT_AROUND | VMAR_CAN_RWX_FLAGS)) {
         return ERR_INVALID_ARGS;
     }
 
@@ -207,7 +221,8 @@ status_t VmAddressRegion::CreateVmMapping(size_t mapping_offset, size_t size, ui
     LTRACEF("%p %#zx %#zx %x\n", this, mapping_offset, size, vmar_flags);
 
     // Check that only allowed flags have been set
-    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_SPECIFIC_OVERWRITE | VMAR_CAN_RWX_FLAGS)) {
+    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_SPECIFIC_OVERWRITE | VMAR_FLAG_FAULT_AROUND |
+                       VMAR_CAN_RWX_FLAGS)) {
         return ERR_INVALID_ARGS;
     }
 
@@ -10,9 +10,11 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
+#include <lk/init.h>
 #include <mxtl/auto_call.h>
 #include <mxtl/auto_lock.h>
 #include <new.h>
@@ -21,6 +23,46 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+#define VM_FAULT_AROUND_DEFAULT_PAGES 16
+
+// size of the fault-around window in pages, set by vm.fault_around_pages
+static size_t fault_around_pages = VM_FAULT_AROUND_DEFAULT_PAGES;
+
+// page fault statistics, reported by vm_fault_stats_dump()
+static uint64_t fault_count;
+static uint64_t fault_around_count;
+static uint64_t fault_around_mapped;
+
+static void vm_fault_around_init(uint level) {
+    fault_around_pages = cmdline_get_uint32("vm.fault_around_pages", VM_FAULT_AROUND_DEFAULT_PAGES);
+}
+LK_INIT_HOOK(vm_fault_around, &vm_fault_around_init, LK_INIT_LEVEL_VM);
+
+void vm_fault_stats_dump() {
+    uint64_t faults = __atomic_load_n(&fault_count, __ATOMIC_RELAXED);
+    uint64_t around = __atomic_load_n(&fault_around_count, __ATOMIC_RELAXED);
+    uint64_t mapped = __atomic_load_n(&fault_around_mapped, __ATOMIC_RELAXED);
+
+    printf("page faults: %" PRIu64 ", fault-around window %zu pages\n", faults, fault_around_pages);
+    printf("fault-around: %" PRIu64 " faults mapped %" PRIu64 " extra pages\n", around, mapped);
+}
+
+// count the large page aligned windows fully covered by the run [va, va + len) mapped
+// to [pa, pa + len), which the arch layer can map with large pages
+static size_t large_pages_in_run(vaddr_t va, paddr_t pa, size_t len) {
+    if ((va ^ pa) & (VM_LARGE_PAGE_SIZE - 1))
+        return 0;
+    vaddr_t start = ROUNDUP(va, VM_LARGE_PAGE_SIZE);
+    vaddr_t end = ROUNDDOWN(va + len, VM_LARGE_PAGE_SIZE);
+    return end > start ? (end - start) / VM_LARGE_PAGE_SIZE : 0;
+}
+
+void vm_fault_stats_reset() {
+    __atomic_store_n(&fault_count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&fault_around_count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&fault_around_mapped, 0, __ATOMIC_RELAXED);
+}
+
 VmMapping::VmMapping(VmAddressRegion& parent, vaddr_t base, size_t size, uint32_t vmar_flags,
                      mxtl::RefPtr<VmObject> vmo, uint64_t vmo_offset, uint arch_mmu_flags,
                      const char* name)
@@ -387,14 +429,56 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     if (commit)
         pf_flags |= VMM_PF_FLAG_SW_FAULT;
 
-    // grab the lock for the vmo
-    AutoLock al(object_->lock());
-
     // set the currently faulting flag for any recursive calls the vmo may make back into us.
     DEBUG_ASSERT(!currently_faulting_);
     currently_faulting_ = true;
     auto ac = mxtl::MakeAutoCall([&]() { currently_faulting_ = false; });
 
+    // commit the whole range up front so the vmo can allocate and insert its pages in
+    // bulk instead of taking a soft fault per page below; anything it can't commit this
+    // way is still faulted in one page at a time
+    if (commit)
+        object_->CommitRange(object_offset_ + offset, len, nullptr);
+
+    // grab the lock for the vmo
+    AutoLock al(object_->lock());
+
+    // accumulate runs of physically contiguous pages and map each with one call,
+    // which lets the arch layer use large pages for the aligned parts of a run
+    vaddr_t run_va = 0;
+    paddr_t run_pa = 0;
+    size_t run_pages = 0;
+
+    auto map_run = [&]() {
+        if (run_pages == 0)
+            return;
+
+        LTRACEF_LEVEL(2, "mapping pa %#" PRIxPTR " to va %#" PRIxPTR " pages %zu\n",
+                      run_pa, run_va, run_pages);
+
+        size_t mapped;
+        auto ret = arch_mmu_map(&aspace_->arch_aspace(), run_va, run_pa, run_pages,
+                                arch_mmu_flags_, &mapped);
+        if (ret == NO_ERROR) {
+            DEBUG_ASSERT(mapped == run_pages);
+            size_t large = large_pages_in_run(run_va, run_pa, run_pages * PAGE_SIZE);
+            if (large > 0)
+                __atomic_fetch_add(&large_page_stats.mapped, large, __ATOMIC_RELAXED);
+        } else {
+            // part of the run may already be mapped, fall back to going a page at a time
+            for (size_t i = 0; i < run_pages; i++) {
+                vaddr_t va = run_va + i * PAGE_SIZE;
+                paddr_t pa = run_pa + i * PAGE_SIZE;
+                ret = arch_mmu_map(&aspace_->arch_aspace(), va, pa, 1, arch_mmu_flags_, &mapped);
+                if (ret < 0) {
+                    TRACEF("error %d mapping page at va %#" PRIxPTR " pa %#" PRIxPTR "\n",
+                           ret, va, pa);
+                }
+            }
+        }
+        run_pages = 0;
+    };
+
     // iterate through the range, grabbing a page from the underlying object and
     // mapping it in
     size_t o;
@@ -406,6 +490,7 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
         status = object_->GetPageLocked(vmo_offset, pf_flags, nullptr, &pa);
         if (status < 0) {
             // no page to map
+            map_run();
             if (commit) {
                 // fail when we can't commit every requested page
                 return status;
@@ -416,16 +501,17 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
         }
 
         vaddr_t va = base_ + o;
-        LTRACEF_LEVEL(2, "mapping pa %#" PRIxPTR " to va %#" PRIxPTR "\n", pa, va);
-
-        size_t mapped;
-        auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, pa, 1, arch_mmu_flags_, &mapped);
-        if (ret < 0) {
-            TRACEF("error %d mapping page at va %#" PRIxPTR " pa %#" PRIxPTR "\n", ret, va, pa);
+        if (run_pages > 0 && pa == run_pa + run_pages * PAGE_SIZE) {
+            run_pages++;
+            continue;
         }
 
-        DEBUG_ASSERT(mapped == 1);
+        map_run();
+        run_va = va;
+        run_pa = pa;
+        run_pages = 1;
     }
+    map_run();
 
     return NO_ERROR;
 }
@@ -507,6 +593,8 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
     va = ROUNDDOWN(va, PAGE_SIZE);
     uint64_t vmo_offset = va - base_ + object_offset_;
 
+    __atomic_fetch_add(&fault_count, 1, __ATOMIC_RELAXED);
+
     __UNUSED char pf_string[5];
     LTRACEF("%p '%s', va %#" PRIxPTR " vmo_offset %#" PRIx64 ", pf_flags %#x (%s)\n",
             this, name_, va, vmo_offset, pf_flags,
@@ -617,6 +705,10 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         // assert that we're not accidentally mapping the zero page writable
         DEBUG_ASSERT((new_pa != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
 
+        // the page may be part of a run that covers its whole large page window
+        if (MapLargePageLocked(va))
+            return NO_ERROR;
+
         size_t mapped;
         status = arch_mmu_map(&aspace_->arch_aspace(), va, new_pa, 1, mmu_flags, &mapped);
         if (status < 0) {
@@ -624,6 +716,9 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
             return ERR_NO_MEMORY;
         }
         DEBUG_ASSERT(mapped == 1);
+
+        if (flags_ & VMAR_FLAG_FAULT_AROUND)
+            FaultAroundLocked(va);
     }
 
 // TODO: figure out what to do with this
@@ -634,6 +729,119 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
     return NO_ERROR;
 }
 
+// See the comment on ActivateLocked() for why analysis is disabled here.
+void VmMapping::FaultAroundLocked(vaddr_t va) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+
+    const size_t window = fault_around_pages * PAGE_SIZE;
+    if (window <= PAGE_SIZE)
+        return;
+
+    // align the window within the mapping and clip it to the end of the mapping
+    vaddr_t start = base_ + ((va - base_) / window) * window;
+    vaddr_t end = start + mxtl::min(window, base_ + size_ - start);
+
+    // only map pages read only, so that a write still faults and can do copy-on-write
+    const uint mmu_flags = arch_mmu_flags_ & ~ARCH_MMU_FLAG_PERM_WRITE;
+
+    // accumulate runs of physically contiguous pages and map each with one call
+    vaddr_t run_va = 0;
+    paddr_t run_pa = 0;
+    size_t run_pages = 0;
+    size_t total = 0;
+
+    auto map_run = [&]() {
+        if (run_pages == 0)
+            return;
+
+        size_t mapped;
+        status_t status = arch_mmu_map(&aspace_->arch_aspace(), run_va, run_pa, run_pages,
+                                       mmu_flags, &mapped);
+        if (status < 0) {
+            // this is purely opportunistic, the pages will be faulted in individually
+            LTRACEF("failed to map %zu pages at va %#" PRIxPTR "\n", run_pages, run_va);
+        } else {
+            DEBUG_ASSERT(mapped == run_pages);
+            total += mapped;
+#if ARCH_ARM64
+            if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
+                arch_sync_cache_range(run_va, run_pages * PAGE_SIZE);
+#endif
+        }
+        run_pages = 0;
+    };
+
+    for (vaddr_t cur = start; cur < end; cur += PAGE_SIZE) {
+        paddr_t pa;
+        uint page_flags;
+        bool resident = false;
+
+        // skip the page we just faulted in and anything that is already mapped
+        if (cur != va && arch_mmu_query(&aspace_->arch_aspace(), cur, &pa, &page_flags) < 0) {
+            // pf_flags of 0 only returns pages that already exist in the object or its parents
+            uint64_t vmo_offset = cur - base_ + object_offset_;
+            resident = object_->GetPageLocked(vmo_offset, 0, nullptr, &pa) == NO_ERROR;
+        }
+
+        if (resident && run_pages > 0 && pa == run_pa + run_pages * PAGE_SIZE) {
+            run_pages++;
+            continue;
+        }
+
+        map_run();
+        if (resident) {
+            run_va = cur;
+            run_pa = pa;
+            run_pages = 1;
+        }
+    }
+    map_run();
+
+    if (total > 0) {
+        __atomic_fetch_add(&fault_around_count, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&fault_around_mapped, total, __ATOMIC_RELAXED);
+    }
+}
+
+// See the comment on ActivateLocked() for why analysis is disabled here.
+bool VmMapping::MapLargePageLocked(vaddr_t va) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+
+    // the window must lie within the mapping and line up with an aligned chunk of the object
+    vaddr_t window = ROUNDDOWN(va, VM_LARGE_PAGE_SIZE);
+    if (window < base_ || window - base_ > size_ - VM_LARGE_PAGE_SIZE || size_ < VM_LARGE_PAGE_SIZE)
+        return false;
+    uint64_t vmo_offset = window - base_ + object_offset_;
+    if (!IS_ALIGNED(vmo_offset, VM_LARGE_PAGE_SIZE))
+        return false;
+
+    paddr_t pa;
+    if (object_->GetLargePageLocked(vmo_offset, &pa) != NO_ERROR)
+        return false;
+
+    // The run belongs to the object itself, never a parent or the zero page, so it can
+    // be mapped with the full permissions of the region right away.  Mapping it read
+    // only on a read fault would split it again on the first write.
+    size_t mapped;
+    status_t status = arch_mmu_map(&aspace_->arch_aspace(), window, pa,
+                                   VM_LARGE_PAGE_SIZE / PAGE_SIZE, arch_mmu_flags_, &mapped);
+    if (status < 0) {
+        // some of the window is already mapped with small pages
+        LTRACEF("failed to map large page at va %#" PRIxPTR ": %d\n", window, status);
+        return false;
+    }
+    DEBUG_ASSERT(mapped == VM_LARGE_PAGE_SIZE / PAGE_SIZE);
+    __atomic_fetch_add(&large_page_stats.mapped, 1, __ATOMIC_RELAXED);
+
+#if ARCH_ARM64
+    if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
+        arch_sync_cache_range(window, VM_LARGE_PAGE_SIZE);
+#endif
+    return true;
+}
+
 // We disable thread safety analysis here because one of the common uses of this
 // function is for splitting one mapping object into several that will be backed
 // by the same VmObject.  In that case, object_->lock() gets aliased across all
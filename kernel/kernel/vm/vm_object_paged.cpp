@@ -13,10 +13,12 @@
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/auto_lock.h>
+#include <kernel/cmdline.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_address_region.h>
 #include <lib/console.h>
 #include <lib/user_copy.h>
+#include <lk/init.h>
 #include <new.h>
 #include <safeint/safe_math.h>
 #include <stdlib.h>
@@ -41,8 +43,37 @@ void ZeroPage(vm_page_t* p) {
 
 } // namespace
 
-VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObject> parent)
-    : VmObject(mxtl::move(parent)), pmm_alloc_flags_(pmm_alloc_flags) {
+bool vm_large_pages_enabled = true;
+vm_large_page_stats large_page_stats;
+
+static void vm_large_pages_init(uint level) {
+    vm_large_pages_enabled = cmdline_get_bool("vm.large_pages", true);
+}
+LK_INIT_HOOK(vm_large_pages, &vm_large_pages_init, LK_INIT_LEVEL_VM);
+
+void vm_large_page_stats_dump() {
+    uint64_t committed = __atomic_load_n(&large_page_stats.committed, __ATOMIC_RELAXED);
+    uint64_t fallbacks = __atomic_load_n(&large_page_stats.commit_fallbacks, __ATOMIC_RELAXED);
+    uint64_t mapped = __atomic_load_n(&large_page_stats.mapped, __ATOMIC_RELAXED);
+    uint64_t demoted = __atomic_load_n(&large_page_stats.demoted, __ATOMIC_RELAXED);
+
+    printf("large pages (%zu KB): %s\n", VM_LARGE_PAGE_SIZE / 1024,
+           vm_large_pages_enabled ? "enabled" : "disabled");
+    printf("committed %" PRIu64 " runs (%" PRIu64 " MB), %" PRIu64 " commit fallbacks\n",
+           committed, committed * VM_LARGE_PAGE_SIZE / MB, fallbacks);
+    printf("mapped %" PRIu64 " runs, demoted %" PRIu64 " runs\n", mapped, demoted);
+}
+
+void vm_large_page_stats_reset() {
+    __atomic_store_n(&large_page_stats.committed, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&large_page_stats.commit_fallbacks, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&large_page_stats.mapped, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&large_page_stats.demoted, 0, __ATOMIC_RELAXED);
+}
+
+VmObjectPaged::VmObjectPaged(uint32_t options, uint32_t pmm_alloc_flags,
+                             mxtl::RefPtr<VmObject> parent)
+    : VmObject(mxtl::move(parent)), options_(options), pmm_alloc_flags_(pmm_alloc_flags) {
     LTRACEF("%p\n", this);
 }
 
@@ -55,13 +86,14 @@ VmObjectPaged::~VmObjectPaged() {
     page_list_.FreeAllPages();
 }
 
-mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t size) {
+mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t size,
+                                             uint32_t options) {
     // there's a max size to keep indexes within range
     if (size > MAX_SIZE)
         return nullptr;
 
     AllocChecker ac;
-    auto vmo = mxtl::AdoptRef<VmObject>(new (&ac) VmObjectPaged(pmm_alloc_flags, nullptr));
+    auto vmo = mxtl::AdoptRef<VmObject>(new (&ac) VmObjectPaged(options, pmm_alloc_flags, nullptr));
     if (!ac.check())
         return nullptr;
 
@@ -82,7 +114,7 @@ status_t VmObjectPaged::CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<Vm
     canary_.Assert();
 
     AllocChecker ac;
-    auto vmo = mxtl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(pmm_alloc_flags_, mxtl::WrapRefPtr(this)));
+    auto vmo = mxtl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(0, pmm_alloc_flags_, mxtl::WrapRefPtr(this)));
     if (!ac.check())
         return ERR_NO_MEMORY;
 
@@ -318,16 +350,13 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
         return NO_ERROR;
     }
 
-    // allocate a page
-    p = pmm_alloc_page(pmm_alloc_flags_, &pa);
+    // allocate a zeroed page, ideally straight out of the pmm's pre-zeroed pool
+    p = pmm_alloc_page(pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, &pa);
     if (!p)
         return ERR_NO_MEMORY;
 
     p->state = VM_PAGE_STATE_OBJECT;
 
-    // TODO: remove once pmm returns zeroed pages
-    ZeroPage(pa);
-
     status_t status = AddPageLocked(p, offset);
     DEBUG_ASSERT(status == NO_ERROR);
 
@@ -344,6 +373,117 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
     return NO_ERROR;
 }
 
+bool VmObjectPaged::IsLargeRunLocked(uint64_t offset, paddr_t* pa_out) {
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(IS_ALIGNED(offset, VM_LARGE_PAGE_SIZE));
+
+    vm_page_t* p = page_list_.GetPage(offset);
+    if (!p)
+        return false;
+
+    paddr_t base = vm_page_to_paddr(p);
+    if (!IS_ALIGNED(base, VM_LARGE_PAGE_SIZE))
+        return false;
+
+    for (uint64_t o = PAGE_SIZE; o < VM_LARGE_PAGE_SIZE; o += PAGE_SIZE) {
+        p = page_list_.GetPage(offset + o);
+        if (!p || vm_page_to_paddr(p) != base + o)
+            return false;
+    }
+
+    if (pa_out)
+        *pa_out = base;
+    return true;
+}
+
+status_t VmObjectPaged::GetLargePageLocked(uint64_t offset, paddr_t* pa) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    if (!IS_ALIGNED(offset, VM_LARGE_PAGE_SIZE))
+        return ERR_INVALID_ARGS;
+    if (!InRange(offset, VM_LARGE_PAGE_SIZE, size_))
+        return ERR_OUT_OF_RANGE;
+
+    return IsLargeRunLocked(offset, pa) ? NO_ERROR : ERR_NOT_FOUND;
+}
+
+uint64_t VmObjectPaged::CommitLargeRuns(uint64_t offset, uint64_t len) {
+    const size_t count = VM_LARGE_PAGE_SIZE / PAGE_SIZE;
+    uint64_t end;
+    uint32_t pmm_alloc_flags;
+    {
+        AutoLock a(&lock_);
+        uint64_t new_len;
+        if (!TrimRange(offset, len, size_, &new_len) || new_len == 0)
+            return 0;
+        end = ROUNDUP_PAGE_SIZE(offset + new_len);
+        pmm_alloc_flags = pmm_alloc_flags_;
+    }
+
+    uint64_t committed = 0;
+    for (uint64_t o = ROUNDUP(offset, VM_LARGE_PAGE_SIZE);
+         o < end && end - o >= VM_LARGE_PAGE_SIZE; o += VM_LARGE_PAGE_SIZE) {
+        // only take over chunks that have no pages at all
+        {
+            AutoLock a(&lock_);
+            if (page_list_.CountMissingPages(o, o + VM_LARGE_PAGE_SIZE) != count)
+                continue;
+        }
+
+        // don't go to any lengths to find a run; the caller falls back to
+        // single pages
+        list_node page_list;
+        list_initialize(&page_list);
+        size_t allocated = pmm_alloc_contiguous(count, pmm_alloc_flags | PMM_ALLOC_FLAG_NO_RECLAIM,
+                                                VM_LARGE_PAGE_SHIFT, nullptr, &page_list);
+        if (allocated < count) {
+            LTRACEF("no contiguous run for offset %#" PRIx64 "\n", o);
+            __atomic_fetch_add(&large_page_stats.commit_fallbacks, 1, __ATOMIC_RELAXED);
+            pmm_free(&page_list);
+            break;
+        }
+
+        // pmm_alloc_contiguous doesn't hand out zeroed pages
+        vm_page_t* p;
+        list_for_every_entry (&page_list, p, vm_page_t, free.node) {
+            ZeroPage(p);
+        }
+
+        {
+            AutoLock a(&lock_);
+
+            // the chunk may have been filled in, or cut off by a resize, while we
+            // weren't holding the lock
+            if (o + VM_LARGE_PAGE_SIZE <= size_ &&
+                page_list_.CountMissingPages(o, o + VM_LARGE_PAGE_SIZE) == count) {
+                // unmap all of the pages in this chunk on all the mapping regions
+                RangeChangeUpdateLocked(o, VM_LARGE_PAGE_SIZE);
+
+                for (uint64_t po = o; po < o + VM_LARGE_PAGE_SIZE; po += PAGE_SIZE) {
+                    p = list_remove_head_type(&page_list, vm_page_t, free.node);
+                    ASSERT(p);
+
+                    p->state = VM_PAGE_STATE_OBJECT;
+
+                    status_t status = page_list_.AddPage(p, po);
+                    DEBUG_ASSERT(status == NO_ERROR);
+                }
+                DEBUG_ASSERT(list_is_empty(&page_list));
+            }
+        }
+        if (!list_is_empty(&page_list)) {
+            pmm_free(&page_list);
+            continue;
+        }
+
+        committed += VM_LARGE_PAGE_SIZE;
+        __atomic_fetch_add(&large_page_stats.committed, 1, __ATOMIC_RELAXED);
+    }
+
+    return committed;
+}
+
 status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* committed) {
     canary_.Assert();
     LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
@@ -351,6 +491,13 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     if (committed)
         *committed = 0;
 
+    // if asked to, back whole aligned chunks of the range with large page runs where
+    // we can, so mappings of them get large pages; the single page pass below fills
+    // in the rest. objects created with options are never clones.
+    uint64_t large_committed = 0;
+    if ((options_ & kLargePages) && vm_large_pages_enabled)
+        large_committed = CommitLargeRuns(offset, len);
+
     AutoLock a(&lock_);
 
     // trim the size
@@ -366,12 +513,28 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     uint64_t end = ROUNDUP_PAGE_SIZE(offset + new_len);
     DEBUG_ASSERT(end > offset);
 
-    // make a pass through the list, counting the number of pages we need to allocate
-    size_t count = 0;
-    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
-        if (!page_list_.GetPage(o))
-            count++;
+    // a clone has to copy whatever its parent holds, so it can't take blank pages in
+    // bulk; fault each page in through the usual copy-on-write path instead
+    if (parent_) {
+        for (uint64_t o = ROUNDDOWN(offset, PAGE_SIZE); o < end; o += PAGE_SIZE) {
+            if (page_list_.GetPage(o))
+                continue;
+            status_t status = GetPageLocked(o, VMM_PF_FLAG_WRITE | VMM_PF_FLAG_SW_FAULT,
+                                            nullptr, nullptr);
+            if (status != NO_ERROR)
+                return status;
+            if (committed)
+                *committed += PAGE_SIZE;
+        }
+        return NO_ERROR;
     }
+
+    if (committed)
+        *committed = large_committed;
+
+    // make a pass through the list, counting the number of pages we need to allocate
+    uint64_t start = ROUNDDOWN(offset, PAGE_SIZE);
+    size_t count = page_list_.CountMissingPages(start, end);
     if (count == 0)
         return NO_ERROR;
 
@@ -379,41 +542,38 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     list_node page_list;
     list_initialize(&page_list);
 
-    size_t allocated = pmm_alloc_pages(count, pmm_alloc_flags_, &page_list);
+    size_t allocated = pmm_alloc_pages(count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, &page_list);
     if (allocated < count) {
         LTRACEF("failed to allocate enough pages (asked for %zu, got %zu)\n", count, allocated);
         pmm_free(&page_list);
         return ERR_NO_MEMORY;
     }
 
-    // unmap all of the pages in this range on all the mapping regions
-    RangeChangeUpdateLocked(offset, end - offset);
-
-    // add them to the appropriate range of the object
-    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
-        vm_page_t* p = page_list_.GetPage(o);
-        if (p)
-            continue;
-
-        p = list_remove_head_type(&page_list, vm_page_t, free.node);
-        ASSERT(p);
-
+    vm_page_t* p;
+    list_for_every_entry (&page_list, p, vm_page_t, free.node) {
         p->state = VM_PAGE_STATE_OBJECT;
+    }
 
-        // TODO: remove once pmm returns zeroed pages
-        ZeroPage(p);
-
-        status_t status = page_list_.AddPage(p, o);
-        DEBUG_ASSERT(status == NO_ERROR);
-
+    // unmap all of the pages in this range on all the mapping regions
+    RangeChangeUpdateLocked(start, end - start);
+
+    // add them to the appropriate range of the object, a page list node at a time
+    status_t status = page_list_.FillRange(start, end, &page_list);
+    if (status != NO_ERROR) {
+        // whatever made it in stays committed, hand back the rest
+        size_t leftover = list_length(&page_list);
+        LTRACEF("failed to insert %zu pages\n", leftover);
         if (committed)
-            *committed += PAGE_SIZE;
+            *committed = large_committed + (count - leftover) * PAGE_SIZE;
+        pmm_free(&page_list);
+        return status;
     }
 
     DEBUG_ASSERT(list_is_empty(&page_list));
 
     // for now we only support committing as much as we were asked for
-    DEBUG_ASSERT(!committed || *committed == count * PAGE_SIZE);
+    if (committed)
+        *committed = large_committed + count * PAGE_SIZE;
 
     return NO_ERROR;
 }
@@ -517,6 +677,17 @@ status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t* d
     LTRACEF("start offset %#" PRIx64 ", end %#" PRIx64 ", page_aliged_len %#" PRIx64 "\n", start, end,
             page_aligned_len);
 
+    // a large page run only partly covered by the range gets broken up; the arch
+    // layer splits any large page mapping of it when the range is unmapped below
+    uint64_t first_chunk = ROUNDDOWN(start, VM_LARGE_PAGE_SIZE);
+    uint64_t last_chunk = ROUNDDOWN(end - 1, VM_LARGE_PAGE_SIZE);
+    if (first_chunk != start && IsLargeRunLocked(first_chunk, nullptr))
+        __atomic_fetch_add(&large_page_stats.demoted, 1, __ATOMIC_RELAXED);
+    if (end - last_chunk != VM_LARGE_PAGE_SIZE &&
+        (last_chunk != first_chunk || first_chunk == start) &&
+        IsLargeRunLocked(last_chunk, nullptr))
+        __atomic_fetch_add(&large_page_stats.demoted, 1, __ATOMIC_RELAXED);
+
     // unmap all of the pages in this range on all the mapping regions
     RangeChangeUpdateLocked(start, page_aligned_len);
 
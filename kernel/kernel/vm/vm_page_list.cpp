@@ -9,6 +9,7 @@
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/vm.h>
+#include <mxtl/algorithm.h>
 #include <new.h>
 #include <trace.h>
 
@@ -139,6 +140,83 @@ status_t VmPageList::FreePage(uint64_t offset) {
     return NO_ERROR;
 }
 
+// Both of the range routines below walk the range a node at a time, so each
+// node of the tree is looked up once rather than once per page.
+size_t VmPageList::CountMissingPages(uint64_t start, uint64_t end) {
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(start) && IS_PAGE_ALIGNED(end));
+    const uint64_t node_size = PAGE_SIZE * VmPageListNode::kPageFanOut;
+
+    size_t count = 0;
+    for (uint64_t node_offset = ROUNDDOWN(start, node_size); node_offset < end;
+         node_offset += node_size) {
+        uint64_t first = mxtl::max(start, node_offset);
+        uint64_t last = mxtl::min(end, node_offset + node_size);
+        size_t pages = static_cast<size_t>((last - first) >> PAGE_SIZE_SHIFT);
+
+        auto pln = list_.find(node_offset);
+        if (!pln.IsValid()) {
+            count += pages;
+            continue;
+        }
+
+        size_t index = (first >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
+        for (size_t i = index; i < index + pages; i++) {
+            if (!pln->GetPage(i))
+                count++;
+        }
+    }
+
+    return count;
+}
+
+status_t VmPageList::FillRange(uint64_t start, uint64_t end, list_node* pages) {
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(start) && IS_PAGE_ALIGNED(end));
+    const uint64_t node_size = PAGE_SIZE * VmPageListNode::kPageFanOut;
+
+    LTRACEF("%p start %#" PRIx64 " end %#" PRIx64 "\n", this, start, end);
+
+    for (uint64_t node_offset = ROUNDDOWN(start, node_size); node_offset < end;
+         node_offset += node_size) {
+        if (list_is_empty(pages))
+            break;
+
+        uint64_t first = mxtl::max(start, node_offset);
+        uint64_t last = mxtl::min(end, node_offset + node_size);
+        size_t index = (first >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
+        size_t count = static_cast<size_t>((last - first) >> PAGE_SIZE_SHIFT);
+
+        VmPageListNode* node;
+        mxtl::unique_ptr<VmPageListNode> new_node;
+        auto pln = list_.find(node_offset);
+        if (pln.IsValid()) {
+            node = &*pln;
+        } else {
+            AllocChecker ac;
+            new_node.reset(new (&ac) VmPageListNode(node_offset));
+            if (!ac.check())
+                return ERR_NO_MEMORY;
+            node = new_node.get();
+        }
+
+        for (size_t i = index; i < index + count; i++) {
+            if (node->GetPage(i))
+                continue;
+            vm_page* p = list_remove_head_type(pages, vm_page, free.node);
+            if (!p)
+                break;
+            __UNUSED auto status = node->AddPage(p, i);
+            DEBUG_ASSERT(status == NO_ERROR);
+        }
+
+        if (new_node) {
+            DEBUG_ASSERT(!new_node->IsEmpty());
+            list_.insert(mxtl::move(new_node));
+        }
+    }
+
+    return NO_ERROR;
+}
+
 size_t VmPageList::FreeAllPages() {
     LTRACEF("%p\n", this);
 
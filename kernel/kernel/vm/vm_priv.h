@@ -26,6 +26,31 @@ extern uintptr_t boot_alloc_end;
 void vmm_init_preheap(void);
 void vmm_init(void);
 
+// page fault and fault-around statistics
+void vm_fault_stats_dump();
+void vm_fault_stats_reset();
+
+// Large pages: naturally aligned, physically contiguous runs of this size are
+// mapped by the arch mmu code with a single entry when the virtual address is
+// aligned the same way.
+#define VM_LARGE_PAGE_SHIFT 21
+#define VM_LARGE_PAGE_SIZE (1UL << VM_LARGE_PAGE_SHIFT)
+
+// set by vm.large_pages, whether CommitRange backs aligned chunks with large page runs
+extern bool vm_large_pages_enabled;
+
+// large page statistics, updated atomically and reported by vm_large_page_stats_dump()
+struct vm_large_page_stats {
+    uint64_t committed;        // runs allocated by CommitRange
+    uint64_t commit_fallbacks; // commits which could not find a contiguous run
+    uint64_t mapped;           // aligned runs handed to arch_mmu_map in one piece
+    uint64_t demoted;          // runs broken up by a partial decommit
+};
+extern vm_large_page_stats large_page_stats;
+
+void vm_large_page_stats_dump();
+void vm_large_page_stats_reset();
+
 // global vmm lock (for now)
 extern mutex_t vmm_lock;
 
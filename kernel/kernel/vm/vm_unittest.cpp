@@ -4,8 +4,12 @@
 // license that can be found in the LICENSE file or at
 // https://opensource.org/licenses/MIT
 
+#include "vm_priv.h"
+
 #include <assert.h>
 #include <err.h>
+#include <inttypes.h>
+#include <kernel/auto_lock.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_address_region.h>
 #include <kernel/vm/vm_aspace.h>
@@ -13,6 +17,7 @@
 #include <kernel/vm/vm_object_paged.h>
 #include <mxtl/array.h>
 #include <new.h>
+#include <platform.h>
 #include <unittest.h>
 
 static const uint kArchRwFlags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
@@ -70,6 +75,134 @@ static bool pmm_oversized_alloc_test(void* context) {
     END_TEST;
 }
 
+// Allocates and frees a bunch of single pages, one at a time, enough to run
+// through the per cpu page cache refill and drain paths.
+static bool pmm_single_page_churn_test(void* context) {
+    BEGIN_TEST;
+    list_node list = LIST_INITIAL_VALUE(list);
+
+    static const size_t alloc_count = 1024;
+
+    for (size_t i = 0; i < alloc_count; i++) {
+        paddr_t pa;
+        vm_page_t* page = pmm_alloc_page(0, &pa);
+        EXPECT_NEQ(nullptr, page, "pmm_alloc single page");
+        if (!page)
+            break;
+        EXPECT_FALSE(page_is_free(page), "allocated page is not free");
+        EXPECT_EQ(pa, vm_page_to_paddr(page), "vm_page_to_paddr on single page");
+        list_add_tail(&list, &page->free.node);
+    }
+    EXPECT_EQ(alloc_count, list_length(&list), "pmm_alloc_page list count");
+
+    size_t freed = 0;
+    vm_page_t* page;
+    while ((page = list_remove_head_type(&list, vm_page_t, free.node)) != nullptr) {
+        freed += pmm_free_page(page);
+    }
+    EXPECT_EQ(alloc_count, freed, "pmm_free_page on each page");
+    END_TEST;
+}
+
+// Dirties a batch of pages and frees them, then asks for zeroed pages both
+// one at a time and in bulk. Whether they come out of the pre-zeroed pool or
+// get zeroed inline, every byte must read back as zero.
+static bool pmm_zeroed_alloc_test(void* context) {
+    BEGIN_TEST;
+    list_node list = LIST_INITIAL_VALUE(list);
+
+    static const size_t alloc_count = 64;
+
+    size_t count = pmm_alloc_pages(alloc_count, 0, &list);
+    EXPECT_EQ(alloc_count, count, "pmm_alloc_pages dirty pages");
+    vm_page_t* page;
+    list_for_every_entry (&list, page, vm_page_t, free.node) {
+        memset(paddr_to_kvaddr(vm_page_to_paddr(page)), 0x99, PAGE_SIZE);
+    }
+    pmm_free(&list);
+
+    paddr_t pa;
+    page = pmm_alloc_page(PMM_ALLOC_FLAG_ZEROED, &pa);
+    EXPECT_NEQ(nullptr, page, "pmm_alloc_page zeroed");
+    if (page)
+        list_add_tail(&list, &page->free.node);
+
+    count = pmm_alloc_pages(alloc_count, PMM_ALLOC_FLAG_ZEROED, &list);
+    EXPECT_EQ(alloc_count, count, "pmm_alloc_pages zeroed");
+
+    bool zeroed = true;
+    list_for_every_entry (&list, page, vm_page_t, free.node) {
+        const uint8_t* ptr = static_cast<const uint8_t*>(paddr_to_kvaddr(vm_page_to_paddr(page)));
+        for (size_t i = 0; i < PAGE_SIZE; i++) {
+            if (ptr[i] != 0) {
+                zeroed = false;
+                break;
+            }
+        }
+    }
+    EXPECT_TRUE(zeroed, "zeroed pages read back as zero");
+
+    pmm_free(&list);
+    END_TEST;
+}
+
+// Times vm_page_t <-> paddr translation over a batch of pages, which will be
+// spread across however many arenas the pmm has. Both directions should cost
+// the same regardless of which arena the page came from.
+static bool pmm_page_translation_bench(void* context) {
+    BEGIN_TEST;
+    list_node list = LIST_INITIAL_VALUE(list);
+
+    static const size_t page_count = 1024;
+    static const size_t iterations = 64;
+
+    size_t count = pmm_alloc_pages(page_count, 0, &list);
+    EXPECT_EQ(page_count, count, "pmm_alloc_pages");
+
+    AllocChecker ac;
+    mxtl::Array<vm_page_t*> pages(new (&ac) vm_page_t*[count], count);
+    EXPECT_TRUE(ac.check(), "allocating page array");
+    mxtl::Array<paddr_t> addrs(new (&ac) paddr_t[count], count);
+    EXPECT_TRUE(ac.check(), "allocating address array");
+
+    size_t i = 0;
+    vm_page_t* p;
+    list_for_every_entry (&list, p, vm_page_t, free.node) {
+        pages[i] = p;
+        addrs[i] = vm_page_to_paddr(p);
+        EXPECT_EQ(p, paddr_to_vm_page(addrs[i]), "paddr_to_vm_page round trip");
+        i++;
+    }
+
+    // accumulate the results so the compiler can't throw the lookups away
+    uintptr_t sum = 0;
+
+    lk_time_t t = current_time();
+    for (size_t n = 0; n < iterations; n++) {
+        for (i = 0; i < count; i++) {
+            sum += vm_page_to_paddr(pages[i]);
+        }
+    }
+    lk_time_t to_paddr = current_time() - t;
+
+    t = current_time();
+    for (size_t n = 0; n < iterations; n++) {
+        for (i = 0; i < count; i++) {
+            sum += reinterpret_cast<uintptr_t>(paddr_to_vm_page(addrs[i]));
+        }
+    }
+    lk_time_t to_page = current_time() - t;
+
+    unittest_printf("%zu lookups: vm_page_to_paddr %" PRIu64 " ns/lookup, "
+                    "paddr_to_vm_page %" PRIu64 " ns/lookup (sum %#" PRIxPTR ")\n",
+                    count * iterations, to_paddr / (count * iterations),
+                    to_page / (count * iterations), sum);
+
+    auto ret = pmm_free(&list);
+    EXPECT_EQ(count, ret, "pmm_free on a list of pages");
+    END_TEST;
+}
+
 static uint32_t test_rand(uint32_t seed) {
     return (seed = seed * 1664525 + 1013904223);
 }
@@ -350,6 +483,35 @@ static bool vmo_odd_size_commit_test(void* context) {
     END_TEST;
 }
 
+// Creates a vm object, commits a few scattered pages, then commits a range
+// straddling several page list nodes around them.
+static bool vmo_partial_commit_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 64;
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size);
+    REQUIRE_NONNULL(vmo, "vmobject creation\n");
+
+    uint64_t committed;
+    static const uint64_t scattered[] = { 3, 15, 16, 40 };
+    for (uint64_t page : scattered) {
+        auto ret = vmo->CommitRange(page * PAGE_SIZE, PAGE_SIZE, &committed);
+        EXPECT_EQ(0, ret, "committing single page\n");
+        EXPECT_EQ(static_cast<uint64_t>(PAGE_SIZE), committed, "committing single page\n");
+    }
+
+    // pages [2, 50) minus the four already there
+    auto ret = vmo->CommitRange(PAGE_SIZE * 2, PAGE_SIZE * 48, &committed);
+    EXPECT_EQ(0, ret, "committing range\n");
+    EXPECT_EQ(static_cast<uint64_t>(PAGE_SIZE) * 44, committed, "committing range\n");
+    EXPECT_EQ(48u, vmo->AllocatedPages(), "allocated pages\n");
+
+    ret = vmo->CommitRange(0, alloc_size, &committed);
+    EXPECT_EQ(0, ret, "committing remainder\n");
+    EXPECT_EQ(static_cast<uint64_t>(PAGE_SIZE) * 16, committed, "committing remainder\n");
+    EXPECT_EQ(64u, vmo->AllocatedPages(), "allocated pages\n");
+    END_TEST;
+}
+
 // Creates a vm object, commits contiguous memory.
 static bool vmo_contiguous_commit_test(void* context) {
     BEGIN_TEST;
@@ -365,6 +527,55 @@ static bool vmo_contiguous_commit_test(void* context) {
     END_TEST;
 }
 
+// Commits a vm object made of whole large pages.  Where a chunk got backed by a
+// large page run, checks that the run is zeroed and that decommitting a single
+// page of it breaks it up.
+static bool vmo_large_page_commit_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = VM_LARGE_PAGE_SIZE * 2;
+    auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size, VmObjectPaged::kLargePages);
+    REQUIRE_NONNULL(vmo, "vmobject creation\n");
+
+    uint64_t committed;
+    auto ret = vmo->CommitRange(0, alloc_size, &committed);
+    EXPECT_EQ(NO_ERROR, ret, "committing vm object\n");
+    EXPECT_EQ(alloc_size, committed, "committing vm object\n");
+
+    paddr_t pa;
+    status_t status;
+    {
+        AutoLock a(vmo->lock());
+        status = vmo->GetLargePageLocked(0, &pa);
+    }
+
+    // physical memory may be too fragmented for a run, that's not an error
+    if (status != NO_ERROR) {
+        EXPECT_EQ(ERR_NOT_FOUND, status, "large page lookup\n");
+        END_TEST;
+    }
+
+    EXPECT_TRUE(IS_ALIGNED(pa, VM_LARGE_PAGE_SIZE), "large page alignment\n");
+    const uint8_t* bytes = static_cast<const uint8_t*>(paddr_to_kvaddr(pa));
+    for (size_t i = 0; i < VM_LARGE_PAGE_SIZE; i++) {
+        if (bytes[i] != 0) {
+            unittest_printf("non zero byte at offset %zu\n", i);
+            all_ok = false;
+            break;
+        }
+    }
+
+    uint64_t decommitted;
+    ret = vmo->DecommitRange(PAGE_SIZE, PAGE_SIZE, &decommitted);
+    EXPECT_EQ(NO_ERROR, ret, "decommitting a page\n");
+    EXPECT_EQ(static_cast<uint64_t>(PAGE_SIZE), decommitted, "decommitting a page\n");
+    {
+        AutoLock a(vmo->lock());
+        status = vmo->GetLargePageLocked(0, &pa);
+    }
+    EXPECT_EQ(ERR_NOT_FOUND, status, "run broken up by decommit\n");
+    END_TEST;
+}
+
 // Creats a vm object, maps it, precommitted.
 static bool vmo_precommitted_map_test(void* context) {
     BEGIN_TEST;
@@ -626,6 +837,9 @@ UNITTEST_START_TESTCASE(vm_tests)
 VM_UNITTEST(pmm_smoke_test)
 VM_UNITTEST(pmm_large_alloc_test)
 VM_UNITTEST(pmm_oversized_alloc_test)
+VM_UNITTEST(pmm_single_page_churn_test)
+VM_UNITTEST(pmm_zeroed_alloc_test)
+VM_UNITTEST(pmm_page_translation_bench)
 VM_UNITTEST(vmm_alloc_smoke_test)
 VM_UNITTEST(vmm_alloc_contiguous_smoke_test)
 VM_UNITTEST(multiple_regions_test)
@@ -638,7 +852,9 @@ VM_UNITTEST(vmaspace_alloc_smoke_test)
 VM_UNITTEST(vmo_create_test)
 VM_UNITTEST(vmo_commit_test)
 VM_UNITTEST(vmo_odd_size_commit_test)
+VM_UNITTEST(vmo_partial_commit_test)
 VM_UNITTEST(vmo_contiguous_commit_test)
+VM_UNITTEST(vmo_large_page_commit_test)
 VM_UNITTEST(vmo_precommitted_map_test)
 VM_UNITTEST(vmo_demand_paged_map_test)
 VM_UNITTEST(vmo_dropped_ref_test)
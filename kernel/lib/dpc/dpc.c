@@ -7,33 +7,96 @@
 
 #include <assert.h>
 #include <err.h>
+#include <inttypes.h>
 #include <list.h>
+#include <stdio.h>
+#include <string.h>
 #include <trace.h>
 
+#include <arch/ops.h>
 #include <kernel/event.h>
+#include <kernel/mp.h>
 #include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <lib/console.h>
 #include <lk/init.h>
+#include <platform.h>
+
+#define LOCAL_TRACE 0
+
+// Queue-to-run latency histogram: bucket 0 counts dpcs which ran within 1us of
+// being queued, bucket n those which took [2^(n-1), 2^n) us, and the last
+// bucket everything slower than that.
+#define DPC_LATENCY_BUCKETS 16
+
+struct dpc_stats {
+    uint64_t queued;
+    uint64_t ran;
+    lk_time_t max_latency;
+    uint64_t latency[DPC_LATENCY_BUCKETS];
+};
+
+// Each cpu has its own queue of dpcs and its own thread, pinned to that cpu,
+// to run them, so bottom halves run on the cpu that took the interrupt
+// instead of all funneling through one thread.
+struct dpc_cpu_state {
+    spin_lock_t lock;
+    struct list_node list;
+    event_t event;
+    thread_t *thread;
+
+    // queued is bumped under lock, everything else only by the dpc thread
+    struct dpc_stats stats;
+};
+
+static struct dpc_cpu_state dpc_state[SMP_MAX_CPUS];
+
+static uint dpc_latency_bucket(lk_time_t latency)
+{
+    lk_time_t usecs = latency / LK_USEC(1);
+    if (usecs == 0)
+        return 0;
 
-static spin_lock_t dpc_lock = SPIN_LOCK_INITIAL_VALUE;
-static struct list_node dpc_list = LIST_INITIAL_VALUE(dpc_list);
-static event_t dpc_event = EVENT_INITIAL_VALUE(dpc_event, false, 0);
+    uint bucket = 64 - __builtin_clzll(usecs);
+    return MIN(bucket, DPC_LATENCY_BUCKETS - 1);
+}
 
-status_t dpc_queue(dpc_t *dpc, bool reschedule)
+static void dpc_enqueue(dpc_t *dpc, uint cpu)
 {
-    DEBUG_ASSERT(dpc);
-    DEBUG_ASSERT(dpc->func);
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
 
-    if (list_in_list(&dpc->node))
-        return NO_ERROR;
+    // only queue to cpus which are running threads, anything else goes on the
+    // current cpu; interrupts are off, so we can't migrate away from it
+    if (cpu >= arch_max_num_cpus() || !mp_is_cpu_active(cpu))
+        cpu = arch_curr_cpu_num();
 
-    spin_lock_saved_state_t state;
-    spin_lock_irqsave(&dpc_lock, state);
+    struct dpc_cpu_state *s = &dpc_state[cpu];
+    spin_lock(&s->lock);
 
     // put the dpc at the tail of the list and signal the worker
-    list_add_tail(&dpc_list, &dpc->node);
-    event_signal(&dpc_event, false);
+    DEBUG_ASSERT(!list_in_list(&dpc->node));
+    dpc->queue_time = current_time();
+    list_add_tail(&s->list, &dpc->node);
+    s->stats.queued++;
+    event_signal(&s->event, false);
+
+    spin_unlock(&s->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
 
-    spin_unlock_irqrestore(&dpc_lock, state);
+status_t dpc_queue_cpu(dpc_t *dpc, uint cpu, bool reschedule)
+{
+    DEBUG_ASSERT(dpc);
+    DEBUG_ASSERT(dpc->func);
+
+    // claim the dpc before picking a queue for it, so that of several cpus
+    // racing to queue it only one does; the others find it already queued,
+    // whichever cpu it went to
+    int expected = 0;
+    if (__atomic_compare_exchange_n(&dpc->queued, &expected, 1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        dpc_enqueue(dpc, cpu);
 
     // reschedule here if asked to
     if (reschedule)
@@ -42,38 +105,128 @@ status_t dpc_queue(dpc_t *dpc, bool reschedule)
     return NO_ERROR;
 }
 
+status_t dpc_queue(dpc_t *dpc, bool reschedule)
+{
+    // dpc_queue_cpu pins down the current cpu with interrupts disabled
+    return dpc_queue_cpu(dpc, SMP_MAX_CPUS, reschedule);
+}
+
 static int dpc_thread(void *arg)
 {
+    struct dpc_cpu_state *s = arg;
+
     for (;;) {
         // wait for a dpc to fire
-        __UNUSED status_t err = event_wait(&dpc_event);
+        __UNUSED status_t err = event_wait(&s->event);
         DEBUG_ASSERT(err == NO_ERROR);
 
         spin_lock_saved_state_t state;
-        spin_lock_irqsave(&dpc_lock, state);
+        spin_lock_irqsave(&s->lock, state);
 
         // pop a dpc off the list
-        dpc_t *dpc = list_remove_head_type(&dpc_list, dpc_t, node);
+        dpc_t *dpc = list_remove_head_type(&s->list, dpc_t, node);
 
         // if the list is now empty, unsignal the event so we block until it is
         if (!dpc)
-            event_unsignal(&dpc_event);
+            event_unsignal(&s->event);
 
-        spin_unlock_irqrestore(&dpc_lock, state);
+        spin_unlock_irqrestore(&s->lock, state);
+
+        if (!dpc)
+            continue;
+
+        // from here on the dpc may be queued again, possibly to another cpu,
+        // so read what we need out of it first
+        lk_time_t queue_time = dpc->queue_time;
+        dpc_func_t func = dpc->func;
+        __atomic_store_n(&dpc->queued, 0, __ATOMIC_RELEASE);
+
+        lk_time_t latency = current_time() - queue_time;
+        s->stats.ran++;
+        s->stats.latency[dpc_latency_bucket(latency)]++;
+        if (latency > s->stats.max_latency)
+            s->stats.max_latency = latency;
 
         // call the dpc
-        if (dpc && dpc->func)
-            dpc->func(dpc);
+        if (func)
+            func(dpc);
     }
 
-
     return 0;
 }
 
+static void dpc_init_early(unsigned int level)
+{
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        struct dpc_cpu_state *s = &dpc_state[i];
+        s->lock = SPIN_LOCK_INITIAL_VALUE;
+        list_initialize(&s->list);
+        event_init(&s->event, false, 0);
+    }
+}
+
 static void dpc_init(unsigned int level)
 {
-    thread_t *t = thread_create("dpc", &dpc_thread, NULL, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
-    thread_detach_and_resume(t);
+    // start a thread for every cpu which may come up; the ones for secondary
+    // cpus sit in their cpu's run queue until it starts scheduling
+    for (uint i = 0; i < arch_max_num_cpus(); i++) {
+        char name[THREAD_NAME_LENGTH];
+        snprintf(name, sizeof(name), "dpc-%u", i);
+
+        struct dpc_cpu_state *s = &dpc_state[i];
+        s->thread = thread_create(name, &dpc_thread, s, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
+        thread_set_pinned_cpu(s->thread, i);
+        thread_detach_and_resume(s->thread);
+    }
 }
 
+LK_INIT_HOOK(dpc_early, dpc_init_early, LK_INIT_LEVEL_EARLIEST);
 LK_INIT_HOOK(dpc, dpc_init, LK_INIT_LEVEL_THREADING);
+
+static int cmd_dpc(int argc, const cmd_args *argv, uint32_t flags)
+{
+    bool reset = (argc >= 2 && !strcmp(argv[1].str, "reset"));
+
+    if (argc >= 2 && !reset) {
+        printf("usage:\n");
+        printf("%s         : dump per cpu dpc queue stats and latency histograms\n", argv[0].str);
+        printf("%s reset   : reset dpc stats\n", argv[0].str);
+        return ERR_INTERNAL;
+    }
+
+    for (uint i = 0; i < arch_max_num_cpus(); i++) {
+        struct dpc_cpu_state *s = &dpc_state[i];
+
+        if (reset) {
+            spin_lock_saved_state_t state;
+            spin_lock_irqsave(&s->lock, state);
+            memset(&s->stats, 0, sizeof(s->stats));
+            spin_unlock_irqrestore(&s->lock, state);
+            continue;
+        }
+
+        if (!mp_is_cpu_active(i))
+            continue;
+
+        struct dpc_stats stats = s->stats;
+        printf("cpu %u: queued %" PRIu64 " ran %" PRIu64 " max latency %" PRIu64 " us\n",
+               i, stats.queued, stats.ran, stats.max_latency / LK_USEC(1));
+
+        for (uint b = 0; b < DPC_LATENCY_BUCKETS; b++) {
+            if (stats.latency[b] == 0)
+                continue;
+            if (b == 0)
+                printf("\t      < 1 us: %" PRIu64 "\n", stats.latency[b]);
+            else if (b == DPC_LATENCY_BUCKETS - 1)
+                printf("\t>= %6u us: %" PRIu64 "\n", 1u << (b - 1), stats.latency[b]);
+            else
+                printf("\t< %7u us: %" PRIu64 "\n", 1u << b, stats.latency[b]);
+        }
+    }
+
+    return NO_ERROR;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("dpcstats", "per cpu dpc queue statistics", &cmd_dpc)
+STATIC_COMMAND_END(dpc);
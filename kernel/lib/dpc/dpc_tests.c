@@ -0,0 +1,119 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/dpc.h>
+
+#include <err.h>
+#include <stdio.h>
+
+#include <kernel/event.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <unittest.h>
+
+#define RACE_ITERATIONS 10000
+
+struct dpc_test_state {
+    event_t event;
+    uint ran_on;
+    uint ran;
+};
+
+static void record_cpu_dpc(dpc_t *dpc)
+{
+    struct dpc_test_state *state = dpc->arg;
+    state->ran_on = arch_curr_cpu_num();
+    event_signal(&state->event, false);
+}
+
+static bool queue_to_each_cpu(void *context)
+{
+    BEGIN_TEST;
+
+    for (uint cpu = 0; cpu < arch_max_num_cpus(); cpu++) {
+        if (!mp_is_cpu_active(cpu))
+            continue;
+
+        struct dpc_test_state state = {};
+        event_init(&state.event, false, EVENT_FLAG_AUTOUNSIGNAL);
+        dpc_t dpc = { .func = record_cpu_dpc, .arg = &state };
+
+        EXPECT_EQ(NO_ERROR, dpc_queue_cpu(&dpc, cpu, false), "");
+        EXPECT_EQ(NO_ERROR, event_wait(&state.event), "");
+        EXPECT_EQ(cpu, state.ran_on, "dpc should run on the cpu it was queued to");
+        event_destroy(&state.event);
+    }
+
+    END_TEST;
+}
+
+// The dpc and its state are shared by the racing threads, and may still be
+// looked at by a dpc thread after the test has seen the dpc finish.
+static struct dpc_test_state race_state;
+static dpc_t race_dpc;
+
+static void count_dpc(dpc_t *dpc)
+{
+    struct dpc_test_state *state = dpc->arg;
+    __atomic_fetch_add(&state->ran, 1, __ATOMIC_RELAXED);
+}
+
+// Repeatedly queue the shared dpc to the next cpu over, while the threads on
+// the other cpus do the same.
+static int race_thread(void *arg)
+{
+    uint cpu = (uint)(uintptr_t)arg;
+    uint target = (cpu + 1) % arch_max_num_cpus();
+
+    for (uint i = 0; i < RACE_ITERATIONS; i++)
+        dpc_queue_cpu(&race_dpc, target, false);
+
+    return 0;
+}
+
+static bool queue_from_many_cpus(void *context)
+{
+    BEGIN_TEST;
+
+    race_state.ran = 0;
+    race_dpc = (dpc_t){ .func = count_dpc, .arg = &race_state };
+
+    thread_t *threads[SMP_MAX_CPUS] = {};
+    uint thread_count = 0;
+    for (uint cpu = 0; cpu < arch_max_num_cpus(); cpu++) {
+        if (!mp_is_cpu_active(cpu))
+            continue;
+
+        char name[THREAD_NAME_LENGTH];
+        snprintf(name, sizeof(name), "dpc race %u", cpu);
+        thread_t *t = thread_create(name, race_thread, (void *)(uintptr_t)cpu,
+                                    DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+        REQUIRE_NONNULL(t, "");
+        thread_set_pinned_cpu(t, cpu);
+        thread_resume(t);
+        threads[thread_count++] = t;
+    }
+
+    for (uint i = 0; i < thread_count; i++)
+        EXPECT_EQ(NO_ERROR, thread_join(threads[i], NULL, INFINITE_TIME), "");
+
+    // the last queueing still has to drain
+    for (uint i = 0; i < 1000 && __atomic_load_n(&race_dpc.queued, __ATOMIC_ACQUIRE); i++)
+        thread_sleep_relative(LK_MSEC(1));
+    EXPECT_EQ(0, __atomic_load_n(&race_dpc.queued, __ATOMIC_ACQUIRE), "dpc never ran");
+    EXPECT_FALSE(list_in_list(&race_dpc.node), "dpc should be off every queue");
+
+    uint ran = __atomic_load_n(&race_state.ran, __ATOMIC_RELAXED);
+    EXPECT_LT(0u, ran, "dpc should have run");
+    EXPECT_LE(ran, thread_count * RACE_ITERATIONS, "dpc ran more often than it was queued");
+
+    END_TEST;
+}
+
+UNITTEST_START_TESTCASE(dpc_tests)
+UNITTEST("queue to each cpu", queue_to_each_cpu)
+UNITTEST("queue from many cpus", queue_from_many_cpus)
+UNITTEST_END_TESTCASE(dpc_tests, "dpc", "dpc tests", NULL, NULL);
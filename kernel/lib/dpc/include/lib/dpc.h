@@ -19,9 +19,23 @@ typedef struct dpc {
 
     dpc_func_t func;
     void *arg;
+
+    // time the dpc was last queued, for latency accounting
+    lk_time_t queue_time;
+
+    // nonzero from the time the dpc is queued until its dpc thread takes it
+    // off the queue to run it
+    int queued;
 } dpc_t;
 
+// Queue a dpc to run on the current cpu's dpc thread.
+//
+// Queuing a dpc that is already queued, on any cpu, is a no-op. The dpc may
+// be queued again once it has started running.
 status_t dpc_queue(dpc_t *dpc, bool reschedule);
 
-__END_CDECLS
+// Queue a dpc to run on the dpc thread of the given cpu. If that cpu is not
+// online, the dpc is queued on the current cpu instead.
+status_t dpc_queue_cpu(dpc_t *dpc, uint cpu, bool reschedule);
 
+__END_CDECLS
@@ -10,6 +10,10 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 MODULE := $(LOCAL_DIR)
 
 MODULE_SRCS += \
-	$(LOCAL_DIR)/dpc.c
+	$(LOCAL_DIR)/dpc.c \
+	$(LOCAL_DIR)/dpc_tests.c
+
+MODULE_DEPS += \
+	kernel/lib/unittest
 
 include make/module.mk
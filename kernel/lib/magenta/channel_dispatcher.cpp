@@ -14,6 +14,7 @@
 #include <trace.h>
 
 #include <kernel/event.h>
+#include <lib/objcache.h>
 #include <platform.h>
 
 #include <magenta/handle.h>
@@ -28,6 +29,8 @@
 
 constexpr mx_rights_t kDefaultChannelRights = MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_WRITE;
 
+static ObjectCache channel_cache("ChannelDispatcher", sizeof(ChannelDispatcher));
+
 // static
 status_t ChannelDispatcher::Create(uint32_t flags,
                                    mxtl::RefPtr<Dispatcher>* dispatcher0,
@@ -51,6 +54,16 @@ status_t ChannelDispatcher::Create(uint32_t flags,
     return NO_ERROR;
 }
 
+// static
+void* ChannelDispatcher::operator new(size_t size, AllocChecker* ac) noexcept {
+    return channel_cache.New(size, ac);
+}
+
+// static
+void ChannelDispatcher::operator delete(void* ptr) {
+    ObjectCache::Free(ptr);
+}
+
 ChannelDispatcher::ChannelDispatcher(uint32_t flags)
     : state_tracker_(MX_CHANNEL_WRITABLE) {
     DEBUG_ASSERT(flags == 0);
@@ -168,6 +181,53 @@ status_t ChannelDispatcher::Read(uint32_t* msg_size,
     return rv;
 }
 
+status_t ChannelDispatcher::ReadMany(const mx_channel_msg_t* limits, uint32_t count,
+                                     mxtl::unique_ptr<MessagePacket>* msgs,
+                                     uint32_t* actual_count,
+                                     uint32_t* msg_size, uint32_t* msg_handle_count) {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+
+    if (messages_.is_empty())
+        return other_ ? ERR_SHOULD_WAIT : ERR_PEER_CLOSED;
+
+    uint32_t n = 0;
+    while (n < count && !messages_.is_empty()) {
+        const MessagePacket& next = messages_.front();
+        if (next.data_size() > limits[n].num_bytes ||
+            next.num_handles() > limits[n].num_handles) {
+            if (n == 0) {
+                *msg_size = next.data_size();
+                *msg_handle_count = next.num_handles();
+                return ERR_BUFFER_TOO_SMALL;
+            }
+            break;
+        }
+        msgs[n++] = messages_.pop_front();
+    }
+
+    if (messages_.is_empty())
+        state_tracker_.UpdateState(MX_CHANNEL_READABLE, 0u);
+
+    *actual_count = n;
+    return NO_ERROR;
+}
+
+void ChannelDispatcher::UnreadMany(mxtl::unique_ptr<MessagePacket>* msgs, uint32_t count) {
+    canary_.Assert();
+
+    if (count == 0u)
+        return;
+
+    AutoLock lock(&lock_);
+
+    for (uint32_t ix = count; ix != 0u; --ix)
+        messages_.push_front(mxtl::move(msgs[ix - 1]));
+
+    state_tracker_.UpdateState(0u, MX_CHANNEL_READABLE);
+}
+
 status_t ChannelDispatcher::Write(mxtl::unique_ptr<MessagePacket> msg) {
     canary_.Assert();
 
@@ -189,6 +249,27 @@ status_t ChannelDispatcher::Write(mxtl::unique_ptr<MessagePacket> msg) {
     return NO_ERROR;
 }
 
+status_t ChannelDispatcher::WriteMany(mxtl::unique_ptr<MessagePacket>* msgs, uint32_t count) {
+    canary_.Assert();
+
+    mxtl::RefPtr<ChannelDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!other_) {
+            // As in Write(), the handles go back to the caller.
+            for (uint32_t ix = 0; ix != count; ++ix)
+                msgs[ix]->set_owns_handles(false);
+            return ERR_PEER_CLOSED;
+        }
+        other = other_;
+    }
+
+    if (other->WriteSelfMany(msgs, count) > 0)
+        thread_preempt(false);
+
+    return NO_ERROR;
+}
+
 status_t ChannelDispatcher::Call(mxtl::unique_ptr<MessagePacket> msg,
                                  mx_time_t deadline, bool* return_handles,
                                  mxtl::unique_ptr<MessagePacket>* reply) {
@@ -265,32 +346,50 @@ status_t ChannelDispatcher::ResumeInterruptedCall(mx_time_t deadline,
 }
 
 int ChannelDispatcher::WriteSelf(mxtl::unique_ptr<MessagePacket> msg) {
+    return WriteSelfMany(&msg, 1u);
+}
+
+int ChannelDispatcher::WriteSelfMany(mxtl::unique_ptr<MessagePacket>* msgs, uint32_t count) {
     canary_.Assert();
 
     AutoLock lock(&lock_);
-    auto size = msg->data_size();
-
-    if (!waiters_.is_empty()) {
-        // If the far side is waiting for replies to messages
-        // send via "call", see if this message has a matching
-        // txid to one of the waiters, and if so, deliver it.
-        mx_txid_t txid = msg->get_txid();
-        for (auto& waiter: waiters_) {
-            // (3C) Deliver message to waiter.
-            // Remove waiter from list.
-            if (waiter.get_txid() == txid) {
-                waiters_.erase(waiter);
-                // we return how many threads have been woken up, or zero.
-                return waiter.Deliver(mxtl::move(msg));
+    int woken = 0;
+    bool queued = false;
+
+    for (uint32_t ix = 0; ix != count; ++ix) {
+        mxtl::unique_ptr<MessagePacket> msg = mxtl::move(msgs[ix]);
+
+        if (!waiters_.is_empty()) {
+            // If the far side is waiting for replies to messages
+            // send via "call", see if this message has a matching
+            // txid to one of the waiters, and if so, deliver it.
+            mx_txid_t txid = msg->get_txid();
+            for (auto& waiter: waiters_) {
+                // (3C) Deliver message to waiter.
+                // Remove waiter from list.
+                if (waiter.get_txid() == txid) {
+                    waiters_.erase(waiter);
+                    // we return how many threads have been woken up, or zero.
+                    woken += waiter.Deliver(mxtl::move(msg));
+                    break;
+                }
             }
+            if (!msg)
+                continue;
         }
+
+        // The port client gets a packet per message, as it does when replaying
+        // the queue in set_port_client().
+        if (iopc_)
+            iopc_->Signal(MX_CHANNEL_READABLE, msg->data_size(), &lock_);
+        messages_.push_back(mxtl::move(msg));
+        queued = true;
     }
-    messages_.push_back(mxtl::move(msg));
 
-    state_tracker_.UpdateState(0u, MX_CHANNEL_READABLE);
-    if (iopc_)
-        iopc_->Signal(MX_CHANNEL_READABLE, size, &lock_);
-    return 0;
+    // Observers only care about the edge, so a batch raises READABLE once.
+    if (queued)
+        state_tracker_.UpdateState(0u, MX_CHANNEL_READABLE);
+    return woken;
 }
 
 status_t ChannelDispatcher::set_port_client(mxtl::unique_ptr<PortClient> client) {
@@ -27,7 +27,18 @@ FutexContext::~FutexContext() {
     DEBUG_ASSERT(futex_table_.is_empty());
 }
 
-status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_time_t deadline) {
+// Stop lending our priority to the futex owner, once we're off the futex's
+// queue and so out of reach of FutexWake's ownership transfer.
+static void FutexWaitPiDone(thread_t* pi_owner) {
+    if (!pi_owner)
+        return;
+    THREAD_LOCK(state);
+    thread_pi_set_owner(get_current_thread(), nullptr);
+    THREAD_UNLOCK(state);
+}
+
+status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_time_t deadline,
+                                 thread_t* pi_owner) {
     LTRACE_ENTRY;
 
     uintptr_t futex_key = reinterpret_cast<uintptr_t>(value_ptr.get());
@@ -55,15 +66,36 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
         return ERR_BAD_STATE;
     }
 
+    if (pi_owner) {
+        // Everyone waiting on the futex lends their priority to the same
+        // owner: the one recorded by the first of them, or the one we name
+        // if the futex has none yet.
+        auto iter = futex_table_.find(futex_key);
+        FutexNode* head = iter.IsValid() ? &*iter : nullptr;
+        thread_t* recorded_owner;
+        {
+            THREAD_LOCK(state);
+            recorded_owner = FutexNode::PiOwnerLocked(head);
+            THREAD_UNLOCK(state);
+        }
+        if (recorded_owner && recorded_owner != pi_owner) {
+            lock_.Release();
+            return ERR_INVALID_ARGS;
+        }
+        if (!recorded_owner)
+            FutexNode::SetPiOwner(head, pi_owner);
+    }
+
     UserThread* thread = UserThread::GetCurrent();
     node = thread->futex_node();
     node->set_hash_key(futex_key);
+    node->set_pi(pi_owner != nullptr);
     node->SetAsSingletonList();
 
     QueueNodesLocked(node);
 
     // Block current thread.  This releases lock_ and does not reacquire it.
-    result = node->BlockThread(&lock_, deadline);
+    result = node->BlockThread(&lock_, deadline, pi_owner);
     if (result == NO_ERROR) {
         // Fix/workaround for MG-624:
         // We must re-acquire the lock here to force this thread to wait until
@@ -72,11 +104,13 @@ status_t FutexContext::FutexWait(user_ptr<int> value_ptr, int current_value, mx_
         // WakeThreads() to scribble on memory.
         AutoLock lock(&lock_);
         DEBUG_ASSERT(!node->IsInQueue());
+        FutexWaitPiDone(pi_owner);
         // All the work necessary for removing us from the hash table was done by FutexWake()
         return NO_ERROR;
     }
 
     AutoLock lock(&lock_);
+    FutexWaitPiDone(pi_owner);
     // If we hit the deadline, we need to remove the thread's node from the
     // wait queue, since FutexWake() didn't do that.
     if (UnqueueNodeLocked(node)) {
@@ -131,6 +165,10 @@ status_t FutexContext::FutexWake(user_ptr<const int> value_ptr,
         if (node != nullptr) {
             DEBUG_ASSERT(node->GetKey() == futex_key);
             futex_table_.insert(node);
+
+            // Whoever we wake is expected to take the lock next, so the
+            // priority lent to the old owner follows it.
+            FutexNode::TransferPiOwner(node, wake_head);
         }
 
         // Traversing this list of threads must be done while holding the
@@ -188,6 +226,19 @@ status_t FutexContext::FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count,
             node = FutexNode::RemoveFromHead(node, requeue_count,
                                              wake_key, requeue_key);
 
+            // The owner of the wake_ptr futex doesn't hold the requeue_ptr
+            // one, so the requeued threads lend their priority to the
+            // requeue_ptr futex's owner instead, if it has one.
+            auto iter = futex_table_.find(requeue_key);
+            FutexNode* requeue_target = iter.IsValid() ? &*iter : nullptr;
+            thread_t* requeue_owner;
+            {
+                THREAD_LOCK(state);
+                requeue_owner = FutexNode::PiOwnerLocked(requeue_target);
+                THREAD_UNLOCK(state);
+            }
+            FutexNode::SetPiOwner(requeue_head, requeue_owner);
+
             // now requeue our nodes to requeue_ptr mutex
             DEBUG_ASSERT(requeue_head->GetKey() == requeue_key);
             QueueNodesLocked(requeue_head);
@@ -105,7 +105,8 @@ FutexNode* FutexNode::RemoveFromHead(FutexNode* list_head, uint32_t count,
 // This blocks the current thread.  This releases the given mutex (which
 // must be held when BlockThread() is called).  To reduce contention, it
 // does not reclaim the mutex on return.
-status_t FutexNode::BlockThread(Mutex* mutex, mx_time_t deadline) TA_NO_THREAD_SAFETY_ANALYSIS {
+status_t FutexNode::BlockThread(Mutex* mutex, mx_time_t deadline,
+                                thread_t* pi_owner) TA_NO_THREAD_SAFETY_ANALYSIS {
     THREAD_LOCK(state);
 
     // We specifically want reschedule=false here, otherwise the
@@ -117,6 +118,10 @@ status_t FutexNode::BlockThread(Mutex* mutex, mx_time_t deadline) TA_NO_THREAD_S
     // check+wait must be done atomically (with respect to THREAD_LOCK),
     // otherwise we could miss a thread termination.
     thread_t* current_thread = get_current_thread();
+    thread_ = current_thread;
+    if (pi_owner)
+        thread_pi_set_owner(current_thread, pi_owner);
+
     status_t result;
     current_thread->interruptable = true;
     result = wait_queue_block(&wait_queue_, deadline);
@@ -134,6 +139,8 @@ void FutexNode::WakeThreads(FutexNode* head) {
     do {
         FutexNode* next = node->queue_next_;
         THREAD_LOCK(state);
+        // The woken thread is no longer waiting on whoever owns the futex.
+        thread_pi_set_owner(node->thread_, nullptr);
         wait_queue_wake_one(&node->wait_queue_, true, NO_ERROR);
         THREAD_UNLOCK(state);
         node->MarkAsNotInQueue();
@@ -141,6 +148,41 @@ void FutexNode::WakeThreads(FutexNode* head) {
     } while (node != head);
 }
 
+// Threads which are lending their priority to the futex's owner lend it to
+// |owner|'s thread instead.
+void FutexNode::TransferPiOwner(FutexNode* head, FutexNode* owner) {
+    SetPiOwner(head, owner->thread_);
+}
+
+void FutexNode::SetPiOwner(FutexNode* head, thread_t* owner) {
+    if (!head)
+        return;
+    THREAD_LOCK(state);
+    FutexNode* node = head;
+    do {
+        // Only threads that named an owner are lending their priority.
+        if (node->pi_)
+            thread_pi_set_owner(node->thread_, owner);
+        node = node->queue_next_;
+    } while (node != head);
+    THREAD_UNLOCK(state);
+}
+
+thread_t* FutexNode::PiOwnerLocked(FutexNode* head) {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    if (!head)
+        return nullptr;
+    FutexNode* node = head;
+    do {
+        // The owner may have exited, which takes it out of every waiter.
+        if (node->pi_ && node->thread_->pi_owner)
+            return node->thread_->pi_owner;
+        node = node->queue_next_;
+    } while (node != head);
+    return nullptr;
+}
+
 // Set |node1| and |node2|'s list pointers so that |node1| is immediately
 // before |node2| in the linked list.
 void FutexNode::RelinkAsAdjacent(FutexNode* node1, FutexNode* node2) {
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <new.h>
 #include <stdint.h>
 
 #include <magenta/dispatcher.h>
@@ -27,6 +28,12 @@ public:
                            mxtl::RefPtr<Dispatcher>* dispatcher1, mx_rights_t* rights);
 
     ~ChannelDispatcher() final;
+
+    // Channels are created in pairs, often for a single transaction, so they
+    // come from a per-cpu object cache.
+    static void* operator new(size_t size, AllocChecker* ac) noexcept;
+    static void operator delete(void* ptr);
+
     mx_obj_type_t get_type() const final { return MX_OBJ_TYPE_CHANNEL; }
     StateTracker* get_state_tracker() final { return &state_tracker_; }
     mx_status_t add_observer(StateObserver* observer) final;
@@ -46,8 +53,26 @@ public:
                   mxtl::unique_ptr<MessagePacket>* msg,
                   bool may_disard);
 
+    // Read up to |count| messages from this endpoint's message queue, with one acquisition of
+    // the lock. Message i is only taken if it fits in the sizes given by |limits[i]|, and reading
+    // stops at the first which doesn't. On NO_ERROR the messages are returned in |msgs| and their
+    // number in |*actual_count|. If not even the first message fits, ERR_BUFFER_TOO_SMALL is
+    // returned with its size and handle count in |*msg_size| and |*msg_handle_count|.
+    status_t ReadMany(const mx_channel_msg_t* limits, uint32_t count,
+                      mxtl::unique_ptr<MessagePacket>* msgs, uint32_t* actual_count,
+                      uint32_t* msg_size, uint32_t* msg_handle_count);
+
+    // Put back the first |count| of |msgs|, as returned by ReadMany, at the front of this
+    // endpoint's message queue, in their original order.
+    void UnreadMany(mxtl::unique_ptr<MessagePacket>* msgs, uint32_t count);
+
     // Write to the opposing endpoint's message queue.
     status_t Write(mxtl::unique_ptr<MessagePacket> msg);
+
+    // Write |count| messages to the opposing endpoint's message queue, with one acquisition of
+    // its lock and one update of its READABLE signal. Either all of |msgs| are consumed, or on
+    // error none are and their handles are left for the caller to put back.
+    status_t WriteMany(mxtl::unique_ptr<MessagePacket>* msgs, uint32_t count);
     status_t Call(mxtl::unique_ptr<MessagePacket> msg,
                   mx_time_t deadline, bool* return_handles,
                   mxtl::unique_ptr<MessagePacket>* reply);
@@ -136,6 +161,7 @@ private:
     ChannelDispatcher(uint32_t flags);
     void Init(mxtl::RefPtr<ChannelDispatcher> other);
     int WriteSelf(mxtl::unique_ptr<MessagePacket> msg);
+    int WriteSelfMany(mxtl::unique_ptr<MessagePacket>* msgs, uint32_t count);
     status_t UserSignalSelf(uint32_t clear_mask, uint32_t set_mask);
     void OnPeerZeroHandles();
 
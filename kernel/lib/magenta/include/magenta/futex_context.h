@@ -33,7 +33,16 @@ public:
     // Otherwise it will block the current thread until the |deadline| passes,
     // or until the thread is woken by a FutexWake or FutexRequeue operation
     // on the same |value_ptr| futex.
-    status_t FutexWait(user_ptr<int> value_ptr, int current_value, mx_time_t deadline);
+    //
+    // If |pi_owner| is given, it is the thread holding the lock the futex
+    // implements. It runs at no less than the waiter's priority until the
+    // waiter is woken or gives up, and when a FutexWake releases some of
+    // the waiters the ones left behind lend their priority to the first
+    // thread woken instead, as it is the one expected to take the lock next.
+    // If the futex's other waiters already lend their priority to a
+    // different thread, FutexWait returns ERR_INVALID_ARGS.
+    status_t FutexWait(user_ptr<int> value_ptr, int current_value, mx_time_t deadline,
+                       thread_t* pi_owner = nullptr);
 
     // FutexWake will wake up to |count| number of threads blocked on the |value_ptr| futex.
     status_t FutexWake(user_ptr<const int> value_ptr, uint32_t count);
@@ -43,7 +52,9 @@ public:
     // Otherwise it will wake up to |wake_count| number of threads blocked on the |wake_ptr| futex.
     // If any other threads remain blocked on on the |wake_ptr| futex, up to |requeue_count|
     // of them will then be requeued to the tail of the list of threads
-    // blocked on the |requeue_ptr| futex.
+    // blocked on the |requeue_ptr| futex. Requeued threads which wait with
+    // priority inheritance lend their priority to the |requeue_ptr| futex's
+    // owner, if it has one, and stop lending it otherwise.
     status_t FutexRequeue(user_ptr<int> wake_ptr, uint32_t wake_count, int current_value,
                           user_ptr<int> requeue_ptr, uint32_t requeue_count);
 
@@ -39,15 +39,35 @@ public:
                                      uintptr_t new_hash_key);
 
     // This must be called with |mutex| held and returns without |mutex| held.
-    status_t BlockThread(Mutex* mutex, mx_time_t deadline) TA_REL(mutex);
+    // If |pi_owner| is non-null, the current thread lends it its priority
+    // while blocked.
+    status_t BlockThread(Mutex* mutex, mx_time_t deadline,
+                         thread_t* pi_owner = nullptr) TA_REL(mutex);
 
     // wakes the list of threads starting with node |head|
     static void WakeThreads(FutexNode* head);
 
+    // moves the priority lent by the threads in the list starting with
+    // |head| over to the thread of node |owner|
+    static void TransferPiOwner(FutexNode* head, FutexNode* owner);
+
+    // Makes the priority inheriting waiters in the list starting with
+    // |head| lend their priority to |owner|, or to nobody if it is null.
+    static void SetPiOwner(FutexNode* head, thread_t* owner);
+
+    // Returns the thread the priority inheriting waiters in the list
+    // starting with |head| lend their priority to, or null if there is
+    // none. Must be called with the thread lock held.
+    static thread_t* PiOwnerLocked(FutexNode* head);
+
     void set_hash_key(uintptr_t key) {
         hash_key_ = key;
     }
 
+    void set_pi(bool pi) {
+        pi_ = pi;
+    }
+
     // Trait implementation for mxtl::HashTable
     uintptr_t GetKey() const { return hash_key_; }
     static size_t GetHash(uintptr_t key) { return (key >> 3); }
@@ -69,6 +89,13 @@ private:
     // Used for waking the thread corresponding to the FutexNode.
     wait_queue_t wait_queue_;
 
+    // The thread blocked on this node, valid while it is in a queue.
+    thread_t* thread_ = nullptr;
+
+    // Whether the thread waits with priority inheritance, lending its
+    // priority to whoever owns the futex.
+    bool pi_ = false;
+
     // queue_prev_ and queue_next_ are used for maintaining a circular
     // doubly-linked list of threads that are waiting on one futex address.
     //  * When the list contains only this node, queue_prev_ and
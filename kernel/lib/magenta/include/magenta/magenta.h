@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 
+#include <kernel/spinlock.h>
 #include <magenta/handle.h>
 #include <magenta/types.h>
 
@@ -33,6 +34,27 @@ void DeleteHandle(Handle* handle);
 // Maps an integer obtained by Handle->base_value() back to a Handle.
 Handle* MapU32ToHandle(uint32_t value);
 
+// Brackets a lookup of a Handle which doesn't hold the owning process's
+// handle table lock. Handle slots are never unmapped, and DeleteHandle()
+// keeps a torn down Handle's Dispatcher alive until every read section which
+// might have seen the Handle has ended, so within one it is safe to take a
+// reference to a Handle's Dispatcher. The Handle may be torn down and its slot
+// reused at any point though, so it must be checked again afterwards.
+//
+// Interrupts are disabled for the duration, so keep it short.
+class HandleReadSection {
+public:
+    HandleReadSection();
+    ~HandleReadSection();
+
+    HandleReadSection(const HandleReadSection&) = delete;
+    HandleReadSection& operator=(const HandleReadSection&) = delete;
+
+private:
+    spin_lock_saved_state_t state_;
+    uint64_t* seq_;
+};
+
 // Set/get the system exception port.
 mx_status_t SetSystemExceptionPort(mxtl::RefPtr<ExceptionPort> eport);
 // Returns true if a port had been set.
@@ -48,6 +70,9 @@ bool magenta_rights_check(const Handle* handle, mx_rights_t desired);
 mx_status_t magenta_sleep(mx_time_t deadline);
 void magenta_check_deadline(const char* name, mx_time_t deadline);
 
+// Timer slack given to every user thread.
+lk_time_t magenta_user_timer_slack();
+
 // Determines if this handle is to a Resource object.
 // Used to provide access to privileged syscalls.
 // Later, Resource objects will be finer-grained.
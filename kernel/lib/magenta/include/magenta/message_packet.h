@@ -44,9 +44,7 @@ private:
     MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles);
     ~MessagePacket();
 
-    static void operator delete(void* ptr) {
-        free(ptr);
-    }
+    static void operator delete(void* ptr);
     friend class mxtl::unique_ptr<MessagePacket>;
 
     bool owns_handles_;
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <kernel/mutex.h>
+#include <new.h>
 
 #include <magenta/dispatcher.h>
 #include <magenta/semaphore.h>
@@ -87,6 +88,11 @@ struct PortPacket final : public mxtl::DoublyLinkedListable<PortPacket*> {
     PortPacket(const PortPacket&) = delete;
     void operator=(PortPacket) = delete;
 
+    // User packets are queued and dequeued at a high rate, so they come from
+    // a per-cpu object cache.
+    static void* operator new(size_t size, AllocChecker* ac) noexcept;
+    static void operator delete(void* ptr);
+
     uint32_t type() const { return packet.type; }
 };
 
@@ -99,6 +105,9 @@ public:
                  uint64_t key, mx_signals_t signals);
     ~PortObserver() = default;
 
+    static void* operator new(size_t size, AllocChecker* ac) noexcept;
+    static void operator delete(void* ptr);
+
 private:
     PortObserver(const PortObserver&) = delete;
     PortObserver& operator=(const PortObserver&) = delete;
@@ -249,6 +249,11 @@ private:
                                                 mxtl::RefPtr<Dispatcher>* dispatcher_out,
                                                 mx_rights_t* out_rights);
 
+    // Takes a reference to the dispatcher of handle |handle_value| and gets
+    // the handle's rights, without taking |handle_table_lock_|.
+    mx_status_t LookupHandle(mx_handle_t handle_value, mxtl::RefPtr<Dispatcher>* dispatcher,
+                             mx_rights_t* rights);
+
     // Thread lifecycle support
     friend class UserThread;
     status_t AddThread(UserThread* t, bool initial_thread);
@@ -280,6 +285,7 @@ private:
     mxtl::RefPtr<VmAspace> aspace_;
 
     // our list of handles
+    // Lookups by handle value don't need the lock, see LookupHandle().
     mutable Mutex handle_table_lock_; // protects |handles_|.
     mxtl::DoublyLinkedList<Handle*> handles_ TA_GUARDED(handle_table_lock_);
 
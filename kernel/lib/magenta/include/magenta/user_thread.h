@@ -97,6 +97,7 @@ public:
     ThreadDispatcher* dispatcher() { return dispatcher_; }
 
     FutexNode* futex_node() { return &futex_node_; }
+    thread_t* kernel_thread() { return &thread_; }
     StateTracker* state_tracker() { return &state_tracker_; }
     const char* name() const { return thread_.name; }
     status_t set_name(const char* name, size_t len);
@@ -9,9 +9,13 @@
 #include <pow2.h>
 #include <trace.h>
 
+#include <arch/ops.h>
+
 #include <kernel/auto_lock.h>
 #include <kernel/cmdline.h>
+#include <kernel/mp.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
 
 #include <lk/init.h>
 
@@ -47,8 +51,43 @@ constexpr size_t kHighHandleCount = (kMaxHandleCount * 7) / 8;
 // The handle arena and its mutex.
 static Mutex handle_mutex;
 static mxtl::Arena TA_GUARDED(handle_mutex) handle_arena;
+// Slots taken out of the arena, whether live handles or sitting free in
+// one of the per-cpu caches below.
 static size_t outstanding_handles TA_GUARDED(handle_mutex) = 0u;
 
+// The arena never gives memory back to its data pool, so every slot it has
+// ever handed out lies below this mark. Kept outside the arena so that
+// handle lookups can range check without taking |handle_mutex|.
+static uintptr_t handle_arena_top = 0u;
+
+// Per-cpu caches of free handle slots. Creating and destroying a handle
+// normally only touches the local cache; |handle_mutex| is taken to move a
+// batch of slots between a cache and the arena when the cache runs empty or
+// fills up. Free slots keep their stashed base_value (see TearDownHandle())
+// while cached, so the generation count carries over.
+constexpr size_t kHandleCacheSize = 64u;
+constexpr size_t kHandleCacheBatch = kHandleCacheSize / 2;
+
+struct HandleCache {
+    spin_lock_t lock;
+    size_t count;
+    void* slots[kHandleCacheSize];
+    // Stats.
+    uint64_t hits;
+    uint64_t refills;
+    uint64_t drains;
+};
+
+static HandleCache handle_caches[SMP_MAX_CPUS];
+
+// Per-cpu read section counters for lock-free handle lookups, odd while the
+// cpu is inside a HandleReadSection. Each is only written by its own cpu.
+struct HandleReaders {
+    uint64_t seq;
+} __CPU_ALIGN;
+
+static HandleReaders handle_readers[SMP_MAX_CPUS];
+
 // The system exception port.
 static mutex_t system_exception_mutex = MUTEX_INITIAL_VALUE(system_exception_mutex);
 static mxtl::RefPtr<ExceptionPort> system_exception_port TA_GUARDED(system_exception_mutex);
@@ -60,14 +99,21 @@ static mxtl::RefPtr<JobDispatcher> root_job;
 // TODO(teisenbe): Remove this and magenta_check_deadline by mid May 2017.  It's
 // just to help catch bugs during a migration.
 static bool fatal_small_deadlines = false;
+// How late user threads' sleeps and timed waits may be woken, so that their
+// timers can be coalesced.
+#define MAGENTA_DEFAULT_TIMER_SLACK LK_USEC(50)
+static lk_time_t user_timer_slack = MAGENTA_DEFAULT_TIMER_SLACK;
 // The singleton policy manager, for jobs and processes. This is
 // a magenta internal class (not a dispatcher-derived).
 static PolicyManager* policy_manager;
 
 void magenta_init(uint level) TA_NO_THREAD_SAFETY_ANALYSIS {
     handle_arena.Init("handles", sizeof(Handle), kMaxHandleCount);
+    for (auto& cache : handle_caches)
+        cache.lock = SPIN_LOCK_INITIAL_VALUE;
     root_job = JobDispatcher::CreateRootJob();
     fatal_small_deadlines = cmdline_get_bool("magenta.fatal_small_deadlines", false);
+    user_timer_slack = cmdline_get_uint32("magenta.timer_slack_ns", MAGENTA_DEFAULT_TIMER_SLACK);
     policy_manager = PolicyManager::Create();
 }
 
@@ -99,7 +145,9 @@ static_assert(((3 << 30) ^ kHandleGenerationMask ^ kHandleIndexMask) ==
 // Returns a new |base_value| based on the value stored in the free
 // |handle_arena| slot pointed to by |addr|. The new value will be different
 // from the last |base_value| used by this slot.
-static uint32_t GetNewHandleBaseValue(void* addr) TA_REQ(handle_mutex) {
+// The slot is owned by the caller, and the arena's start never changes after
+// magenta_init(), so this doesn't need |handle_mutex|.
+static uint32_t GetNewHandleBaseValue(void* addr) TA_NO_THREAD_SAFETY_ANALYSIS {
     // Get the index of this slot within handle_arena.
     auto va = reinterpret_cast<Handle*>(addr) -
               reinterpret_cast<Handle*>(handle_arena.start());
@@ -126,6 +174,11 @@ static uint32_t GetNewHandleBaseValue(void* addr) TA_REQ(handle_mutex) {
 void internal::TearDownHandle(Handle *handle) TA_EXCL(handle_mutex) {
     uint32_t base_value = handle->base_value();
 
+    // A lock-free lookup may have read the Dispatcher pointer out of this
+    // Handle and be about to take a reference to it, so hang on to one
+    // until it is done.
+    mxtl::RefPtr<Dispatcher> dispatcher = handle->dispatcher();
+
     // Calling the handle dtor can cause many things to happen, so it is
     // important to call it outside the lock.
     handle->~Handle();
@@ -139,6 +192,19 @@ void internal::TearDownHandle(Handle *handle) TA_EXCL(handle_mutex) {
     // it at the beginning of the free slot.
     *reinterpret_cast<uint32_t*>(handle) = base_value;
 
+    // Any read section which starts from here on sees the wiped slot, so
+    // only the ones already running can still be looking at |dispatcher|.
+    // They run with interrupts disabled and never block, so this won't
+    // wait long.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (uint i = 0; i < arch_max_num_cpus(); i++) {
+        uint64_t seq = __atomic_load_n(&handle_readers[i].seq, __ATOMIC_ACQUIRE);
+        if ((seq & 1) == 0)
+            continue;
+        while (__atomic_load_n(&handle_readers[i].seq, __ATOMIC_ACQUIRE) == seq)
+            arch_spinloop_pause();
+    }
+
     // Double-check that the process_id field is zero, ensuring that
     // no process can refer to this slot while it's free. This isn't
     // completely legal since |handle| points to unconstructed memory,
@@ -147,40 +213,144 @@ void internal::TearDownHandle(Handle *handle) TA_EXCL(handle_mutex) {
 }
 
 static void high_handle_count(size_t count) {
-    // TODO: Avoid calling this for every handle after kHighHandleCount;
+    // TODO: Avoid calling this for every batch after kHighHandleCount;
     // printfs are slow and |handle_mutex| is held by our caller.
     printf("WARNING: High handle count: %zu handles\n", count);
 }
 
-Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
-    AutoLock lock(&handle_mutex);
-    void* addr = handle_arena.Alloc();
-    if (addr == nullptr) {
-        const auto oh = outstanding_handles;
-        lock.release();
-        printf("WARNING: Could not allocate new handle (%zu outstanding)\n",
-               oh);
-        return nullptr;
+static HandleCache* LockHandleCache(spin_lock_saved_state_t* state) {
+    arch_interrupt_save(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    HandleCache* cache = &handle_caches[arch_curr_cpu_num()];
+    spin_lock(&cache->lock);
+    return cache;
+}
+
+static void UnlockHandleCache(HandleCache* cache, spin_lock_saved_state_t state) {
+    spin_unlock_restore(&cache->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+// Takes up to |count| slots from the arena. Returns the number taken.
+static size_t AllocArenaSlotsLocked(void** slots, size_t count) TA_REQ(handle_mutex) {
+    size_t n = 0;
+    for (; n < count; n++) {
+        void* addr = handle_arena.Alloc();
+        if (addr == nullptr)
+            break;
+        slots[n] = addr;
+        uintptr_t top = reinterpret_cast<uintptr_t>(addr) + sizeof(Handle);
+        if (top > handle_arena_top)
+            __atomic_store_n(&handle_arena_top, top, __ATOMIC_RELEASE);
     }
-    if (++outstanding_handles > kHighHandleCount)
+    outstanding_handles += n;
+    if (n > 0 && outstanding_handles > kHighHandleCount)
         high_handle_count(outstanding_handles);
+    return n;
+}
+
+static void FreeArenaSlotsLocked(void** slots, size_t count) TA_REQ(handle_mutex) {
+    for (size_t i = 0; i < count; i++)
+        handle_arena.Free(slots[i]);
+    outstanding_handles -= count;
+}
+
+// Returns every cached slot to the arena. Used when the arena runs dry,
+// since the free slots may all be sitting in other cpus' caches.
+static void DrainHandleCachesLocked() TA_REQ(handle_mutex) {
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        HandleCache* cache = &handle_caches[i];
+        void* slots[kHandleCacheSize];
+
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&cache->lock, state);
+        size_t count = cache->count;
+        memcpy(slots, cache->slots, count * sizeof(void*));
+        cache->count = 0;
+        spin_unlock_irqrestore(&cache->lock, state);
+
+        FreeArenaSlotsLocked(slots, count);
+    }
+}
+
+// Returns a free slot for a new Handle, or nullptr if there are none left.
+static void* AllocHandleSlot() {
+    spin_lock_saved_state_t state;
+    HandleCache* cache = LockHandleCache(&state);
+    if (likely(cache->count > 0)) {
+        void* addr = cache->slots[--cache->count];
+        cache->hits++;
+        UnlockHandleCache(cache, state);
+        return addr;
+    }
+    UnlockHandleCache(cache, state);
+
+    // Refill: grab a batch from the arena, keep one and cache the rest.
+    void* slots[kHandleCacheBatch];
+    size_t count;
+    {
+        AutoLock lock(&handle_mutex);
+        count = AllocArenaSlotsLocked(slots, kHandleCacheBatch);
+        if (count == 0) {
+            DrainHandleCachesLocked();
+            count = AllocArenaSlotsLocked(slots, 1);
+        }
+        if (count == 0) {
+            const auto oh = outstanding_handles;
+            lock.release();
+            printf("WARNING: Could not allocate new handle (%zu outstanding)\n", oh);
+            return nullptr;
+        }
+    }
+
+    // We may have moved cpus, or another thread may have refilled this
+    // cache in the meantime; give back whatever doesn't fit.
+    cache = LockHandleCache(&state);
+    size_t i = 1;
+    for (; i < count && cache->count < kHandleCacheSize; i++)
+        cache->slots[cache->count++] = slots[i];
+    cache->refills++;
+    UnlockHandleCache(cache, state);
+
+    if (i < count) {
+        AutoLock lock(&handle_mutex);
+        FreeArenaSlotsLocked(&slots[i], count - i);
+    }
+    return slots[0];
+}
+
+// Returns a torn down Handle's slot to the local cache, spilling half of the
+// cache back to the arena if it is full.
+static void FreeHandleSlot(void* addr) {
+    void* slots[kHandleCacheBatch];
+
+    spin_lock_saved_state_t state;
+    HandleCache* cache = LockHandleCache(&state);
+    if (likely(cache->count < kHandleCacheSize)) {
+        cache->slots[cache->count++] = addr;
+        UnlockHandleCache(cache, state);
+        return;
+    }
+    cache->count -= kHandleCacheBatch;
+    memcpy(slots, &cache->slots[cache->count], sizeof(slots));
+    cache->slots[cache->count++] = addr;
+    cache->drains++;
+    UnlockHandleCache(cache, state);
+
+    AutoLock lock(&handle_mutex);
+    FreeArenaSlotsLocked(slots, kHandleCacheBatch);
+}
+
+Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
+    void* addr = AllocHandleSlot();
+    if (addr == nullptr)
+        return nullptr;
     uint32_t base_value = GetNewHandleBaseValue(addr);
     return new (addr) Handle(mxtl::move(dispatcher), rights, base_value);
 }
 
 Handle* DupHandle(Handle* source, mx_rights_t rights) {
-    AutoLock lock(&handle_mutex);
-    void* addr = handle_arena.Alloc();
-    if (addr == nullptr) {
-        const auto oh = outstanding_handles;
-        lock.release();
-        printf(
-            "WARNING: Could not allocate duplicate handle (%zu outstanding)\n",
-            oh);
+    void* addr = AllocHandleSlot();
+    if (addr == nullptr)
         return nullptr;
-    }
-    if (++outstanding_handles > kHighHandleCount)
-        high_handle_count(outstanding_handles);
     uint32_t base_value = GetNewHandleBaseValue(addr);
     return new (addr) Handle(source, rights, base_value);
 }
@@ -211,14 +381,13 @@ void DeleteHandle(Handle* handle) {
     // base_value for reuse the next time this slot is allocated.
     internal::TearDownHandle(handle);
 
-    AutoLock lock(&handle_mutex);
-    --outstanding_handles;
-    handle_arena.Free(handle);
+    FreeHandleSlot(handle);
 }
 
-bool HandleInRange(void* addr) {
-    AutoLock lock(&handle_mutex);
-    return handle_arena.in_range(addr);
+bool HandleInRange(void* addr) TA_NO_THREAD_SAFETY_ANALYSIS {
+    uintptr_t a = reinterpret_cast<uintptr_t>(addr);
+    return a >= reinterpret_cast<uintptr_t>(handle_arena.start()) &&
+           a + sizeof(Handle) <= __atomic_load_n(&handle_arena_top, __ATOMIC_ACQUIRE);
 }
 
 Handle* MapU32ToHandle(uint32_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
@@ -230,9 +399,31 @@ Handle* MapU32ToHandle(uint32_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
     return handle->base_value() == value ? handle : nullptr;
 }
 
+HandleReadSection::HandleReadSection() {
+    arch_interrupt_save(&state_, SPIN_LOCK_FLAG_INTERRUPTS);
+    seq_ = &handle_readers[arch_curr_cpu_num()].seq;
+    __atomic_store_n(seq_, *seq_ + 1, __ATOMIC_RELAXED);
+    // Pairs with the fence in TearDownHandle(): either it sees this cpu in
+    // the read section and waits for it, or the lookup sees the wiped slot.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+HandleReadSection::~HandleReadSection() {
+    __atomic_store_n(seq_, *seq_ + 1, __ATOMIC_RELEASE);
+    arch_interrupt_restore(state_, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
 void internal::DumpHandleTableInfo() {
     AutoLock lock(&handle_mutex);
     handle_arena.Dump();
+    printf("%zu slots outstanding\n", outstanding_handles);
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (!mp_is_cpu_active(i))
+            continue;
+        const HandleCache* cache = &handle_caches[i];
+        printf("cpu %u cache: %zu free slots, %" PRIu64 " hits %" PRIu64 " refills %" PRIu64
+               " drains\n", i, cache->count, cache->hits, cache->refills, cache->drains);
+    }
 }
 
 mx_status_t SetSystemExceptionPort(mxtl::RefPtr<ExceptionPort> eport) {
@@ -308,6 +499,10 @@ void magenta_check_deadline(const char* name, mx_time_t deadline) {
     }
 }
 
+lk_time_t magenta_user_timer_slack() {
+    return user_timer_slack;
+}
+
 mx_status_t validate_resource_handle(mx_handle_t handle) {
     auto up = ProcessDispatcher::GetCurrent();
     mxtl::RefPtr<ResourceDispatcher> resource;
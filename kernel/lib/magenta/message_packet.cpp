@@ -7,6 +7,8 @@
 #include <err.h>
 #include <new.h>
 
+#include <lib/objcache.h>
+
 #include <magenta/handle_reaper.h>
 #include <magenta/magenta.h>
 #include <magenta/message_packet.h>
@@ -23,10 +25,11 @@ mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
         return ERR_OUT_OF_RANGE;
 
     // Allocate space for the MessagePacket object followed by num_handles
-    // Handle*s followed by data_size bytes.
-    char* ptr = static_cast<char*>(malloc(sizeof(MessagePacket) +
-                                          num_handles * sizeof(Handle*) +
-                                          data_size));
+    // Handle*s followed by data_size bytes. Messages come and go at a high
+    // rate, so they come from the per-cpu object caches instead of the heap.
+    char* ptr = static_cast<char*>(ObjectCache::AllocSized(sizeof(MessagePacket) +
+                                                           num_handles * sizeof(Handle*) +
+                                                           data_size));
     if (ptr == nullptr)
         return ERR_NO_MEMORY;
 
@@ -46,6 +49,11 @@ MessagePacket::~MessagePacket() {
     }
 }
 
+// static
+void MessagePacket::operator delete(void* ptr) {
+    ObjectCache::Free(ptr);
+}
+
 MessagePacket::MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles)
     : owns_handles_(false), data_size_(data_size), num_handles_(num_handles), handles_(handles) {
 }
@@ -17,14 +17,34 @@
 #include <magenta/syscalls/port.h>
 
 #include <kernel/auto_lock.h>
+#include <lib/objcache.h>
 
 constexpr mx_rights_t kDefaultIOPortRightsV2 =
     MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER | MX_RIGHT_READ | MX_RIGHT_WRITE;
 
+static ObjectCache port_packet_cache("PortPacket", sizeof(PortPacket));
+static ObjectCache port_observer_cache("PortObserver", sizeof(PortObserver));
+
 PortPacket::PortPacket() : packet{}, observer(nullptr) {
     // Note that packet is initialized to zeros.
 }
 
+void* PortPacket::operator new(size_t size, AllocChecker* ac) noexcept {
+    return port_packet_cache.New(size, ac);
+}
+
+void PortPacket::operator delete(void* ptr) {
+    ObjectCache::Free(ptr);
+}
+
+void* PortObserver::operator new(size_t size, AllocChecker* ac) noexcept {
+    return port_observer_cache.New(size, ac);
+}
+
+void PortObserver::operator delete(void* ptr) {
+    ObjectCache::Free(ptr);
+}
+
 PortObserver::PortObserver(uint32_t type, Handle* handle, mxtl::RefPtr<PortDispatcherV2> port,
                            uint64_t key, mx_signals_t signals)
     : type_(type),
@@ -429,25 +429,52 @@ void ProcessDispatcher::UndoRemoveHandleLocked(mx_handle_t handle_value) {
     AddHandleLocked(HandleOwner(handle));
 }
 
+mx_status_t ProcessDispatcher::LookupHandle(mx_handle_t handle_value,
+                                            mxtl::RefPtr<Dispatcher>* dispatcher,
+                                            mx_rights_t* rights) {
+    mxtl::RefPtr<Dispatcher> disp;
+    mx_rights_t handle_rights;
+    bool valid;
+    {
+        HandleReadSection section;
+        Handle* handle = map_value_to_handle(handle_value, handle_rand_);
+        if (!handle || handle->process_id() != get_koid())
+            return ERR_BAD_HANDLE;
+        disp = handle->dispatcher();
+        handle_rights = handle->rights();
+
+        // The handle may have been closed or moved to another process, and
+        // its slot reused, while the above was being read.
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        valid = map_value_to_handle(handle_value, handle_rand_) == handle &&
+                handle->process_id() == get_koid();
+    }
+    if (!valid || !disp)
+        return ERR_BAD_HANDLE;
+
+    *dispatcher = mxtl::move(disp);
+    *rights = handle_rights;
+    return NO_ERROR;
+}
+
 mx_koid_t ProcessDispatcher::GetKoidForHandle(mx_handle_t handle_value) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    if (LookupHandle(handle_value, &dispatcher, &rights) != NO_ERROR)
         return MX_KOID_INVALID;
-    return handle->dispatcher()->get_koid();
+    return dispatcher->get_koid();
 }
 
 mx_status_t ProcessDispatcher::GetDispatcherInternal(mx_handle_t handle_value,
                                                      mxtl::RefPtr<Dispatcher>* dispatcher,
                                                      mx_rights_t* rights) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
-        return ERR_BAD_HANDLE;
+    mx_rights_t handle_rights;
+    mx_status_t status = LookupHandle(handle_value, dispatcher, &handle_rights);
+    if (status != NO_ERROR)
+        return status;
 
-    *dispatcher = handle->dispatcher();
     if (rights)
-        *rights = handle->rights();
+        *rights = handle_rights;
     return NO_ERROR;
 }
 
@@ -455,17 +482,20 @@ mx_status_t ProcessDispatcher::GetDispatcherWithRightsInternal(mx_handle_t handl
                                                                mx_rights_t desired_rights,
                                                                mxtl::RefPtr<Dispatcher>* dispatcher_out,
                                                                mx_rights_t* out_rights) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
-        return ERR_BAD_HANDLE;
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    mx_status_t status = LookupHandle(handle_value, &dispatcher, &rights);
+    if (status != NO_ERROR)
+        return status;
 
-    if (!magenta_rights_check(handle, desired_rights))
+    if ((rights & desired_rights) != desired_rights) {
+        LTRACEF("rights check fail!! has 0x%x, needs 0x%x\n", rights, desired_rights);
         return ERR_ACCESS_DENIED;
+    }
 
-    *dispatcher_out = handle->dispatcher();
+    *dispatcher_out = mxtl::move(dispatcher);
     if (out_rights)
-        *out_rights = handle->rights();
+        *out_rights = rights;
     return NO_ERROR;
 }
 
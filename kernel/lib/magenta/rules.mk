@@ -53,6 +53,7 @@ MODULE_SRCS := \
 MODULE_DEPS := \
     kernel/lib/dpc \
     kernel/lib/mxtl \
+    kernel/lib/objcache \
     kernel/dev/interrupt \
     kernel/dev/udisplay \
 
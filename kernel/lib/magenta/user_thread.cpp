@@ -212,6 +212,9 @@ status_t UserThread::Initialize(const char* name, size_t len) {
     }
     DEBUG_ASSERT(lkthread == &thread_);
 
+    // user sleeps and waits don't need to be precise to the nanosecond
+    thread_.timer_slack = magenta_user_timer_slack();
+
     // bump the ref on this object that the LK thread state will now own until the lk thread has exited
     AddRef();
 
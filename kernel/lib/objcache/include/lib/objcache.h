@@ -0,0 +1,165 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <arch/defines.h>
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <list.h>
+#include <new.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// An ObjectCache hands out fixed size blocks of memory carved out of slabs of
+// pages, for kernel objects which are created and destroyed at a high rate.
+//
+// Each cpu keeps two "magazines" (small stacks of free objects) per cache, and
+// allocations and frees are normally satisfied by them with only the cpu's own
+// spinlock held. When both are empty (or full) they are traded for a full (or
+// empty) magazine from the cache's depot; only when the depot can't help does
+// an operation fall through to the slab layer and its mutex.
+//
+// Objects sitting in magazines and slabs with nothing allocated from them are
+// given back by Reclaim(). All caches are reclaimed when a slab can't be
+// allocated, and from the "objcache reclaim" shell command.
+//
+// Caches are meant to be globals: the constructor is constexpr, and a cache
+// registers itself for ReclaimAll() and the shell when it allocates its first
+// slab. Every object is preceded by a small header which records where it came
+// from, so Free() doesn't need to be told the cache.
+class ObjectCache {
+public:
+    constexpr ObjectCache(const char* name, size_t object_size)
+        : name_(name),
+          object_size_(object_size),
+          stride_(Stride(object_size)),
+          slab_size_(SlabSize(Stride(object_size))),
+          rounds_(Rounds(Stride(object_size))),
+          partial_slabs_(LIST_INITIAL_VALUE(partial_slabs_)),
+          empty_slabs_(LIST_INITIAL_VALUE(empty_slabs_)),
+          node_(LIST_INITIAL_VALUE(node_)) {}
+
+    // Returns nullptr if out of memory.
+    void* Alloc();
+
+    // For class specific operator new. Allocations of any other size than the
+    // cache's, like those for a derived class, are passed to AllocSized().
+    void* New(size_t size, AllocChecker* ac);
+
+    // Frees memory returned by any ObjectCache, or by AllocSized().
+    static void Free(void* ptr);
+
+    // Allocates from the smallest of a set of size class caches (the largest
+    // of which holds a maximum size channel message) which fits, or from the
+    // heap for anything bigger. Returns nullptr if out of memory.
+    static void* AllocSized(size_t size);
+
+    // Returns every cached free object to its slab, and frees the slabs
+    // which are no longer in use. Returns the number of bytes freed.
+    size_t Reclaim();
+    static size_t ReclaimAll();
+
+    // Prints (and optionally resets) the statistics of every cache.
+    static void DumpAll(bool reset);
+
+    const char* name() const { return name_; }
+    size_t object_size() const { return object_size_; }
+
+    // suppress default constructors
+    ObjectCache(const ObjectCache&) = delete;
+    ObjectCache(ObjectCache&&) = delete;
+    ObjectCache& operator=(const ObjectCache&) = delete;
+    ObjectCache& operator=(ObjectCache&&) = delete;
+
+private:
+    struct Header;
+    struct Magazine;
+    struct Slab;
+
+    enum class FreeResult {
+        kFreed,
+        kNoEmptyMagazine,   // the depot needs another empty magazine
+        kDepotFull,         // the depot already holds as many full magazines as it may
+    };
+
+    struct CpuCache {
+        spin_lock_t lock = SPIN_LOCK_INITIAL_VALUE;
+        Magazine* loaded = nullptr;
+        Magazine* previous = nullptr;
+        // Stats.
+        uint64_t allocs = 0;    // allocations from a magazine
+        uint64_t frees = 0;     // frees to a magazine
+        uint64_t misses = 0;    // allocations and frees which went to the slab layer
+    };
+
+    static constexpr size_t kHeaderSize = 16u;
+    static constexpr size_t kSlabHeaderSize = 64u;
+    static constexpr size_t kMinSlabObjects = 4u;
+    static constexpr size_t kMaxEmptySlabs = 2u;
+    static constexpr size_t kMaxRounds = 32u;
+    static constexpr size_t kMagazineBytes = 64u * 1024u;
+    static constexpr size_t kMaxFullMagazines = 8u;
+    static constexpr size_t kMaxEmptyMagazines = 8u;
+
+    static constexpr size_t Stride(size_t object_size) {
+        return kHeaderSize + ((object_size + kHeaderSize - 1) & ~(kHeaderSize - 1));
+    }
+    static constexpr size_t SlabSize(size_t stride) {
+        return ((kSlabHeaderSize + kMinSlabObjects * stride) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    }
+    // Fewer rounds for bigger objects, to bound what a magazine holds on to.
+    static constexpr size_t Rounds(size_t stride) {
+        return (kMagazineBytes / stride > kMaxRounds) ? kMaxRounds
+               : (kMagazineBytes / stride < 2u) ? 2u : kMagazineBytes / stride;
+    }
+
+    static Header* HeaderOf(void* obj);
+
+    CpuCache* LockCpu(spin_lock_saved_state_t* state);
+    void UnlockCpu(CpuCache* cpu, spin_lock_saved_state_t state);
+    void* AllocFromMagazinesLocked(CpuCache* cpu);
+    FreeResult FreeToMagazinesLocked(CpuCache* cpu, void* obj);
+    bool AddEmptyMagazine();
+
+    void* AllocFromSlab();
+    void* AllocFromSlabLocked() TA_REQ(lock_);
+    Slab* NewSlabLocked() TA_REQ(lock_);
+    void FreeToSlabLocked(void* obj) TA_REQ(lock_);
+    void FreeSlabLocked(Slab* slab) TA_REQ(lock_);
+    void FreeObject(void* obj);
+
+    void Register();
+    void Dump(bool reset);
+
+    const char* const name_;
+    const size_t object_size_;
+    const size_t stride_;       // Header plus object, rounded up to the header's alignment
+    const size_t slab_size_;    // A multiple of PAGE_SIZE
+    const size_t rounds_;       // Capacity of a magazine
+
+    CpuCache cpus_[SMP_MAX_CPUS] = {};
+
+    // The depot. Taken with a cpu's lock held.
+    spin_lock_t depot_lock_ = SPIN_LOCK_INITIAL_VALUE;
+    Magazine* full_magazines_ = nullptr;
+    Magazine* empty_magazines_ = nullptr;
+    size_t full_count_ = 0u;
+    size_t empty_count_ = 0u;
+
+    // The slab layer. Slabs with every object allocated are on neither list.
+    Mutex lock_;
+    list_node partial_slabs_ TA_GUARDED(lock_);
+    list_node empty_slabs_ TA_GUARDED(lock_);
+    size_t slab_count_ TA_GUARDED(lock_) = 0u;
+    size_t empty_slab_count_ TA_GUARDED(lock_) = 0u;
+    // Objects allocated from slabs, whether live or cached in a magazine.
+    size_t slab_objects_ TA_GUARDED(lock_) = 0u;
+
+    // On the list of all caches, once registered.
+    bool registered_ = false;
+    list_node node_;
+};
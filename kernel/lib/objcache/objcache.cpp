@@ -0,0 +1,558 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/objcache.h>
+
+#include <assert.h>
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <trace.h>
+
+#include <arch/ops.h>
+#include <kernel/auto_lock.h>
+#include <kernel/mp.h>
+#include <lib/console.h>
+#include <lib/page_alloc.h>
+
+#define LOCAL_TRACE 0
+
+namespace {
+
+constexpr uint64_t kObjectMagic = 0x6f626a6361636865ull;  // 'objcache'
+
+// Every cache which has allocated a slab, for ReclaimAll() and the shell.
+// Lock order: all_caches_lock, then a cache's lock_.
+Mutex all_caches_lock;
+list_node all_caches TA_GUARDED(all_caches_lock) = LIST_INITIAL_VALUE(all_caches);
+
+}  // namespace
+
+struct ObjectCache::Header {
+    Slab* slab;     // nullptr for objects which came from the heap
+    uint64_t magic;
+};
+
+struct ObjectCache::Magazine {
+    Magazine* next;
+    size_t count;
+    void* objects[kMaxRounds];
+};
+
+// Sits at the start of each slab, followed by its objects.
+struct ObjectCache::Slab {
+    list_node node;
+    ObjectCache* cache;
+    void* free_list;    // threaded through the free objects
+    size_t in_use;
+    size_t capacity;
+};
+
+// The size classes used by AllocSized(). Each is about 1.5x the one before;
+// the last one holds a channel message with the maximum amount of data and
+// the maximum number of handles.
+static ObjectCache size_caches[] = {
+    {"size-64", 64u},
+    {"size-96", 96u},
+    {"size-128", 128u},
+    {"size-192", 192u},
+    {"size-256", 256u},
+    {"size-384", 384u},
+    {"size-512", 512u},
+    {"size-768", 768u},
+    {"size-1k", 1024u},
+    {"size-1.5k", 1536u},
+    {"size-2k", 2048u},
+    {"size-3k", 3072u},
+    {"size-4k", 4096u},
+    {"size-6k", 6144u},
+    {"size-8k", 8192u},
+    {"size-12k", 12288u},
+    {"size-16k", 16384u},
+    {"size-24k", 24576u},
+    {"size-32k", 32768u},
+    {"size-48k", 49152u},
+    {"size-64k", 65536u},
+    {"size-80k", 81920u},
+};
+
+ObjectCache::CpuCache* ObjectCache::LockCpu(spin_lock_saved_state_t* state) {
+    arch_interrupt_save(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    CpuCache* cpu = &cpus_[arch_curr_cpu_num()];
+    spin_lock(&cpu->lock);
+    return cpu;
+}
+
+void ObjectCache::UnlockCpu(CpuCache* cpu, spin_lock_saved_state_t state) {
+    spin_unlock_restore(&cpu->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+// Pops an object off the cpu's loaded magazine. If it is empty, tries the
+// previous one, and then trades the previous one for a full magazine from the
+// depot.
+void* ObjectCache::AllocFromMagazinesLocked(CpuCache* cpu) {
+    if (likely(cpu->loaded && cpu->loaded->count > 0))
+        return cpu->loaded->objects[--cpu->loaded->count];
+
+    if (cpu->previous && cpu->previous->count > 0) {
+        Magazine* tmp = cpu->loaded;
+        cpu->loaded = cpu->previous;
+        cpu->previous = tmp;
+        return cpu->loaded->objects[--cpu->loaded->count];
+    }
+
+    spin_lock(&depot_lock_);
+    Magazine* full = full_magazines_;
+    if (full == nullptr) {
+        spin_unlock(&depot_lock_);
+        return nullptr;
+    }
+    full_magazines_ = full->next;
+    full_count_--;
+    if (cpu->previous) {
+        cpu->previous->next = empty_magazines_;
+        empty_magazines_ = cpu->previous;
+        empty_count_++;
+    }
+    spin_unlock(&depot_lock_);
+
+    cpu->previous = cpu->loaded;
+    cpu->loaded = full;
+    return cpu->loaded->objects[--cpu->loaded->count];
+}
+
+// The reverse of the above: pushes |obj| on to a magazine with room, trading
+// the previous (full) magazine for an empty one from the depot if need be.
+ObjectCache::FreeResult ObjectCache::FreeToMagazinesLocked(CpuCache* cpu, void* obj) {
+    if (likely(cpu->loaded && cpu->loaded->count < rounds_)) {
+        cpu->loaded->objects[cpu->loaded->count++] = obj;
+        return FreeResult::kFreed;
+    }
+
+    if (cpu->previous && cpu->previous->count < rounds_) {
+        Magazine* tmp = cpu->loaded;
+        cpu->loaded = cpu->previous;
+        cpu->previous = tmp;
+        cpu->loaded->objects[cpu->loaded->count++] = obj;
+        return FreeResult::kFreed;
+    }
+
+    spin_lock(&depot_lock_);
+    if (cpu->previous && full_count_ >= kMaxFullMagazines) {
+        spin_unlock(&depot_lock_);
+        return FreeResult::kDepotFull;
+    }
+    Magazine* empty = empty_magazines_;
+    if (empty == nullptr) {
+        spin_unlock(&depot_lock_);
+        return FreeResult::kNoEmptyMagazine;
+    }
+    empty_magazines_ = empty->next;
+    empty_count_--;
+    if (cpu->previous) {
+        cpu->previous->next = full_magazines_;
+        full_magazines_ = cpu->previous;
+        full_count_++;
+    }
+    spin_unlock(&depot_lock_);
+
+    cpu->previous = cpu->loaded;
+    cpu->loaded = empty;
+    cpu->loaded->objects[cpu->loaded->count++] = obj;
+    return FreeResult::kFreed;
+}
+
+// Gives the depot a new empty magazine, unless another cpu beat us to it or
+// the depot already holds its limit. Since magazines are only ever made here,
+// this bounds how many a cache can have. Returns false if none was added.
+bool ObjectCache::AddEmptyMagazine() {
+    Magazine* mag = static_cast<Magazine*>(malloc(sizeof(Magazine)));
+    if (mag == nullptr)
+        return false;
+    mag->count = 0;
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&depot_lock_, state);
+    bool added = (empty_magazines_ == nullptr && empty_count_ < kMaxEmptyMagazines);
+    if (added) {
+        mag->next = empty_magazines_;
+        empty_magazines_ = mag;
+        empty_count_++;
+    }
+    spin_unlock_irqrestore(&depot_lock_, state);
+
+    if (!added)
+        free(mag);
+    return added;
+}
+
+void* ObjectCache::Alloc() {
+    spin_lock_saved_state_t state;
+    CpuCache* cpu = LockCpu(&state);
+    void* obj = AllocFromMagazinesLocked(cpu);
+    if (likely(obj != nullptr)) {
+        cpu->allocs++;
+    } else {
+        cpu->misses++;
+    }
+    UnlockCpu(cpu, state);
+
+    if (likely(obj != nullptr))
+        return obj;
+    return AllocFromSlab();
+}
+
+void* ObjectCache::New(size_t size, AllocChecker* ac) {
+    void* obj = (size == object_size_) ? Alloc() : AllocSized(size);
+    ac->arm(size, obj != nullptr);
+    return obj;
+}
+
+void ObjectCache::FreeObject(void* obj) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        spin_lock_saved_state_t state;
+        CpuCache* cpu = LockCpu(&state);
+        FreeResult result = FreeToMagazinesLocked(cpu, obj);
+        if (likely(result == FreeResult::kFreed)) {
+            cpu->frees++;
+            UnlockCpu(cpu, state);
+            return;
+        }
+        // if the depot is out of empty magazines, make one and try again. if
+        // it is full up, another magazine wouldn't help
+        bool retry = (attempt == 0 && result == FreeResult::kNoEmptyMagazine);
+        if (!retry)
+            cpu->misses++;
+        UnlockCpu(cpu, state);
+
+        if (!retry)
+            break;
+        AddEmptyMagazine();
+    }
+
+    AutoLock lock(&lock_);
+    FreeToSlabLocked(obj);
+}
+
+void ObjectCache::Free(void* ptr) {
+    if (ptr == nullptr)
+        return;
+
+    Header* hdr = HeaderOf(ptr);
+    DEBUG_ASSERT_MSG(hdr->magic == kObjectMagic, "bad object %p (magic %#" PRIx64 ")\n",
+                     ptr, hdr->magic);
+    if (hdr->slab == nullptr) {
+        free(hdr);
+        return;
+    }
+    hdr->slab->cache->FreeObject(ptr);
+}
+
+void* ObjectCache::AllocSized(size_t size) {
+    for (auto& cache : size_caches) {
+        if (size <= cache.object_size_) {
+            void* obj = cache.Alloc();
+            if (obj != nullptr)
+                return obj;
+            break;
+        }
+    }
+
+    // too big for the size classes, or they are out of slabs; the heap may
+    // still manage
+    Header* hdr = static_cast<Header*>(malloc(sizeof(Header) + size));
+    if (hdr == nullptr)
+        return nullptr;
+    hdr->slab = nullptr;
+    hdr->magic = kObjectMagic;
+    return hdr + 1;
+}
+
+ObjectCache::Header* ObjectCache::HeaderOf(void* obj) {
+    static_assert(sizeof(Header) == kHeaderSize, "");
+    return static_cast<Header*>(obj) - 1;
+}
+
+void* ObjectCache::AllocFromSlab() {
+    if (unlikely(!__atomic_load_n(&registered_, __ATOMIC_ACQUIRE)))
+        Register();
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        {
+            AutoLock lock(&lock_);
+            void* obj = AllocFromSlabLocked();
+            if (obj != nullptr)
+                return obj;
+        }
+
+        // free slabs and pages may be hiding in the caches, put them back
+        // and retry
+        if (ReclaimAll() == 0)
+            break;
+    }
+
+    LTRACEF("%s: failed to allocate an object\n", name_);
+    return nullptr;
+}
+
+void* ObjectCache::AllocFromSlabLocked() {
+    Slab* slab = list_peek_head_type(&partial_slabs_, Slab, node);
+    if (slab == nullptr) {
+        slab = list_remove_head_type(&empty_slabs_, Slab, node);
+        if (slab != nullptr) {
+            empty_slab_count_--;
+        } else {
+            slab = NewSlabLocked();
+            if (slab == nullptr)
+                return nullptr;
+        }
+        list_add_head(&partial_slabs_, &slab->node);
+    }
+
+    void* obj = slab->free_list;
+    slab->free_list = *static_cast<void**>(obj);
+    if (++slab->in_use == slab->capacity)
+        list_delete(&slab->node);
+    slab_objects_++;
+    return obj;
+}
+
+ObjectCache::Slab* ObjectCache::NewSlabLocked() {
+    static_assert(sizeof(Slab) <= kSlabHeaderSize, "");
+
+    void* pages = page_alloc(slab_size_ / PAGE_SIZE);
+    if (pages == nullptr)
+        return nullptr;
+
+    Slab* slab = static_cast<Slab*>(pages);
+    list_clear_node(&slab->node);
+    slab->cache = this;
+    slab->free_list = nullptr;
+    slab->in_use = 0;
+    slab->capacity = (slab_size_ - kSlabHeaderSize) / stride_;
+
+    // thread the free list through the objects in address order
+    uintptr_t base = reinterpret_cast<uintptr_t>(pages) + kSlabHeaderSize;
+    for (size_t i = slab->capacity; i > 0; i--) {
+        Header* hdr = reinterpret_cast<Header*>(base + (i - 1) * stride_);
+        hdr->slab = slab;
+        hdr->magic = kObjectMagic;
+        void* obj = hdr + 1;
+        *static_cast<void**>(obj) = slab->free_list;
+        slab->free_list = obj;
+    }
+
+    slab_count_++;
+    LTRACEF("%s: new slab %p, %zu objects\n", name_, slab, slab->capacity);
+    return slab;
+}
+
+void ObjectCache::FreeToSlabLocked(void* obj) {
+    Slab* slab = HeaderOf(obj)->slab;
+    DEBUG_ASSERT(slab->cache == this);
+    DEBUG_ASSERT(slab->in_use > 0);
+
+    *static_cast<void**>(obj) = slab->free_list;
+    slab->free_list = obj;
+    if (slab->in_use-- == slab->capacity)
+        list_add_head(&partial_slabs_, &slab->node);
+    slab_objects_--;
+
+    if (slab->in_use == 0) {
+        // keep a couple of empty slabs around so a cache which hovers around
+        // a slab boundary doesn't go to the page allocator every time
+        list_delete(&slab->node);
+        if (empty_slab_count_ < kMaxEmptySlabs) {
+            list_add_head(&empty_slabs_, &slab->node);
+            empty_slab_count_++;
+        } else {
+            FreeSlabLocked(slab);
+        }
+    }
+}
+
+void ObjectCache::FreeSlabLocked(Slab* slab) {
+    LTRACEF("%s: freeing slab %p\n", name_, slab);
+    page_free(slab, slab_size_ / PAGE_SIZE);
+    slab_count_--;
+}
+
+size_t ObjectCache::Reclaim() {
+    // pull every magazine out of the cpus and the depot
+    Magazine* mags = nullptr;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        CpuCache* cpu = &cpus_[i];
+
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&cpu->lock, state);
+        Magazine* loaded = cpu->loaded;
+        Magazine* previous = cpu->previous;
+        cpu->loaded = nullptr;
+        cpu->previous = nullptr;
+        spin_unlock_irqrestore(&cpu->lock, state);
+
+        if (loaded) {
+            loaded->next = mags;
+            mags = loaded;
+        }
+        if (previous) {
+            previous->next = mags;
+            mags = previous;
+        }
+    }
+
+    Magazine* full;
+    Magazine* empty;
+    {
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&depot_lock_, state);
+        full = full_magazines_;
+        empty = empty_magazines_;
+        full_magazines_ = nullptr;
+        empty_magazines_ = nullptr;
+        full_count_ = 0;
+        empty_count_ = 0;
+        spin_unlock_irqrestore(&depot_lock_, state);
+    }
+    Magazine* lists[] = {full, empty};
+    for (Magazine* list : lists) {
+        while (list) {
+            Magazine* next = list->next;
+            list->next = mags;
+            mags = list;
+            list = next;
+        }
+    }
+
+    // and give their objects back to the slabs, freeing every slab which
+    // ends up empty
+    size_t freed = 0;
+    {
+        AutoLock lock(&lock_);
+        size_t slabs = slab_count_;
+        for (Magazine* mag = mags; mag; mag = mag->next) {
+            for (size_t i = 0; i < mag->count; i++)
+                FreeToSlabLocked(mag->objects[i]);
+        }
+
+        Slab* slab;
+        while ((slab = list_remove_head_type(&empty_slabs_, Slab, node)) != nullptr)
+            FreeSlabLocked(slab);
+        empty_slab_count_ = 0;
+        freed = (slabs - slab_count_) * slab_size_;
+    }
+
+    while (mags) {
+        Magazine* next = mags->next;
+        free(mags);
+        freed += sizeof(Magazine);
+        mags = next;
+    }
+    return freed;
+}
+
+size_t ObjectCache::ReclaimAll() {
+    size_t freed = 0;
+    AutoLock lock(&all_caches_lock);
+    ObjectCache* cache;
+    list_for_every_entry (&all_caches, cache, ObjectCache, node_) {
+        freed += cache->Reclaim();
+    }
+    return freed;
+}
+
+void ObjectCache::Register() {
+    AutoLock lock(&all_caches_lock);
+    if (registered_)
+        return;
+    list_add_tail(&all_caches, &node_);
+    __atomic_store_n(&registered_, true, __ATOMIC_RELEASE);
+}
+
+void ObjectCache::Dump(bool reset) {
+    uint64_t allocs = 0, frees = 0, misses = 0;
+    size_t cached = 0;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        CpuCache* cpu = &cpus_[i];
+
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&cpu->lock, state);
+        allocs += cpu->allocs;
+        frees += cpu->frees;
+        misses += cpu->misses;
+        if (cpu->loaded)
+            cached += cpu->loaded->count;
+        if (cpu->previous)
+            cached += cpu->previous->count;
+        if (reset)
+            cpu->allocs = cpu->frees = cpu->misses = 0;
+        spin_unlock_irqrestore(&cpu->lock, state);
+    }
+
+    size_t full_count, empty_count;
+    {
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&depot_lock_, state);
+        full_count = full_count_;
+        empty_count = empty_count_;
+        spin_unlock_irqrestore(&depot_lock_, state);
+    }
+    cached += full_count * rounds_;
+
+    size_t slabs, objects;
+    {
+        AutoLock lock(&lock_);
+        slabs = slab_count_;
+        objects = slab_objects_;
+    }
+
+    if (reset)
+        return;
+
+    printf("%-20s %6zu %5zu %7zu KB %7zu %7zu %4zu/%-4zu %10" PRIu64 " %10" PRIu64
+           " %8" PRIu64 "\n",
+           name_, object_size_, slabs, slabs * slab_size_ / 1024,
+           objects > cached ? objects - cached : 0u, cached, full_count, empty_count, allocs, frees, misses);
+}
+
+void ObjectCache::DumpAll(bool reset) {
+    AutoLock lock(&all_caches_lock);
+    if (!reset) {
+        printf("%-20s %6s %5s %10s %7s %7s %9s %10s %10s %8s\n",
+               "name", "size", "slabs", "memory", "in use", "cached", "full/empty",
+               "allocs", "frees", "misses");
+    }
+    ObjectCache* cache;
+    list_for_every_entry (&all_caches, cache, ObjectCache, node_) {
+        cache->Dump(reset);
+    }
+}
+
+static int cmd_objcache(int argc, const cmd_args* argv, uint32_t flags) {
+    if (argc < 2) {
+        ObjectCache::DumpAll(false);
+        return NO_ERROR;
+    }
+
+    if (!strcmp(argv[1].str, "reset")) {
+        ObjectCache::DumpAll(true);
+    } else if (!strcmp(argv[1].str, "reclaim")) {
+        printf("reclaimed %zu bytes\n", ObjectCache::ReclaimAll());
+    } else {
+        printf("usage:\n");
+        printf("%s           : dump object cache stats\n", argv[0].str);
+        printf("%s reset     : reset object cache stats\n", argv[0].str);
+        printf("%s reclaim   : free cached objects and empty slabs\n", argv[0].str);
+        return ERR_INTERNAL;
+    }
+    return NO_ERROR;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("objcache", "object cache statistics", &cmd_objcache)
+STATIC_COMMAND_END(objcache);
@@ -0,0 +1,129 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/objcache.h>
+
+#include <string.h>
+#include <unittest.h>
+
+struct TestObj {
+    uint64_t xx, yy, zz;
+};
+
+// Caches register themselves on a global list, so they have to outlive the
+// tests.
+static ObjectCache test_cache("objcache-test", sizeof(TestObj));
+static ObjectCache big_cache("objcache-test-big", 3 * PAGE_SIZE);
+
+static bool alloc_and_free(void* context) {
+    BEGIN_TEST;
+    void* a = test_cache.Alloc();
+    void* b = test_cache.Alloc();
+    REQUIRE_NONNULL(a, "");
+    REQUIRE_NONNULL(b, "");
+    EXPECT_NEQ(a, b, "");
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(a) % 16, "objects should be 16 byte aligned");
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(b) % 16, "objects should be 16 byte aligned");
+
+    // a free object goes to this cpu's magazine, and should come straight
+    // back out of it (unless we migrated in between)
+    ObjectCache::Free(b);
+    void* c = test_cache.Alloc();
+    REQUIRE_NONNULL(c, "");
+    ObjectCache::Free(c);
+    ObjectCache::Free(a);
+    END_TEST;
+}
+
+static bool many_objects(void* context) {
+    BEGIN_TEST;
+    static const size_t kCount = 1000;
+
+    AllocChecker ac;
+    TestObj** objs = new (&ac) TestObj*[kCount];
+    REQUIRE_TRUE(ac.check(), "");
+
+    // enough objects to need several slabs and to overflow the magazines
+    for (size_t i = 0; i < kCount; i++) {
+        objs[i] = static_cast<TestObj*>(test_cache.Alloc());
+        REQUIRE_NONNULL(objs[i], "");
+        *objs[i] = {i, i * 2, i * 3};
+    }
+    for (size_t i = 0; i < kCount; i++) {
+        EXPECT_EQ(i, objs[i]->xx, "");
+        EXPECT_EQ(i * 2, objs[i]->yy, "");
+        EXPECT_EQ(i * 3, objs[i]->zz, "");
+    }
+    for (size_t i = 0; i < kCount; i++)
+        ObjectCache::Free(objs[i]);
+
+    // everything is free now, so reclaiming has to give some slabs back
+    EXPECT_GT(test_cache.Reclaim(), 0u, "");
+
+    delete[] objs;
+    END_TEST;
+}
+
+static bool big_objects(void* context) {
+    BEGIN_TEST;
+    void* objs[8];
+    for (auto& obj : objs) {
+        obj = big_cache.Alloc();
+        REQUIRE_NONNULL(obj, "");
+        memset(obj, 0xa5, big_cache.object_size());
+    }
+    for (auto& obj : objs)
+        ObjectCache::Free(obj);
+    EXPECT_GT(big_cache.Reclaim(), 0u, "");
+    END_TEST;
+}
+
+static bool alloc_sized(void* context) {
+    BEGIN_TEST;
+    // from the smallest size class up to past the largest one, which falls
+    // back to the heap
+    for (size_t size = 1; size <= 256 * 1024; size *= 3) {
+        void* obj = ObjectCache::AllocSized(size);
+        REQUIRE_NONNULL(obj, "");
+        memset(obj, 0x5a, size);
+        ObjectCache::Free(obj);
+    }
+    END_TEST;
+}
+
+static bool new_other_size(void* context) {
+    BEGIN_TEST;
+    AllocChecker ac;
+    void* obj = test_cache.New(sizeof(TestObj), &ac);
+    EXPECT_TRUE(ac.check(), "");
+    REQUIRE_NONNULL(obj, "");
+    ObjectCache::Free(obj);
+
+    // a size other than the cache's, as for a derived class
+    obj = test_cache.New(sizeof(TestObj) * 4, &ac);
+    EXPECT_TRUE(ac.check(), "");
+    REQUIRE_NONNULL(obj, "");
+    memset(obj, 0, sizeof(TestObj) * 4);
+    ObjectCache::Free(obj);
+    END_TEST;
+}
+
+static bool free_null(void* context) {
+    BEGIN_TEST;
+    ObjectCache::Free(nullptr);
+    END_TEST;
+}
+
+#define OBJCACHE_UNITTEST(fname) UNITTEST(#fname, fname)
+
+UNITTEST_START_TESTCASE(objcache_tests)
+OBJCACHE_UNITTEST(alloc_and_free)
+OBJCACHE_UNITTEST(many_objects)
+OBJCACHE_UNITTEST(big_objects)
+OBJCACHE_UNITTEST(alloc_sized)
+OBJCACHE_UNITTEST(new_other_size)
+OBJCACHE_UNITTEST(free_null)
+UNITTEST_END_TESTCASE(objcache_tests, "objcachetests", "Object cache allocator test", nullptr, nullptr);
@@ -31,6 +31,7 @@
 
 constexpr size_t kChannelReadHandlesChunkCount = 16u;
 constexpr size_t kChannelWriteHandlesInlineCount = 8u;
+constexpr size_t kChannelBatchInlineCount = 8u;
 
 mx_status_t sys_channel_create(
     uint32_t options, user_ptr<mx_handle_t> _out0, user_ptr<mx_handle_t> _out1) {
@@ -73,10 +74,11 @@ mx_status_t sys_channel_create(
     return NO_ERROR;
 }
 
-void msg_get_handles(ProcessDispatcher* up, MessagePacket* msg,
-                     user_ptr<mx_handle_t> _handles, uint32_t num_handles) {
+// Copies out the values the handles of |msg| will have in |up|, without
+// installing them yet.
+static mx_status_t msg_copy_handle_values(ProcessDispatcher* up, const MessagePacket* msg,
+                                          user_ptr<mx_handle_t> _handles, uint32_t num_handles) {
     Handle* const* handle_list = msg->handles();
-    msg->set_owns_handles(false);
 
     // Copy the handle values out in chunks.
     mx_handle_t hvs[kChannelReadHandlesChunkCount];
@@ -87,10 +89,19 @@ void msg_get_handles(ProcessDispatcher* up, MessagePacket* msg,
                                            kChannelReadHandlesChunkCount);
         for (size_t i = 0; i < this_chunk_size; i++)
             hvs[i] = up->MapHandleToValue(handle_list[num_copied + i]);
-        _handles.element_offset(num_copied).copy_array_to_user(hvs, this_chunk_size);
+        if (_handles.element_offset(num_copied).copy_array_to_user(hvs, this_chunk_size) != NO_ERROR)
+            return ERR_INVALID_ARGS;
         num_copied += this_chunk_size;
     } while (num_copied < num_handles);
 
+    return NO_ERROR;
+}
+
+// Moves the handles of |msg| into the handle table of |up|.
+static void msg_install_handles(ProcessDispatcher* up, MessagePacket* msg, uint32_t num_handles) {
+    Handle* const* handle_list = msg->handles();
+    msg->set_owns_handles(false);
+
     for (size_t idx = 0u; idx < num_handles; ++idx) {
         if (handle_list[idx]->dispatcher()->get_state_tracker())
             handle_list[idx]->dispatcher()->get_state_tracker()->Cancel(handle_list[idx]);
@@ -99,6 +110,12 @@ void msg_get_handles(ProcessDispatcher* up, MessagePacket* msg,
     }
 }
 
+void msg_get_handles(ProcessDispatcher* up, MessagePacket* msg,
+                     user_ptr<mx_handle_t> _handles, uint32_t num_handles) {
+    msg_copy_handle_values(up, msg, _handles, num_handles);
+    msg_install_handles(up, msg, num_handles);
+}
+
 mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t options,
                              user_ptr<void> _bytes, user_ptr<mx_handle_t> _handles,
                              uint32_t num_bytes, uint32_t num_handles,
@@ -198,6 +215,90 @@ static mx_status_t msg_put_handles(ProcessDispatcher* up, MessagePacket* msg, mx
     return NO_ERROR;
 }
 
+mx_status_t sys_channel_read_many(mx_handle_t handle_value, uint32_t options,
+                                  user_ptr<mx_channel_msg_t> _msgs, uint32_t count,
+                                  user_ptr<uint32_t> _actual_count) {
+    LTRACEF("handle %d msgs %p count %u options 0x%x\n",
+            handle_value, _msgs.get(), count, options);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+    if (count == 0u)
+        return ERR_INVALID_ARGS;
+    count = mxtl::min(count, MX_CHANNEL_MAX_BATCH_MSGS);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcherWithRights(handle_value, MX_RIGHT_READ, &channel);
+    if (result != NO_ERROR)
+        return result;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_channel_msg_t, kChannelBatchInlineCount> descs(&ac, count);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    mxtl::InlineArray<mxtl::unique_ptr<MessagePacket>, kChannelBatchInlineCount> msgs(&ac, count);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    if (_msgs.copy_array_from_user(descs.get(), count) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    uint32_t actual_count = 0u;
+    uint32_t num_bytes = 0u;
+    uint32_t num_handles = 0u;
+    result = channel->ReadMany(descs.get(), count, msgs.get(), &actual_count,
+                               &num_bytes, &num_handles);
+    if (result == ERR_BUFFER_TOO_SMALL) {
+        // As with channel_read, report the size of the message which didn't
+        // fit. It stays in the channel.
+        descs[0].num_bytes = num_bytes;
+        descs[0].num_handles = num_handles;
+        if (_msgs.copy_array_to_user(descs.get(), 1u) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        return result;
+    }
+    if (result != NO_ERROR)
+        return result;
+
+    // Everything is copied out before any handle is installed, so that a bad
+    // buffer leaves the process untouched and the messages in the channel.
+    result = NO_ERROR;
+    for (uint32_t ix = 0; ix != actual_count && result == NO_ERROR; ++ix) {
+        MessagePacket* msg = msgs[ix].get();
+        descs[ix].num_bytes = msg->data_size();
+        descs[ix].num_handles = msg->num_handles();
+
+        if (descs[ix].num_bytes > 0u &&
+            make_user_ptr(descs[ix].bytes).copy_array_to_user(msg->data(), descs[ix].num_bytes) !=
+                NO_ERROR)
+            result = ERR_INVALID_ARGS;
+        else if (descs[ix].num_handles > 0u &&
+                 msg_copy_handle_values(up, msg, make_user_ptr(descs[ix].handles),
+                                        descs[ix].num_handles) != NO_ERROR)
+            result = ERR_INVALID_ARGS;
+    }
+    if (result == NO_ERROR && _msgs.copy_array_to_user(descs.get(), actual_count) != NO_ERROR)
+        result = ERR_INVALID_ARGS;
+    if (result == NO_ERROR && _actual_count.copy_to_user(actual_count) != NO_ERROR)
+        result = ERR_INVALID_ARGS;
+    if (result != NO_ERROR) {
+        channel->UnreadMany(msgs.get(), actual_count);
+        return result;
+    }
+
+    for (uint32_t ix = 0; ix != actual_count; ++ix) {
+        MessagePacket* msg = msgs[ix].get();
+        if (descs[ix].num_handles > 0u)
+            msg_install_handles(up, msg, descs[ix].num_handles);
+
+        ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(), descs[ix].num_bytes,
+               descs[ix].num_handles, 0);
+    }
+    return NO_ERROR;
+}
+
 mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t options,
                               user_ptr<const void> _bytes, uint32_t num_bytes,
                               user_ptr<const mx_handle_t> _handles, uint32_t num_handles) {
@@ -368,3 +469,93 @@ read_failed:
         read_status.copy_to_user(result);
     return ERR_CALL_FAILED;
 }
+
+mx_status_t sys_channel_write_many(mx_handle_t handle_value, uint32_t options,
+                                   user_ptr<const mx_channel_msg_t> _msgs, uint32_t count) {
+    LTRACEF("handle %d msgs %p count %u options 0x%x\n",
+            handle_value, _msgs.get(), count, options);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+    if (count == 0u)
+        return ERR_INVALID_ARGS;
+    if (count > MX_CHANNEL_MAX_BATCH_MSGS)
+        return ERR_OUT_OF_RANGE;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcherWithRights(handle_value, MX_RIGHT_WRITE, &channel);
+    if (result != NO_ERROR)
+        return result;
+
+    AllocChecker ac;
+    mxtl::InlineArray<mx_channel_msg_t, kChannelBatchInlineCount> descs(&ac, count);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+    mxtl::InlineArray<mxtl::unique_ptr<MessagePacket>, kChannelBatchInlineCount> msgs(&ac, count);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    if (_msgs.copy_array_from_user(descs.get(), count) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    // Create every packet first, which checks the sizes before we go on to
+    // allocate space for the batch's handle values.
+    size_t total_handles = 0u;
+    for (uint32_t ix = 0; ix != count; ++ix) {
+        const mx_channel_msg_t& desc = descs[ix];
+
+        result = MessagePacket::Create(desc.num_bytes, desc.num_handles, &msgs[ix]);
+        if (result != NO_ERROR)
+            return result;
+
+        if (desc.num_bytes > 0u) {
+            auto _bytes = make_user_ptr(static_cast<const void*>(desc.bytes));
+            if (_bytes.copy_array_from_user(msgs[ix]->mutable_data(), desc.num_bytes) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+        }
+        total_handles += desc.num_handles;
+    }
+
+    // The handle values of the whole batch are kept, so that if a later
+    // message's handles or the write fail, the earlier ones can be put back.
+    mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(&ac, total_handles);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    size_t taken_handles = 0u;
+    for (uint32_t ix = 0; ix != count; ++ix) {
+        const mx_channel_msg_t& desc = descs[ix];
+        if (desc.num_handles == 0u)
+            continue;
+
+        auto _handles = make_user_ptr(static_cast<const mx_handle_t*>(desc.handles));
+        result = msg_put_handles(up, msgs[ix].get(), handles.get() + taken_handles,
+                                 _handles, desc.num_handles,
+                                 static_cast<Dispatcher*>(channel.get()));
+        if (result != NO_ERROR)
+            break;
+        taken_handles += desc.num_handles;
+    }
+
+    if (result == NO_ERROR)
+        result = channel->WriteMany(msgs.get(), count);
+
+    if (result != NO_ERROR) {
+        // Put back the handles of every message which got them into this process.
+        for (uint32_t ix = 0; ix != count; ++ix)
+            msgs[ix]->set_owns_handles(false);
+        AutoLock lock(up->handle_table_lock());
+        for (size_t ix = 0; ix != taken_handles; ++ix) {
+            up->UndoRemoveHandleLocked(handles[ix]);
+        }
+        return result;
+    }
+
+    for (uint32_t ix = 0; ix != count; ++ix) {
+        ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(),
+               descs[ix].num_bytes, descs[ix].num_handles, 0);
+    }
+    return NO_ERROR;
+}
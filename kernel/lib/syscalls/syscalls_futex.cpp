@@ -7,6 +7,9 @@
 #include <trace.h>
 
 #include <magenta/process_dispatcher.h>
+#include <magenta/thread_dispatcher.h>
+#include <magenta/user_thread.h>
+#include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
 
@@ -20,6 +23,29 @@ mx_status_t sys_futex_wait(user_ptr<mx_futex_t> value_ptr, int current_value, mx
         value_ptr, current_value, deadline);
 }
 
+mx_status_t sys_futex_wait_pi(user_ptr<mx_futex_t> value_ptr, int current_value,
+                              mx_handle_t owner, mx_time_t deadline) {
+    LTRACEF("futex %p current %d owner %x\n", value_ptr.get(), current_value, owner);
+    magenta_check_deadline("futex_wait_pi", deadline);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // The reference keeps the owner's thread structure around while we lend
+    // it our priority; if it exits first it just stops borrowing.
+    mxtl::RefPtr<ThreadDispatcher> thread;
+    mx_status_t status = up->GetDispatcherWithRights(owner, MX_RIGHT_READ, &thread);
+    if (status != NO_ERROR)
+        return status;
+
+    // The futex is only shared within the process, so a thread of another
+    // process can't be holding it.
+    if (thread->thread()->process() != up)
+        return ERR_INVALID_ARGS;
+
+    return up->futex_context()->FutexWait(
+        value_ptr, current_value, deadline, thread->thread()->kernel_thread());
+}
+
 mx_status_t sys_futex_wake(user_ptr<const mx_futex_t> value_ptr, uint32_t count) {
     LTRACEF("futex %p count %" PRIu32 "\n", value_ptr.get(), count);
 
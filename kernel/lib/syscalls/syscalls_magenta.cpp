@@ -20,6 +20,7 @@
 #include <lib/crypto/global_prng.h>
 #include <lib/user_copy.h>
 #include <lib/user_copy/user_ptr.h>
+#include <lib/vdso.h>
 
 #include <magenta/event_dispatcher.h>
 #include <magenta/event_pair_dispatcher.h>
@@ -32,7 +33,6 @@
 #include <magenta/user_thread.h>
 #include <magenta/wait_set_dispatcher.h>
 
-#include <mxtl/atomic.h>
 #include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
@@ -57,15 +57,14 @@ mx_status_t sys_nanosleep(mx_time_t deadline) {
     return magenta_sleep(deadline);
 }
 
-// This must be accessed atomically from any given thread.
-static mxtl::atomic<int64_t> utc_offset;
-
-uint64_t sys_time_get(uint32_t clock_id) {
+// mx_time_get is implemented in the vDSO, which makes this call only when
+// it can't read the clock in user mode.
+uint64_t sys_time_get_via_kernel(uint32_t clock_id) {
     switch (clock_id) {
     case MX_CLOCK_MONOTONIC:
         return current_time();
     case MX_CLOCK_UTC:
-        return current_time() + utc_offset.load();
+        return current_time() + VDso::utc_offset();
     case MX_CLOCK_THREAD:
         return UserThread::GetCurrent()->runtime_ns();
     default:
@@ -85,7 +84,7 @@ mx_status_t sys_clock_adjust(mx_handle_t hrsrc, uint32_t clock_id, int64_t offse
     case MX_CLOCK_MONOTONIC:
         return ERR_ACCESS_DENIED;
     case MX_CLOCK_UTC:
-        utc_offset.store(offset);
+        VDso::set_utc_offset(offset);
         return NO_ERROR;
     default:
         return ERR_INVALID_ARGS;
@@ -31,4 +31,25 @@ struct vdso_constants {
 
     // Total amount of physical memory in the system, in bytes.
     uint64_t physmem;
+
+    // Conversion factor for mx_ticks_get return values to MX_CLOCK_MONOTONIC
+    // nanoseconds, as a struct fp_32_64 (see lib/fixed_point.h).  All zero
+    // if the monotonic clock can't be computed from the tick counter, in
+    // which case mx_time_get has to ask the kernel.
+    uint32_t ns_per_tick_l0;
+    uint32_t ns_per_tick_l32;
+    uint32_t ns_per_tick_l64;
+    uint32_t reserved;
+};
+
+// This struct contains the clock state that the kernel changes at run
+// time.  It is a sequence lock: the kernel makes seq odd, updates the
+// other members and then makes seq even again, so readers must retry
+// until they see the same even seq before and after reading them.
+struct vdso_clock {
+    uint64_t seq;
+
+    // Offset of MX_CLOCK_UTC from MX_CLOCK_MONOTONIC, set by
+    // mx_clock_adjust.
+    int64_t utc_offset;
 };
@@ -11,6 +11,7 @@
 #include <new.h>
 
 class VmMapping;
+struct vdso_clock;
 
 class VDso : public RoDso {
 public:
@@ -28,8 +29,16 @@ public:
     // Given VmAspace::vdso_code_mapping_, return the vDSO base address or 0.
     static uintptr_t base_address(const mxtl::RefPtr<VmMapping>& code_mapping);
 
+    // The offset of MX_CLOCK_UTC from MX_CLOCK_MONOTONIC.  It lives in the
+    // vDSO's data so that mx_time_get can read the UTC clock in user mode.
+    static int64_t utc_offset();
+    static void set_utc_offset(int64_t offset);
+
 private:
     VDso();
 
     static const VDso* instance_;
+
+    // The kernel's writable mapping of the vDSO's vdso_clock struct.
+    static vdso_clock* clock_;
 };
@@ -14,6 +14,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/vdso-image.S \
 
 MODULE_DEPS := \
+    kernel/lib/fixed_point \
     kernel/lib/mxtl \
 
 vdso-filename := $(BUILDDIR)/system/ulib/magenta/libmagenta.so
@@ -8,9 +8,11 @@
 #include <lib/vdso-constants.h>
 
 #include <kernel/cmdline.h>
+#include <kernel/mutex.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
+#include <lib/fixed_point.h>
 #include <mxtl/type_support.h>
 #include <platform.h>
 
@@ -105,6 +107,10 @@ private:
 }; // anonymous namespace
 
 const VDso* VDso::instance_ = NULL;
+vdso_clock* VDso::clock_ = NULL;
+
+// Serializes updates of the vdso_clock struct.  Readers don't take it.
+static Mutex clock_lock;
 
 // Private constructor, can only be called by Create (below).
 VDso::VDso() : RoDso("vdso", vdso_image, VDSO_CODE_END, VDSO_CODE_START) {}
@@ -123,6 +129,15 @@ const VDso* VDso::Create() {
     KernelVmoWindow<vdso_constants> constants_window(
         "vDSO constants", instance_->vmo()->vmo(), VDSO_DATA_CONSTANTS);
     uint64_t per_second = ticks_per_second();
+    bool soft_ticks = (per_second == 0 ||
+                       cmdline_get_bool("vdso.soft_ticks", false));
+
+    // Only give mx_time_get the means to compute the monotonic clock
+    // itself if that comes out the same as current_time().  Otherwise
+    // the factor stays zero and it makes the syscall instead.
+    struct fp_32_64 ns_per_tick = {};
+    if (!soft_ticks)
+        platform_get_ns_per_tick(&ns_per_tick);
 
     // Initialize the constants that should be visible to the vDSO.
     // Rather than assigning each member individually, do this with
@@ -133,11 +148,15 @@ const VDso* VDso::Create() {
         arch_dcache_line_size(),
         per_second,
         pmm_count_total_bytes(),
+        ns_per_tick.l0,
+        ns_per_tick.l32,
+        ns_per_tick.l64,
+        0,
     };
 
     // If ticks_per_second has not been calibrated, it will return 0. In this
     // case, use soft_ticks instead.
-    if (per_second == 0 || cmdline_get_bool("vdso.soft_ticks", false)) {
+    if (soft_ticks) {
         // Make mx_ticks_per_second return nanoseconds per second.
         constants_window.data()->ticks_per_second = MX_SEC(1);
 
@@ -146,9 +165,42 @@ const VDso* VDso::Create() {
         REDIRECT_SYSCALL(dynsym_window, mx_ticks_get, soft_ticks_get);
     }
 
+    // Unlike the constants, the clock struct is updated for as long as the
+    // system runs, so its window is never unmapped.
+    static_assert(sizeof(vdso_clock) == VDSO_DATA_CLOCK_SIZE,
+                  "gen-rodso-code.sh is suspect");
+    auto clock_window = new(&ac) KernelVmoWindow<vdso_clock>(
+        "vDSO clock", instance_->vmo()->vmo(), VDSO_DATA_CLOCK);
+    ASSERT(ac.check());
+    clock_ = clock_window->data();
+    *clock_ = (vdso_clock) {
+        0,
+        0,
+    };
+
     return instance_;
 }
 
+int64_t VDso::utc_offset() {
+    uint64_t seq;
+    int64_t offset;
+    do {
+        seq = __atomic_load_n(&clock_->seq, __ATOMIC_ACQUIRE);
+        offset = __atomic_load_n(&clock_->utc_offset, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || __atomic_load_n(&clock_->seq, __ATOMIC_RELAXED) != seq);
+    return offset;
+}
+
+void VDso::set_utc_offset(int64_t offset) {
+    AutoLock lock(&clock_lock);
+    uint64_t seq = clock_->seq;
+    __atomic_store_n(&clock_->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&clock_->utc_offset, offset, __ATOMIC_RELAXED);
+    __atomic_store_n(&clock_->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
 uintptr_t VDso::base_address(const mxtl::RefPtr<VmMapping>& code_mapping) {
     return code_mapping ? code_mapping->base() - VDSO_CODE_START : 0;
 }
@@ -161,6 +161,14 @@ uint64_t ticks_per_second(void)
     return tsc_ticks_per_ms * 1000;
 }
 
+bool platform_get_ns_per_tick(struct fp_32_64* ns_per_tick)
+{
+    if (wall_clock != CLOCK_TSC)
+        return false;
+    *ns_per_tick = ns_per_tsc;
+    return true;
+}
+
 lk_time_t ticks_to_nanos(uint64_t ticks) {
     return u64_mul_u64_fp32_64(ticks, ns_per_tsc);
 }
@@ -45,19 +45,12 @@ void Dnode::RemoveFromParent() {
 
     // Detach from parent
     if (parent_) {
+        parent_->child_index_.erase(*this);
         parent_->children_.erase(*this);
         if (IsDirectory()) {
             // '..' no longer references parent.
             parent_->vnode_->link_count_--;
         }
-        if (parent_->vnode_->IsDetachedDevice() && !parent_->HasChildren()) {
-            // Extremely special case: Parent is a detached device node,
-            // which has had a linked reference, but just ran out of children.
-            // Delete it explicitly, since the raw "vn" ptr was leaked
-            // from a RefPtr when the device was created.
-            parent_->vnode_->dnode_ = nullptr;
-            delete parent_->vnode_.get();
-        }
         parent_ = nullptr;
         vnode_->link_count_--;
     }
@@ -94,6 +87,7 @@ void Dnode::AddChild(mxtl::RefPtr<Dnode> parent, mxtl::RefPtr<Dnode> child) {
     } else {
         child->ordering_token_ = parent->children_.back().ordering_token_ + 1;
     }
+    parent->child_index_.insert(child.get());
     parent->children_.push_back(mxtl::move(child));
 }
 
@@ -116,15 +110,13 @@ mx_status_t Dnode::Lookup(const char* name, size_t len, mxtl::RefPtr<Dnode>* out
         return NO_ERROR;
     }
 
-    auto dn = children_.find_if([&name, &len](const Dnode& elem) -> bool {
-        return elem.NameMatch(name, len);
-    });
-    if (dn == children_.end()) {
+    auto dn = child_index_.find(NameKey{ name, len, HashName(name, len) });
+    if (!dn.IsValid()) {
         return ERR_NOT_FOUND;
     }
 
     if (out != nullptr) {
-        *out = dn.CopyPointer();
+        *out = mxtl::RefPtr<Dnode>(const_cast<Dnode*>(&*dn));
     }
     return NO_ERROR;
 }
@@ -232,22 +224,32 @@ mxtl::unique_ptr<char[]> Dnode::TakeName() {
 }
 
 void Dnode::PutName(mxtl::unique_ptr<char[]> name, size_t len) {
+    // The name is part of the key in the parent's index; it may only change
+    // while the dnode is not in one.
+    MX_DEBUG_ASSERT(parent_ == nullptr);
     flags_ = static_cast<uint32_t>((flags_ & ~kDnodeNameMax) | len);
     name_ = mxtl::move(name);
+    name_hash_ = HashName(name_.get(), len);
 }
 
 bool Dnode::IsDirectory() const { return vnode_->IsDirectory(); }
 
 Dnode::Dnode(mxtl::RefPtr<VnodeMemfs> vn, mxtl::unique_ptr<char[]> name, uint32_t flags) :
-    vnode_(mxtl::move(vn)), parent_(nullptr), ordering_token_(0), flags_(flags), name_(mxtl::move(name)) {
+    vnode_(mxtl::move(vn)), parent_(nullptr), ordering_token_(0), flags_(flags),
+    name_hash_(HashName(name.get(), flags & kDnodeNameMax)), name_(mxtl::move(name)) {
 };
 
 size_t Dnode::NameLen() const {
     return flags_ & kDnodeNameMax;
 }
 
-bool Dnode::NameMatch(const char* name, size_t len) const {
-    return (NameLen() == len) && (memcmp(name_.get(), name, len) == 0);
+// 32-bit FNV-1a; the index mixes the hash again before picking a bucket.
+uint32_t Dnode::HashName(const char* name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ static_cast<uint8_t>(name[i])) * 16777619u;
+    }
+    return hash;
 }
 
 } // namespace memfs
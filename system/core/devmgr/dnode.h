@@ -10,6 +10,8 @@
 #include <fs/vfs.h>
 #include <mxio/vfs.h>
 #include <mxtl/intrusive_double_list.h>
+#include <mxtl/intrusive_dynamic_hash_table.h>
+#include <mxtl/intrusive_single_list.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
@@ -42,6 +44,33 @@ public:
     using ChildList = mxtl::DoublyLinkedList<mxtl::RefPtr<Dnode>, Dnode::TypeChildTraits>;
     using DeviceList = mxtl::DoublyLinkedList<mxtl::RefPtr<Dnode>, Dnode::TypeDeviceTraits>;
 
+    // NameKey / TypeNameTraits are used to index the children of a dnode by name.
+    // The index holds raw pointers; the reference to each child is owned by
+    // the "children_" list, which also keeps children in creation order for
+    // readdir.
+    struct NameKey {
+        const char* name;
+        size_t len;
+        uint32_t hash;
+    };
+    using NameState = mxtl::SinglyLinkedListNodeState<Dnode*>;
+    struct TypeNameTraits {
+        static NameState& node_state(Dnode& dn) { return dn.type_name_state_; }
+        static NameKey GetKey(const Dnode& dn) {
+            return NameKey{ dn.name_.get(), dn.NameLen(), dn.name_hash_ };
+        }
+        static bool LessThan(const NameKey& a, const NameKey& b) {
+            return a.hash < b.hash;
+        }
+        static bool EqualTo(const NameKey& a, const NameKey& b) {
+            return (a.hash == b.hash) && (a.len == b.len) && (memcmp(a.name, b.name, a.len) == 0);
+        }
+        static uint32_t GetHash(const NameKey& key) { return key.hash; }
+    };
+    using NameIndex = mxtl::DynamicHashTable<NameKey, Dnode*,
+                                             mxtl::SinglyLinkedList<Dnode*, TypeNameTraits>,
+                                             uint32_t, TypeNameTraits, TypeNameTraits>;
+
     // Allocates a dnode, attached to a vnode
     static mxtl::RefPtr<Dnode> Create(const char* name, size_t len, mxtl::RefPtr<VnodeMemfs> vn);
 
@@ -61,6 +90,9 @@ public:
 
     bool HasChildren() const { return !children_.is_empty(); }
 
+    // Returns the dnode of the directory containing this one, if any.
+    mxtl::RefPtr<Dnode> GetParent() const { return parent_; }
+
     // Look up the child dnode (within a parent directory) by name.
     // Returns NO_ERROR if the child is found.
     //
@@ -96,20 +128,24 @@ public:
 private:
     friend struct TypeChildTraits;
     friend struct TypeDeviceTraits;
+    friend struct TypeNameTraits;
 
     Dnode(mxtl::RefPtr<VnodeMemfs> vn, mxtl::unique_ptr<char[]> name, uint32_t flags);
 
     size_t NameLen() const;
-    bool NameMatch(const char* name, size_t len) const;
+    static uint32_t HashName(const char* name, size_t len);
 
     NodeState type_child_state_;
     NodeState type_device_state_;
+    NameState type_name_state_;
     mxtl::RefPtr<VnodeMemfs> vnode_;
     mxtl::RefPtr<Dnode> parent_;
     // Used to impose an absolute order on dnodes within a directory.
     size_t ordering_token_;
     ChildList children_;
+    NameIndex child_index_;
     uint32_t flags_;
+    uint32_t name_hash_;
     mxtl::unique_ptr<char[]> name_;
 };
 
@@ -35,6 +35,7 @@ public:
     ssize_t Ioctl(uint32_t op, const void* in_buf,
                   size_t in_len, void* out_buf, size_t out_len) final;
     mx_status_t AttachRemote(mx_handle_t h) final;
+    mx_status_t AddDispatcher(mx_handle_t h, vfs_iostate_t* cookie) final;
 
     // To be more specific: Is this vnode connected into the directory hierarchy?
     // VnodeDirs can be unlinked, and this method will subsequently return false.
@@ -67,8 +68,16 @@ private:
     mx_status_t Truncate(size_t len) final;
     mx_status_t Getattr(vnattr_t* a) final;
 
+    // Grows the backing VMO so it can hold at least "len" bytes.
+    mx_status_t Reserve(size_t len);
+
     mx_handle_t vmo_;
+    // Logical length of the file.
     mx_off_t length_;
+    // Size of "vmo_". Grown geometrically ahead of "length_" so a series of
+    // appends doesn't resize the VMO on every write. Bytes in
+    // [length_, vmo_size_) are always zero.
+    mx_off_t vmo_size_;
 };
 
 class VnodeDir : public VnodeMemfs {
@@ -177,7 +186,7 @@ mx_handle_t vfs_create_root_handle(VnodeMemfs* vn);
 // device fs
 VnodeDir* devfs_get_root(void);
 mx_status_t memfs_create_device_at(VnodeDir* parent, VnodeDir** out, const char* name,
-                                   mx_handle_t hdevice) TA_EXCL(vfs_lock);
+                                   mx_handle_t hdevice);
 mx_status_t devfs_remove(VnodeDir* vn);
 
 // boot fs
@@ -189,7 +198,7 @@ mx_status_t systemfs_add_file(const char* path, mx_handle_t vmo, mx_off_t off, s
 
 // memory fs
 mx_status_t memfs_add_link(VnodeDir* parent, const char* name,
-                           VnodeMemfs* target) TA_EXCL(vfs_lock);
+                           VnodeMemfs* target) TA_EXCL(vfs_rename_lock);
 
 // Create the global root to memfs
 VnodeDir* vfs_create_global_root(void) TA_NO_THREAD_SAFETY_ANALYSIS;
@@ -199,6 +208,6 @@ VnodeDir* vfs_create_root(void);
 
 // shared among all memory filesystems
 mx_status_t memfs_create_directory(const char* path, uint32_t flags);
-void memfs_mount(VnodeDir* parent, VnodeDir* subtree) TA_EXCL(vfs_lock);
+void memfs_mount(VnodeDir* parent, VnodeDir* subtree) TA_EXCL(vfs_rename_lock);
 
 __END_CDECLS
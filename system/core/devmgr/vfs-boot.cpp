@@ -56,6 +56,7 @@ static mx_status_t add_file(mxtl::RefPtr<VnodeDir> vnb, const char* path, mx_han
             if (path[0] == 0) {
                 return ERR_INVALID_ARGS;
             }
+            fs::AutoWriterLock lock(vnb->lock());
             return vnb->CreateFromVmo(path, strlen(path), vmo, off, len);
         } else {
             if (nextpath == path) {
@@ -63,9 +64,12 @@ static mx_status_t add_file(mxtl::RefPtr<VnodeDir> vnb, const char* path, mx_han
             }
 
             mxtl::RefPtr<fs::Vnode> out;
-            r = vnb->Lookup(&out, path, nextpath - path);
-            if (r == ERR_NOT_FOUND) {
-                r = vnb->Create(&out, path, nextpath - path, S_IFDIR);
+            {
+                fs::AutoWriterLock lock(vnb->lock());
+                r = vnb->Lookup(&out, path, nextpath - path);
+                if (r == ERR_NOT_FOUND) {
+                    r = vnb->Create(&out, path, nextpath - path, S_IFDIR);
+                }
             }
 
             if (r < 0) {
@@ -19,24 +19,84 @@
 
 #define MXDEBUG 0
 
+// A device directory which was removed while it still had children is kept
+// around, detached, until the last of them goes away. Deletes "dir" if that
+// has just happened; the raw "vn" ptr was leaked from a RefPtr when the device
+// was created, so this code is its only owner.
+static void devfs_reap_detached(const mxtl::RefPtr<memfs::Dnode>& dir) TA_REQ(vfs_rename_lock) {
+    if (dir == nullptr) {
+        return;
+    }
+    VnodeMemfs* dirvn = dir->AcquireVnode().get();
+    if ((dirvn != nullptr) && dirvn->IsDetachedDevice() && !dir->HasChildren()) {
+        dirvn->dnode_ = nullptr;
+        delete dirvn;
+    }
+}
+
+// Removes "dn" from the directory containing it, under that directory's lock.
+// Returns the directory, if any.
+static mxtl::RefPtr<memfs::Dnode> devfs_detach(const mxtl::RefPtr<memfs::Dnode>& dn)
+    TA_REQ(vfs_rename_lock) {
+    mxtl::RefPtr<memfs::Dnode> parent = dn->GetParent();
+    if (parent == nullptr) {
+        dn->Detach();
+    } else {
+        mxtl::RefPtr<VnodeMemfs> parentvn = parent->AcquireVnode();
+        fs::AutoWriterLock lock(parentvn->lock());
+        dn->Detach();
+    }
+    return parent;
+}
+
+// Unlinks a device directory from its parent. Returns true if the directory
+// still has children, in which case it is left detached to be deleted later.
+static bool devfs_remove_dnode(VnodeDir* vn) TA_REQ(vfs_rename_lock) {
+    fs::AutoWriterLock lock(vn->lock());
+    vn->DetachRemote();
+    if (vn->dnode_->HasChildren()) {
+        // Detach the vnode, flag it to be deleted later.
+        vn->dnode_->RemoveFromParent();
+        vn->DetachDevice();
+        return true;
+    }
+    vn->dnode_->Detach();
+    vn->dnode_ = nullptr;
+    return false;
+}
+
 mx_status_t devfs_remove(VnodeDir* vn) {
-    mxtl::AutoLock lock(&vfs_lock);
+    // Removing a device is an unlink, so it takes the same locks in the same
+    // order: vfs_rename_lock, then the parent directory, then the device.
+    mxtl::AutoLock rename_lock(&vfs_rename_lock);
 
     xprintf("devfs_remove(%p)\n", vn);
-    vn->DetachRemote();
 
     // If this vnode is a directory, delete its dnode
     if (vn->IsDirectory()) {
         xprintf("devfs_remove(%p) delete dnode\n", vn);
-        if (vn->dnode_->HasChildren()) {
-            // Detach the vnode, flag it to be deleted later.
-            vn->dnode_->RemoveFromParent();
-            vn->DetachDevice();
-            return NO_ERROR;
+        mxtl::RefPtr<memfs::Dnode> parent = vn->dnode_->GetParent();
+        bool deferred;
+        if (parent != nullptr) {
+            mxtl::RefPtr<VnodeMemfs> parentvn = parent->AcquireVnode();
+            fs::AutoWriterLock lock(parentvn->lock());
+            deferred = devfs_remove_dnode(vn);
         } else {
-            vn->dnode_->Detach();
-            vn->dnode_ = nullptr;
+            deferred = devfs_remove_dnode(vn);
         }
+        devfs_reap_detached(parent);
+        if (deferred) {
+            return NO_ERROR;
+        }
+    } else {
+        fs::AutoWriterLock lock(vn->lock());
+        vn->DetachRemote();
+    }
+
+    // Unlink any other names the device was given (see memfs_add_link), each
+    // under its own directory's lock, before the vnode goes away.
+    while (!vn->devices_.is_empty()) {
+        devfs_reap_detached(devfs_detach(vn->devices_.pop_front()));
     }
 
     // The raw "vn" ptr was originally leaked from a RefPtr when
@@ -15,6 +15,7 @@
 #include <magenta/thread_annotations.h>
 #include <mxio/debug.h>
 #include <mxio/vfs.h>
+#include <mxtl/algorithm.h>
 #include <mxtl/auto_lock.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
@@ -44,7 +45,7 @@ VnodeMemfs::~VnodeMemfs() {
     }
 }
 
-VnodeFile::VnodeFile() : vmo_(MX_HANDLE_INVALID), length_(0) {}
+VnodeFile::VnodeFile() : vmo_(MX_HANDLE_INVALID), length_(0), vmo_size_(0) {}
 VnodeFile::~VnodeFile() {
     if (vmo_ != MX_HANDLE_INVALID) {
         mx_handle_close(vmo_);
@@ -90,6 +91,12 @@ ssize_t VnodeFile::Read(void* data, size_t len, size_t off) {
         return 0;
     }
 
+    // The VMO may extend past the end of the file; don't read beyond it.
+    size_t rlen = length_ - off;
+    if (len > rlen) {
+        len = rlen;
+    }
+
     size_t actual;
     mx_status_t status;
     if ((status = mx_vmo_read(vmo_, data, off, len, &actual)) != NO_ERROR) {
@@ -111,23 +118,38 @@ ssize_t VnodeVmo::Read(void* data, size_t len, size_t off) {
     return len;
 }
 
-ssize_t VnodeFile::Write(const void* data, size_t len, size_t off) {
-    mx_status_t status;
-    size_t newlen = off + len;
-    newlen = newlen > kMinfsMaxFileSize ? kMinfsMaxFileSize : newlen;
+mx_status_t VnodeFile::Reserve(size_t len) {
+    if ((vmo_ != MX_HANDLE_INVALID) && (len <= vmo_size_)) {
+        return NO_ERROR;
+    }
+
+    // Double the VMO each time it needs to grow, so the cost of resizing is
+    // amortized across a series of small appends.
+    size_t newsize = mxtl::max(mxtl::roundup(len, static_cast<size_t>(PAGE_SIZE)),
+                               static_cast<size_t>(vmo_size_ * 2));
+    newsize = newsize > kMinfsMaxFileSize ? kMinfsMaxFileSize : newsize;
 
-    // TODO(smklein): Round up to PAGE_SIZE increments to reduce overhead on a series of small
-    // writes.
+    mx_status_t status;
     if (vmo_ == MX_HANDLE_INVALID) {
         // First access to the file? Allocate it.
-        if ((status = mx_vmo_create(newlen, 0, &vmo_)) != NO_ERROR) {
-            return status;
-        }
-    } else if (newlen > length_) {
-        // Accessing beyond the end of the file? Extend it.
-        if ((status = mx_vmo_set_size(vmo_, newlen)) != NO_ERROR) {
+        if ((status = mx_vmo_create(newsize, 0, &vmo_)) != NO_ERROR) {
             return status;
         }
+    } else if ((status = mx_vmo_set_size(vmo_, newsize)) != NO_ERROR) {
+        // Accessing beyond the end of the VMO? Extend it.
+        return status;
+    }
+    vmo_size_ = newsize;
+    return NO_ERROR;
+}
+
+ssize_t VnodeFile::Write(const void* data, size_t len, size_t off) {
+    mx_status_t status;
+    size_t newlen = off + len;
+    newlen = newlen > kMinfsMaxFileSize ? kMinfsMaxFileSize : newlen;
+
+    if ((status = Reserve(newlen)) != NO_ERROR) {
+        return status;
     }
 
     size_t actual;
@@ -271,7 +293,13 @@ mx_status_t VnodeDir::Unlink(const char* name, size_t len, bool must_be_dir) {
     } else if (dn == nullptr) {
         // Cannot unlink directory 'foo' using the argument 'foo/.'
         return ERR_INVALID_ARGS;
-    } else if (!dn->IsDirectory() && must_be_dir) {
+    }
+
+    // The caller holds this directory's lock; the child's is needed too, since
+    // detaching it changes its link count and (for directories) its dnode.
+    mxtl::RefPtr<VnodeMemfs> vn = dn->AcquireVnode();
+    fs::AutoWriterLock lock(vn->lock());
+    if (!dn->IsDirectory() && must_be_dir) {
         // Path ending in "/" was requested, implying that the dnode must be a directory
         return ERR_NOT_DIR;
     } else if ((r = dn->CanUnlink()) != NO_ERROR) {
@@ -286,32 +314,34 @@ mx_status_t VnodeFile::Truncate(size_t len) {
     mx_status_t status;
     len = len > kMinfsMaxFileSize ? kMinfsMaxFileSize : len;
 
-    if (vmo_ == MX_HANDLE_INVALID) {
-        // First access to the file? Allocate it.
-        if ((status = mx_vmo_create(len, 0, &vmo_)) != NO_ERROR) {
+    if (len >= length_) {
+        // Everything between the old and new length is already zero; the
+        // VMO only needs to grow if the new length is past its end.
+        if ((status = Reserve(len)) != NO_ERROR) {
             return status;
         }
-    } else if ((len < length_) && (len % PAGE_SIZE != 0)) {
-        // TODO(smklein): Remove this case when the VMO system causes 'shrinking to a partial page'
-        // to fill the end of that page with zeroes.
+    } else {
+        // TODO(smklein): Remove the zeroing when the VMO system causes 'shrinking to a partial
+        // page' to fill the end of that page with zeroes.
         //
-        // Currently, if the file is truncated to a 'partial page', an later re-expanded, then the
-        // partial page is *not necessarily* filled with zeroes. As a consequence, we manually must
-        // fill the portion between "len" and the next highest page (or vn->length, whichever
-        // is smaller) with zeroes.
-        char buf[PAGE_SIZE];
-        size_t ppage_size = PAGE_SIZE - (len % PAGE_SIZE);
-        ppage_size = len + ppage_size < length_ ? ppage_size : length_ - len;
-        memset(buf, 0, ppage_size);
-        size_t actual;
-        status = mx_vmo_write(vmo_, buf, len, ppage_size, &actual);
-        if ((status != NO_ERROR) || (actual != ppage_size)) {
-            return status != NO_ERROR ? ERR_IO : status;
-        } else if ((status = mx_vmo_set_size(vmo_, len)) != NO_ERROR) {
+        // The VMO is shrunk to the page holding the new end of file, so bytes past "len" in that
+        // page (up to the old length; the rest are already zero) must be cleared by hand to keep
+        // them from reappearing if the file is re-extended.
+        size_t vmo_size = mxtl::roundup(len, static_cast<size_t>(PAGE_SIZE));
+        size_t ppage_size = (vmo_size < length_ ? vmo_size : length_) - len;
+        if (ppage_size > 0) {
+            char buf[PAGE_SIZE];
+            memset(buf, 0, ppage_size);
+            size_t actual;
+            status = mx_vmo_write(vmo_, buf, len, ppage_size, &actual);
+            if ((status != NO_ERROR) || (actual != ppage_size)) {
+                return status != NO_ERROR ? ERR_IO : status;
+            }
+        }
+        if ((status = mx_vmo_set_size(vmo_, vmo_size)) != NO_ERROR) {
             return status;
         }
-    } else if ((status = mx_vmo_set_size(vmo_, len)) != NO_ERROR) {
-        return status;
+        vmo_size_ = vmo_size;
     }
 
     length_ = len;
@@ -367,8 +397,6 @@ mx_status_t VnodeDir::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldnam
         if (olddn->IsDirectory() != targetdn->IsDirectory()) {
             // Cannot rename files to directories (and vice versa)
             return ERR_INVALID_ARGS;
-        } else if ((r = targetdn->CanUnlink()) != NO_ERROR) {
-            return r;
         }
     } else if (r != ERR_NOT_FOUND) {
         return r;
@@ -379,6 +407,16 @@ mx_status_t VnodeDir::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldnam
     // (2) Allocating a new name, if creating a new name.
     mxtl::unique_ptr<char[]> namebuffer(nullptr);
     if (target_exists) {
+        mxtl::RefPtr<VnodeMemfs> targetvn = targetdn->AcquireVnode();
+        if (targetvn.get() == this) {
+            // The target is the source's parent, which can't be empty; bail
+            // out before trying to take our own lock a second time.
+            return ERR_BAD_STATE;
+        }
+        fs::AutoWriterLock lock(targetvn->lock());
+        if ((r = targetdn->CanUnlink()) != NO_ERROR) {
+            return r;
+        }
         targetdn->Detach();
         namebuffer = mxtl::move(targetdn->TakeName());
     } else {
@@ -396,6 +434,10 @@ mx_status_t VnodeDir::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldnam
     // Validation ends here, and modifications begin. Rename should not fail
     // beyond this point.
 
+    // Both directories are locked by the caller; the node being moved is
+    // locked on its own since its parent (its "..") changes.
+    mxtl::RefPtr<VnodeMemfs> oldvn = olddn->AcquireVnode();
+    fs::AutoWriterLock lock(oldvn->lock());
     olddn->RemoveFromParent();
     olddn->PutName(mxtl::move(namebuffer), newlen);
     Dnode::AddChild(newdir->dnode_, mxtl::move(olddn));
@@ -498,18 +540,17 @@ static mx_status_t memfs_create_fs(const char* name, bool device, mxtl::RefPtr<V
     return NO_ERROR;
 }
 
-static void memfs_mount_locked(mxtl::RefPtr<VnodeDir> parent, mxtl::RefPtr<VnodeDir> subtree) TA_REQ(vfs_lock) {
+static void memfs_mount_locked(mxtl::RefPtr<VnodeDir> parent, mxtl::RefPtr<VnodeDir> subtree) TA_REQ(vfs_rename_lock) {
     Dnode::AddChild(parent->dnode_, subtree->dnode_);
 }
 
-// TODO(smklein): Update the usage of the vfs_lock here to a Vnode-specific lock,
-// allowing vnode creation, but preventing TOCTTOU bugs between checking if the
-// device exists and when we actually create it.
+// The caller holds this directory's lock exclusively, which prevents TOCTTOU
+// bugs between checking if the device exists and when we actually create it.
 //
 // precondition: no ref taken on parent
 // postcondition: ref returned on out parameter
 mx_status_t VnodeDir::CreateDeviceAtLocked(mxtl::RefPtr<VnodeDir>* out, const char* name,
-                                           mx_handle_t h) TA_REQ(vfs_lock) {
+                                           mx_handle_t h) {
     if (name == nullptr) {
         return ERR_INVALID_ARGS;
     }
@@ -554,7 +595,7 @@ mx_status_t VnodeDir::CreateDeviceAtLocked(mxtl::RefPtr<VnodeDir>* out, const ch
 }
 
 static mx_status_t memfs_add_link_locked(mxtl::RefPtr<VnodeDir> parent, const char* name,
-                                         mxtl::RefPtr<VnodeMemfs> vn) TA_REQ(vfs_lock) {
+                                         mxtl::RefPtr<VnodeMemfs> vn) TA_REQ(vfs_rename_lock) {
     if ((parent == nullptr) || (vn == nullptr)) {
         return ERR_INVALID_ARGS;
     }
@@ -660,6 +701,7 @@ mx_status_t memfs_create_directory(const char* path, uint32_t flags) {
     }
 
     mxtl::RefPtr<fs::Vnode> out;
+    fs::AutoWriterLock lock(parent->lock());
     r = parent->Create(&out, pathout, strlen(pathout), S_IFDIR);
     if (r < 0) {
         return r;
@@ -724,9 +766,12 @@ mx_status_t memfs_create_device_at(memfs::VnodeDir* parent, memfs::VnodeDir** ou
     if ((parent == nullptr) || !parent->IsDirectory()) {
         return ERR_INVALID_ARGS;
     }
-    mxtl::AutoLock lock(&vfs_lock);
     mxtl::RefPtr<memfs::VnodeDir> refout;
-    mx_status_t status = parent->CreateDeviceAtLocked(&refout, name, h);
+    mx_status_t status;
+    {
+        fs::AutoWriterLock lock(parent->lock());
+        status = parent->CreateDeviceAtLocked(&refout, name, h);
+    }
     // Leak a reference to be held by C code, which is not aware of RefPtrs.
     // Although the device Vnode can be used interoperably with C++ RefPtr code,
     // it will never be naturally deleted, and the C code is responsible for
@@ -756,13 +801,18 @@ VnodeDir* vfs_create_global_root() {
 }
 
 void memfs_mount(memfs::VnodeDir* parent, memfs::VnodeDir* subtree) {
-    mxtl::AutoLock lock(&vfs_lock);
+    mxtl::AutoLock rename_lock(&vfs_rename_lock);
+    fs::AutoWriterLock lock(parent->lock());
     memfs_mount_locked(mxtl::RefPtr<VnodeDir>(parent), mxtl::RefPtr<VnodeDir>(subtree));
 }
 
 mx_status_t memfs_add_link(memfs::VnodeDir* parent, const char* name,
                            memfs::VnodeMemfs* target) {
-    mxtl::AutoLock lock(&vfs_lock);
+    if (parent == nullptr) {
+        return ERR_INVALID_ARGS;
+    }
+    mxtl::AutoLock rename_lock(&vfs_rename_lock);
+    fs::AutoWriterLock lock(parent->lock());
     return memfs_add_link_locked(mxtl::RefPtr<VnodeDir>(parent), name,
                                  mxtl::RefPtr<VnodeMemfs>(target));
 }
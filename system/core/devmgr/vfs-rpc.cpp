@@ -8,6 +8,7 @@
 #include <string.h>
 #include <threads.h>
 
+#include <fs/vfs-dispatcher.h>
 #include <fs/vfs.h>
 #include <magenta/device/device.h>
 #include <magenta/device/vfs.h>
@@ -32,6 +33,15 @@ namespace memfs {
 
 static VnodeMemfs* global_vfs_root;
 
+// Requests to memfs are served by a pool of threads. Vnodes lock themselves,
+// so requests on different files and directories run concurrently.
+static constexpr uint32_t kDispatcherPoolSize = 4;
+static fs::VfsDispatcher* memfs_dispatcher;
+
+mx_status_t VnodeMemfs::AddDispatcher(mx_handle_t h, vfs_iostate_t* cookie) {
+    return memfs_dispatcher->Add(h, reinterpret_cast<void*>(vfs_handler), cookie);
+}
+
 void VnodeDir::NotifyAdd(const char* name, size_t len) { watcher_.NotifyAdd(name, len); }
 mx_status_t VnodeDir::WatchDir(mx_handle_t* out) { return watcher_.WatchDir(out); }
 
@@ -63,9 +73,21 @@ mx_handle_t vfs_create_root_handle(VnodeMemfs* vn) {
 // Initialize the global root VFS node and dispatcher
 void vfs_global_init(VnodeDir* root) {
     memfs::global_vfs_root = root;
-    if (mxio_dispatcher_create(&vfs_dispatcher, mxrio_handler) == NO_ERROR) {
-        mxio_dispatcher_start(vfs_dispatcher, "vfs-rio-dispatcher");
+
+    AllocChecker ac;
+    mxtl::unique_ptr<fs::VfsDispatcher> dispatcher(new (&ac) fs::VfsDispatcher());
+    if (!ac.check()) {
+        printf("fatal error allocating vfs dispatcher\n");
+        panic();
+    }
+    mx_status_t status;
+    if (((status = dispatcher->Create(mxrio_handler, memfs::kDispatcherPoolSize)) != NO_ERROR) ||
+        ((status = dispatcher->Start("vfs-rio-dispatcher")) != NO_ERROR)) {
+        printf("fatal error %d starting vfs dispatcher\n", status);
+        panic();
     }
+    // Lives as long as devmgr does.
+    memfs::memfs_dispatcher = dispatcher.release();
 }
 
 // Return a RIO handle to the global root
@@ -32,8 +32,10 @@ bool X86AssemblyGenerator::syscall(ofstream& os, const Syscall& sc) const {
   if (sc.is_vdso())
     return true;
   // SYSCALL_DEF(nargs64, nargs32, n, ret, name, args...) m_syscall nargs64, mx_##name, n
+  // Internal syscalls pass public=0 so the vDSO doesn't export them.
   os << syscall_macro_ << " " << sc.num_kernel_args() << " "
-     << name_prefix_ << sc.name << " " << sc.index << "\n";
+     << name_prefix_ << sc.name << " " << sc.index
+     << (sc.is_internal() ? " 0" : "") << "\n";
   return os.good();
 }
 
@@ -41,7 +43,8 @@ bool Arm64AssemblyGenerator::syscall(ofstream& os, const Syscall& sc) const {
   if (sc.is_vdso())
     return true;
   // SYSCALL_DEF(nargs64, nargs32, n, ret, name, args...) m_syscall mx_##name, n
-  os << syscall_macro_ << " " << name_prefix_ << sc.name << " " << sc.index << "\n";
+  os << syscall_macro_ << " " << name_prefix_ << sc.name << " " << sc.index
+     << (sc.is_internal() ? " 0" : "") << "\n";
   return os.good();
 }
 
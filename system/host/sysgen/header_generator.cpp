@@ -17,6 +17,9 @@ bool HeaderGenerator::syscall(std::ofstream& os, const Syscall& sc) const {
     if (skip_vdso_calls_ && sc.is_vdso()) {
         return true;
     }
+    if (skip_internal_calls_ && sc.is_internal()) {
+        return true;
+    }
 
     constexpr uint32_t indent_spaces = 4u;
 
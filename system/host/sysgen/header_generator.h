@@ -18,13 +18,15 @@ public:
                     const std::string& no_args_type,
                     bool allow_pointer_wrapping,
                     const std::map<std::string, std::string>& attributes,
-                    bool skip_vdso_calls) :
+                    bool skip_vdso_calls,
+                    bool skip_internal_calls) :
         function_prefix_(function_prefix),
         name_prefixes_(name_prefixes),
         no_args_type_(no_args_type),
         attributes_(attributes),
         allow_pointer_wrapping_(allow_pointer_wrapping),
-        skip_vdso_calls_(skip_vdso_calls) {}
+        skip_vdso_calls_(skip_vdso_calls),
+        skip_internal_calls_(skip_internal_calls) {}
 
     bool syscall(std::ofstream& os, const Syscall& sc) const override;
 
@@ -35,6 +37,7 @@ private:
     const std::map<std::string, std::string> attributes_;
     const bool allow_pointer_wrapping_;
     const bool skip_vdso_calls_;
+    const bool skip_internal_calls_;
 };
 
 HeaderGenerator kernel_header_generator();
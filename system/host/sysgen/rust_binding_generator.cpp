@@ -22,6 +22,9 @@ bool RustBindingGenerator::footer(std::ofstream& os) const {
 }
 
 bool RustBindingGenerator::syscall(std::ofstream& os, const Syscall& sc) const {
+    if (sc.is_internal())
+        return true;
+
     os << "    pub fn mx_" << sc.name << "(";
 
     // Writes all arguments.
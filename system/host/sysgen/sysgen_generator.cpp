@@ -43,7 +43,8 @@ static HeaderGenerator user_header(
             "void",                             // no-args special type
             false,
             user_attrs,
-            false);
+            false,
+            true);
 
 static HeaderGenerator vdso_header(
             "__attribute__((visibility(\"hidden\"))) extern ",  // function prefix
@@ -51,6 +52,7 @@ static HeaderGenerator vdso_header(
             "void",                                             // no-args special type
             false,
             user_attrs,
+            false,
             false);
 
 static HeaderGenerator kernel_header(
@@ -59,7 +61,8 @@ static HeaderGenerator kernel_header(
             "",
             true,
             kernel_attrs,
-            true);
+            true,
+            false);
 
 static X86AssemblyGenerator x86_generator(
             "m_syscall",                // syscall macro name
@@ -148,6 +148,10 @@ bool Syscall::is_vdso() const {
     return has_attribute("vdsocall", attributes);
 }
 
+bool Syscall::is_internal() const {
+    return has_attribute("internal", attributes);
+}
+
 bool Syscall::is_noreturn() const {
     return has_attribute("noreturn", attributes);
 }
@@ -185,6 +189,9 @@ bool Syscall::validate() const {
                (ret_spec.size() == 0 || ret_spec[0].type != "mx_status_t")) {
         print_error("blocking must have first return be of type mx_status_t");
         return false;
+    } else if (is_internal() && is_vdso()) {
+        print_error("internal and vdsocall are mutually exclusive");
+        return false;
     }
     bool valid_args = true;
     for_each_kernel_arg([this, &valid_args](const TypeSpec& arg) {
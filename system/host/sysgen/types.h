@@ -59,6 +59,7 @@ struct Syscall {
         : fc(sc_fc), name(sc_name) {}
 
     bool is_vdso() const;
+    bool is_internal() const;
     bool is_noreturn() const;
     bool is_no_wrap() const;
     bool is_blocking() const;
@@ -172,6 +172,20 @@ typedef struct {
     uint32_t rd_num_handles;
 } mx_channel_call_args_t;
 
+// Message descriptor for mx_channel_read_many() and mx_channel_write_many().
+// When reading, |num_bytes| and |num_handles| are the sizes of the buffers on
+// input, and are replaced with the sizes of the message read into them.
+typedef struct {
+    void* bytes;
+    mx_handle_t* handles;
+    uint32_t num_bytes;
+    uint32_t num_handles;
+} mx_channel_msg_t;
+
+// The most messages mx_channel_write_many() accepts, and mx_channel_read_many()
+// returns, in one call.
+#define MX_CHANNEL_MAX_BATCH_MSGS 64u
+
 // Structure for mx_object_wait_many():
 typedef struct {
     mx_handle_t handle;
@@ -214,6 +228,9 @@ typedef uint32_t mx_rights_t;
 #define MX_VMO_OP_CACHE_CLEAN            8u
 #define MX_VMO_OP_CACHE_CLEAN_INVALIDATE 9u
 
+// VM Object creation options
+#define MX_VMO_LARGE_PAGES               1u
+
 // VM Object clone flags
 #define MX_VMO_CLONE_COPY_ON_WRITE       1u
 
@@ -229,6 +246,7 @@ typedef uint32_t mx_rights_t;
 #define MX_VM_FLAG_CAN_MAP_WRITE      (1u << 8)
 #define MX_VM_FLAG_CAN_MAP_EXECUTE    (1u << 9)
 #define MX_VM_FLAG_MAP_RANGE          (1u << 10)
+#define MX_VM_FLAG_FAULT_AROUND       (1u << 11)
 
 // clock ids
 #define MX_CLOCK_MONOTONIC        (0u)
@@ -9,6 +9,8 @@
 #include <bitmap/raw-bitmap.h>
 #include <merkle/digest.h>
 #include <mxtl/algorithm.h>
+#include <mxtl/intrusive_hash_table.h>
+#include <mxtl/intrusive_single_list.h>
 #include <mxtl/macros.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
@@ -146,6 +148,12 @@ private:
     mx_status_t WriteShared(const void** data, size_t* len, size_t* actual,
                             uint64_t maxlen, mx_handle_t vmo, uint64_t start_block);
 
+    // Verifies [off, off + len) of the blob against the Merkle tree, skipping
+    // any Merkle leaves which have already been verified since the VMOs were
+    // loaded.
+    // Requires: InitVmos has succeeded.
+    mx_status_t VerifyRange(uint64_t off, uint64_t len);
+
     // Called by Blob once the last write has completed, updating the
     // on-disk metadata.
     mx_status_t WriteMetadata();
@@ -161,6 +169,11 @@ private:
     mx_handle_t readable_event_;
     uint64_t bytes_written_;
 
+    // One bit per Merkle leaf (merkle::Tree::kNodeSize bytes of data) which
+    // is set once that leaf has been verified. Sized on first use, and reset
+    // whenever the VMOs are released.
+    bitmap::RawBitmapGeneric<bitmap::DefaultStorage> verified_;
+
     BlobFlags flags_;
     uint8_t digest_[merkle::Digest::kLength];
 
@@ -180,6 +193,39 @@ struct MerkleRootTraits {
     }
 };
 
+// An entry in the digest index, which maps the Merkle root of every blob
+// present in the node map to the index of the node which holds it. One entry
+// is allocated per node when the blobstore is created.
+class DigestIndexEntry : public mxtl::SinglyLinkedListable<DigestIndexEntry*> {
+public:
+    const uint8_t* GetKey() const { return digest_; }
+
+    // Digests are uniformly distributed, so the leading bytes of one are
+    // already a good hash.
+    static size_t GetHash(const uint8_t* key) {
+        size_t hash;
+        memcpy(&hash, key, sizeof(hash));
+        return hash;
+    }
+
+    // Points at the merkle_root_hash of the indexed node.
+    const uint8_t* digest_ = nullptr;
+    size_t map_index_ = 0;
+};
+
+struct DigestIndexTraits {
+    static const uint8_t* GetKey(const DigestIndexEntry& obj) { return obj.GetKey(); }
+    static bool LessThan(const uint8_t* k1, const uint8_t* k2) {
+        return MerkleRootTraits::LessThan(k1, k2);
+    }
+    static bool EqualTo(const uint8_t* k1, const uint8_t* k2) {
+        return MerkleRootTraits::EqualTo(k1, k2);
+    }
+};
+
+// Prime, and large enough to keep chains short for the default inode count.
+constexpr size_t kDigestIndexBuckets = 8191;
+
 class Blobstore : public mxtl::RefCounted<Blobstore> {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Blobstore);
@@ -226,6 +272,11 @@ private:
     mx_status_t AllocateNode(size_t* node_index_out);
     void FreeNode(size_t node_index);
 
+    // Adds or removes a node, which must hold a valid Merkle root, from the
+    // in-memory digest index.
+    void IndexNode(size_t node_index);
+    void UnindexNode(size_t node_index);
+
     // Access the nth block of the block bitmap.
     void* GetBlockmapData(uint64_t n) const;
     // Access the nth block of the node map.
@@ -246,6 +297,18 @@ private:
                                             VnodeBlob::TypeWavlTraits>;
     WAVLTreeByMerkle hash_; // Map of all 'in use' blobs
 
+    // Map of all blobs stored in the node map, built when the blobstore is
+    // mounted. Lets LookupBlob find blobs which are not open without
+    // scanning the node map.
+    using DigestIndex = mxtl::HashTable<const uint8_t*,
+                                        DigestIndexEntry*,
+                                        mxtl::SinglyLinkedList<DigestIndexEntry*>,
+                                        size_t,
+                                        kDigestIndexBuckets,
+                                        DigestIndexTraits>;
+    DigestIndex digest_index_;
+    mxtl::unique_ptr<DigestIndexEntry[]> digest_entries_;
+
     RawBitmap block_map_;
     mxtl::unique_ptr<blobstore_inode_t[]> node_map_;
 };
@@ -283,6 +283,7 @@ void VnodeBlob::BlobCloseHandles() {
     vmo_merkle_tree_ = MX_HANDLE_INVALID;
     vmo_blob_ = MX_HANDLE_INVALID;
     readable_event_ = MX_HANDLE_INVALID;
+    verified_.Reset(0);
 }
 
 mx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
@@ -411,6 +412,7 @@ mx_status_t VnodeBlob::WriteMetadata() {
 
     // Update the on-disk hash
     memcpy(inode->merkle_root_hash, &digest_[0], merkle::Digest::kLength);
+    blobstore_->IndexNode(map_index_);
 
     // Write back the blob node
     if (blobstore_->WriteNode(map_index_)) {
@@ -506,19 +508,61 @@ mx_status_t VnodeBlob::CopyVmo(mx_rights_t rights, mx_handle_t* out) {
     // 2) We could create a COW subsection of the original VMO.
     //
     // For now, we aggressively verify the entire VMO up front.
+    auto inode = &blobstore_->node_map_[map_index_];
+    if ((status = VerifyRange(0, inode->blob_size)) != NO_ERROR) {
+        return status;
+    }
+
+    return mx_handle_duplicate(vmo_blob_, rights, out);
+}
+
+mx_status_t VnodeBlob::VerifyRange(uint64_t off, uint64_t len) {
     merkle::Tree mt;
     merkle::Digest d;
     d = ((const uint8_t*) &digest_[0]);
     auto inode = &blobstore_->node_map_[map_index_];
     uint64_t size_merkle = merkle::Tree::GetTreeLength(inode->blob_size);
-    status = mt.Verify((const void*)vmo_blob_addr_, inode->blob_size,
-                       (const void*)vmo_merkle_tree_addr_, size_merkle,
-                       0, inode->blob_size, d);
-    if (status != NO_ERROR) {
-        return status;
+    if ((off + len < off) || (off + len > inode->blob_size)) {
+        return ERR_INVALID_ARGS;
     }
 
-    return mx_handle_duplicate(vmo_blob_, rights, out);
+    size_t leaves = mxtl::roundup(inode->blob_size, merkle::Tree::kNodeSize) /
+            merkle::Tree::kNodeSize;
+    if (verified_.size() != leaves) {
+        mx_status_t status = verified_.Reset(leaves);
+        if (status != NO_ERROR) {
+            return status;
+        }
+    }
+
+    size_t leaf_start = off / merkle::Tree::kNodeSize;
+    size_t leaf_end = mxtl::min<size_t>(mxtl::roundup(off + len, merkle::Tree::kNodeSize) /
+                                        merkle::Tree::kNodeSize, verified_.size());
+    if (leaf_start >= leaf_end) {
+        // Nothing to cache (an empty blob or an empty range); the tree still
+        // checks the root.
+        return mt.Verify((const void*)vmo_blob_addr_, inode->blob_size,
+                         (const void*)vmo_merkle_tree_addr_, size_merkle,
+                         off, len, d);
+    }
+
+    // Only hash the runs of leaves which have not been verified yet.
+    size_t leaf = leaf_start;
+    while (!verified_.Get(leaf, leaf_end, &leaf)) {
+        size_t run_end = verified_.Scan(leaf, leaf_end, false);
+        uint64_t run_off = leaf * merkle::Tree::kNodeSize;
+        uint64_t run_len = mxtl::min<uint64_t>(run_end * merkle::Tree::kNodeSize,
+                                               inode->blob_size) - run_off;
+        mx_status_t status = mt.Verify((const void*)vmo_blob_addr_, inode->blob_size,
+                                       (const void*)vmo_merkle_tree_addr_, size_merkle,
+                                       run_off, run_len, d);
+        if (status != NO_ERROR) {
+            return status;
+        }
+        verified_.Set(leaf, run_end);
+        leaf = run_end;
+    }
+    return NO_ERROR;
 }
 
 mx_status_t VnodeBlob::ReadInternal(void* data, size_t len, size_t off, size_t* actual) {
@@ -531,15 +575,7 @@ mx_status_t VnodeBlob::ReadInternal(void* data, size_t len, size_t off, size_t*
         return status;
     }
 
-    merkle::Tree mt;
-    merkle::Digest d;
-    d = ((const uint8_t*) &digest_[0]);
-    auto inode = &blobstore_->node_map_[map_index_];
-    uint64_t size_merkle = merkle::Tree::GetTreeLength(inode->blob_size);
-    status = mt.Verify((const void*)vmo_blob_addr_, inode->blob_size,
-                       (const void*)vmo_merkle_tree_addr_, size_merkle,
-                       off, len, d);
-    if (status != NO_ERROR) {
+    if ((status = VerifyRange(off, len)) != NO_ERROR) {
         return status;
     }
 
@@ -584,9 +620,25 @@ mx_status_t Blobstore::AllocateNode(size_t* node_index_out) {
 
 // Frees a node IN MEMORY
 void Blobstore::FreeNode(size_t node_index) {
+    UnindexNode(node_index);
     memset(&node_map_[node_index], 0, sizeof(blobstore_inode_t));
 }
 
+void Blobstore::IndexNode(size_t node_index) {
+    DigestIndexEntry* entry = &digest_entries_[node_index];
+    assert(!entry->InContainer());
+    entry->digest_ = node_map_[node_index].merkle_root_hash;
+    entry->map_index_ = node_index;
+    digest_index_.insert(entry);
+}
+
+void Blobstore::UnindexNode(size_t node_index) {
+    DigestIndexEntry* entry = &digest_entries_[node_index];
+    if (entry->InContainer()) {
+        digest_index_.erase(*entry);
+    }
+}
+
 mx_status_t Blobstore::Unmount() {
     close(blockfd_);
     return NO_ERROR;
@@ -720,36 +772,36 @@ mx_status_t Blobstore::LookupBlob(const merkle::Digest& digest, mxtl::RefPtr<Vno
         return NO_ERROR;
     }
 
-    // Look up blob in the slow map
-    for (size_t i = 0; i < info_.inode_count; ++i) {
-        if (node_map_[i].start_block >= kStartBlockMinimum) {
-            if (digest == node_map_[i].merkle_root_hash) {
-                if (out != nullptr) {
-                    // Found it. Attempt to wrap the blob in a vnode.
-                    AllocChecker ac;
-                    mxtl::RefPtr<VnodeBlob> vn =
-                            mxtl::AdoptRef(new (&ac) VnodeBlob(mxtl::RefPtr<Blobstore>(this), digest));
-                    if (!ac.check()) {
-                        return ERR_NO_MEMORY;
-                    }
-                    vn->SetState(kBlobStateReadable);
-                    vn->SetMapIndex(i);
-                    // Delay reading any data from disk until read.
-                    hash_.insert(vn.get());
-                    *out = mxtl::move(vn);
-                }
-                return NO_ERROR;
-            }
+    // Look up blob in the digest index (is the blob on disk?)
+    auto entry = digest_index_.find(digest.AcquireBytes());
+    digest.ReleaseBytes();
+    if (!entry.IsValid()) {
+        return ERR_NOT_FOUND;
+    }
+    if (out != nullptr) {
+        // Found it. Attempt to wrap the blob in a vnode.
+        AllocChecker ac;
+        mxtl::RefPtr<VnodeBlob> vn =
+                mxtl::AdoptRef(new (&ac) VnodeBlob(mxtl::RefPtr<Blobstore>(this), digest));
+        if (!ac.check()) {
+            return ERR_NO_MEMORY;
         }
+        vn->SetState(kBlobStateReadable);
+        vn->SetMapIndex(entry->map_index_);
+        // Delay reading any data from disk until read.
+        hash_.insert(vn.get());
+        *out = mxtl::move(vn);
     }
-    return ERR_NOT_FOUND;
+    return NO_ERROR;
 }
 
 Blobstore::Blobstore(int fd, const blobstore_info_t* info) : blockfd_(fd) {
     memcpy(&info_, info, sizeof(blobstore_info_t));
 }
 
-Blobstore::~Blobstore() {}
+Blobstore::~Blobstore() {
+    digest_index_.clear();
+}
 
 mx_status_t Blobstore::Create(int fd, const blobstore_info_t* info, mxtl::RefPtr<VnodeBlob>* out) {
     uint64_t blocks = info->block_count;
@@ -781,6 +833,12 @@ mx_status_t Blobstore::Create(int fd, const blobstore_info_t* info, mxtl::RefPtr
     }
     fs->node_map_.reset(mxtl::move(nodemap));
 
+    auto entries = new (&ac) DigestIndexEntry[fs->info_.inode_count];
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+    fs->digest_entries_.reset(mxtl::move(entries));
+
     if ((status = fs->LoadBitmaps()) < 0) {
         fprintf(stderr, "blobstore: Failed to load bitmaps\n");
         return status;
@@ -809,6 +867,18 @@ mx_status_t Blobstore::LoadBitmaps() {
             return ERR_IO;
         }
     }
+
+    // Index every allocated node by its Merkle root, so lookups of blobs
+    // which are not open don't need to scan the node map.
+    for (size_t i = 0; i < info_.inode_count; ++i) {
+        if (node_map_[i].start_block < kStartBlockMinimum) {
+            continue;
+        } else if (digest_index_.find(node_map_[i].merkle_root_hash).IsValid()) {
+            fprintf(stderr, "blobstore: node %zu duplicates an existing blob\n", i);
+            continue;
+        }
+        IndexNode(i);
+    }
     return NO_ERROR;
 }
 
@@ -9,8 +9,13 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <threads.h>
 
+#include <launchpad/launchpad.h>
 #include <magenta/compiler.h>
+#include <magenta/process.h>
+#include <magenta/processargs.h>
 #include <magenta/syscalls.h>
 #include <mxtl/unique_ptr.h>
 
@@ -33,7 +38,9 @@ struct TestArgs {
     uint32_t queue;
 };
 
-void do_test(uint32_t duration, const TestArgs& test_args) {
+// Writes messages to a fresh channel and reads them back out for |duration|
+// seconds. Returns the number of write/read iterations per second.
+double write_read_loop(uint32_t duration, const TestArgs& test_args) {
     __UNUSED mx_status_t status;
 
     uint64_t duration_ns = duration * 1000000000ull;
@@ -105,15 +112,379 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
     assert(status == NO_ERROR);
 
     double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
-    double its_per_second = static_cast<double>(big_its) * big_it_size / real_duration;
+    return static_cast<double>(big_its) * big_it_size / real_duration;
+}
+
+void do_test(uint32_t duration, const TestArgs& test_args) {
+    double its_per_second = write_read_loop(duration, test_args);
     printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued): "
                "%.0f iterations/second\n",
            test_args.size, test_args.handles, test_args.queue, its_per_second);
 }
 
+struct ScalingThread {
+    thrd_t thread;
+    mx_handle_t start;
+    uint32_t duration;
+    TestArgs test_args;
+    double its_per_second;
+};
+
+int scaling_thread(void* arg) {
+    auto t = static_cast<ScalingThread*>(arg);
+    __UNUSED mx_status_t status =
+        mx_object_wait_one(t->start, MX_EVENT_SIGNALED, MX_TIME_INFINITE, nullptr);
+    assert(status == NO_ERROR);
+    t->its_per_second = write_read_loop(t->duration, t->test_args);
+    return 0;
+}
+
+// Runs the single test on 1, 2, 4, ... |max_threads| threads at once, each
+// with its own channel, and reports the combined message rate. Messages don't
+// contend on any one channel's lock here, so how well this scales across cpus
+// comes down to the kernel's allocators and other shared state.
+void do_scaling(uint32_t duration, const TestArgs& test_args, uint32_t max_threads) {
+    __UNUSED mx_status_t status;
+
+    mxtl::unique_ptr<ScalingThread[]> threads(new ScalingThread[max_threads]);
+    double single_rate = 0.0;
+    for (uint32_t n = 1u;; n = (n * 2u < max_threads) ? n * 2u : max_threads) {
+        // Start them all at once, so they run side by side for the whole
+        // duration.
+        mx_handle_t start;
+        status = mx_event_create(0u, &start);
+        assert(status == NO_ERROR);
+        for (uint32_t i = 0; i < n; i++) {
+            threads[i].start = start;
+            threads[i].duration = duration;
+            threads[i].test_args = test_args;
+            threads[i].its_per_second = 0.0;
+            __UNUSED int ret = thrd_create(&threads[i].thread, scaling_thread, &threads[i]);
+            assert(ret == thrd_success);
+        }
+        status = mx_object_signal(start, 0u, MX_EVENT_SIGNALED);
+        assert(status == NO_ERROR);
+
+        double total = 0.0;
+        for (uint32_t i = 0; i < n; i++) {
+            thrd_join(threads[i].thread, nullptr);
+            total += threads[i].its_per_second;
+        }
+        mx_handle_close(start);
+
+        if (n == 1u)
+            single_rate = total;
+        printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued), "
+                   "%2" PRIu32 " threads: %.0f iterations/second (%.2fx)\n",
+               test_args.size, test_args.handles, test_args.queue, n, total,
+               single_rate > 0.0 ? total / single_rate : 0.0);
+
+        if (n == max_threads)
+            break;
+    }
+}
+
+// Like write_read_loop(), but moves |batch| messages at a time: with one
+// mx_channel_write_many()/mx_channel_read_many() pair if |vectored|, and with
+// |batch| mx_channel_write()/mx_channel_read() pairs otherwise. Returns the
+// number of messages per second.
+double batch_loop(uint32_t duration, const TestArgs& test_args, uint32_t batch, bool vectored) {
+    __UNUSED mx_status_t status;
+
+    uint64_t duration_ns = duration * 1000000000ull;
+
+    // We'll write to mp[0] (and read from mp[1]).
+    mx_handle_t mp[2] = {MX_HANDLE_INVALID, MX_HANDLE_INVALID};
+    status = mx_channel_create(0u, &mp[0], &mp[1]);
+    assert(status == NO_ERROR);
+
+    // We'll send/receive duplicates of this handle.
+    mx_handle_t event;
+    assert(mx_event_create(0u, &event) == NO_ERROR);
+
+    // Each message in a batch gets its own slice of the data and handle buffers.
+    mxtl::unique_ptr<uint8_t[]> data;
+    if (test_args.size) {
+        data.reset(new uint8_t[batch * test_args.size]);
+        memset(data.get(), 0x5a, batch * test_args.size);
+    }
+    mxtl::unique_ptr<mx_handle_t[]> handles;
+    if (test_args.handles)
+        handles.reset(new mx_handle_t[batch * test_args.handles]);
+
+    mxtl::unique_ptr<mx_channel_msg_t[]> msgs(new mx_channel_msg_t[batch]);
+    for (uint32_t i = 0; i < batch; i++) {
+        msgs[i].bytes = test_args.size ? data.get() + i * test_args.size : nullptr;
+        msgs[i].handles = test_args.handles ? handles.get() + i * test_args.handles : nullptr;
+        msgs[i].num_bytes = test_args.size;
+        msgs[i].num_handles = test_args.handles;
+    }
+
+    for (uint32_t i = 0; i < test_args.queue; i++) {
+        duplicate_handles(test_args.handles, event, handles.get());
+        status = mx_channel_write(mp[0], 0u, data.get(), test_args.size,
+                                  handles.get(), test_args.handles);
+        assert(status == NO_ERROR);
+    }
+
+    duplicate_handles(batch * test_args.handles, event, handles.get());
+
+    static constexpr uint32_t big_it_size = 1000;
+    uint64_t big_its = 0;
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    uint64_t end_ns;
+    for (;;) {
+        big_its++;
+        for (uint32_t i = 0; i < big_it_size; i++) {
+            if (vectored) {
+                status = mx_channel_write_many(mp[0], 0u, msgs.get(), batch);
+                assert(status == NO_ERROR);
+
+                uint32_t r_count = 0;
+                status = mx_channel_read_many(mp[1], 0u, msgs.get(), batch, &r_count);
+                assert(status == NO_ERROR);
+                assert(r_count == batch);
+                continue;
+            }
+
+            for (uint32_t j = 0; j < batch; j++) {
+                status = mx_channel_write(mp[0], 0u, msgs[j].bytes, test_args.size,
+                                          msgs[j].handles, test_args.handles);
+                assert(status == NO_ERROR);
+            }
+            for (uint32_t j = 0; j < batch; j++) {
+                uint32_t r_size = test_args.size;
+                uint32_t r_handles = test_args.handles;
+                status = mx_channel_read(mp[1], 0u, msgs[j].bytes, msgs[j].handles, r_size,
+                                         r_handles, &r_size, &r_handles);
+                assert(status == NO_ERROR);
+                assert(r_size == test_args.size);
+                assert(r_handles == test_args.handles);
+            }
+        }
+
+        end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+        if ((end_ns - start_ns) >= duration_ns)
+            break;
+    }
+
+    for (uint32_t i = 0; i < batch * test_args.handles; i++) {
+        status = mx_handle_close(handles[i]);
+        assert(status == NO_ERROR);
+    }
+    status = mx_handle_close(event);
+    assert(status == NO_ERROR);
+    status = mx_handle_close(mp[0]);
+    assert(status == NO_ERROR);
+    status = mx_handle_close(mp[1]);
+    assert(status == NO_ERROR);
+
+    double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
+    return static_cast<double>(big_its) * big_it_size * batch / real_duration;
+}
+
+// Moves 1, 2, 4, ... |max_batch| messages at a time, one syscall per message
+// and then one syscall per batch, and reports both message rates.
+void do_batch(uint32_t duration, const TestArgs& test_args, uint32_t max_batch) {
+    for (uint32_t n = 1u;; n = (n * 2u < max_batch) ? n * 2u : max_batch) {
+        double single = batch_loop(duration, test_args, n, false);
+        double vectored = batch_loop(duration, test_args, n, true);
+        printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued), "
+                   "batches of %2" PRIu32 ": %.0f messages/second single, "
+                   "%.0f messages/second vectored (%.2fx)\n",
+               test_args.size, test_args.handles, test_args.queue, n, single, vectored,
+               single > 0.0 ? vectored / single : 0.0);
+
+        if (n == max_batch)
+            break;
+    }
+}
+
+constexpr size_t kPageSize = 4096u;
+
+// Writes |size| byte messages and reads them into a page aligned buffer, or
+// one |misalign| bytes past a page boundary, for |duration| seconds. Returns
+// the throughput in MiB/second.
+double bulk_loop(uint32_t duration, uint32_t size, size_t misalign) {
+    __UNUSED mx_status_t status;
+
+    mx_handle_t mp[2] = {MX_HANDLE_INVALID, MX_HANDLE_INVALID};
+    status = mx_channel_create(0u, &mp[0], &mp[1]);
+    assert(status == NO_ERROR);
+
+    mxtl::unique_ptr<uint8_t[]> out(new uint8_t[size]);
+    memset(out.get(), 0x5a, size);
+    void* in_base = nullptr;
+    __UNUSED int ret = posix_memalign(&in_base, kPageSize, size + kPageSize);
+    assert(ret == 0);
+    uint8_t* in = static_cast<uint8_t*>(in_base) + misalign;
+    // Touch the buffer up front, so the first reads don't fault it in.
+    memset(in_base, 0, size + kPageSize);
+
+    uint64_t duration_ns = duration * 1000000000ull;
+    static constexpr uint32_t big_it_size = 100;
+    uint64_t big_its = 0;
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    uint64_t end_ns;
+    for (;;) {
+        big_its++;
+        for (uint32_t i = 0; i < big_it_size; i++) {
+            status = mx_channel_write(mp[0], 0u, out.get(), size, nullptr, 0u);
+            assert(status == NO_ERROR);
+
+            uint32_t r_size = 0;
+            status = mx_channel_read(mp[1], 0u, in, nullptr, size, 0u, &r_size, nullptr);
+            assert(status == NO_ERROR);
+            assert(r_size == size);
+            // Use the data, as a real reader would.
+            assert(in[size - 1] == 0x5a);
+        }
+
+        end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+        if ((end_ns - start_ns) >= duration_ns)
+            break;
+    }
+
+    free(in_base);
+    status = mx_handle_close(mp[0]);
+    assert(status == NO_ERROR);
+    status = mx_handle_close(mp[1]);
+    assert(status == NO_ERROR);
+
+    double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
+    double bytes = static_cast<double>(big_its) * big_it_size * size;
+    return bytes / real_duration / (1024.0 * 1024.0);
+}
+
+// Compares bulk throughput into page aligned and unaligned buffers, for sizes
+// from one page up to the largest message.
+void do_bulk(uint32_t duration) {
+    static constexpr uint32_t sizes[] = {4096, 8192, 16384, 32768, 65536};
+    for (uint32_t size : sizes) {
+        double aligned = bulk_loop(duration, size, 0u);
+        double unaligned = bulk_loop(duration, size, 64u);
+        printf("bulk %5" PRIu32 " bytes: %.0f MiB/second page aligned, "
+                   "%.0f MiB/second unaligned (%.2fx)\n",
+               size, aligned, unaligned, unaligned > 0.0 ? aligned / unaligned : 0.0);
+    }
+}
+
+// Argument used to launch ourselves as the remote end of the ping-pong test.
+constexpr char kEchoArg[] = "--echo";
+
+// The kernel's limit on the size of a channel message.
+constexpr uint32_t kMaxMessageSize = 65536u;
+
+// Sends every message received on |channel| straight back until the peer goes away.
+int echo_loop(mx_handle_t channel) {
+    mxtl::unique_ptr<uint8_t[]> buffer(new uint8_t[kMaxMessageSize]);
+    for (;;) {
+        mx_signals_t observed = 0;
+        mx_status_t status = mx_object_wait_one(
+            channel, MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED, MX_TIME_INFINITE, &observed);
+        if (status != NO_ERROR || !(observed & MX_CHANNEL_READABLE))
+            break;
+        uint32_t size = 0;
+        if (mx_channel_read(channel, 0u, buffer.get(), nullptr, kMaxMessageSize, 0u,
+                            &size, nullptr) != NO_ERROR)
+            break;
+        if (mx_channel_write(channel, 0u, buffer.get(), size, nullptr, 0u) != NO_ERROR)
+            break;
+    }
+    mx_handle_close(channel);
+    return 0;
+}
+
+int echo_thread(void* arg) {
+    return echo_loop(static_cast<mx_handle_t>(reinterpret_cast<uintptr_t>(arg)));
+}
+
+// Bounces |size| byte messages off an echo loop running in another thread of
+// this process, or in another process.  The round trip time of the latter
+// includes two address space switches, which is what the x86.pcid kernel
+// option is meant to make cheaper.
+void do_ping_pong(const char* argv0, uint32_t duration, uint32_t size, bool remote) {
+    __UNUSED mx_status_t status;
+
+    mx_handle_t mp[2] = {MX_HANDLE_INVALID, MX_HANDLE_INVALID};
+    status = mx_channel_create(0u, &mp[0], &mp[1]);
+    assert(status == NO_ERROR);
+
+    thrd_t thread;
+    mx_handle_t proc = MX_HANDLE_INVALID;
+    if (remote) {
+        launchpad_t* lp;
+        launchpad_create(0u, "channel-perf-echo", &lp);
+        launchpad_load_from_file(lp, argv0);
+        const char* args[] = {argv0, kEchoArg};
+        launchpad_set_args(lp, countof(args), args);
+        launchpad_clone(lp, LP_CLONE_ALL);
+        launchpad_add_handle(lp, mp[1], PA_HND(PA_USER0, 0));
+        const char* errmsg;
+        status = launchpad_go(lp, &proc, &errmsg);
+        if (status != NO_ERROR) {
+            fprintf(stderr, "%s: error: failed to launch echo process: %s: %d\n",
+                    argv0, errmsg, status);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        int ret = thrd_create(&thread, echo_thread,
+                              reinterpret_cast<void*>(static_cast<uintptr_t>(mp[1])));
+        assert(ret == thrd_success);
+    }
+
+    mxtl::unique_ptr<uint8_t[]> data;
+    if (size) {
+        data.reset(new uint8_t[size]);
+        memset(data.get(), 0x5a, size);
+    }
+
+    uint64_t duration_ns = duration * 1000000000ull;
+    static constexpr uint32_t big_it_size = 1000;
+    uint64_t big_its = 0;
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    uint64_t end_ns;
+    for (;;) {
+        big_its++;
+        for (uint32_t i = 0; i < big_it_size; i++) {
+            status = mx_channel_write(mp[0], 0u, data.get(), size, nullptr, 0u);
+            assert(status == NO_ERROR);
+
+            status = mx_object_wait_one(mp[0], MX_CHANNEL_READABLE, MX_TIME_INFINITE, nullptr);
+            assert(status == NO_ERROR);
+            uint32_t r_size = 0;
+            status = mx_channel_read(mp[0], 0u, data.get(), nullptr, size, 0u, &r_size, nullptr);
+            assert(status == NO_ERROR);
+            assert(r_size == size);
+        }
+
+        end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+        if ((end_ns - start_ns) >= duration_ns)
+            break;
+    }
+
+    // Closing our end makes the echo loop exit.
+    status = mx_handle_close(mp[0]);
+    assert(status == NO_ERROR);
+    if (remote) {
+        status = mx_object_wait_one(proc, MX_PROCESS_SIGNALED, MX_TIME_INFINITE, nullptr);
+        assert(status == NO_ERROR);
+        mx_handle_close(proc);
+    } else {
+        thrd_join(thread, nullptr);
+    }
+
+    uint64_t round_trips = big_its * big_it_size;
+    printf("ping-pong %" PRIu32 " bytes with echo %s: %" PRIu64 " ns/round trip\n",
+           size, remote ? "process" : "thread ", (end_ns - start_ns) / round_trips);
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
+    if (argc == 2 && strcmp(argv[1], kEchoArg) == 0)
+        return echo_loop(mx_get_startup_handle(PA_HND(PA_USER0, 0)));
+
     static constexpr char help[] =
         "Usage: %s [options ...]\n"
         "\n"
@@ -121,6 +492,10 @@ int main(int argc, char** argv) {
         "  -h    show help (this)\n"
         "  -o    run single test (default)\n"
         "  -s    run suite (ignores -S/-H/-Q)\n"
+        "  -p    run ping-pong against an echo thread and an echo process (ignores -H/-Q)\n"
+        "  -l    run bulk throughput into aligned and unaligned buffers (ignores -S/-H/-Q)\n"
+        "  -t N  run single test on 1, 2, 4, ... N threads at once (default: 1)\n"
+        "  -b N  run single test moving 1, 2, 4, ... N messages per syscall (max: 64)\n"
         "  -n N  set test repetition count to N (default: 1)\n"
         "  -d N  set test duration to N seconds (default: 5)\n"
         "  -S N  set message size to N bytes (default: 10)\n"
@@ -128,6 +503,10 @@ int main(int argc, char** argv) {
         "  -Q N  set message pre-queue count to N messages (default: 0)\n";
 
     bool run_suite = false;  // -o/-s
+    bool ping_pong = false;  // -p
+    bool bulk = false;       // -l
+    uint32_t threads = 1;    // -t
+    uint32_t batch = 0;      // -b
     uint32_t duration = 5;   // -d
     uint32_t repeats = 1;    // -n
     // Ignored when running a suite:
@@ -138,7 +517,7 @@ int main(int argc, char** argv) {
     };
 
     int opt;
-    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:")) != -1) {
+    while ((opt = getopt(argc, argv, "+hosplt:b:n:d:S:H:Q:")) != -1) {
         // Our option values are always unsigned numbers.
         uint32_t value = 0;
         if (optarg) {
@@ -160,6 +539,24 @@ int main(int argc, char** argv) {
             case 's':
                 run_suite = true;
                 break;
+            case 'p':
+                ping_pong = true;
+                break;
+            case 'l':
+                bulk = true;
+                break;
+            case 't':
+                assert(optarg);
+                if (value == 0)
+                    argument_error(argv[0], "thread count must be at least 1");
+                threads = value;
+                break;
+            case 'b':
+                assert(optarg);
+                if (value == 0 || value > MX_CHANNEL_MAX_BATCH_MSGS)
+                    argument_error(argv[0], "batch size must be from 1 to 64");
+                batch = value;
+                break;
             case 'n':
                 assert(optarg);
                 repeats = value;
@@ -196,7 +593,12 @@ int main(int argc, char** argv) {
                    repeats);
         }
 
-        if (run_suite) {
+        if (ping_pong) {
+            do_ping_pong(argv[0], duration, test_args.size, false);
+            do_ping_pong(argv[0], duration, test_args.size, true);
+        } else if (bulk) {
+            do_bulk(duration);
+        } else if (run_suite) {
             static constexpr TestArgs suite[] = {
                 {10, 0, 0},
                 {100, 0, 0},
@@ -216,6 +618,10 @@ int main(int argc, char** argv) {
             };
             for (size_t i = 0; i < countof(suite); i++)
                 do_test(duration, suite[i]);
+        } else if (threads > 1u) {
+            do_scaling(duration, test_args, threads);
+        } else if (batch > 0u) {
+            do_batch(duration, test_args, batch);
         } else {
             do_test(duration, test_args);
         }
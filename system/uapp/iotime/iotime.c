@@ -4,11 +4,14 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <magenta/process.h>
 #include <magenta/syscalls.h>
 #include <magenta/device/ramdisk.h>
 #include <magenta/device/block.h>
@@ -249,12 +252,78 @@ int iotime_fread(int argc, char** argv) {
     return 0;
 }
 
+// Map |vmo| read-only and touch one byte of each page, returning the elapsed time.
+static mx_status_t mscan_pass(mx_handle_t vmo, size_t total, uint32_t extra_flags,
+                              mx_time_t* elapsed) {
+    uintptr_t addr;
+    mx_status_t status = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, total,
+                                     MX_VM_FLAG_PERM_READ | extra_flags, &addr);
+    if (status != NO_ERROR) {
+        return status;
+    }
+
+    mx_time_t t0 = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (size_t off = 0; off < total; off += PAGE_SIZE) {
+        (void)*(volatile uint8_t*)(addr + off);
+    }
+    mx_time_t t1 = mx_time_get(MX_CLOCK_MONOTONIC);
+    *elapsed = t1 - t0;
+
+    mx_vmar_unmap(mx_vmar_root_self(), addr, total);
+    return NO_ERROR;
+}
+
+int iotime_mscan(int argc, char** argv) {
+    if (argc != 3) {
+        return usage();
+    }
+    size_t total = number(argv[2]);
+
+    if ((total == 0) || (total % PAGE_SIZE)) {
+        fprintf(stderr, "error: size must be a non-zero multiple of 4K\n");
+        return -1;
+    }
+
+    // commit the whole vmo up front so every page is resident and only the
+    // cost of faulting it into the new mapping is measured
+    mx_handle_t vmo;
+    if (mx_vmo_create(total, 0, &vmo) != NO_ERROR) {
+        fprintf(stderr, "error: out of memory\n");
+        return -1;
+    }
+    if (mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, total, NULL, 0) != NO_ERROR) {
+        fprintf(stderr, "error: cannot commit %zu bytes\n", total);
+        mx_handle_close(vmo);
+        return -1;
+    }
+
+    size_t pages = total / PAGE_SIZE;
+    mx_time_t base, around;
+    if (mscan_pass(vmo, total, 0, &base) != NO_ERROR ||
+        mscan_pass(vmo, total, MX_VM_FLAG_FAULT_AROUND, &around) != NO_ERROR) {
+        fprintf(stderr, "error: cannot map vmo\n");
+        mx_handle_close(vmo);
+        return -1;
+    }
+    mx_handle_close(vmo);
+
+    fprintf(stderr, "scan %zu pages, per-page faults:  %" PRIu64 " ns (%" PRIu64 " ns/page): ",
+            pages, base, base / pages);
+    bytes_per_second(total, base);
+    fprintf(stderr, "scan %zu pages, fault-around:     %" PRIu64 " ns (%" PRIu64 " ns/page): ",
+            pages, around, around / pages);
+    bytes_per_second(total, around);
+    fprintf(stderr, "(use 'k vm faultstats' for kernel fault counts)\n");
+    return 0;
+}
+
 int usage(void) {
     fprintf(stderr,
             "usage: iotime <op>...\n\n"
             "   op: lread <device> <bytes> <bufsize>   posix linear read\n"
             "       bread <device> <bytes> <bufsize>   block linear read\n"
-            "       fread <device> <bytes> <bufsize>   fifo linear read\n");
+            "       fread <device> <bytes> <bufsize>   fifo linear read\n"
+            "       mscan <bytes>                      mapped vmo scan, with and without fault-around\n");
     return -1;
 }
 
@@ -269,6 +338,8 @@ int main(int argc, char** argv) {
         return iotime_bread(argc, argv);
     } else if (!strcmp(argv[1], "fread")) {
         return iotime_fread(argc, argv);
+    } else if (!strcmp(argv[1], "mscan")) {
+        return iotime_mscan(argc, argv);
     } else {
         return usage();
     }
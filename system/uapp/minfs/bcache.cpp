@@ -5,10 +5,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <fs/trace.h>
 
+#ifdef __Fuchsia__
+#include <magenta/syscalls.h>
+#include <mxtl/auto_lock.h>
+#endif
 #include <magenta/new.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
@@ -18,7 +23,33 @@
 
 namespace minfs {
 
-mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
+// Holds the cache's lock for the lifetime of the object. The host-side tool is
+// single threaded, and the cache has no lock there.
+class Bcache::AutoLock {
+public:
+#ifdef __Fuchsia__
+    explicit AutoLock(Bcache* bc) : lock_(&bc->lock_) {}
+private:
+    mxtl::AutoLock lock_;
+#else
+    explicit AutoLock(Bcache* bc) {}
+#endif
+};
+
+constexpr uint32_t kModeFind = 0;
+constexpr uint32_t kModeLoad = 1;
+constexpr uint32_t kModeZero = 2;
+
+static const char* modestr(uint32_t mode) {
+    switch (mode) {
+    case kModeFind: return "FIND";
+    case kModeLoad: return "LOAD";
+    case kModeZero: return "ZERO";
+    default: return "????";
+    }
+}
+
+mx_status_t Bcache::ReadDisk(uint32_t bno, void* data) {
     off_t off = bno * kMinfsBlockSize;
     trace(IO, "readblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
     if (lseek(fd_, off, SEEK_SET) < 0) {
@@ -32,7 +63,7 @@ mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
     return NO_ERROR;
 }
 
-mx_status_t Bcache::Writeblk(uint32_t bno, const void* data) {
+mx_status_t Bcache::WriteDisk(uint32_t bno, const void* data) {
     off_t off = bno * kMinfsBlockSize;
     trace(IO, "writeblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
     if (lseek(fd_, off, SEEK_SET) < 0) {
@@ -46,20 +77,92 @@ mx_status_t Bcache::Writeblk(uint32_t bno, const void* data) {
     return NO_ERROR;
 }
 
-constexpr uint32_t kModeFind = 0;
-constexpr uint32_t kModeLoad = 1;
-constexpr uint32_t kModeZero = 2;
+mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
+    AutoLock lock(this);
+    auto blk = hash_.find(bno);
+    if (blk.IsValid()) {
+        memcpy(data, blk->data(), blocksize_);
+        return NO_ERROR;
+    }
+    return ReadDisk(bno, data);
+}
 
-static const char* modestr(uint32_t mode) {
-    switch (mode) {
-    case kModeFind: return "FIND";
-    case kModeLoad: return "LOAD";
-    case kModeZero: return "ZERO";
-    default: return "????";
+mx_status_t Bcache::Writeblk(uint32_t bno, const void* data) {
+    AutoLock lock(this);
+    if (bno >= blockmax_) {
+        return ERR_OUT_OF_RANGE;
+    }
+    mxtl::RefPtr<BlockNode> blk = GetLocked(bno, kModeZero);
+    if (blk == nullptr) {
+        // No block could be freed up to hold the data; write it through.
+        return WriteDisk(bno, data);
     }
+    memcpy(blk->data(), data, blocksize_);
+    PutLocked(mxtl::move(blk), kBlockDirty);
+    return NO_ERROR;
+}
+
+bool Bcache::IsDirty(uint32_t bno) {
+    AutoLock lock(this);
+    auto blk = hash_.find(bno);
+    return blk.IsValid() && (blk->flags_ & kBlockDirty);
+}
+
+#ifdef __Fuchsia__
+mx_status_t Bcache::AttachVmo(mx_handle_t vmo, vmoid_t* out) {
+    if (!HasFifo()) {
+        return ERR_NOT_SUPPORTED;
+    }
+    mx_handle_t xfer_vmo;
+    mx_status_t status = mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &xfer_vmo);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    ssize_t r = ioctl_block_attach_vmo(fd_, &xfer_vmo, out);
+    if (r < 0) {
+        return static_cast<mx_status_t>(r);
+    }
+    return NO_ERROR;
 }
 
+mx_status_t Bcache::DetachVmo(vmoid_t vmoid) {
+    if (!HasFifo()) {
+        return ERR_NOT_SUPPORTED;
+    }
+    block_fifo_request_t request;
+    memset(&request, 0, sizeof(request));
+    request.vmoid = vmoid;
+    request.opcode = BLOCKIO_CLOSE_VMO;
+    return Txn(&request, 1);
+}
+
+mx_status_t Bcache::Txn(block_fifo_request_t* requests, size_t count) {
+    mxtl::AutoLock lock(&txn_lock_);
+    return TxnLocked(requests, count);
+}
+
+mx_status_t Bcache::TxnLocked(block_fifo_request_t* requests, size_t count) {
+    if (!HasFifo()) {
+        return ERR_NOT_SUPPORTED;
+    }
+    for (size_t i = 0; i < count; i++) {
+        requests[i].txnid = txnid_;
+        trace(IO, "txn() op=%u vmoid=%u len=%llu vmo_off=%#llx dev_off=%#llx\n",
+              requests[i].opcode, requests[i].vmoid,
+              (unsigned long long)requests[i].length,
+              (unsigned long long)requests[i].vmo_offset,
+              (unsigned long long)requests[i].dev_offset);
+    }
+    mx_status_t status = block_fifo_txn(fifo_client_, requests, count);
+    if (status != NO_ERROR) {
+        error("minfs: block fifo transaction failed: %d\n", status);
+    }
+    return status;
+}
+#endif
+
 void Bcache::Invalidate() {
+    AutoLock lock(this);
     mxtl::RefPtr<BlockNode> blk;
     uint32_t n = 0;
     while ((blk = lists_.PopFront(kBlockLRU)) != nullptr) {
@@ -72,19 +175,47 @@ void Bcache::Invalidate() {
     trace(BCACHE, "[ %d blocks dropped ]\n", n);
 }
 
-mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno, uint32_t mode) {
+void Bcache::MarkDirtyLocked(BlockNode* blk) {
+    // A write back already under way has the old contents
+    blk->flags_ &= ~kBlockFlushing;
+    if (blk->flags_ & kBlockDirty) {
+        return;
+    }
+    blk->flags_ |= kBlockDirty;
+    dirty_count_++;
+#ifdef __Fuchsia__
+    // Wake the flusher when it has a new deadline, or when it's time to flush
+    if (dirty_count_ == 1) {
+        first_dirty_ = mx_time_get(MX_CLOCK_MONOTONIC);
+        cnd_signal(&flusher_cond_);
+    } else if (dirty_count_ == kMinfsWritebackBlocks) {
+        cnd_signal(&flusher_cond_);
+    }
+#endif
+}
+
+mxtl::RefPtr<BlockNode> Bcache::GetLocked(uint32_t bno, uint32_t mode) {
     trace(BCACHE,"bcache_get() bno=%u %s\n", bno, modestr(mode));
     if (bno >= blockmax_) {
         return nullptr;
     }
     mxtl::RefPtr<BlockNode> blk = hash_.find(bno).CopyPointer();
+#ifdef __Fuchsia__
+    // Someone else has the block; wait for them to put it back. It may be
+    // reassigned by the time we wake, so look it up again.
+    while ((blk != nullptr) && (blk->flags_ & kBlockBusy)) {
+        blk = nullptr;
+        cnd_wait(&busy_cond_, lock_.GetInternal());
+        blk = hash_.find(bno).CopyPointer();
+    }
+#endif
     if (blk != nullptr) {
-        // remove from lru
-        assert(blk->flags_ & kBlockLRU);
+        // remove from lru or writeback list
+        assert(blk->flags_ & (kBlockLRU | kBlockWriteback));
         assert(!(blk->flags_ & kBlockBusy));
-        lists_.Erase(blk, kBlockLRU);
+        lists_.Erase(blk, blk->flags_ & (kBlockLRU | kBlockWriteback));
         if (mode == kModeZero) {
-            blk->flags_ |= kBlockDirty;
+            MarkDirtyLocked(blk.get());
             memset(blk->data(), 0, blocksize_);
         }
         goto done;
@@ -98,16 +229,27 @@ mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno, uint32_t mode) {
             // remove from hash, bno to be reassigned
             hash_.erase(*blk);
         } else {
-            panic("bcache: out of blocks\n");
+            // Every block is either busy or dirty. Writing back the dirty
+            // ones makes them clean, and available for re-use. The flush may
+            // drop the lock, so someone else may have loaded the block by
+            // the time it's done; start over.
+            if ((FlushLocked() != NO_ERROR) || lists_.IsEmpty(kBlockLRU)) {
+                error("bcache: out of blocks\n");
+                return nullptr;
+            }
+            return GetLocked(bno, mode);
         }
         blk->bno_ = bno;
         hash_.insert(blk);
         assert(hash_.size() <= kMinfsBlockCacheSize);
         if (mode == kModeZero) {
-            blk->flags_ |= kBlockDirty;
+            MarkDirtyLocked(blk.get());
             memset(blk->data(), 0, blocksize_);
-        } else if (Readblk(bno, blk->data()) < 0) {
-            panic("bcache: bno %u read error!\n", bno);
+        } else if (ReadDisk(bno, blk->data()) != NO_ERROR) {
+            error("bcache: bno %u read error!\n", bno);
+            hash_.erase(*blk);
+            lists_.PushBack(mxtl::move(blk), kBlockFree);
+            return nullptr;
         }
     }
 done:
@@ -119,25 +261,36 @@ done:
 }
 
 mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno) {
-    return Get(bno, kModeLoad);
+    AutoLock lock(this);
+    return GetLocked(bno, kModeLoad);
 }
 
 mxtl::RefPtr<BlockNode> Bcache::GetZero(uint32_t bno) {
-    return Get(bno, kModeZero);
+    AutoLock lock(this);
+    return GetLocked(bno, kModeZero);
 }
 
-void Bcache::Put(mxtl::RefPtr<BlockNode> blk, uint32_t flags) {
+void Bcache::PutLocked(mxtl::RefPtr<BlockNode> blk, uint32_t flags) {
     trace(BCACHE, "bcache_put() bno=%u%s\n", blk->bno_, (flags & kBlockDirty) ? " DIRTY" : "");
     assert(blk->flags_ & kBlockBusy);
     // remove from busy list
     lists_.Erase(blk, kBlockBusy);
-    if ((flags | blk->flags_) & kBlockDirty) {
-        if (Writeblk(blk->bno_, blk->data()) < 0) {
-            error("block write error!\n");
-        }
-        blk->flags_ &= ~kBlockDirty;
+    if (flags & kBlockDirty) {
+        MarkDirtyLocked(blk.get());
+    }
+    if (blk->flags_ & kBlockDirty) {
+        lists_.PushBack(mxtl::move(blk), kBlockWriteback);
+    } else {
+        lists_.PushBack(mxtl::move(blk), kBlockLRU);
     }
-    lists_.PushBack(mxtl::move(blk), kBlockLRU);
+#ifdef __Fuchsia__
+    cnd_broadcast(&busy_cond_);
+#endif
+}
+
+void Bcache::Put(mxtl::RefPtr<BlockNode> blk, uint32_t flags) {
+    AutoLock lock(this);
+    PutLocked(mxtl::move(blk), flags);
 }
 
 mx_status_t Bcache::Read(uint32_t bno, void* data, uint32_t off, uint32_t len) {
@@ -145,11 +298,12 @@ mx_status_t Bcache::Read(uint32_t bno, void* data, uint32_t off, uint32_t len) {
     if ((off > blocksize_) || ((blocksize_ - off) < len)) {
         return ERR_INVALID_ARGS;
     }
-    mxtl::RefPtr<BlockNode> blk = Get(bno);
+    AutoLock lock(this);
+    mxtl::RefPtr<BlockNode> blk = GetLocked(bno, kModeLoad);
     if (blk != nullptr) {
         void* bdata_src = (void*)((uintptr_t)blk->data() + off);
         memcpy(data, bdata_src, len);
-        Put(mxtl::move(blk), 0);
+        PutLocked(mxtl::move(blk), 0);
         return 0;
     } else {
         return ERR_IO;
@@ -161,18 +315,198 @@ mx_status_t Bcache::Write(uint32_t bno, const void* data, uint32_t off, uint32_t
     if ((off > blocksize_) || ((blocksize_ - off) < len)) {
         return ERR_INVALID_ARGS;
     }
-    mxtl::RefPtr<BlockNode> blk = Get(bno);
+    AutoLock lock(this);
+    // Overwriting a whole block doesn't need its old contents
+    uint32_t mode = ((off == 0) && (len == blocksize_)) ? kModeZero : kModeLoad;
+    mxtl::RefPtr<BlockNode> blk = GetLocked(bno, mode);
     if (blk != nullptr) {
         void* bdata_src = (void*)((uintptr_t)blk->data() + off);
         memcpy(bdata_src, data, len);
-        Put(mxtl::move(blk), kBlockDirty);
+        PutLocked(mxtl::move(blk), kBlockDirty);
         return 0;
     } else {
         return ERR_IO;
     }
 }
 
+static int CompareBno(const void* a, const void* b) {
+    uint32_t bno_a = (*static_cast<BlockNode* const*>(a))->GetKey();
+    uint32_t bno_b = (*static_cast<BlockNode* const*>(b))->GetKey();
+    return (bno_a < bno_b) ? -1 : (bno_a > bno_b);
+}
+
+mx_status_t Bcache::FlushLocked() {
+#ifdef __Fuchsia__
+    // The blocks in flight and the flush VMO belong to one flush at a time
+    while (flushing_) {
+        cnd_wait(&flush_cond_, lock_.GetInternal());
+    }
+#endif
+    BlockNode** blocks = flush_blocks_.get();
+    size_t count = 0;
+    lists_.ForEach(kBlockWriteback, [blocks, &count](BlockNode* blk) {
+        blk->flags_ |= kBlockFlushing;
+        blocks[count++] = blk;
+    });
+    if (count == 0) {
+        return NO_ERROR;
+    }
+    trace(BCACHE, "bcache_flush() %zu blocks\n", count);
+
+    // Writing blocks in order lets neighbours be merged into one request, and
+    // is kinder to spinning disks either way.
+    qsort(blocks, count, sizeof(BlockNode*), CompareBno);
+
+    mx_status_t status = NO_ERROR;
+#ifdef __Fuchsia__
+    if (flush_vmo_ != MX_HANDLE_INVALID) {
+        flushing_ = true;
+        status = FlushFifoLocked(blocks, count);
+        flushing_ = false;
+        cnd_broadcast(&flush_cond_);
+    } else
+#endif
+    {
+        for (size_t i = 0; (i < count) && (status == NO_ERROR); i++) {
+            status = WriteDisk(blocks[i]->bno_, blocks[i]->data());
+        }
+    }
+
+    // Dirty blocks stay on the writeback list (or busy) until they are
+    // written, so nothing in flight was reassigned. Those which were dirtied
+    // again, or are busy now, stay dirty for the next flush.
+    uint32_t cleaned = 0;
+    for (size_t i = 0; i < count; i++) {
+        BlockNode* blk = blocks[i];
+        bool written = (status == NO_ERROR) && (blk->flags_ & kBlockFlushing) &&
+                       (blk->flags_ & kBlockWriteback);
+        blk->flags_ &= ~kBlockFlushing;
+        if (!written) {
+            continue;
+        }
+        mxtl::RefPtr<BlockNode> ref = lists_.Erase(mxtl::RefPtr<BlockNode>(blk), kBlockWriteback);
+        ref->flags_ &= ~kBlockDirty;
+        lists_.PushBack(mxtl::move(ref), kBlockLRU);
+        cleaned++;
+    }
+    assert(dirty_count_ >= cleaned);
+    dirty_count_ -= cleaned;
+
+    if (status != NO_ERROR) {
+        error("minfs: failed to write back %zu blocks: %d\n", count, status);
+    }
+    return status;
+}
+
+#ifdef __Fuchsia__
+// The blocks are copied into the flush VMO back to back, so blocks which are
+// adjacent on disk are adjacent in the VMO too, and are written with a single
+// request. Requests are sent in batches of up to MAX_TXN_MESSAGES.
+mx_status_t Bcache::FlushFifoLocked(BlockNode** blocks, size_t count) {
+    mx_status_t status;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t vmo_offset = static_cast<uint64_t>(i) * blocksize_;
+        size_t actual;
+        if ((status = mx_vmo_write(flush_vmo_, blocks[i]->data(), vmo_offset, blocksize_,
+                                   &actual)) != NO_ERROR) {
+            return status;
+        } else if (actual != blocksize_) {
+            return ERR_IO;
+        }
+    }
+
+    // The VMO now holds what is being written back, so the cache can be used
+    // while the device works. The blocks keep their block numbers while
+    // they are dirty.
+    lock_.Release();
+    {
+        mxtl::AutoLock txn_lock(&txn_lock_);
+        block_fifo_request_t requests[MAX_TXN_MESSAGES];
+        size_t n = 0;
+        status = NO_ERROR;
+        for (size_t i = 0; (i < count) && (status == NO_ERROR); i++) {
+            uint64_t vmo_offset = static_cast<uint64_t>(i) * blocksize_;
+            uint64_t dev_offset = static_cast<uint64_t>(blocks[i]->bno_) * blocksize_;
+            if ((n > 0) && (requests[n - 1].dev_offset + requests[n - 1].length == dev_offset)) {
+                // Extend the previous request
+                requests[n - 1].length += blocksize_;
+                continue;
+            }
+            if (n == MAX_TXN_MESSAGES) {
+                status = TxnLocked(requests, n);
+                n = 0;
+            }
+            requests[n].vmoid = flush_vmoid_;
+            requests[n].opcode = BLOCKIO_WRITE;
+            requests[n].length = blocksize_;
+            requests[n].vmo_offset = vmo_offset;
+            requests[n].dev_offset = dev_offset;
+            n++;
+        }
+        if ((status == NO_ERROR) && (n > 0)) {
+            status = TxnLocked(requests, n);
+        }
+    }
+    lock_.Acquire();
+    return status;
+}
+
+int Bcache::FlusherThread(void* arg) {
+    static_cast<Bcache*>(arg)->Flusher();
+    return 0;
+}
+
+void Bcache::Flusher() {
+    AutoLock lock(this);
+    // After a flush fails, or leaves the cache over the writeback threshold
+    // (say, because the blocks were busy), nothing more is flushed until
+    // this time, so a failing device doesn't have us spinning on the lock.
+    mx_time_t backoff = 0;
+    while (!flusher_stop_) {
+        if (dirty_count_ == 0) {
+            cnd_wait(&flusher_cond_, lock_.GetInternal());
+            continue;
+        }
+
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        mx_time_t deadline = first_dirty_ + kMinfsWritebackDelay;
+        if (dirty_count_ >= kMinfsWritebackBlocks) {
+            deadline = now;
+        }
+        if (deadline < backoff) {
+            deadline = backoff;
+        }
+        if (now >= deadline) {
+            // Errors are logged by FlushLocked. The blocks it couldn't write
+            // back stay dirty, with their original deadline, and are tried
+            // again once the backoff expires.
+            if (FlushLocked() != NO_ERROR) {
+                backoff = now + kMinfsWritebackDelay;
+                continue;
+            }
+            first_dirty_ = now;
+            if (dirty_count_ >= kMinfsWritebackBlocks) {
+                backoff = now + kMinfsWritebackDelay;
+            }
+            continue;
+        }
+
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        uint64_t nsec = ts.tv_nsec + (deadline - now);
+        ts.tv_sec += nsec / MX_SEC(1);
+        ts.tv_nsec = nsec % MX_SEC(1);
+        cnd_timedwait(&flusher_cond_, lock_.GetInternal(), &ts);
+    }
+}
+#endif
+
 int Bcache::Sync() {
+    AutoLock lock(this);
+    mx_status_t status = FlushLocked();
+    if (status != NO_ERROR) {
+        return status;
+    }
     return fsync(fd_);
 }
 
@@ -183,6 +517,14 @@ mx_status_t Bcache::Create(Bcache** out, int fd, uint32_t blockmax, uint32_t blo
     if (!ac.check()) {
         return ERR_NO_MEMORY;
     }
+    // Every block may need flushing at once
+    bc->flush_blocks_.reset(new (&ac) BlockNode*[num]);
+    if (!ac.check()) {
+        return ERR_NO_MEMORY;
+    }
+#ifdef __Fuchsia__
+    size_t flush_vmo_size = static_cast<size_t>(num) * blocksize;
+#endif
     while (num > 0) {
         mx_status_t status;
         if ((status = BlockNode::Create(bc.get())) != NO_ERROR) {
@@ -190,20 +532,100 @@ mx_status_t Bcache::Create(Bcache** out, int fd, uint32_t blockmax, uint32_t blo
         }
         num--;
     }
+#ifdef __Fuchsia__
+    // Not every block device speaks the FIFO protocol; if this one doesn't,
+    // the cache falls back to reading and writing through "fd".
+    mx_handle_t fifo;
+    if (ioctl_block_get_fifos(fd, &fifo) == sizeof(fifo)) {
+        mx_status_t status;
+        if (ioctl_block_alloc_txn(fd, &bc->txnid_) != sizeof(bc->txnid_)) {
+            mx_handle_close(fifo);
+            ioctl_block_fifo_close(fd);
+        } else if ((status = block_fifo_create_client(fifo, &bc->fifo_client_)) != NO_ERROR) {
+            ioctl_block_free_txn(fd, &bc->txnid_);
+            mx_handle_close(fifo);
+            ioctl_block_fifo_close(fd);
+            return status;
+        }
+    }
+    if (bc->HasFifo()) {
+        // Without the flush VMO, dirty blocks are written back through "fd".
+        if (mx_vmo_create(flush_vmo_size, 0, &bc->flush_vmo_) != NO_ERROR) {
+            bc->flush_vmo_ = MX_HANDLE_INVALID;
+        } else if (bc->AttachVmo(bc->flush_vmo_, &bc->flush_vmoid_) != NO_ERROR) {
+            mx_handle_close(bc->flush_vmo_);
+            bc->flush_vmo_ = MX_HANDLE_INVALID;
+        }
+    }
+    // Without the flusher, dirty blocks are still written back when the cache
+    // runs out of clean blocks, and by Sync and Close.
+    bc->flusher_running_ = (thrd_create_with_name(&bc->flusher_, FlusherThread, bc.get(),
+                                                  "minfs-flusher") == thrd_success);
+#endif
     *out = bc.release();
     return NO_ERROR;
 }
 
 int Bcache::Close() {
+#ifdef __Fuchsia__
+    if (flusher_running_) {
+        {
+            AutoLock lock(this);
+            flusher_stop_ = true;
+            cnd_signal(&flusher_cond_);
+        }
+        thrd_join(flusher_, nullptr);
+        flusher_running_ = false;
+    }
+#endif
+    int r = Sync();
+    if (r != 0) {
+        error("minfs: failed to sync on close: %d\n", r);
+    }
+#ifdef __Fuchsia__
+    if (flush_vmo_ != MX_HANDLE_INVALID) {
+        DetachVmo(flush_vmoid_);
+        mx_handle_close(flush_vmo_);
+        flush_vmo_ = MX_HANDLE_INVALID;
+    }
+    if (fifo_client_ != nullptr) {
+        ioctl_block_free_txn(fd_, &txnid_);
+        block_fifo_release_client(fifo_client_);
+        ioctl_block_fifo_close(fd_);
+        fifo_client_ = nullptr;
+    }
+#endif
     return close(fd_);
 }
 
 Bcache::Bcache(int fd, uint32_t blockmax, uint32_t blocksize) :
-    fd_(fd), blockmax_(blockmax), blocksize_(blocksize) {}
-Bcache::~Bcache() {}
+    fd_(fd), blockmax_(blockmax), blocksize_(blocksize), dirty_count_(0) {
+#ifdef __Fuchsia__
+    fifo_client_ = nullptr;
+    txnid_ = 0;
+    flush_vmo_ = MX_HANDLE_INVALID;
+    flush_vmoid_ = 0;
+    first_dirty_ = 0;
+    flusher_running_ = false;
+    flusher_stop_ = false;
+    flushing_ = false;
+    cnd_init(&flusher_cond_);
+    cnd_init(&busy_cond_);
+    cnd_init(&flush_cond_);
+#endif
+}
+
+Bcache::~Bcache() {
+#ifdef __Fuchsia__
+    cnd_destroy(&flusher_cond_);
+    cnd_destroy(&busy_cond_);
+    cnd_destroy(&flush_cond_);
+#endif
+}
 
 size_t BcacheLists::SizeAllSlow() const {
-    return list_busy_.size_slow() + list_lru_.size_slow() + list_free_.size_slow();
+    return list_busy_.size_slow() + list_lru_.size_slow() + list_free_.size_slow() +
+           list_writeback_.size_slow();
 }
 
 void BcacheLists::PushBack(mxtl::RefPtr<BlockNode> blk, uint32_t block_type) {
@@ -236,9 +658,10 @@ mxtl::RefPtr<BlockNode> BcacheLists::Erase(mxtl::RefPtr<BlockNode> blk, uint32_t
 
 BcacheLists::LinkedList* BcacheLists::GetList(uint32_t block_type) {
     switch (block_type) {
-        case kBlockBusy : return &list_busy_;
-        case kBlockLRU  : return &list_lru_;
-        case kBlockFree : return &list_free_;
+        case kBlockBusy      : return &list_busy_;
+        case kBlockLRU       : return &list_lru_;
+        case kBlockFree      : return &list_free_;
+        case kBlockWriteback : return &list_writeback_;
     }
     assert(false); // Invalid Block Cache List
     return nullptr;
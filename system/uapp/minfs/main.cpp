@@ -386,7 +386,13 @@ found:
 
     for (unsigned i = 0; i < countof(CMDS); i++) {
         if (!strcmp(cmd, CMDS[i].name)) {
-            return CMDS[i].func(bc, argc - 3, argv + 3);
+            int r = CMDS[i].func(bc, argc - 3, argv + 3);
+            // Write back whatever the command left in the block cache
+            if (bc->Sync() != 0) {
+                fprintf(stderr, "minfs: failed to sync block device\n");
+                return -1;
+            }
+            return r;
         }
     }
     return -1;
@@ -12,6 +12,7 @@
 #include <sys/stat.h>
 
 #include <mxtl/algorithm.h>
+#include <mxtl/auto_lock.h>
 #include <magenta/device/vfs.h>
 
 #ifdef __Fuchsia__
@@ -126,6 +127,7 @@ void VnodeMinfs::InodeSync(uint32_t flags) {
 // Delete all blocks (relative to a file) from "start" (inclusive) to the end of
 // the file. Does not update mtime/atime.
 mx_status_t VnodeMinfs::BlocksShrink(uint32_t start) {
+    mxtl::AutoLock lock(&fs_->block_lock_);
     mxtl::RefPtr<BlockNode> bitmap_blk = nullptr;
 
     bool doSync = false;
@@ -215,9 +217,9 @@ mx_status_t VnodeMinfs::BlocksShrink(uint32_t start) {
 
 #ifdef __Fuchsia__
 // Read data from disk at block 'bno', into the 'nth' logical block of the file.
+// Only used if the block device can't read into the VMO directly, or if the
+// block cache holds a newer copy of the block than the disk does.
 mx_status_t VnodeMinfs::FillBlock(uint32_t n, uint32_t bno) {
-    // TODO(smklein): read directly from block device into vmo; no need to copy
-    // into an intermediate buffer.
     char bdata[kMinfsBlockSize];
     if (fs_->bc_->Readblk(bno, bdata)) {
         return ERR_IO;
@@ -230,12 +232,8 @@ mx_status_t VnodeMinfs::FillBlock(uint32_t n, uint32_t bno) {
 }
 
 // Since we cannot yet register the filesystem as a paging service (and cleanly
-// fault on pages when they are actually needed), we currently read an entire
-// file to a VMO when a file's data block are accessed.
-//
-// TODO(smklein): Even this hack can be optimized; a bitmap could be used to
-// track all 'empty/read/dirty' blocks for each vnode, rather than reading
-// the entire file.
+// fault on pages when they are actually needed), the file's data blocks are
+// read into a VMO when they are first accessed; see PopulateVmo.
 mx_status_t VnodeMinfs::InitVmo() {
     if (vmo_ != MX_HANDLE_INVALID) {
         return NO_ERROR;
@@ -246,44 +244,75 @@ mx_status_t VnodeMinfs::InitVmo() {
         error("Failed to initialize vmo; error: %d\n", status);
         return status;
     }
+    vmo_resident_.ClearAll();
 
-    // Initialize all direct blocks
-    uint32_t bno;
-    for (uint32_t d = 0; d < kMinfsDirect; d++) {
-        if ((bno = inode_.dnum[d]) != 0) {
-            if ((status = FillBlock(d, bno)) != NO_ERROR) {
-                error("Failed to fill bno %u; error: %d\n", bno, status);
-                return status;
-            }
+    if (fs_->bc_->HasFifo()) {
+        if ((status = fs_->bc_->AttachVmo(vmo_, &vmoid_)) != NO_ERROR) {
+            error("Failed to attach vmo; error: %d\n", status);
+            mx_handle_close(vmo_);
+            vmo_ = MX_HANDLE_INVALID;
+            return status;
         }
+        vmo_attached_ = true;
     }
+    return NO_ERROR;
+}
 
-    // Initialize all indirect blocks
-    for (uint32_t i = 0; i < kMinfsIndirect; i++) {
-        uint32_t ibno;
-        mxtl::RefPtr<BlockNode> iblk;
-        if ((ibno = inode_.inum[i]) != 0) {
-            // TODO(smklein): Should there be a separate vmo for indirect blocks?
-            if ((iblk = fs_->bc_->Get(ibno)) == nullptr) {
-                return ERR_IO;
+// Blocks which are contiguous both in the file and on disk are read with a
+// single request, and the requests are sent to the block device in batches of
+// up to MAX_TXN_MESSAGES. Unallocated blocks are holes, and left zeroed.
+mx_status_t VnodeMinfs::PopulateVmo(uint32_t start, uint32_t end) {
+    block_fifo_request_t requests[MAX_TXN_MESSAGES];
+    size_t count = 0;
+    mx_status_t status;
+
+    size_t n = start;
+    while (n < end) {
+        // Skip blocks which are already resident
+        if (vmo_resident_.Get(n, end, &n)) {
+            break;
+        }
+
+        uint32_t bno;
+        if ((status = GetBno(static_cast<uint32_t>(n), &bno, false)) != NO_ERROR) {
+            return status;
+        }
+        if (bno == 0) {
+            // Nothing to read for a hole
+        } else if (!vmo_attached_ || fs_->bc_->IsDirty(bno)) {
+            // A block which hasn't been written back yet must come from the
+            // block cache, not the device
+            if ((status = FillBlock(static_cast<uint32_t>(n), bno)) != NO_ERROR) {
+                return status;
             }
-            uint32_t* ientry = static_cast<uint32_t*>(iblk->data());
-
-            const uint32_t direct_per_indirect = kMinfsBlockSize / sizeof(uint32_t);
-            for (uint32_t j = 0; j < direct_per_indirect; j++) {
-                if ((bno = ientry[j]) != 0) {
-                    uint32_t n = kMinfsDirect + i * direct_per_indirect + j;
-                    if ((status = FillBlock(n, bno)) != NO_ERROR) {
-                        fs_->bc_->Put(iblk, 0);
-                        return status;
-                    }
+        } else if ((count > 0) &&
+                   (requests[count - 1].vmo_offset + requests[count - 1].length ==
+                    n * kMinfsBlockSize) &&
+                   (requests[count - 1].dev_offset + requests[count - 1].length ==
+                    static_cast<uint64_t>(bno) * kMinfsBlockSize)) {
+            // Extend the previous request
+            requests[count - 1].length += kMinfsBlockSize;
+        } else {
+            if (count == MAX_TXN_MESSAGES) {
+                if ((status = fs_->bc_->Txn(requests, count)) != NO_ERROR) {
+                    return status;
                 }
+                count = 0;
             }
-            fs_->bc_->Put(iblk, 0);
+            requests[count].vmoid = vmoid_;
+            requests[count].opcode = BLOCKIO_READ;
+            requests[count].length = kMinfsBlockSize;
+            requests[count].vmo_offset = n * kMinfsBlockSize;
+            requests[count].dev_offset = static_cast<uint64_t>(bno) * kMinfsBlockSize;
+            count++;
         }
+        n++;
     }
 
-    return NO_ERROR;
+    if ((count > 0) && ((status = fs_->bc_->Txn(requests, count)) != NO_ERROR)) {
+        return status;
+    }
+    return vmo_resident_.Set(start, end);
 }
 #endif
 
@@ -545,13 +574,17 @@ static mx_status_t cb_dir_unlink(mxtl::RefPtr<VnodeMinfs> vndir, minfs_dirent_t*
     if ((args->type == kMinfsTypeDir) && !vn->IsDirectory()) {
         return ERR_NOT_DIR;
     }
+    // The caller holds the parent's lock; the child is locked after it, since
+    // both its dirent count and its link count are examined and changed.
+    fs::AutoWriterLock lock(vn->lock());
     if (!vn->CanUnlink()) {
         return ERR_BAD_STATE;
     }
     return vndir->UnlinkChild(mxtl::move(vn), de, offs);
 }
 
-// same as unlink, but do not validate vnode
+// same as unlink, but do not validate vnode. The caller holds the lock of the
+// vnode being unlinked.
 static mx_status_t cb_dir_force_unlink(mxtl::RefPtr<VnodeMinfs> vndir, minfs_dirent_t* de,
                                        DirArgs* args, DirectoryOffset* offs) {
     if ((de->ino == 0) || (args->len != de->namelen) ||
@@ -593,7 +626,12 @@ static mx_status_t cb_dir_attempt_rename(mxtl::RefPtr<VnodeMinfs> vndir, minfs_d
     } else if (args->type != de->type) {
         // cannot rename directory to file (or vice versa)
         return ERR_BAD_STATE;
-    } else if (!vn->CanUnlink()) {
+    }
+
+    // The caller has ruled out the target being the (already locked) source
+    // directory, so it may be locked after both parents.
+    fs::AutoWriterLock lock(vn->lock());
+    if (!vn->CanUnlink()) {
         // if we cannot unlink the target, we cannot rename the target
         return ERR_BAD_STATE;
     }
@@ -724,12 +762,16 @@ mx_status_t VnodeMinfs::ForEachDirent(DirArgs* args,
 }
 
 VnodeMinfs::~VnodeMinfs() {
+    // Leave the hash before the inode can be freed and handed out again
+    fs_->VnodeRelease(this);
+
     if (inode_.link_count == 0) {
         InodeDestroy();
     }
-
-    fs_->VnodeRelease(this);
 #ifdef __Fuchsia__
+    if (vmo_attached_) {
+        fs_->bc_->DetachVmo(vmoid_);
+    }
     mx_handle_close(vmo_);
 #endif
 }
@@ -773,8 +815,20 @@ mx_status_t VnodeMinfs::ReadInternal(void* data, size_t len, size_t off, size_t*
 
     mx_status_t status;
 #ifdef __Fuchsia__
+    // Read ahead of the request (but not past the end of the file), so that
+    // sequential reads reach the disk in large requests.
+    uint32_t start = static_cast<uint32_t>(off / kMinfsBlockSize);
+    uint32_t end = static_cast<uint32_t>(mxtl::roundup(off + len, kMinfsBlockSize) /
+                                         kMinfsBlockSize);
+    uint32_t file_end = static_cast<uint32_t>(mxtl::roundup(inode_.size, kMinfsBlockSize) /
+                                              kMinfsBlockSize);
+    end = mxtl::min(mxtl::max(end, start + kMinfsReadaheadBlocks), file_end);
+
+    mxtl::AutoLock lock(&vmo_lock_);
     if ((status = InitVmo()) != NO_ERROR) {
         return status;
+    } else if ((status = PopulateVmo(start, end)) != NO_ERROR) {
+        return status;
     } else if ((status = mx_vmo_read(vmo_, data, off, len, actual)) != NO_ERROR) {
         return status;
     }
@@ -873,10 +927,17 @@ mx_status_t VnodeMinfs::WriteInternal(const void* data, size_t len, size_t off,
         // the file. As a consequence, an error is returned (ERR_IO) rather than
         // doing a partial read.
 
+        // A partial write is merged with the rest of the block, which must be
+        // read first if it hasn't been already.
+        if ((xfer != kMinfsBlockSize) && (PopulateVmo(n, n + 1) != NO_ERROR)) {
+            return ERR_IO;
+        }
+
         // Update this block of the in-memory VMO
         if ((status = vmo_write_exact(vmo_, data, xfer_off, xfer)) != NO_ERROR) {
             return ERR_IO;
         }
+        vmo_resident_.Set(n, n + 1);
 
         // Update this block on-disk
         char bdata[kMinfsBlockSize];
@@ -1083,7 +1144,8 @@ fail:
 }
 
 #ifdef __Fuchsia__
-VnodeMinfs::VnodeMinfs(Minfs* fs) : fs_(fs), vmo_(MX_HANDLE_INVALID) {}
+VnodeMinfs::VnodeMinfs(Minfs* fs) :
+    fs_(fs), vmo_(MX_HANDLE_INVALID), vmoid_(0), vmo_attached_(false) {}
 #else
 VnodeMinfs::VnodeMinfs(Minfs* fs) : fs_(fs) {}
 #endif
@@ -1263,6 +1325,10 @@ mx_status_t VnodeMinfs::TruncateInternal(size_t len) {
             if (bno != 0) {
                 size_t adjust = len % kMinfsBlockSize;
 #ifdef __Fuchsia__
+                uint32_t n = static_cast<uint32_t>(len / kMinfsBlockSize);
+                if ((r = PopulateVmo(n, n + 1)) != NO_ERROR) {
+                    return ERR_IO;
+                }
                 if ((r = vmo_read_exact(vmo_, bdata, len - adjust, adjust)) != NO_ERROR) {
                     return ERR_IO;
                 }
@@ -1301,13 +1367,20 @@ mx_status_t VnodeMinfs::TruncateInternal(size_t len) {
     if ((r = mx_vmo_set_size(vmo_, mxtl::roundup(len, kMinfsBlockSize))) != NO_ERROR) {
         return r;
     }
+    // Blocks past the end of the file were dropped from the VMO along with
+    // the (freed) blocks on disk.
+    vmo_resident_.Clear(mxtl::roundup(len, kMinfsBlockSize) / kMinfsBlockSize,
+                        kMinfsMaxFileBlock);
 #endif
 
     return NO_ERROR;
 }
 
 // verify that the 'newdir' inode is not a subdirectory of the source.
-static mx_status_t check_not_subdirectory(mxtl::RefPtr<VnodeMinfs> src, mxtl::RefPtr<VnodeMinfs> newdir) {
+// Both parents of the rename are locked by the caller; every other ancestor
+// is locked while its ".." is read.
+static mx_status_t check_not_subdirectory(mxtl::RefPtr<VnodeMinfs> src, VnodeMinfs* olddir,
+                                          mxtl::RefPtr<VnodeMinfs> newdir) {
     mxtl::RefPtr<VnodeMinfs> vn = newdir;
     mx_status_t status = NO_ERROR;
     while (vn->ino_ != kMinfsRootIno) {
@@ -1317,7 +1390,13 @@ static mx_status_t check_not_subdirectory(mxtl::RefPtr<VnodeMinfs> src, mxtl::Re
         }
 
         mxtl::RefPtr<fs::Vnode> out = nullptr;
-        if ((status = vn->LookupInternal(&out, "..", 2)) < 0) {
+        if ((vn.get() == olddir) || (vn == newdir)) {
+            status = vn->LookupInternal(&out, "..", 2);
+        } else {
+            fs::AutoReaderLock lock(vn->lock());
+            status = vn->LookupInternal(&out, "..", 2);
+        }
+        if (status < 0) {
             break;
         }
         vn = mxtl::RefPtr<VnodeMinfs>::Downcast(out);
@@ -1359,7 +1438,7 @@ mx_status_t VnodeMinfs::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldn
         return status;
     } else if ((status = fs_->VnodeGet(&oldvn, args.ino)) < 0) {
         return status;
-    } else if ((status = check_not_subdirectory(oldvn, newdir)) < 0) {
+    } else if ((status = check_not_subdirectory(oldvn, this, newdir)) < 0) {
         goto done;
     }
 
@@ -1369,10 +1448,21 @@ mx_status_t VnodeMinfs::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldn
         goto done;
     }
 
-    // if the entry for 'newname' exists, make sure it can be replaced by
-    // the vnode behind 'oldname'.
+    // if the entry for 'newname' is the directory holding 'oldname', it is
+    // not empty; bail out before trying to take its lock a second time.
     args.name = newname;
     args.len = newlen;
+    if ((status = newdir->ForEachDirent(&args, cb_dir_find)) == NO_ERROR) {
+        if (args.ino == ino_) {
+            status = ERR_BAD_STATE;
+            goto done;
+        }
+    } else if (status != ERR_NOT_FOUND) {
+        goto done;
+    }
+
+    // if the entry for 'newname' exists, make sure it can be replaced by
+    // the vnode behind 'oldname'.
     args.ino = oldvn->ino_;
     args.type = oldvn->IsDirectory() ? kMinfsTypeDir : kMinfsTypeFile;
     status = newdir->ForEachDirent(&args, cb_dir_attempt_rename);
@@ -1387,30 +1477,31 @@ mx_status_t VnodeMinfs::Rename(mxtl::RefPtr<fs::Vnode> _newdir, const char* oldn
         goto done;
     }
 
-    // update the oldvn's entry for '..' if (1) it was a directory, and (2) it
-    // moved to a new directory
-    if ((args.type == kMinfsTypeDir) && (ino_ != newdir->ino_)) {
-        mxtl::RefPtr<fs::Vnode> vn_fs;
-        if ((status = newdir->Lookup(&vn_fs, newname, newlen)) < 0) {
-            goto done;
-        }
-        auto vn = mxtl::RefPtr<VnodeMinfs>::Downcast(vn_fs);
-        args.name = "..";
-        args.len = 2;
-        args.ino = newdir->ino_;
-        if ((status = vn->ForEachDirent(&args, cb_dir_update_inode)) < 0) {
-            goto done;
+    {
+        // The vnode being moved is locked after both parents, since its link
+        // count (and, for a directory, its "..") changes.
+        fs::AutoWriterLock lock(oldvn->lock());
+
+        // update the oldvn's entry for '..' if (1) it was a directory, and (2) it
+        // moved to a new directory
+        if ((args.type == kMinfsTypeDir) && (ino_ != newdir->ino_)) {
+            args.name = "..";
+            args.len = 2;
+            args.ino = newdir->ino_;
+            if ((status = oldvn->ForEachDirent(&args, cb_dir_update_inode)) < 0) {
+                goto done;
+            }
         }
-    }
 
-    // at this point, the oldvn exists with multiple names (or the same name in
-    // different directories)
-    oldvn->inode_.link_count++;
+        // at this point, the oldvn exists with multiple names (or the same name in
+        // different directories)
+        oldvn->inode_.link_count++;
 
-    // finally, remove oldname from its original position
-    args.name = oldname;
-    args.len = oldlen;
-    status = ForEachDirent(&args, cb_dir_force_unlink);
+        // finally, remove oldname from its original position
+        args.name = oldname;
+        args.len = oldlen;
+        status = ForEachDirent(&args, cb_dir_force_unlink);
+    }
 done:
     return status;
 }
@@ -1454,6 +1545,7 @@ mx_status_t VnodeMinfs::Link(const char* name, size_t len, mxtl::RefPtr<fs::Vnod
     }
 
     // We have successfully added the vn to a new location. Increment the link count.
+    fs::AutoWriterLock lock(target->lock());
     target->inode_.link_count++;
     target->InodeSync(kMxFsSyncDefault);
 
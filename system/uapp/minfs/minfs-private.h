@@ -5,14 +5,17 @@
 #pragma once
 
 #include <mxtl/algorithm.h>
-#include <mxtl/intrusive_hash_table.h>
+#include <mxtl/intrusive_dynamic_hash_table.h>
 #include <mxtl/intrusive_single_list.h>
 #include <mxtl/macros.h>
+#include <mxtl/mutex.h>
+#include <mxtl/null_lock.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
 #include <fs/mapped-vmo.h>
 #ifdef __Fuchsia__
+#include <bitmap/rle-bitmap.h>
 #include <fs/vfs-dispatcher.h>
 #endif
 #include <fs/vfs.h>
@@ -29,7 +32,23 @@ constexpr uint32_t kMxFsSyncDefault = 0;     // default: no implicit time update
 constexpr uint32_t kMxFsSyncMtime   = (1<<0);
 constexpr uint32_t kMxFsSyncCtime   = (1<<1);
 
-constexpr uint32_t kMinfsBlockCacheSize = 64;
+constexpr uint32_t kMinfsBlockCacheSize = 256;
+
+// Dirty blocks are written back once this many of them have accumulated, or
+// once the oldest of them has been dirty for kMinfsWritebackDelay.
+constexpr uint32_t kMinfsWritebackBlocks = kMinfsBlockCacheSize / 2;
+constexpr mx_duration_t kMinfsWritebackDelay = MX_SEC(1);
+
+// Number of blocks of a file read from disk at once, at minimum, when reading
+// blocks which aren't yet in the file's VMO.
+constexpr uint32_t kMinfsReadaheadBlocks = 32;
+
+#ifdef __Fuchsia__
+using FsLock = mxtl::Mutex;
+#else
+// The host-side tool is single threaded.
+using FsLock = mxtl::NullLock;
+#endif
 
 // Used by fsck
 struct CheckMaps {
@@ -81,6 +100,14 @@ public:
 
     mx_status_t AddDispatcher(mx_handle_t h, vfs_iostate_t* cookie);
 
+    // The VFS only locks individual vnodes, so the state which every vnode
+    // in the filesystem shares has locks of its own. Lock order: vnode locks,
+    // block_lock_, hash_lock_, inode_lock_, and the block cache's lock last.
+    //
+    // block_lock_ guards block_map_ and the allocation bitmap on disk. Callers
+    // of BitmapBlockGet and BitmapBlockPut hold it across the whole sequence.
+    FsLock block_lock_;
+
     Bcache* bc_;
     RawBitmap block_map_;
     minfs_info_t info_;
@@ -92,6 +119,7 @@ private:
     Minfs(Bcache* bc_, minfs_info_t* info_);
     // Find a free inode, allocate it in the inode bitmap, and write it back to disk
     mx_status_t InoNew(const minfs_inode_t* inode, uint32_t* ino_out);
+    mx_status_t InodeSyncLocked(uint32_t ino, const minfs_inode_t* inode);
     mx_status_t LoadBitmaps();
 
 #ifdef __Fuchsia__
@@ -99,13 +127,17 @@ private:
 #endif
     uint32_t abmblks_;
     uint32_t ibmblks_;
+    // Guards inode_map_, the inode table, and the inode bitmap on disk.
+    FsLock inode_lock_;
     RawBitmap inode_map_;
 #ifdef __Fuchsia__
     mxtl::unique_ptr<MappedVmo> inode_table_;
 #endif
     // Vnodes exist in the hash table as long as one or more reference exists;
     // when the Vnode is deleted, it is immediately removed from the map.
-    using HashTable = mxtl::HashTable<uint32_t, VnodeMinfs*>;
+    // The table grows with the number of open vnodes.
+    using HashTable = mxtl::DynamicHashTable<uint32_t, VnodeMinfs*>;
+    FsLock hash_lock_;
     HashTable vnode_hash_;
 };
 
@@ -122,8 +154,6 @@ struct DirectoryOffset {
     size_t off_prev; // Offset in directory of previous record
 };
 
-#define INO_HASH(ino) fnv1a_tiny(ino, kMinfsHashBits)
-
 constexpr uint32_t kMinfsFlagDeletedDirectory = 0x00010000;
 constexpr uint32_t kMinfsFlagReservedMask     = 0xFFFF0000;
 
@@ -142,7 +172,7 @@ public:
     bool CanUnlink() const;
 
     uint32_t GetKey() const { return ino_; }
-    static size_t GetHash(uint32_t key) { return INO_HASH(key); }
+    static size_t GetHash(uint32_t key) { return key; }
 
     mx_status_t UnlinkChild(mxtl::RefPtr<VnodeMinfs> child, minfs_dirent_t* de, DirectoryOffset* offs);
     mx_status_t ReadInternal(void* data, size_t len, size_t off, size_t* actual);
@@ -190,6 +220,10 @@ private:
     // Read data from disk at block 'bno', into the 'nth' logical block of the file.
     mx_status_t FillBlock(uint32_t n, uint32_t bno);
 
+    // Ensure logical blocks [start, end) of the file are in the VMO, reading
+    // any which aren't from disk.
+    mx_status_t PopulateVmo(uint32_t start, uint32_t end);
+
     // Get the disk block 'bno' corresponding to the 'nth' logical block of the file.
     // Allocate the block if reqeusted.
     mx_status_t GetBno(uint32_t n, uint32_t* bno, bool alloc);
@@ -215,10 +249,21 @@ private:
     // Fuchsia (since there is no "handle-equivalent" in host-side tools).
 
     // TODO(smklein): When we have can register MinFS as a pager service, and
-    // it can properly handle pages faults on a vnode's contents, then we can
-    // avoid reading the entire file up-front. Until then, read the contents of
-    // a VMO into memory when it is read/written.
+    // it can properly handle pages faults on a vnode's contents, then the
+    // kernel can fault in blocks as they are touched. Until then, blocks are
+    // read into the VMO as they are read/written, and tracked in
+    // "vmo_resident_".
+    //
+    // Readers hold the vnode's lock shared, and fill in the VMO as they go,
+    // so they also take vmo_lock_. Anything else which touches the VMO holds
+    // the vnode's lock exclusive, which keeps the readers out.
+    FsLock vmo_lock_;
     mx_handle_t vmo_;
+    // Logical blocks of the file whose contents are in the VMO.
+    bitmap::RleBitmap vmo_resident_;
+    // Identifies the VMO to the block device, if "vmo_attached_".
+    vmoid_t vmoid_;
+    bool vmo_attached_;
 
 #endif
     // The vnode is acting as a mount point for a remote filesystem or device.
@@ -12,6 +12,7 @@
 #include <bitmap/raw-bitmap.h>
 #include <magenta/new.h>
 #include <mxtl/algorithm.h>
+#include <mxtl/auto_lock.h>
 #include <mxtl/unique_ptr.h>
 
 #include "minfs-private.h"
@@ -65,6 +66,11 @@ mx_status_t minfs_check_info(minfs_info_t* info, uint32_t max) {
 }
 
 mx_status_t Minfs::InodeSync(uint32_t ino, const minfs_inode_t* inode) {
+    mxtl::AutoLock lock(&inode_lock_);
+    return InodeSyncLocked(ino, inode);
+}
+
+mx_status_t Minfs::InodeSyncLocked(uint32_t ino, const minfs_inode_t* inode) {
     // Obtain the offset of the inode within its containing block
     uint32_t off_of_ino = (ino % kMinfsInodesPerBlock) * kMinfsInodeSize;
 #ifdef __Fuchsia__
@@ -87,24 +93,28 @@ Minfs::Minfs(Bcache* bc, minfs_info_t* info) : bc_(bc) {
 }
 
 mx_status_t Minfs::InoFree(const minfs_inode_t& inode, uint32_t ino) {
-    // locate data and block offset of bitmap
-    void *bmdata;
-    uint32_t ibm_relative_bno;
-    if ((bmdata = GetBitBlock(inode_map_, &ibm_relative_bno, ino)) == nullptr) {
-        panic("inode not in bitmap");
-    }
+    {
+        mxtl::AutoLock lock(&inode_lock_);
+        // locate data and block offset of bitmap
+        void *bmdata;
+        uint32_t ibm_relative_bno;
+        if ((bmdata = GetBitBlock(inode_map_, &ibm_relative_bno, ino)) == nullptr) {
+            panic("inode not in bitmap");
+        }
 
-    // obtain the block of the inode bitmap we need
-    mxtl::RefPtr<BlockNode> block_ibm;
-    if ((block_ibm = bc_->Get(info_.ibm_block + ibm_relative_bno)) == nullptr) {
-        return ERR_IO;
-    }
+        // obtain the block of the inode bitmap we need
+        mxtl::RefPtr<BlockNode> block_ibm;
+        if ((block_ibm = bc_->Get(info_.ibm_block + ibm_relative_bno)) == nullptr) {
+            return ERR_IO;
+        }
 
-    // update and commit block to disk
-    inode_map_.Clear(ino, ino + 1);
-    memcpy(block_ibm->data(), bmdata, kMinfsBlockSize);
-    bc_->Put(block_ibm, kBlockDirty);
+        // update and commit block to disk
+        inode_map_.Clear(ino, ino + 1);
+        memcpy(block_ibm->data(), bmdata, kMinfsBlockSize);
+        bc_->Put(block_ibm, kBlockDirty);
+    }
 
+    mxtl::AutoLock lock(&block_lock_);
     mxtl::RefPtr<BlockNode> bitmap_blk;
 
     // release all direct blocks
@@ -153,6 +163,7 @@ mx_status_t Minfs::InoFree(const minfs_inode_t& inode, uint32_t ino) {
 }
 
 mx_status_t Minfs::InoNew(const minfs_inode_t* inode, uint32_t* ino_out) {
+    mxtl::AutoLock lock(&inode_lock_);
     size_t bitoff_start;
     mx_status_t status = inode_map_.Find(false, 0, inode_map_.size(), 1, &bitoff_start);
     if (status != NO_ERROR) {
@@ -179,7 +190,7 @@ mx_status_t Minfs::InoNew(const minfs_inode_t* inode, uint32_t* ino_out) {
     // TODO(smklein): optional sanity check of both blocks
 
     // Write the inode back first
-    if ((status = InodeSync(ino, inode)) != NO_ERROR) {
+    if ((status = InodeSyncLocked(ino, inode)) != NO_ERROR) {
         bc_->Put(block_ibm, 0);
         inode_map_.Clear(ino, ino + 1);
         return status;
@@ -212,6 +223,7 @@ mx_status_t Minfs::VnodeNew(mxtl::RefPtr<VnodeMinfs>* out, uint32_t type) {
         return status;
     }
 
+    mxtl::AutoLock lock(&hash_lock_);
     vnode_hash_.insert(vn.get());
 
     *out = mxtl::move(vn);
@@ -219,33 +231,49 @@ mx_status_t Minfs::VnodeNew(mxtl::RefPtr<VnodeMinfs>* out, uint32_t type) {
 }
 
 void Minfs::VnodeRelease(VnodeMinfs* vn) {
-    vnode_hash_.erase(*vn);
+    mxtl::AutoLock lock(&hash_lock_);
+    // VnodeGet may already have taken it out, see below
+    if (vn->InContainer()) {
+        vnode_hash_.erase(*vn);
+    }
 }
 
 mx_status_t Minfs::VnodeGet(mxtl::RefPtr<VnodeMinfs>* out, uint32_t ino) {
     if ((ino < 1) || (ino >= info_.inode_count)) {
         return ERR_OUT_OF_RANGE;
     }
-    mxtl::RefPtr<VnodeMinfs> vn = mxtl::RefPtr<VnodeMinfs>(vnode_hash_.find(ino).CopyPointer());
-    if (vn != nullptr) {
-        *out = mxtl::move(vn);
-        return NO_ERROR;
+    mxtl::AutoLock lock(&hash_lock_);
+    auto iter = vnode_hash_.find(ino);
+    if (iter.IsValid()) {
+        mxtl::RefPtr<VnodeMinfs> vn = mxtl::internal::MakeRefPtrUpgradeFromRaw(&*iter);
+        if (vn != nullptr) {
+            *out = mxtl::move(vn);
+            return NO_ERROR;
+        }
+        // The last reference to the vnode has been dropped, and it's waiting
+        // on the lock we hold to remove itself. Do that for it, so the inode
+        // can be given a new vnode.
+        vnode_hash_.erase(iter);
     }
+    mxtl::RefPtr<VnodeMinfs> vn;
     mx_status_t status;
     if ((status = VnodeMinfs::AllocateHollow(this, &vn)) != NO_ERROR) {
         return ERR_NO_MEMORY;
     }
 
     // obtain the block of the inode table we need
-    uint32_t off_of_ino = (ino % kMinfsInodesPerBlock) * kMinfsInodeSize;
+    {
+        mxtl::AutoLock inode_lock(&inode_lock_);
+        uint32_t off_of_ino = (ino % kMinfsInodesPerBlock) * kMinfsInodeSize;
 #ifdef __Fuchsia__
-    void* inodata = (void*)((uintptr_t)(inode_table_->GetData()) +
-                            (uintptr_t)((ino / kMinfsInodesPerBlock) * kMinfsBlockSize));
+        void* inodata = (void*)((uintptr_t)(inode_table_->GetData()) +
+                                (uintptr_t)((ino / kMinfsInodesPerBlock) * kMinfsBlockSize));
 #else
-    uint8_t inodata[kMinfsBlockSize];
-    bc_->Readblk(info_.ino_block + (ino / kMinfsInodesPerBlock), inodata);
+        uint8_t inodata[kMinfsBlockSize];
+        bc_->Readblk(info_.ino_block + (ino / kMinfsInodesPerBlock), inodata);
 #endif
-    memcpy(&vn->inode_, (void*)((uintptr_t)inodata + off_of_ino), kMinfsInodeSize);
+        memcpy(&vn->inode_, (void*)((uintptr_t)inodata + off_of_ino), kMinfsInodeSize);
+    }
 
     vn->fs_ = this;
     vn->ino_ = ino;
@@ -261,6 +289,7 @@ mx_status_t Minfs::VnodeGet(mxtl::RefPtr<VnodeMinfs>* out, uint32_t ino) {
 // If hint is nonzero it indicates which block number to start the search for
 // free blocks from.
 mx_status_t Minfs::BlockNew(uint32_t hint, uint32_t* out_bno, mxtl::RefPtr<BlockNode> *out_block) {
+    mxtl::AutoLock lock(&block_lock_);
     size_t bitoff_start;
     mx_status_t status;
     if ((status = block_map_.Find(false, hint, block_map_.size(), 1, &bitoff_start)) != NO_ERROR) {
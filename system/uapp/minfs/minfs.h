@@ -12,9 +12,17 @@
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_free_ptr.h>
+#include <mxtl/unique_ptr.h>
 
 #include <magenta/types.h>
 
+#ifdef __Fuchsia__
+#include <block-client/client.h>
+#include <magenta/device/block.h>
+#include <mxtl/mutex.h>
+#include <threads.h>
+#endif
+
 #include <assert.h>
 #include <limits.h>
 #include <stdint.h>
@@ -168,8 +176,12 @@ constexpr uint32_t kBlockDirty = 0x01;
 constexpr uint32_t kBlockBusy  = 0x02;
 constexpr uint32_t kBlockLRU   = 0x04;
 constexpr uint32_t kBlockFree  = 0x08;
+constexpr uint32_t kBlockWriteback = 0x10;
+// Flag denoting a dirty block whose contents are being written back; it is
+// cleared if the block is dirtied again before the write completes.
+constexpr uint32_t kBlockFlushing = 0x20;
 
-constexpr uint32_t kBlockLLFlags = (kBlockBusy | kBlockLRU | kBlockFree);
+constexpr uint32_t kBlockLLFlags = (kBlockBusy | kBlockLRU | kBlockFree | kBlockWriteback);
 
 constexpr uint32_t kMinfsHashBits = (8);
 constexpr uint32_t kMinfsBuckets = (1 << kMinfsHashBits);
@@ -218,15 +230,25 @@ public:
     void PushBack(mxtl::RefPtr<BlockNode> blk, uint32_t block_type);
     mxtl::RefPtr<BlockNode> PopFront(uint32_t block_type);
     mxtl::RefPtr<BlockNode> Erase(mxtl::RefPtr<BlockNode> blk, uint32_t block_type);
+    bool IsEmpty(uint32_t block_type) { return GetList(block_type & kBlockLLFlags)->is_empty(); }
+
+    // Calls 'func' with each block on a list, without removing it
+    template <typename Func>
+    void ForEach(uint32_t block_type, Func func) {
+        for (auto& blk : *GetList(block_type & kBlockLLFlags)) {
+            func(&blk);
+        }
+    }
 
 private:
     using LinkedList = mxtl::DoublyLinkedList<mxtl::RefPtr<BlockNode>, BlockNode::TypeListTraits>;
     LinkedList* GetList(uint32_t block_type);
     size_t SizeAllSlow() const; // Used for debugging
 
-    LinkedList list_busy_;  // Between Get() and Put(). In hash.
-    LinkedList list_lru_;   // Available for re-use. In hash.
-    LinkedList list_free_;  // Never been used. Not in hash.
+    LinkedList list_busy_;      // Between Get() and Put(). In hash.
+    LinkedList list_lru_;       // Clean, available for re-use. In hash.
+    LinkedList list_free_;      // Never been used. Not in hash.
+    LinkedList list_writeback_; // Dirty, waiting to be written back. In hash.
 };
 
 class Bcache {
@@ -237,15 +259,39 @@ public:
     static mx_status_t Create(Bcache** out, int fd, uint32_t blockmax, uint32_t blocksize,
                               uint32_t num);
 
-    // Raw block read functions.
-    // These do not track blocks (or attempt to access the block cache)
+    // Whole block read and write functions, which don't hold on to a block.
+    // Readblk returns the cached copy of the block if there is one, and reads
+    // it from disk (without caching it) otherwise. Writeblk stores the data in
+    // a dirty cache block, which is written back later (see Sync).
     mx_status_t Readblk(uint32_t bno, void* data);
     mx_status_t Writeblk(uint32_t bno, const void* data);
 
+    // Returns true if the cache holds a copy of the block which has not been
+    // written back yet, in which case reading the block straight from the
+    // device would return stale data.
+    bool IsDirty(uint32_t bno);
+
+#ifdef __Fuchsia__
+    // Raw block IO through the block device's FIFO, which moves data directly
+    // between the device and VMOs registered with AttachVmo. Only available
+    // if the device speaks the FIFO protocol (see HasFifo); otherwise these
+    // return ERR_NOT_SUPPORTED.
+    //
+    // The cache has a single txnid; transactions are serialized by the
+    // cache, which doesn't hold its block lock while they run.
+    bool HasFifo() const { return fifo_client_ != nullptr; }
+    mx_status_t AttachVmo(mx_handle_t vmo, vmoid_t* out);
+    mx_status_t DetachVmo(vmoid_t vmoid);
+    // Issues up to MAX_TXN_MESSAGES requests as one transaction, filling in
+    // the txnid of each, and waits for all of them to complete.
+    mx_status_t Txn(block_fifo_request_t* requests, size_t count);
+#endif
+
     uint32_t Maxblk() const { return blockmax_; };
 
     // acquire a block, reading from disk if necessary,
-    // returning a handle and a pointer to the data
+    // returning a handle and a pointer to the data.
+    // waits if someone else has the block until they Put it
     mxtl::RefPtr<BlockNode> Get(uint32_t bno);
     // acquire a block, not reading from disk, marking dirty,
     // and clearing to all 0s
@@ -253,6 +299,7 @@ public:
 
     // release a block back to the cache
     // flags *must* contain kBlockDirty if it was modified
+    // dirty blocks are written back later, not by Put
     void Put(mxtl::RefPtr<BlockNode> blk, uint32_t flags);
 
     // Helper functions which combine 'Get' and 'Put'.
@@ -262,15 +309,45 @@ public:
     // drop all non-busy, non-dirty blocks
     void Invalidate();
 
+    // Writes back every dirty block which isn't busy, then flushes the
+    // device. Everything written through the cache before the call is on
+    // disk once it returns successfully.
     int Sync();
     int Close();
 
     ~Bcache();
 
 private:
+    class AutoLock;
+
     Bcache(int fd, uint32_t blockmax, uint32_t blocksize);
 
-    mxtl::RefPtr<BlockNode> Get(uint32_t bno, uint32_t mode);
+    mxtl::RefPtr<BlockNode> GetLocked(uint32_t bno, uint32_t mode);
+    void PutLocked(mxtl::RefPtr<BlockNode> blk, uint32_t flags);
+    void MarkDirtyLocked(BlockNode* blk);
+
+    // Uncached IO
+    mx_status_t ReadDisk(uint32_t bno, void* data);
+    mx_status_t WriteDisk(uint32_t bno, const void* data);
+
+    // Writes back all dirty blocks on the writeback list, in order of block
+    // number, and moves them to the LRU list. Blocks stay dirty if writing
+    // them fails, or if they are dirtied again while being written. With the
+    // FIFO, the lock is dropped while the device writes the blocks.
+    mx_status_t FlushLocked();
+
+#ifdef __Fuchsia__
+    // Requires txn_lock_.
+    mx_status_t TxnLocked(block_fifo_request_t* requests, size_t count);
+    // Copies the blocks into the flush VMO, then writes them back with lock_
+    // dropped.
+    mx_status_t FlushFifoLocked(BlockNode** blocks, size_t count);
+
+    // Writes back dirty blocks once there are too many of them, or once the
+    // oldest has been dirty for too long.
+    static int FlusherThread(void* arg);
+    void Flusher();
+#endif
 
     using HashTableBucket = mxtl::DoublyLinkedList<mxtl::RefPtr<BlockNode>, BlockNode::TypeHashTraits>;
     using HashTable = mxtl::HashTable<uint32_t, mxtl::RefPtr<BlockNode>, HashTableBucket>;
@@ -279,6 +356,32 @@ private:
     int fd_;
     uint32_t blockmax_;
     uint32_t blocksize_;
+    uint32_t dirty_count_;       // Blocks with kBlockDirty set, busy or not
+    mxtl::unique_ptr<BlockNode*[]> flush_blocks_; // Scratch space for FlushLocked
+#ifdef __Fuchsia__
+    // Protects everything above, and all non-busy blocks. Busy blocks belong
+    // to whoever called Get until they are Put.
+    mxtl::Mutex lock_;
+
+    // Serializes transactions on the FIFO. Never held while acquiring lock_.
+    mxtl::Mutex txn_lock_;
+    fifo_client_t* fifo_client_; // Null if the device has no FIFO
+    txnid_t txnid_;
+
+    // Dirty blocks are copied here, in order of block number, to be written
+    // back with as few requests as possible.
+    mx_handle_t flush_vmo_;
+    vmoid_t flush_vmoid_;
+
+    mx_time_t first_dirty_;      // When dirty_count_ last became nonzero
+    thrd_t flusher_;
+    bool flusher_running_;
+    bool flusher_stop_;
+    cnd_t flusher_cond_;         // Signalled when the flusher has work, or should stop
+    cnd_t busy_cond_;            // Broadcast when a block is Put
+    bool flushing_;              // A flush has dropped lock_ to write back blocks
+    cnd_t flush_cond_;           // Broadcast when flushing_ is cleared
+#endif
 };
 
 void* GetBlock(const RawBitmap& bitmap, uint32_t blkno);
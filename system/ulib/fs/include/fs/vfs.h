@@ -20,6 +20,7 @@
 #include <mxio/vfs.h>
 
 #ifdef __Fuchsia__
+#include <pthread.h>
 #include <threads.h>
 #include <mxio/io.h>
 #endif
@@ -33,8 +34,29 @@
 #define V_FLAG_RESERVED_MASK 0x0000FFFF
 
 __BEGIN_CDECLS
-// A lock which should be used to protect lookup and walk operations
+// Locking within the VFS layer, outermost first:
+//
+// 1) vfs_rename_lock: Serializes the operations which add or remove links to
+//    an existing vnode (rename, link, unlink), and which consequently may need
+//    to hold more than one directory lock at a time.
+// 2) Vnode locks (Vnode::lock_): A reader/writer lock per vnode. Lookup,
+//    readdir, read and getattr hold it shared; operations which change the
+//    contents of the vnode (create / unlink / rename within a directory,
+//    write, truncate) hold it exclusive.
+//    - Only holders of vfs_rename_lock may hold more than one directory
+//      lock. Rename locks its two directories in ascending address order;
+//      the filesystem may then lock, one at a time, the ancestors it walks
+//      and the children whose links change (parents before children).
+//      Unlink and link likewise lock the child after its parent.
+//    - No lock of another vnode may be acquired while holding the lock of a
+//      non-directory vnode.
+// 3) vfs_lock: Protects the list of mounted remote filesystems and the
+//    cookies of vnode tokens. Never held while acquiring any other lock.
+//
+// Path walks hold at most one vnode lock at a time, so lookups in distinct
+// (or the same) directories proceed in parallel.
 #ifdef __Fuchsia__
+extern mtx_t vfs_rename_lock;
 extern mtx_t vfs_lock;
 #endif
 
@@ -55,12 +77,74 @@ __END_CDECLS
 
 namespace fs {
 
+// RwLock is a reader/writer lock used to protect individual vnodes.
+//
+// Host-side tools which use this library are single threaded, so outside of
+// Fuchsia acquiring and releasing the lock are no-ops.
+class __TA_CAPABILITY("mutex") RwLock {
+public:
+#ifdef __Fuchsia__
+    RwLock() { pthread_rwlock_init(&lock_, nullptr); }
+    ~RwLock() { pthread_rwlock_destroy(&lock_); }
+    void AcquireShared() __THREAD_ANNOTATION(acquire_shared_capability()) {
+        pthread_rwlock_rdlock(&lock_);
+    }
+    void ReleaseShared() __THREAD_ANNOTATION(release_shared_capability()) {
+        pthread_rwlock_unlock(&lock_);
+    }
+    void Acquire() __TA_ACQUIRE() { pthread_rwlock_wrlock(&lock_); }
+    void Release() __TA_RELEASE() { pthread_rwlock_unlock(&lock_); }
+#else
+    RwLock() {}
+    void AcquireShared() __THREAD_ANNOTATION(acquire_shared_capability()) {}
+    void ReleaseShared() __THREAD_ANNOTATION(release_shared_capability()) {}
+    void Acquire() __TA_ACQUIRE() {}
+    void Release() __TA_RELEASE() {}
+#endif
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(RwLock);
+
+private:
+#ifdef __Fuchsia__
+    pthread_rwlock_t lock_;
+#endif
+};
+
+class __TA_SCOPED_CAPABILITY AutoReaderLock {
+public:
+    explicit AutoReaderLock(RwLock* lock) __THREAD_ANNOTATION(acquire_shared_capability(lock))
+        : lock_(lock) {
+        lock_->AcquireShared();
+    }
+    ~AutoReaderLock() __TA_RELEASE() { lock_->ReleaseShared(); }
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(AutoReaderLock);
+
+private:
+    RwLock* lock_;
+};
+
+class __TA_SCOPED_CAPABILITY AutoWriterLock {
+public:
+    explicit AutoWriterLock(RwLock* lock) __TA_ACQUIRE(lock) : lock_(lock) {
+        lock_->Acquire();
+    }
+    ~AutoWriterLock() __TA_RELEASE() { lock_->Release(); }
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(AutoWriterLock);
+
+private:
+    RwLock* lock_;
+};
+
 // RemoteContainer adds support for mounting remote handles on nodes.
 class RemoteContainer {
 public:
     bool IsRemote() const;
     mx_handle_t DetachRemote(uint32_t &flags_);
     // Access the remote handle if it's ready -- otherwise, return an error.
+    // Called with only the vnode's reader lock held, so V_FLAG_MOUNT_READY
+    // is set and cleared with atomic operations on |flags_|.
     mx_handle_t WaitForRemote(uint32_t &flags_);
     mx_handle_t GetRemote() const;
     void SetRemote(mx_handle_t remote);
@@ -247,11 +331,21 @@ public:
         flags_ |= V_FLAG_DEVICE_DETACHED;
     }
     bool IsDetachedDevice() const { return (flags_ & V_FLAG_DEVICE_DETACHED); }
+
+    // The lock protecting this vnode. See the lock ordering rules above
+    // vfs_rename_lock. The VFS layer acquires it around calls into the vnode;
+    // filesystems only need to take it themselves when operating on a vnode
+    // other than the one they were called on.
+    RwLock* lock() __TA_RETURN_CAPABILITY(lock_) { return &lock_; }
+
 protected:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Vnode);
     Vnode() : flags_(0) {};
 
     uint32_t flags_;
+
+private:
+    RwLock lock_;
 };
 
 struct Vfs {
@@ -276,9 +370,12 @@ struct Vfs {
 #ifdef __Fuchsia__
     // Pins a handle to a remote filesystem onto a vnode, if possible.
     static mx_status_t InstallRemote(mxtl::RefPtr<Vnode> vn, mx_handle_t h);
-    static mx_status_t InstallRemoteLocked(mxtl::RefPtr<Vnode> vn, mx_handle_t h) __TA_REQUIRES(vfs_lock);
+    // As InstallRemote, but the caller must hold vn's lock exclusively.
+    static mx_status_t InstallRemoteLocked(mxtl::RefPtr<Vnode> vn, mx_handle_t h);
     // Unpin a handle to a remote filesystem from a vnode, if one exists.
     static mx_status_t UninstallRemote(mxtl::RefPtr<Vnode> vn, mx_handle_t* h);
+    // As UninstallRemote, but the caller must hold vn's lock exclusively.
+    static mx_status_t UninstallRemoteLocked(mxtl::RefPtr<Vnode> vn, mx_handle_t* h);
 #endif  // ifdef __Fuchsia__
 };
 
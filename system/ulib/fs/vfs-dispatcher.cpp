@@ -24,9 +24,11 @@
 
 #define MXDEBUG 0
 
-// ** NOTE -- this prototype multithreaded dispatcher is only used by
-// ** minfs as part of ongoing multithread development. Not yet safe
-// ** for general consumption
+// A pool of threads servicing a single port. Each handler's async wait is
+// only re-armed once its callback has returned, so the callbacks for any one
+// handle are serialized, while different handles are serviced in parallel.
+// Callbacks are responsible for any locking between handles; vfs_handler
+// relies on the per-vnode locks described in fs/vfs.h.
 
 namespace fs {
 
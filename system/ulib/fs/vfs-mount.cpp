@@ -38,6 +38,18 @@ public:
     }
 
     mx_handle_t ReleaseRemote() {
+        MX_DEBUG_ASSERT(vn_ != nullptr);
+        mx_handle_t h;
+        {
+            AutoWriterLock lock(vn_->lock());
+            h = vn_->DetachRemote();
+        }
+        vn_ = nullptr;
+        return h;
+    }
+
+    // As ReleaseRemote, but the caller already holds the vnode's lock.
+    mx_handle_t ReleaseRemoteLocked() {
         MX_DEBUG_ASSERT(vn_ != nullptr);
         mx_handle_t h = vn_->DetachRemote();
         vn_ = nullptr;
@@ -70,21 +82,8 @@ mx_status_t Vfs::InstallRemote(mxtl::RefPtr<Vnode> vn, mx_handle_t h) {
         return ERR_ACCESS_DENIED;
     }
 
-    // Allocate a node to track the remote handle
-    AllocChecker ac;
-    mxtl::unique_ptr<MountNode> mount_point(new (&ac) MountNode());
-    if (!ac.check()) {
-        return ERR_NO_MEMORY;
-    }
-    mx_status_t status = vn->AttachRemote(h);
-    if (status != NO_ERROR) {
-        return status;
-    }
-    // Save this node in the list of mounted vnodes
-    mount_point->SetNode(mxtl::move(vn));
-    mxtl::AutoLock lock(&vfs_lock);
-    remote_list.push_front(mxtl::move(mount_point));
-    return NO_ERROR;
+    AutoWriterLock lock(vn->lock());
+    return InstallRemoteLocked(mxtl::move(vn), h);
 }
 
 // Installs a remote filesystem on vn and adds it to the remote_list.
@@ -105,28 +104,38 @@ mx_status_t Vfs::InstallRemoteLocked(mxtl::RefPtr<Vnode> vn, mx_handle_t h) {
     }
     // Save this node in the list of mounted vnodes
     mount_point->SetNode(mxtl::move(vn));
+    mxtl::AutoLock lock(&vfs_lock);
     remote_list.push_front(mxtl::move(mount_point));
     return NO_ERROR;
 }
 
+static mxtl::unique_ptr<MountNode> RemoveMountPoint(const mxtl::RefPtr<Vnode>& vn) {
+    mxtl::AutoLock lock(&vfs_lock);
+    return remote_list.erase_if([&vn](const MountNode& node) {
+        return node.VnodeMatch(vn);
+    });
+}
 
 // Uninstall the remote filesystem mounted on vn. Removes vn from the
 // remote_list, and sends its corresponding filesystem an 'unmount' signal.
 mx_status_t Vfs::UninstallRemote(mxtl::RefPtr<Vnode> vn, mx_handle_t* h) {
-    mxtl::unique_ptr<MountNode> mount_point;
-    {
-        mxtl::AutoLock lock(&vfs_lock);
-        mount_point = remote_list.erase_if([&vn](const MountNode& node) {
-            return node.VnodeMatch(vn);
-        });
-        if (!mount_point) {
-            return ERR_NOT_FOUND;
-        }
+    mxtl::unique_ptr<MountNode> mount_point = RemoveMountPoint(vn);
+    if (!mount_point) {
+        return ERR_NOT_FOUND;
     }
     *h = mount_point->ReleaseRemote();
     return NO_ERROR;
 }
 
+mx_status_t Vfs::UninstallRemoteLocked(mxtl::RefPtr<Vnode> vn, mx_handle_t* h) {
+    mxtl::unique_ptr<MountNode> mount_point = RemoveMountPoint(vn);
+    if (!mount_point) {
+        return ERR_NOT_FOUND;
+    }
+    *h = mount_point->ReleaseRemoteLocked();
+    return NO_ERROR;
+}
+
 } // namespace fs
 
 // Uninstall all remote filesystems. Acts like 'UninstallRemote' for all
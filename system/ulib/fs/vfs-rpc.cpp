@@ -61,10 +61,7 @@ void vfs_rpc_open(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode> vn, cons
     bool pipeline = flags & MXRIO_OFLAG_PIPELINE;
     uint32_t open_flags = flags & (~MXRIO_OFLAG_MASK);
 
-    {
-        mxtl::AutoLock lock(&vfs_lock);
-        r = Vfs::Open(mxtl::move(vn), &vn, path, &path, open_flags, mode);
-    }
+    r = Vfs::Open(mxtl::move(vn), &vn, path, &path, open_flags, mode);
 
     mxrio_object_t obj;
     memset(&obj, 0, sizeof(obj));
@@ -234,6 +231,7 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
         return ERR_DISPATCHER_INDIRECT;
     }
     case MXRIO_READ: {
+        fs::AutoReaderLock lock(vn->lock());
         ssize_t r = vn->Read(msg->data, arg, ios->io_off);
         if (r >= 0) {
             ios->io_off += r;
@@ -243,6 +241,7 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
         return static_cast<mx_status_t>(r);
     }
     case MXRIO_READ_AT: {
+        fs::AutoReaderLock lock(vn->lock());
         ssize_t r = vn->Read(msg->data, arg, msg->arg2.off);
         if (r >= 0) {
             msg->datalen = static_cast<uint32_t>(r);
@@ -250,6 +249,8 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
         return static_cast<mx_status_t>(r);
     }
     case MXRIO_WRITE: {
+        // Held across the Getattr for O_APPEND, so appends don't interleave.
+        fs::AutoWriterLock lock(vn->lock());
         if (ios->io_flags & O_APPEND) {
             vnattr_t attr;
             mx_status_t r;
@@ -266,14 +267,18 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
         return static_cast<mx_status_t>(r);
     }
     case MXRIO_WRITE_AT: {
+        fs::AutoWriterLock lock(vn->lock());
         ssize_t r = vn->Write(msg->data, len, msg->arg2.off);
         return static_cast<mx_status_t>(r);
     }
     case MXRIO_SEEK: {
         vnattr_t attr;
         mx_status_t r;
-        if ((r = vn->Getattr(&attr)) < 0) {
-            return r;
+        {
+            fs::AutoReaderLock lock(vn->lock());
+            if ((r = vn->Getattr(&attr)) < 0) {
+                return r;
+            }
         }
         size_t n;
         switch (arg) {
@@ -329,6 +334,7 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
         return NO_ERROR;
     }
     case MXRIO_STAT: {
+        fs::AutoReaderLock lock(vn->lock());
         mx_status_t r;
         msg->datalen = sizeof(vnattr_t);
         if ((r = vn->Getattr((vnattr_t*)msg->data)) < 0) {
@@ -337,6 +343,7 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
         return msg->datalen;
     }
     case MXRIO_SETATTR: {
+        fs::AutoWriterLock lock(vn->lock());
         mx_status_t r = vn->Setattr((vnattr_t*)msg->data);
         return r;
     }
@@ -349,7 +356,7 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
         }
         mx_status_t r;
         {
-            mxtl::AutoLock lock(&vfs_lock);
+            fs::AutoReaderLock lock(vn->lock());
             r = vn->Readdir(&ios->dircookie, msg->data, arg);
         }
         if (r >= 0) {
@@ -435,6 +442,7 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
         if (msg->arg2.off < 0) {
             return ERR_INVALID_ARGS;
         }
+        fs::AutoWriterLock lock(vn->lock());
         return vn->Truncate(msg->arg2.off);
     }
     case MXRIO_RENAME:
@@ -459,20 +467,24 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
 
         mx_status_t r;
         uint64_t vcookie;
+        mxtl::RefPtr<Vnode> target_parent;
+        {
+            // The token's cookie is cleared under vfs_lock before the vnode it
+            // refers to may be released, so a reference taken under the lock
+            // is always to a live vnode.
+            mxtl::AutoLock lock(&vfs_lock);
+            if ((r = mx_object_get_cookie(msg->handle[0], mx_process_self(), &vcookie)) < 0) {
+                // TODO(smklein): Return a more specific error code for "token not from this server"
+                return ERR_INVALID_ARGS;
+            }
 
-        mxtl::AutoLock lock(&vfs_lock);
-        if ((r = mx_object_get_cookie(msg->handle[0], mx_process_self(), &vcookie)) < 0) {
-            // TODO(smklein): Return a more specific error code for "token not from this server"
-            return ERR_INVALID_ARGS;
-        }
+            if (vcookie == 0) {
+                // Client closed the channel associated with the token
+                return ERR_INVALID_ARGS;
+            }
 
-        if (vcookie == 0) {
-            // Client closed the channel associated with the token
-            return ERR_INVALID_ARGS;
+            target_parent = mxtl::RefPtr<Vnode>(reinterpret_cast<Vnode*>(vcookie));
         }
-
-        mxtl::RefPtr<Vnode> target_parent =
-                mxtl::RefPtr<Vnode>(reinterpret_cast<Vnode*>(vcookie));
         switch (MXRIO_OP(msg->op)) {
         case MXRIO_RENAME:
             return fs::Vfs::Rename(mxtl::move(vn), mxtl::move(target_parent), oldname, newname);
@@ -486,6 +498,7 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
             return ERR_INVALID_ARGS;
         }
         mxrio_mmap_data_t* data = reinterpret_cast<mxrio_mmap_data_t*>(msg->data);
+        fs::AutoReaderLock lock(vn->lock());
 
         mx_status_t status = vn->Mmap(data->flags, data->length, &data->offset,
                                       &msg->handle[0]);
@@ -495,6 +508,7 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
         return status;
     }
     case MXRIO_SYNC: {
+        fs::AutoReaderLock lock(vn->lock());
         return vn->Sync();
     }
     case MXRIO_UNLINK:
@@ -508,14 +522,12 @@ mx_status_t vfs_handler_vn(mxrio_msg_t* msg, mx_handle_t rh, mxtl::RefPtr<Vnode>
     }
 }
 
-// TODO(orr): temporary; prevent multithread weirdness while we
-// make locking more fine grained
-static mtx_t vfs_big_lock = MTX_INIT;
-
+// Messages on any one handle are never dispatched concurrently, so the iostate
+// needs no locking of its own. The vnode it refers to may be shared by many
+// handles, and is locked per-operation above.
 mx_status_t vfs_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie) {
     vfs_iostate_t* ios = static_cast<vfs_iostate_t*>(cookie);
 
-    mxtl::AutoLock lock(&vfs_big_lock);
     mxtl::RefPtr<Vnode> vn = ios->vn;
     mx_status_t status = vfs_handler_vn(msg, rh, mxtl::move(vn), ios);
     return status;
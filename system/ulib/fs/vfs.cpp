@@ -23,6 +23,7 @@
 uint32_t __trace_bits;
 
 #ifdef __Fuchsia__
+mtx_t vfs_rename_lock = MTX_INIT;
 mtx_t vfs_lock = MTX_INIT;
 #endif
 mxio_dispatcher_t* vfs_dispatcher;
@@ -51,6 +52,44 @@ mx_status_t vfs_name_trim(const char* name, size_t len, size_t* len_out, bool* d
     return NO_ERROR;
 }
 
+// Holds vfs_rename_lock for the lifetime of the object. Host-side tools are
+// single threaded, and have no such lock.
+class AutoRenameLock {
+public:
+#ifdef __Fuchsia__
+    AutoRenameLock() : lock_(&vfs_rename_lock) {}
+private:
+    mxtl::AutoLock lock_;
+#endif
+};
+
+// Holds the locks of the two directories involved in a rename, acquired in
+// ascending address order. The caller must hold vfs_rename_lock, which makes
+// it the only thread holding more than one directory lock.
+class AutoRenameDirLocks {
+public:
+    AutoRenameDirLocks(Vnode* a, Vnode* b) __TA_NO_THREAD_SAFETY_ANALYSIS
+        : first_(reinterpret_cast<uintptr_t>(a) < reinterpret_cast<uintptr_t>(b) ? a : b),
+          second_(first_ == a ? b : a) {
+        first_->lock()->Acquire();
+        if (second_ != first_) {
+            second_->lock()->Acquire();
+        }
+    }
+    ~AutoRenameDirLocks() __TA_NO_THREAD_SAFETY_ANALYSIS {
+        if (second_ != first_) {
+            second_->lock()->Release();
+        }
+        first_->lock()->Release();
+    }
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(AutoRenameDirLocks);
+
+private:
+    Vnode* first_;
+    Vnode* second_;
+};
+
 } // namespace anonymous
 
 bool RemoteContainer::IsRemote() const {
@@ -60,7 +99,7 @@ bool RemoteContainer::IsRemote() const {
 mx_handle_t RemoteContainer::DetachRemote(uint32_t &flags_) {
     mx_handle_t h = remote_;
     remote_ = MX_HANDLE_INVALID;
-    flags_ &= ~V_FLAG_MOUNT_READY;
+    __atomic_fetch_and(&flags_, ~V_FLAG_MOUNT_READY, __ATOMIC_RELAXED);
     return h;
 }
 
@@ -70,7 +109,7 @@ mx_handle_t RemoteContainer::WaitForRemote(uint32_t &flags_) {
     if (remote_ == 0) {
         // Trying to get remote on a non-remote vnode
         return ERR_UNAVAILABLE;
-    } else if (!(flags_ & V_FLAG_MOUNT_READY)) {
+    } else if (!(__atomic_load_n(&flags_, __ATOMIC_ACQUIRE) & V_FLAG_MOUNT_READY)) {
         mx_signals_t observed;
         mx_status_t status = mx_object_wait_one(remote_,
                                                 MX_USER_SIGNAL_0 | MX_CHANNEL_PEER_CLOSED,
@@ -80,7 +119,7 @@ mx_handle_t RemoteContainer::WaitForRemote(uint32_t &flags_) {
             // Not set (or otherwise remote is bad)
             return ERR_UNAVAILABLE;
         }
-        flags_ |= V_FLAG_MOUNT_READY;
+        __atomic_fetch_or(&flags_, V_FLAG_MOUNT_READY, __ATOMIC_RELEASE);
     }
     return remote_;
 #else
@@ -121,7 +160,11 @@ mx_status_t Vfs::Open(mxtl::RefPtr<Vnode> vndir, mxtl::RefPtr<Vnode>* out, const
         if (must_be_dir && !S_ISDIR(mode)) {
             return ERR_INVALID_ARGS;
         }
-        if ((r = vndir->Create(&vn, path, len, mode)) < 0) {
+        {
+            AutoWriterLock lock(vndir->lock());
+            r = vndir->Create(&vn, path, len, mode);
+        }
+        if (r < 0) {
             if ((r == ERR_ALREADY_EXISTS) && (!(flags & O_EXCL))) {
                 goto try_open;
             }
@@ -135,31 +178,41 @@ mx_status_t Vfs::Open(mxtl::RefPtr<Vnode> vndir, mxtl::RefPtr<Vnode>* out, const
         vndir->NotifyAdd(path, len);
     } else {
     try_open:
-        r = vndir->Lookup(&vn, path, len);
-        if (r < 0) {
-            return r;
+        {
+            AutoReaderLock lock(vndir->lock());
+            r = vndir->Lookup(&vn, path, len);
         }
-        if (!(flags & O_NOREMOTE) && vn->IsRemote() && !vn->IsDevice()) {
-            // Opening a mount point: Traverse across remote.
-            // Devices are different, even though they also have remotes.  Ignore them.
-            *pathout = ".";
-            r = vn->WaitForRemote();
+        if (r < 0) {
             return r;
         }
 
 #ifdef __Fuchsia__
         flags |= (must_be_dir ? O_DIRECTORY : 0);
 #endif
-        if ((r = vn->Open(flags)) < 0) {
-            return r;
-        }
-        if (vn->IsDevice() && !(flags & O_DIRECTORY)) {
-            *pathout = ".";
-            r = vn->GetRemote();
-            return r;
+        {
+            AutoReaderLock lock(vn->lock());
+            if (!(flags & O_NOREMOTE) && vn->IsRemote() && !vn->IsDevice()) {
+                // Opening a mount point: Traverse across remote.
+                // Devices are different, even though they also have remotes.  Ignore them.
+                *pathout = ".";
+                r = vn->WaitForRemote();
+                return r;
+            }
+
+            if ((r = vn->Open(flags)) < 0) {
+                return r;
+            }
+            if (vn->IsDevice() && !(flags & O_DIRECTORY)) {
+                *pathout = ".";
+                r = vn->GetRemote();
+                return r;
+            }
         }
-        if ((flags & O_TRUNC) && ((r = vn->Truncate(0)) < 0)) {
-            return r;
+        if (flags & O_TRUNC) {
+            AutoWriterLock lock(vn->lock());
+            if ((r = vn->Truncate(0)) < 0) {
+                return r;
+            }
         }
     }
     trace(VFS, "VfsOpen: vn=%p\n", vn.get());
@@ -174,6 +227,10 @@ mx_status_t Vfs::Unlink(mxtl::RefPtr<Vnode> vndir, const char* path, size_t len)
     if ((r = vfs_name_trim(path, len, &len, &must_be_dir)) != NO_ERROR) {
         return r;
     }
+    // Unlinking may drop the last link to a directory, which the filesystem
+    // locks (after its parent) to check that it is empty.
+    AutoRenameLock rename_lock;
+    AutoWriterLock lock(vndir->lock());
     return vndir->Unlink(path, len, must_be_dir);
 }
 
@@ -197,12 +254,20 @@ mx_status_t Vfs::Link(mxtl::RefPtr<Vnode> oldparent, mxtl::RefPtr<Vnode> newpare
         return ERR_NOT_DIR;
     }
 
-    // Look up the target vnode
-    mxtl::RefPtr<Vnode> target;
-    if ((r = oldparent->Lookup(&target, oldname, oldlen)) < 0) {
-        return r;
+    {
+        AutoRenameLock rename_lock;
+
+        // Look up the target vnode
+        mxtl::RefPtr<Vnode> target;
+        {
+            AutoReaderLock lock(oldparent->lock());
+            if ((r = oldparent->Lookup(&target, oldname, oldlen)) < 0) {
+                return r;
+            }
+        }
+        AutoWriterLock lock(newparent->lock());
+        r = newparent->Link(newname, newlen, target);
     }
-    r = newparent->Link(newname, newlen, target);
     if (r != NO_ERROR) {
         return r;
     }
@@ -224,8 +289,12 @@ mx_status_t Vfs::Rename(mxtl::RefPtr<Vnode> oldparent, mxtl::RefPtr<Vnode> newpa
     if ((r = vfs_name_trim(newname, newlen, &newlen, &new_must_be_dir)) != NO_ERROR) {
         return r;
     }
-    r = oldparent->Rename(newparent, oldname, oldlen, newname, newlen,
-                          old_must_be_dir, new_must_be_dir);
+    {
+        AutoRenameLock rename_lock;
+        AutoRenameDirLocks dir_locks(oldparent.get(), newparent.get());
+        r = oldparent->Rename(newparent, oldname, oldlen, newname, newlen,
+                              old_must_be_dir, new_must_be_dir);
+    }
     if (r != NO_ERROR) {
         return r;
     }
@@ -273,19 +342,21 @@ ssize_t Vfs::Ioctl(mxtl::RefPtr<Vnode> vn, uint32_t op, const void* in_buf, size
             (out_len != 0)) {
             return ERR_INVALID_ARGS;
         }
-        mxtl::AutoLock lock(&vfs_lock);
         mx_status_t r = Open(vn, &vn, name, &name,
                              O_CREAT | O_RDWR | O_DIRECTORY | O_NOREMOTE, S_IFDIR);
         MX_DEBUG_ASSERT(r <= NO_ERROR); // Should not be accessing remote nodes
         if (r < 0) {
             return r;
         }
+        // Hold the mount point's lock while swapping remotes, so walks through
+        // it see either the old filesystem or the new one.
+        AutoWriterLock lock(vn->lock());
         if (vn->IsRemote()) {
             if (config->flags & MOUNT_MKDIR_FLAG_REPLACE) {
                 // There is an old remote handle on this vnode; shut it down and
                 // replace it with our own.
                 mx_handle_t old_remote;
-                Vfs::UninstallRemote(vn, &old_remote);
+                Vfs::UninstallRemoteLocked(vn, &old_remote);
                 vfs_unmount_handle(old_remote, 0);
                 mx_handle_close(old_remote);
             } else {
@@ -373,16 +444,6 @@ mx_status_t Vfs::Walk(mxtl::RefPtr<Vnode> vn, mxtl::RefPtr<Vnode>* out,
             // convert empty initial path of final path segment to "."
             path = ".";
         }
-        if (vn->IsRemote() && !vn->IsDevice()) {
-            // remote filesystem mount, caller must resolve
-            // devices are different, so ignore them even though they can have vn->remote
-            if ((r = vn->WaitForRemote()) < 0) {
-                return r;
-            }
-            *out = vn;
-            *pathout = path;
-            return r;
-        }
 
         const char* nextpath = strchr(path, '/');
         bool additional_segment = false;
@@ -396,23 +457,40 @@ mx_status_t Vfs::Walk(mxtl::RefPtr<Vnode> vn, mxtl::RefPtr<Vnode>* out,
                 end++;
             }
         }
-        if (additional_segment) {
-            // path has at least one additional segment
-            // traverse to the next segment
-            size_t len = nextpath - path;
-            nextpath++;
-            r = vn->Lookup(&vn, path, len);
-            assert(r <= 0);
-            if (r < 0) {
+
+        // Only the vnode being walked through is locked, and only shared, so
+        // any number of walks may pass through the same directories at once.
+        mxtl::RefPtr<Vnode> next;
+        {
+            AutoReaderLock lock(vn->lock());
+            if (vn->IsRemote() && !vn->IsDevice()) {
+                // remote filesystem mount, caller must resolve
+                // devices are different, so ignore them even though they can have vn->remote
+                if ((r = vn->WaitForRemote()) < 0) {
+                    return r;
+                }
+                *out = vn;
+                *pathout = path;
                 return r;
             }
-            path = nextpath;
-        } else {
-            // final path segment, we're done here
-            *out = vn;
-            *pathout = path;
-            return NO_ERROR;
+
+            if (!additional_segment) {
+                // final path segment, we're done here
+                *out = vn;
+                *pathout = path;
+                return NO_ERROR;
+            }
+
+            // path has at least one additional segment
+            // traverse to the next segment
+            r = vn->Lookup(&next, path, nextpath - path);
+        }
+        assert(r <= 0);
+        if (r < 0) {
+            return r;
         }
+        vn = mxtl::move(next);
+        path = nextpath + 1;
     }
 }
 
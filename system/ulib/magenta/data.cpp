@@ -13,4 +13,14 @@ const struct vdso_constants DATA_CONSTANTS = {
     0,
     0,
     0,
+    0,
+    0,
+    0,
+    0,
+};
+
+// The kernel keeps this up to date; see VDso::set_utc_offset.
+const struct vdso_clock DATA_CLOCK = {
+    0,
+    0xdeadbeef,
 };
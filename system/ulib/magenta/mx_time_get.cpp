@@ -0,0 +1,41 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lib/fixed_point.h>
+#include <magenta/syscalls.h>
+
+#include "private.h"
+
+static int64_t utc_offset(void) {
+    uint64_t seq;
+    int64_t offset;
+    do {
+        seq = __atomic_load_n(&DATA_CLOCK.seq, __ATOMIC_ACQUIRE);
+        offset = __atomic_load_n(&DATA_CLOCK.utc_offset, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || __atomic_load_n(&DATA_CLOCK.seq, __ATOMIC_RELAXED) != seq);
+    return offset;
+}
+
+mx_time_t _mx_time_get(uint32_t clock_id) {
+    // The kernel leaves this zero unless its monotonic clock is exactly
+    // the tick counter scaled by it.  VDSO_mx_ticks_get always reads the
+    // counter, even when mx_ticks_get has been redirected to soft ticks.
+    const struct fp_32_64 ns_per_tick = {
+        DATA_CONSTANTS.ns_per_tick_l0,
+        DATA_CONSTANTS.ns_per_tick_l32,
+        DATA_CONSTANTS.ns_per_tick_l64,
+    };
+    if (ns_per_tick.l0 | ns_per_tick.l32 | ns_per_tick.l64) {
+        switch (clock_id) {
+        case MX_CLOCK_MONOTONIC:
+            return u64_mul_u64_fp32_64(VDSO_mx_ticks_get(), ns_per_tick);
+        case MX_CLOCK_UTC:
+            return u64_mul_u64_fp32_64(VDSO_mx_ticks_get(), ns_per_tick) + utc_offset();
+        }
+    }
+    return VDSO_mx_time_get_via_kernel(clock_id);
+}
+
+VDSO_PUBLIC_ALIAS(mx_time_get);
@@ -12,6 +12,10 @@
 
 extern __LOCAL const struct vdso_constants DATA_CONSTANTS;
 
+// The kernel updates this at run time, so it must be read following the
+// protocol described in lib/vdso-constants.h.
+extern __LOCAL const struct vdso_clock DATA_CLOCK;
+
 extern "C" {
 
 // This declares the VDSO_mx_* aliases for the vDSO entry points.
@@ -24,4 +28,7 @@ __LOCAL decltype(mx_ticks_get) CODE_soft_ticks_get;
 };
 
 // Code should define '_mx_foo' and then do 'VDSO_PUBLIC_ALIAS(mx_foo);'.
-#define VDSO_PUBLIC_ALIAS(name) decltype(name) name __WEAK_ALIAS("_" #name)
+// This also defines the VDSO_mx_foo name for calls from within the vDSO.
+#define VDSO_PUBLIC_ALIAS(name)                             \
+    decltype(name) name __WEAK_ALIAS("_" #name);            \
+    __LOCAL decltype(name) VDSO_##name __ALIAS("_" #name)
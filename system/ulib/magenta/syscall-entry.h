@@ -4,21 +4,28 @@
 
 #pragma once
 
-.macro syscall_entry_begin name
+// Entry points with public=0 are only for use inside the vDSO (as
+// VDSO_name), and are left out of its dynamic symbol table.
+.macro syscall_entry_begin name, public=1
 .globl _\name
+.if !\public
+.hidden _\name
+.endif
 .type _\name,STT_FUNC
 _\name:
 .cfi_startproc
 .endm
 
-.macro syscall_entry_end name
+.macro syscall_entry_end name, public=1
 .cfi_endproc
 .size _\name, . - _\name
 
+.if \public
 .weak \name
 .type \name,STT_FUNC
 \name = _\name
 .size \name, . - _\name
+.endif
 
 .globl VDSO_\name
 .hidden VDSO_\name
@@ -0,0 +1,680 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <magenta/assert.h>
+#include <mxtl/intrusive_container_utils.h>
+#include <mxtl/intrusive_pointer_traits.h>
+#include <mxtl/intrusive_single_list.h>
+#include <mxtl/macros.h>
+
+// TODO(vtl): Rectify this difference.
+#ifdef _KERNEL
+#include <new.h>
+#else
+#include <magenta/new.h>
+#endif
+
+namespace mxtl {
+
+// Fwd decl of sanity checker class used by tests.
+namespace tests {
+namespace intrusive_containers {
+class DynamicHashTableChecker;
+}  // namespace tests
+}  // namespace intrusive_containers
+
+// DefaultDynamicHashTraits defines the default hash traits of a
+// DynamicHashTable.
+//
+// Unlike the traits of a fixed size HashTable, the hash returned by a dynamic
+// hash table's GetHash is *not* reduced to a bucket index by the user.  The
+// table scrambles and reduces it itself every time the number of buckets
+// changes, so GetHash should return the full width of whatever hash the key
+// has.  The default implementation simply forwards to a static method of
+// ObjType named GetHash which takes a const reference to a KeyType.
+template <typename KeyType,
+          typename ObjType,
+          typename HashType>
+struct DefaultDynamicHashTraits {
+    static_assert(is_unsigned_integer<HashType>::value, "HashTypes must be unsigned integers");
+    static HashType GetHash(const KeyType& key) {
+        return static_cast<HashType>(ObjType::GetHash(key));
+    }
+};
+
+// DynamicHashTable
+//
+// An intrusive hash table with the same interface as HashTable, but whose
+// number of buckets grows with the number of elements it holds.
+//
+// The table starts out with kMinBuckets buckets stored inline in the table
+// itself.  When the average bucket holds more than kMaxLoadFactor elements, an
+// insert allocates a bucket array twice the size of the current one.  Rather
+// than moving every element over at once, each following insert migrates
+// kRehashStep buckets from the old array to the new one; until the old array
+// has been drained, lookups consult whichever of the two arrays holds the
+// bucket for the key.  The cost of a resize is spread over the inserts which
+// caused it, and no single insert pays for more than a handful of buckets.
+//
+// Notes:
+// ++ Insert operations (insert, insert_or_find) may allocate memory.  If an
+//    allocation fails, the table keeps working with the buckets it has and
+//    tries again on a later insert.  Callers which may not allocate where they
+//    insert should stick with a fixed size HashTable.
+// ++ Insert operations may move elements between buckets, which invalidates
+//    all outstanding iterators.  Erase operations never move elements and only
+//    invalidate iterators to the erased element, as with HashTable.
+// ++ The table never shrinks, except to free the old bucket array once it has
+//    been drained.
+template <typename  _KeyType,
+          typename  _PtrType,
+          typename  _BucketType = SinglyLinkedList<_PtrType>,
+          typename  _HashType   = size_t,
+          typename  _KeyTraits  = DefaultKeyedObjectTraits<
+                                    _KeyType,
+                                    typename internal::ContainerPtrTraits<_PtrType>::ValueType>,
+          typename  _HashTraits = DefaultDynamicHashTraits<
+                                    _KeyType,
+                                    typename internal::ContainerPtrTraits<_PtrType>::ValueType,
+                                    _HashType>>
+class DynamicHashTable {
+private:
+    // Private fwd decls of the iterator implementation.
+    template <typename IterTraits> class iterator_impl;
+    struct iterator_traits;
+    struct const_iterator_traits;
+
+public:
+    // Pointer types/traits
+    using PtrType      = _PtrType;
+    using PtrTraits    = internal::ContainerPtrTraits<PtrType>;
+    using ValueType    = typename PtrTraits::ValueType;
+
+    // Key types/traits
+    using KeyType      = _KeyType;
+    using KeyTraits    = _KeyTraits;
+
+    // Hash types/traits
+    using HashType     = _HashType;
+    using HashTraits   = _HashTraits;
+
+    // Bucket types/traits
+    using BucketType   = _BucketType;
+    using NodeTraits   = typename BucketType::NodeTraits;
+
+    // Declarations of the standard iterator types.
+    using iterator       = iterator_impl<iterator_traits>;
+    using const_iterator = iterator_impl<const_iterator_traits>;
+
+    // An alias for the type of this specific DynamicHashTable<...> and its test
+    // sanity checker.
+    using ContainerType = DynamicHashTable<_KeyType, _PtrType, _BucketType, _HashType,
+                                           _KeyTraits, _HashTraits>;
+    using CheckerType   = ::mxtl::tests::intrusive_containers::DynamicHashTableChecker;
+
+    // The number of buckets a table starts out with (always a power of two),
+    // the average number of elements per bucket which triggers growth, and the
+    // number of old buckets each insert migrates while a resize is underway.
+    //
+    // Growing doubles the bucket count, so the table has to take another
+    // (kMaxLoadFactor * old bucket count) inserts before it grows again.
+    // Migrating at least one bucket per insert is enough to drain the old
+    // array before that happens.
+    static constexpr size_t kMinBuckets = 8;
+    static constexpr size_t kMaxLoadFactor = 2;
+    static constexpr size_t kRehashStep = 2;
+
+    // Hash tables only support constant order erase if their underlying bucket
+    // type does.
+    static constexpr bool SupportsConstantOrderErase = BucketType::SupportsConstantOrderErase;
+    static constexpr bool SupportsConstantOrderSize = true;
+    static constexpr bool IsAssociative = true;
+    static constexpr bool IsSequenced = false;
+
+    static_assert((kMinBuckets & (kMinBuckets - 1)) == 0, "kMinBuckets must be a power of two");
+    static_assert(kRehashStep > 0, "Resizes must make progress");
+    static_assert(is_unsigned_integer<HashType>::value, "HashTypes must be unsigned integers");
+
+    DynamicHashTable() { }
+    ~DynamicHashTable() {
+        MX_DEBUG_ASSERT(PtrTraits::IsManaged || is_empty());
+        FreeBuckets(old_buckets_);
+        FreeBuckets(buckets_);
+    }
+
+    // Standard begin/end, cbegin/cend iterator accessors.
+    iterator begin()              { return       iterator(this,       iterator::BEGIN); }
+    const_iterator begin()  const { return const_iterator(this, const_iterator::BEGIN); }
+    const_iterator cbegin() const { return const_iterator(this, const_iterator::BEGIN); }
+
+    iterator end()              { return       iterator(this,       iterator::END); }
+    const_iterator end()  const { return const_iterator(this, const_iterator::END); }
+    const_iterator cend() const { return const_iterator(this, const_iterator::END); }
+
+    // make_iterator : construct an iterator out of a reference to an object.
+    iterator make_iterator(ValueType& obj) {
+        size_t ndx = GetBucketNdx(KeyTraits::GetKey(obj));
+        return iterator(this, ndx, GetBucket(ndx).make_iterator(obj));
+    }
+
+    void insert(const PtrType& ptr) { insert(PtrType(ptr)); }
+    void insert(PtrType&& ptr) {
+        MX_DEBUG_ASSERT(ptr != nullptr);
+        PrepareForInsert();
+
+        KeyType key = KeyTraits::GetKey(*ptr);
+        BucketType& bucket = GetBucket(GetBucketNdx(key));
+
+        // Duplicate keys are disallowed.  Debug assert if someone tries to to
+        // insert an element with a duplicate key.  If the user thought that
+        // there might be a duplicate key in the table already, he/she should
+        // have used insert_or_find() instead.
+        MX_DEBUG_ASSERT(FindInBucket(bucket, key).IsValid() == false);
+
+        bucket.push_front(mxtl::move(ptr));
+        ++count_;
+    }
+
+    // insert_or_find
+    //
+    // Insert the element pointed to by ptr if it is not already in the
+    // table, or find the element that the ptr collided with instead.
+    //
+    // 'iter' is an optional out parameter pointer to an iterator which
+    // will reference either the newly inserted item, or the item whose key
+    // collided with ptr.
+    //
+    // insert_or_find returns true if there was no collision and the item was
+    // successfully inserted, otherwise it returns false.
+    //
+    bool insert_or_find(const PtrType& ptr, iterator* iter = nullptr) {
+        return insert_or_find(PtrType(ptr), iter);
+    }
+
+    bool insert_or_find(PtrType&& ptr, iterator* iter = nullptr) {
+        MX_DEBUG_ASSERT(ptr != nullptr);
+        PrepareForInsert();
+
+        KeyType key         = KeyTraits::GetKey(*ptr);
+        size_t  ndx         = GetBucketNdx(key);
+        auto&   bucket      = GetBucket(ndx);
+        auto    bucket_iter = FindInBucket(bucket, key);
+
+        if (bucket_iter.IsValid()) {
+            if (iter) *iter = iterator(this, ndx, bucket_iter);
+            return false;
+        }
+
+        bucket.push_front(mxtl::move(ptr));
+        ++count_;
+        if (iter) *iter = iterator(this, ndx, bucket.begin());
+        return true;
+    }
+
+    iterator find(const KeyType& key) {
+        size_t ndx         = GetBucketNdx(key);
+        auto&  bucket      = GetBucket(ndx);
+        auto   bucket_iter = FindInBucket(bucket, key);
+
+        return bucket_iter.IsValid() ? iterator(this, ndx, bucket_iter)
+                                     : iterator(this, iterator::END);
+    }
+
+    const_iterator find(const KeyType& key) const {
+        size_t      ndx         = GetBucketNdx(key);
+        const auto& bucket      = GetBucket(ndx);
+        auto        bucket_iter = FindInBucket(bucket, key);
+
+        return bucket_iter.IsValid() ? const_iterator(this, ndx, bucket_iter)
+                                     : const_iterator(this, const_iterator::END);
+    }
+
+    PtrType erase(const KeyType& key) {
+        BucketType& bucket = GetBucket(GetBucketNdx(key));
+
+        PtrType ret = internal::KeyEraseUtils<BucketType, KeyTraits>::erase(bucket, key);
+        if (ret != nullptr)
+            --count_;
+
+        return ret;
+    }
+
+    PtrType erase(const iterator& iter) {
+        if (!iter.IsValid())
+            return PtrType(nullptr);
+
+        return direct_erase(GetBucket(iter.bucket_ndx_), *iter);
+    }
+
+    PtrType erase(ValueType& obj) {
+        return direct_erase(GetBucket(GetBucketNdx(KeyTraits::GetKey(obj))), obj);
+    }
+
+    // clear
+    //
+    // Clear out the all of the buckets.  For managed pointer types, this will
+    // release all references held by the table to the objects which were in
+    // it.  The current bucket array is kept around for reuse; a partially
+    // drained old array is released.
+    void clear() {
+        for (size_t i = 0; i < bucket_ndx_count(); ++i)
+            GetBucket(i).clear();
+        FinishRehash();
+        count_ = 0;
+    }
+
+    // clear_unsafe
+    //
+    // Perform a clear_unsafe on all buckets and reset the internal count to
+    // zero.  See comments in mxtl/intrusive_single_list.h
+    // Think carefully before calling this!
+    void clear_unsafe() {
+        static_assert(PtrTraits::IsManaged == false,
+                     "clear_unsafe is not allowed for containers of managed pointers");
+
+        for (size_t i = 0; i < bucket_ndx_count(); ++i)
+            GetBucket(i).clear_unsafe();
+        FinishRehash();
+        count_ = 0;
+    }
+
+    size_t size()      const { return count_; }
+    bool   is_empty()  const { return count_ == 0; }
+
+    // bucket_count
+    //
+    // The number of buckets in the current bucket array, not counting any old
+    // array still being drained.
+    size_t bucket_count() const { return static_cast<size_t>(1) << shift_; }
+
+    // is_rehashing
+    //
+    // True while elements are still being migrated out of an old bucket array.
+    bool is_rehashing() const { return old_buckets_ != nullptr; }
+
+    // erase_if
+    //
+    // Find the first member of the table which satisfies the predicate given
+    // by 'fn' and erase it from the table, returning a referenced pointer to
+    // the removed element.  Return nullptr if no member satisfies the
+    // predicate.
+    template <typename UnaryFn>
+    PtrType erase_if(UnaryFn fn) {
+        if (is_empty())
+            return PtrType(nullptr);
+
+        for (size_t i = 0; i < bucket_ndx_count(); ++i) {
+            auto& bucket = GetBucket(i);
+            if (!bucket.is_empty()) {
+                PtrType ret = bucket.erase_if(fn);
+                if (ret != nullptr) {
+                    --count_;
+                    return ret;
+                }
+            }
+        }
+
+        return PtrType(nullptr);
+    }
+
+    // find_if
+    //
+    // Find the first member of the table which satisfies the predicate given
+    // by 'fn' and return an iterator to it.  Return end() if no member
+    // satisfies the predicate.
+    template <typename UnaryFn>
+    const_iterator find_if(UnaryFn fn) const {
+        for (auto iter = begin(); iter.IsValid(); ++iter)
+            if (fn(*iter))
+                return iter;
+
+        return end();
+    }
+
+    template <typename UnaryFn>
+    iterator find_if(UnaryFn fn) {
+        for (auto iter = begin(); iter.IsValid(); ++iter)
+            if (fn(*iter))
+                return iter;
+
+        return end();
+    }
+
+private:
+    // The traits of a non-const iterator
+    struct iterator_traits {
+        using RefType    = typename PtrTraits::RefType;
+        using RawPtrType = typename PtrTraits::RawPtrType;
+        using IterType   = typename BucketType::iterator;
+
+        static IterType BucketBegin(BucketType& bucket) { return bucket.begin(); }
+        static IterType BucketEnd  (BucketType& bucket) { return bucket.end(); }
+    };
+
+    // The traits of a const iterator
+    struct const_iterator_traits {
+        using RefType    = typename PtrTraits::ConstRefType;
+        using RawPtrType = typename PtrTraits::ConstRawPtrType;
+        using IterType   = typename BucketType::const_iterator;
+
+        static IterType BucketBegin(const BucketType& bucket) { return bucket.cbegin(); }
+        static IterType BucketEnd  (const BucketType& bucket) { return bucket.cend(); }
+    };
+
+    // The shared implementation of the iterator.  Iterators walk the buckets
+    // by bucket index (see GetBucket), which covers the old bucket array, if
+    // any, followed by the current one.
+    template <class IterTraits>
+    class iterator_impl {
+    public:
+        iterator_impl() { }
+        iterator_impl(const iterator_impl& other) {
+            hash_table_ = other.hash_table_;
+            bucket_ndx_ = other.bucket_ndx_;
+            iter_       = other.iter_;
+        }
+
+        iterator_impl& operator=(const iterator_impl& other) {
+            hash_table_ = other.hash_table_;
+            bucket_ndx_ = other.bucket_ndx_;
+            iter_       = other.iter_;
+            return *this;
+        }
+
+        bool IsValid() const { return iter_.IsValid(); }
+        bool operator==(const iterator_impl& other) const { return iter_ == other.iter_; }
+        bool operator!=(const iterator_impl& other) const { return iter_ != other.iter_; }
+
+        // Prefix
+        iterator_impl& operator++() {
+            if (!IsValid()) return *this;
+            MX_DEBUG_ASSERT(hash_table_);
+
+            // Bump the bucket iterator and go looking for a new bucket if the
+            // iterator has become invalid.
+            ++iter_;
+            advance_if_invalid_iter();
+
+            return *this;
+        }
+
+        iterator_impl& operator--() {
+            // If we have never been bound to a table instance, the we had
+            // better be invalid.
+            if (!hash_table_) {
+                MX_DEBUG_ASSERT(!IsValid());
+                return *this;
+            }
+
+            // Back up the bucket iterator.  If it is still valid, then we are done.
+            --iter_;
+            if (iter_.IsValid())
+                return *this;
+
+            // If the iterator is invalid after backing up, check previous
+            // buckets to see if they contain any nodes.
+            while (bucket_ndx_) {
+                --bucket_ndx_;
+                auto& bucket = GetBucket(bucket_ndx_);
+                if (!bucket.is_empty()) {
+                    iter_ = --IterTraits::BucketEnd(bucket);
+                    MX_DEBUG_ASSERT(iter_.IsValid());
+                    return *this;
+                }
+            }
+
+            // Looks like we have backed up past the beginning.  Update the
+            // bookkeeping to point at the end of the last bucket.
+            bucket_ndx_ = last_ndx();
+            iter_ = IterTraits::BucketEnd(GetBucket(bucket_ndx_));
+
+            return *this;
+        }
+
+        // Postfix
+        iterator_impl operator++(int) {
+            iterator_impl ret(*this);
+            ++(*this);
+            return ret;
+        }
+
+        iterator_impl operator--(int) {
+            iterator_impl ret(*this);
+            --(*this);
+            return ret;
+        }
+
+        typename PtrTraits::PtrType CopyPointer()          { return iter_.CopyPointer(); }
+        typename IterTraits::RefType operator*()     const { return iter_.operator*(); }
+        typename IterTraits::RawPtrType operator->() const { return iter_.operator->(); }
+
+    private:
+        friend ContainerType;
+        using IterType = typename IterTraits::IterType;
+
+        enum BeginTag { BEGIN };
+        enum EndTag { END };
+
+        iterator_impl(const ContainerType* hash_table, BeginTag)
+            : hash_table_(hash_table),
+              bucket_ndx_(0),
+              iter_(IterTraits::BucketBegin(GetBucket(0))) {
+            advance_if_invalid_iter();
+        }
+
+        iterator_impl(const ContainerType* hash_table, EndTag)
+            : hash_table_(hash_table),
+              bucket_ndx_(last_ndx()),
+              iter_(IterTraits::BucketEnd(GetBucket(last_ndx()))) { }
+
+        iterator_impl(const ContainerType* hash_table, size_t bucket_ndx, const IterType& iter)
+            : hash_table_(hash_table),
+              bucket_ndx_(bucket_ndx),
+              iter_(iter) { }
+
+        BucketType& GetBucket(size_t ndx) {
+            return const_cast<ContainerType*>(hash_table_)->GetBucket(ndx);
+        }
+
+        size_t last_ndx() const { return hash_table_->bucket_ndx_count() - 1; }
+
+        void advance_if_invalid_iter() {
+            // If the iterator has run off the end of it's current bucket, then
+            // check to see if there are nodes in any of the remaining buckets.
+            if (!iter_.IsValid()) {
+                while (bucket_ndx_ < last_ndx()) {
+                    ++bucket_ndx_;
+                    auto& bucket = GetBucket(bucket_ndx_);
+
+                    if (!bucket.is_empty()) {
+                        iter_ = IterTraits::BucketBegin(bucket);
+                        MX_DEBUG_ASSERT(iter_.IsValid());
+                        break;
+                    } else if (bucket_ndx_ == last_ndx()) {
+                        iter_ = IterTraits::BucketEnd(bucket);
+                    }
+                }
+            }
+        }
+
+        const ContainerType* hash_table_ = nullptr;
+        size_t bucket_ndx_ = 0;
+        IterType iter_;
+    };
+
+    PtrType direct_erase(BucketType& bucket, ValueType& obj) {
+        PtrType ret = internal::DirectEraseUtils<BucketType>::erase(bucket, obj);
+
+        if (ret != nullptr)
+            --count_;
+
+        return ret;
+    }
+
+    static typename BucketType::iterator FindInBucket(BucketType& bucket,
+                                                      const KeyType& key) {
+        return bucket.find_if(
+            [key](const ValueType& other) -> bool {
+                return KeyTraits::EqualTo(key, KeyTraits::GetKey(other));
+            });
+    }
+
+    static typename BucketType::const_iterator FindInBucket(const BucketType& bucket,
+                                                            const KeyType& key) {
+        return bucket.find_if(
+            [key](const ValueType& other) -> bool {
+                return KeyTraits::EqualTo(key, KeyTraits::GetKey(other));
+            });
+    }
+
+    // Reduce a hash to an index into a bucket array of (1 << shift) buckets.
+    // Multiplying by 2^64 / phi and keeping the top bits mixes every bit of
+    // the hash into the index, so cheap hash functions with a period which
+    // happens to divide the (power of two) bucket count don't pile up.
+    static size_t HashToNdx(HashType hash, uint32_t shift) {
+        return static_cast<size_t>((static_cast<uint64_t>(hash) * 0x9e3779b97f4a7c15ull)
+                                   >> (64 - shift));
+    }
+
+    // Buckets are addressed by a single index which covers both bucket arrays.
+    // While a resize is underway, indices [0, old_bucket_count()) refer to the
+    // old array and the rest to the current one.  Otherwise only the current
+    // array exists, starting at index 0.
+    size_t old_bucket_count() const {
+        return old_buckets_ ? (static_cast<size_t>(1) << old_shift_) : 0;
+    }
+
+    size_t bucket_ndx_count() const { return old_bucket_count() + bucket_count(); }
+
+    BucketType& GetBucket(size_t ndx) {
+        size_t old_count = old_bucket_count();
+        return (ndx < old_count) ? old_buckets_[ndx] : buckets_[ndx - old_count];
+    }
+
+    const BucketType& GetBucket(size_t ndx) const {
+        return const_cast<ContainerType*>(this)->GetBucket(ndx);
+    }
+
+    // Every key lives in exactly one bucket: the old array's bucket for it if
+    // that bucket has not been migrated yet, otherwise the current array's.
+    size_t GetBucketNdx(const KeyType& key) const {
+        HashType hash = HashTraits::GetHash(key);
+
+        if (old_buckets_) {
+            size_t old_ndx = HashToNdx(hash, old_shift_);
+            if (old_ndx >= migrate_ndx_)
+                return old_ndx;
+        }
+
+        return old_bucket_count() + HashToNdx(hash, shift_);
+    }
+
+    // Called at the start of every insert: move the next few old buckets over
+    // to the current array, then start a resize if the table has gotten too
+    // crowded.
+    void PrepareForInsert() {
+        if (old_buckets_)
+            MigrateBuckets(kRehashStep);
+
+        if (count_ >= bucket_count() * kMaxLoadFactor)
+            Grow();
+    }
+
+    void Grow() {
+        // Growth is paced so that the previous resize always finishes first,
+        // but don't count on it.
+        FinishRehash();
+
+        const uint32_t new_shift = shift_ + 1;
+        if (new_shift >= sizeof(size_t) * 8)
+            return;
+
+        AllocChecker ac;
+        BucketType* new_buckets = new (&ac) BucketType[static_cast<size_t>(1) << new_shift];
+        if (!ac.check())
+            return;  // Make do with the buckets we have and try again later.
+
+        old_buckets_ = buckets_;
+        old_shift_   = shift_;
+        migrate_ndx_ = 0;
+        buckets_     = new_buckets;
+        shift_       = new_shift;
+    }
+
+    void MigrateBuckets(size_t count) {
+        MX_DEBUG_ASSERT(old_buckets_);
+        const size_t old_count = old_bucket_count();
+
+        for (; count && (migrate_ndx_ < old_count); --count) {
+            BucketType& src = old_buckets_[migrate_ndx_++];
+            while (!src.is_empty()) {
+                PtrType ptr = src.pop_front();
+                HashType hash = HashTraits::GetHash(KeyTraits::GetKey(*ptr));
+                buckets_[HashToNdx(hash, shift_)].push_front(mxtl::move(ptr));
+            }
+        }
+
+        if (migrate_ndx_ == old_count) {
+            FreeBuckets(old_buckets_);
+            old_buckets_ = nullptr;
+            migrate_ndx_ = 0;
+        }
+    }
+
+    void FinishRehash() {
+        if (old_buckets_)
+            MigrateBuckets(old_bucket_count());
+    }
+
+    void FreeBuckets(BucketType* buckets) {
+        if (buckets != inline_buckets_)
+            delete[] buckets;
+    }
+
+    // The test framework's 'checker' class is our friend.
+    friend CheckerType;
+
+    // Iterators need to access our bucket arrays in order to iterate.
+    friend iterator;
+    friend const_iterator;
+
+    // Hash tables may not currently be copied, assigned or moved.
+    DISALLOW_COPY_ASSIGN_AND_MOVE(DynamicHashTable);
+
+    size_t count_ = 0UL;
+
+    // The current bucket array, holding (1 << shift_) buckets, and the old one
+    // being drained (if any), holding (1 << old_shift_).  Old buckets below
+    // migrate_ndx_ have already been moved and are empty.
+    BucketType* buckets_ = inline_buckets_;
+    uint32_t shift_ = __builtin_ctzl(kMinBuckets);
+    BucketType* old_buckets_ = nullptr;
+    uint32_t old_shift_ = 0;
+    size_t migrate_ndx_ = 0;
+
+    BucketType inline_buckets_[kMinBuckets];
+};
+
+// Explicit declaration of constexpr storage.  Appologies for the macro, but the
+// template declarations are just too hideous with it.
+#define DYNAMIC_HASH_TABLE_PROP(_type, _name) \
+template <typename KeyType, typename PtrType, typename BucketType, typename HashType, \
+          typename KeyTraits, typename HashTraits> \
+constexpr _type DynamicHashTable<KeyType, PtrType, BucketType, HashType, \
+                                 KeyTraits, HashTraits>::_name
+
+DYNAMIC_HASH_TABLE_PROP(size_t, kMinBuckets);
+DYNAMIC_HASH_TABLE_PROP(size_t, kMaxLoadFactor);
+DYNAMIC_HASH_TABLE_PROP(size_t, kRehashStep);
+DYNAMIC_HASH_TABLE_PROP(bool, SupportsConstantOrderErase);
+DYNAMIC_HASH_TABLE_PROP(bool, SupportsConstantOrderSize);
+DYNAMIC_HASH_TABLE_PROP(bool, IsAssociative);
+DYNAMIC_HASH_TABLE_PROP(bool, IsSequenced);
+
+#undef DYNAMIC_HASH_TABLE_PROP
+
+}  // namespace mxtl
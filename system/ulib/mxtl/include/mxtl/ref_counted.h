@@ -36,6 +36,7 @@ public:
     ~RefCounted() {}
 
     using internal::RefCountedBase::AddRef;
+    using internal::RefCountedBase::AddRefMaybeInDestructor;
     using internal::RefCountedBase::Release;
 #if MX_DEBUG_ASSERT_IMPLEMENTED
     using internal::RefCountedBase::Adopt;
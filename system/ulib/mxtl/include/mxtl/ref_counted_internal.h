@@ -20,6 +20,21 @@ protected:
         // TODO(jamesr): Replace uses of GCC builtins with something safer.
         ref_count_.fetch_add(1, memory_order_relaxed);
     }
+    // Like AddRef(), but fails if the count has already dropped to zero and
+    // the object is on its way to being destroyed. For objects which are
+    // found through a raw pointer in a table that their destructor removes
+    // them from. Returns true if a reference was added.
+    bool AddRefMaybeInDestructor() __WARN_UNUSED_RESULT {
+        MX_DEBUG_ASSERT_COND(adopted_);
+        int count = ref_count_.load(memory_order_relaxed);
+        do {
+            if (count == 0) {
+                return false;
+            }
+        } while (!ref_count_.compare_exchange_weak(&count, count + 1, memory_order_acquire,
+                                                   memory_order_relaxed));
+        return true;
+    }
     // Returns true if the object should self-delete.
     bool Release() __WARN_UNUSED_RESULT {
         MX_DEBUG_ASSERT_COND(adopted_);
@@ -23,6 +23,8 @@ RefPtr<T> WrapRefPtr(T* ptr);
 namespace internal {
 template <typename T>
 RefPtr<T> MakeRefPtrNoAdopt(T* ptr);
+template <typename T>
+RefPtr<T> MakeRefPtrUpgradeFromRaw(T* ptr);
 } // namespace internal
 
 // RefPtr<T> holds a reference to an intrusively-refcounted object of type
@@ -190,6 +192,7 @@ private:
     friend class RefPtr;
     friend RefPtr<T> AdoptRef<T>(T*);
     friend RefPtr<T> internal::MakeRefPtrNoAdopt<T>(T*);
+    friend RefPtr<T> internal::MakeRefPtrUpgradeFromRaw<T>(T*);
 
     enum AdoptTag { ADOPT };
     enum NoAdoptTag { NO_ADOPT };
@@ -254,6 +257,18 @@ template <typename T>
 inline RefPtr<T> MakeRefPtrNoAdopt(T* ptr) {
     return RefPtr<T>(ptr, RefPtr<T>::NO_ADOPT);
 }
+
+// Constructs a RefPtr from a raw T* which may be in the middle of being
+// destroyed, returning nullptr if it is. The caller must hold whatever lock
+// the destructor takes to stop others finding the raw pointer, so that the
+// memory stays valid while it's being looked at.
+template <typename T>
+inline RefPtr<T> MakeRefPtrUpgradeFromRaw(T* ptr) {
+    if (!ptr->AddRefMaybeInDestructor()) {
+        return nullptr;
+    }
+    return RefPtr<T>(ptr, RefPtr<T>::NO_ADOPT);
+}
 } // namespace internal
 
 } // namespace mxtl
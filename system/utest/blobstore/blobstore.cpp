@@ -1216,6 +1216,89 @@ static bool RootDirectory(void) {
     END_TEST;
 }
 
+// Reads an entire blob one Merkle leaf at a time, accumulating the time spent
+// reading into |ticks|.
+static bool ReadByLeaf(int fd, char* buf, size_t size_data, uint64_t* ticks) {
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0, "");
+    uint64_t start = mx_ticks_get();
+    for (size_t off = 0; off < size_data; off += merkle::Tree::kNodeSize) {
+        size_t len = size_data - off;
+        if (len > merkle::Tree::kNodeSize) {
+            len = merkle::Tree::kNodeSize;
+        }
+        ASSERT_EQ(StreamAll(read, fd, buf, len), 0, "Failed to read data");
+    }
+    *ticks += mx_ticks_get() - start;
+    return true;
+}
+
+// Benchmarks lookup and read latency across a large number of blobs.
+//
+// The blobs are written, then the filesystem is remounted so that every open
+// must find its blob on disk rather than in the set of open vnodes. Reads are
+// issued one Merkle leaf at a time, and each blob is read twice to show the
+// cost of re-reading data which has already been verified.
+static bool BenchmarkLookupRead(void) {
+    BEGIN_TEST;
+    char ramdisk_path[PATH_MAX];
+    ASSERT_EQ(StartBlobstoreTest(512, 1 << 20, ramdisk_path), 0, "Mounting Blobstore");
+
+    constexpr size_t kNumBlobs = 10000;
+    constexpr size_t kBlobSize = 4 * merkle::Tree::kNodeSize;
+    constexpr size_t kPathLen = sizeof(MOUNT_PATH "/") + merkle::Digest::kLength * 2;
+    AllocChecker ac;
+    mxtl::unique_ptr<char[]> paths(new (&ac) char[kNumBlobs * kPathLen]);
+    ASSERT_TRUE(ac.check(), "");
+
+    // Only the paths are kept around; the blobs themselves would not fit in
+    // memory all at once.
+    for (size_t i = 0; i < kNumBlobs; i++) {
+        mxtl::unique_ptr<blob_info_t> info;
+        ASSERT_TRUE(GenerateBlob(kBlobSize, &info), "");
+        int fd = open(info->path, O_CREAT | O_RDWR);
+        ASSERT_GT(fd, 0, "Failed to create blob");
+        blob_ioctl_config_t config;
+        config.size_data = info->size_data;
+        ASSERT_EQ(ioctl_blobstore_blob_init(fd, &config), 0, "");
+        ASSERT_EQ(StreamAll(write, fd, info->merkle.get(), info->size_merkle), 0, "");
+        ASSERT_EQ(StreamAll(write, fd, info->data.get(), info->size_data), 0, "");
+        ASSERT_EQ(close(fd), 0, "");
+        ASSERT_LT(strlen(info->path), kPathLen, "");
+        strcpy(&paths[i * kPathLen], info->path);
+    }
+
+    ASSERT_EQ(umount(MOUNT_PATH), NO_ERROR, "Could not unmount blobstore");
+    ASSERT_EQ(MountBlobstore(ramdisk_path), 0, "Could not re-mount blobstore");
+
+    mxtl::unique_ptr<char[]> buf(new (&ac) char[merkle::Tree::kNodeSize]);
+    ASSERT_TRUE(ac.check(), "");
+    uint64_t lookup_ticks = 0;
+    uint64_t read_ticks = 0;
+    uint64_t reread_ticks = 0;
+    for (size_t i = 0; i < kNumBlobs; i++) {
+        uint64_t start = mx_ticks_get();
+        int fd = open(&paths[i * kPathLen], O_RDONLY);
+        lookup_ticks += mx_ticks_get() - start;
+        ASSERT_GT(fd, 0, "Failed to open blob");
+
+        ASSERT_TRUE(ReadByLeaf(fd, buf.get(), kBlobSize, &read_ticks), "");
+        ASSERT_TRUE(ReadByLeaf(fd, buf.get(), kBlobSize, &reread_ticks), "");
+        ASSERT_EQ(close(fd), 0, "");
+    }
+
+    uint64_t ticks_per_usec = mx_ticks_per_second() / 1000000;
+    printf("\nBenchmark %zu blobs of %zu bytes\n", kNumBlobs, kBlobSize);
+    printf("Benchmark lookup: [%10lu] usec/blob\n", lookup_ticks / ticks_per_usec / kNumBlobs);
+    printf("Benchmark read:   [%10lu] usec/blob\n", read_ticks / ticks_per_usec / kNumBlobs);
+    printf("Benchmark reread: [%10lu] usec/blob\n", reread_ticks / ticks_per_usec / kNumBlobs);
+
+    for (size_t i = 0; i < kNumBlobs; i++) {
+        ASSERT_EQ(unlink(&paths[i * kPathLen]), 0, "");
+    }
+    ASSERT_EQ(EndBlobstoreTest(ramdisk_path), 0, "unmounting blobstore");
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(blobstore_tests)
 RUN_TEST_MEDIUM(TestBasic)
 RUN_TEST_MEDIUM(TestMmap)
@@ -1237,6 +1320,7 @@ RUN_TEST_MEDIUM(RootDirectory)
 RUN_TEST_LARGE(CreateUmountRemountLargeMultithreaded)
 RUN_TEST_LARGE(CreateUmountRemountLarge)
 RUN_TEST_LARGE(NoSpace)
+RUN_TEST_LARGE(BenchmarkLookupRead)
 END_TEST_CASE(blobstore_tests)
 
 int main(int argc, char** argv) {
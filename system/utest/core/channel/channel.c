@@ -10,6 +10,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <threads.h>
 #include <unistd.h>
 
@@ -773,6 +774,220 @@ static bool channel_nest(void) {
     END_TEST;
 }
 
+static bool channel_read_write_many(void) {
+    BEGIN_TEST;
+    mx_handle_t channel[2];
+    mx_status_t status = mx_channel_create(0, &channel[0], &channel[1]);
+    ASSERT_EQ(status, NO_ERROR, "error in channel create");
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+
+    // Three messages of different sizes, the second carrying a handle.
+    char out[3][8] = {"a", "bb", "ccc"};
+    mx_channel_msg_t wr[3] = {
+        {out[0], NULL, 1u, 0u},
+        {out[1], &event, 2u, 1u},
+        {out[2], NULL, 3u, 0u},
+    };
+    status = mx_channel_write_many(channel[0], 0u, wr, 3u);
+    ASSERT_EQ(status, NO_ERROR, "write_many failed");
+    EXPECT_EQ(mx_handle_close(event), ERR_BAD_HANDLE, "handle should have been transferred");
+
+    // Ask for more than are queued; we get the three there are.
+    char in[4][8];
+    mx_handle_t handles[4] = {};
+    mx_channel_msg_t rd[4];
+    for (int i = 0; i < 4; i++) {
+        rd[i] = (mx_channel_msg_t){in[i], &handles[i], sizeof(in[i]), 1u};
+    }
+    uint32_t count = 0u;
+    status = mx_channel_read_many(channel[1], 0u, rd, 4u, &count);
+    ASSERT_EQ(status, NO_ERROR, "read_many failed");
+    ASSERT_EQ(count, 3u, "wrong message count");
+    for (uint32_t i = 0; i < count; i++) {
+        EXPECT_EQ(rd[i].num_bytes, i + 1u, "wrong message size");
+        EXPECT_EQ(memcmp(in[i], out[i], i + 1u), 0, "wrong message data");
+    }
+    EXPECT_EQ(rd[0].num_handles, 0u, "");
+    EXPECT_EQ(rd[1].num_handles, 1u, "");
+    EXPECT_EQ(rd[2].num_handles, 0u, "");
+    EXPECT_EQ(mx_handle_close(handles[1]), NO_ERROR, "handle should have been received");
+
+    status = mx_channel_read_many(channel[1], 0u, rd, 4u, &count);
+    EXPECT_EQ(status, ERR_SHOULD_WAIT, "read_many on empty channel");
+
+    mx_handle_close(channel[0]);
+    mx_handle_close(channel[1]);
+    END_TEST;
+}
+
+static bool channel_read_many_small_buffer(void) {
+    BEGIN_TEST;
+    mx_handle_t channel[2];
+    mx_status_t status = mx_channel_create(0, &channel[0], &channel[1]);
+    ASSERT_EQ(status, NO_ERROR, "error in channel create");
+
+    char big[16] = "0123456789abcde";
+    mx_channel_msg_t wr[3] = {
+        {big, NULL, 4u, 0u},
+        {big, NULL, 16u, 0u},
+        {big, NULL, 4u, 0u},
+    };
+    ASSERT_EQ(mx_channel_write_many(channel[0], 0u, wr, 3u), NO_ERROR, "");
+
+    // Reading stops at the message which doesn't fit, leaving it queued.
+    char in[3][8];
+    mx_channel_msg_t rd[3];
+    for (int i = 0; i < 3; i++) {
+        rd[i] = (mx_channel_msg_t){in[i], NULL, sizeof(in[i]), 0u};
+    }
+    uint32_t count = 0u;
+    status = mx_channel_read_many(channel[1], 0u, rd, 3u, &count);
+    ASSERT_EQ(status, NO_ERROR, "read_many failed");
+    EXPECT_EQ(count, 1u, "read past a message which doesn't fit");
+
+    // Now it's first, so there's nothing to return but its size.
+    rd[0].num_bytes = sizeof(in[0]);
+    status = mx_channel_read_many(channel[1], 0u, rd, 3u, &count);
+    EXPECT_EQ(status, ERR_BUFFER_TOO_SMALL, "");
+    EXPECT_EQ(rd[0].num_bytes, 16u, "size of the message which didn't fit");
+
+    char data[16];
+    uint32_t size = 0u;
+    status = mx_channel_read(channel[1], 0u, data, NULL, sizeof(data), 0u, &size, NULL);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(size, 16u, "");
+
+    mx_handle_close(channel[0]);
+    mx_handle_close(channel[1]);
+    END_TEST;
+}
+
+static bool channel_read_many_bad_buffer(void) {
+    BEGIN_TEST;
+    mx_handle_t channel[2];
+    mx_status_t status = mx_channel_create(0, &channel[0], &channel[1]);
+    ASSERT_EQ(status, NO_ERROR, "error in channel create");
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+
+    char out[2][8] = {"a", "bb"};
+    mx_channel_msg_t wr[2] = {
+        {out[0], &event, 1u, 1u},
+        {out[1], NULL, 2u, 0u},
+    };
+    ASSERT_EQ(mx_channel_write_many(channel[0], 0u, wr, 2u), NO_ERROR, "");
+
+    // The second buffer is bad; nothing is read, and the handle carried by
+    // the first message is not installed.
+    char in[2][8];
+    mx_handle_t handle = MX_HANDLE_INVALID;
+    mx_channel_msg_t rd[2] = {
+        {in[0], &handle, sizeof(in[0]), 1u},
+        {(void*)1, NULL, sizeof(in[1]), 0u},
+    };
+    uint32_t count = 0u;
+    status = mx_channel_read_many(channel[1], 0u, rd, 2u, &count);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "read_many into a bad buffer");
+
+    // Both messages are still there, in order.
+    rd[0] = (mx_channel_msg_t){in[0], &handle, sizeof(in[0]), 1u};
+    rd[1] = (mx_channel_msg_t){in[1], NULL, sizeof(in[1]), 0u};
+    status = mx_channel_read_many(channel[1], 0u, rd, 2u, &count);
+    ASSERT_EQ(status, NO_ERROR, "read_many failed");
+    ASSERT_EQ(count, 2u, "messages should have been put back");
+    EXPECT_EQ(memcmp(in[0], out[0], 1u), 0, "wrong message data");
+    EXPECT_EQ(memcmp(in[1], out[1], 2u), 0, "wrong message data");
+    EXPECT_EQ(rd[0].num_handles, 1u, "");
+    EXPECT_EQ(mx_handle_close(handle), NO_ERROR, "handle should have been received");
+
+    mx_handle_close(channel[0]);
+    mx_handle_close(channel[1]);
+    END_TEST;
+}
+
+static bool channel_write_many_bad_handle(void) {
+    BEGIN_TEST;
+    mx_handle_t channel[2];
+    mx_status_t status = mx_channel_create(0, &channel[0], &channel[1]);
+    ASSERT_EQ(status, NO_ERROR, "error in channel create");
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+    mx_handle_t bad = MX_HANDLE_INVALID;
+
+    // The second message fails, so neither is written and the first one's
+    // handle stays with us.
+    char data = 'x';
+    mx_channel_msg_t wr[2] = {
+        {&data, &event, 1u, 1u},
+        {&data, &bad, 1u, 1u},
+    };
+    status = mx_channel_write_many(channel[0], 0u, wr, 2u);
+    EXPECT_EQ(status, ERR_BAD_HANDLE, "write_many with a bad handle");
+    EXPECT_EQ(mx_channel_read(channel[1], 0u, NULL, NULL, 0u, 0u, NULL, NULL), ERR_SHOULD_WAIT,
+              "no message should have been written");
+    EXPECT_EQ(mx_handle_close(event), NO_ERROR, "handle should have been put back");
+
+    status = mx_channel_write_many(channel[0], 0u, wr, MX_CHANNEL_MAX_BATCH_MSGS + 1u);
+    EXPECT_EQ(status, ERR_OUT_OF_RANGE, "batch too big");
+
+    mx_handle_close(channel[0]);
+    mx_handle_close(channel[1]);
+    END_TEST;
+}
+
+static bool read_large_message(mx_handle_t channel[2], const uint8_t* out, uint32_t size,
+                               uint8_t* in) {
+    BEGIN_HELPER;
+    mx_status_t status = mx_channel_write(channel[0], 0u, out, size, NULL, 0u);
+    ASSERT_EQ(status, NO_ERROR, "write failed");
+    uint32_t r_size = 0u;
+    status = mx_channel_read(channel[1], 0u, in, NULL, size, 0u, &r_size, NULL);
+    ASSERT_EQ(status, NO_ERROR, "read failed");
+    ASSERT_EQ(r_size, size, "wrong message size");
+    EXPECT_EQ(memcmp(in, out, size), 0, "wrong message data");
+    END_HELPER;
+}
+
+static bool channel_large_message(void) {
+    BEGIN_TEST;
+    mx_handle_t channel[2];
+    mx_status_t status = mx_channel_create(0, &channel[0], &channel[1]);
+    ASSERT_EQ(status, NO_ERROR, "error in channel create");
+
+    // Many pages long, with a partial page at the end.
+    const uint32_t size = 65536u - 100u;
+    uint8_t* out = malloc(size);
+    uint8_t* in = aligned_alloc(4096, 65536u + 4096u);
+    ASSERT_NONNULL(out, "");
+    ASSERT_NONNULL(in, "");
+    for (uint32_t i = 0; i < size; i++)
+        out[i] = (uint8_t)(i * 7u);
+
+    EXPECT_TRUE(read_large_message(channel, out, size, in), "aligned");
+
+    // Again into the same pages, with different data.
+    for (uint32_t i = 0; i < size; i++)
+        out[i] = (uint8_t)(i * 13u);
+    EXPECT_TRUE(read_large_message(channel, out, size, in), "aligned again");
+
+    // Bytes past the message are left alone.
+    in[size] = 0xa5;
+    EXPECT_TRUE(read_large_message(channel, out, size, in), "aligned, guard byte");
+    EXPECT_EQ(in[size], 0xa5, "read past the end of the message");
+
+    EXPECT_TRUE(read_large_message(channel, out, size, in + 1), "unaligned");
+
+    free(in);
+    free(out);
+    mx_handle_close(channel[0]);
+    mx_handle_close(channel[1]);
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(channel_tests)
 RUN_TEST(channel_test)
 RUN_TEST(channel_read_error_test)
@@ -784,6 +999,11 @@ RUN_TEST(channel_may_discard)
 RUN_TEST(channel_call)
 RUN_TEST(channel_call2)
 RUN_TEST(channel_nest)
+RUN_TEST(channel_read_write_many)
+RUN_TEST(channel_read_many_small_buffer)
+RUN_TEST(channel_read_many_bad_buffer)
+RUN_TEST(channel_write_many_bad_handle)
+RUN_TEST(channel_large_message)
 END_TEST_CASE(channel_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -62,6 +62,58 @@ static bool test_futex_wait_bad_address() {
     END_TEST;
 }
 
+static bool test_futex_wait_pi_args() {
+    BEGIN_TEST;
+    int futex_value = 123;
+    mx_handle_t self = thrd_get_mx_handle(thrd_current());
+
+    mx_status_t rc = mx_futex_wait_pi(&futex_value, futex_value, MX_HANDLE_INVALID, 0);
+    ASSERT_EQ(rc, ERR_BAD_HANDLE, "PI futex wait needs a valid owner");
+    rc = mx_futex_wait_pi(&futex_value, futex_value + 1, self, MX_TIME_INFINITE);
+    ASSERT_EQ(rc, ERR_BAD_STATE, "PI futex wait should have returned bad state");
+    rc = mx_futex_wait_pi(&futex_value, futex_value, self, 0);
+    ASSERT_EQ(rc, ERR_TIMED_OUT, "PI futex wait should have returned timeout");
+    END_TEST;
+}
+
+struct PiWaiterArgs {
+    volatile int* futex_addr;
+    mx_handle_t owner;
+};
+
+static int pi_waiter_thread(void* arg) {
+    auto args = static_cast<PiWaiterArgs*>(arg);
+    return mx_futex_wait_pi(const_cast<int*>(args->futex_addr), 0, args->owner,
+                            MX_TIME_INFINITE);
+}
+
+// Waiters on a PI futex must all name the same owner.
+static bool test_futex_wait_pi_owner_mismatch() {
+    BEGIN_TEST;
+    volatile int futex_value = 0;
+    mx_handle_t self = thrd_get_mx_handle(thrd_current());
+    PiWaiterArgs args = {&futex_value, self};
+
+    thrd_t thread;
+    ASSERT_EQ(thrd_create_with_name(&thread, pi_waiter_thread, &args, "pi_waiter"),
+              thrd_success, "Error during thread creation");
+    // This should be long enough for the thread to block on the futex.
+    struct timespec wait_time = {0, 100 * 1000000 /* nanoseconds */};
+    EXPECT_EQ(nanosleep(&wait_time, NULL), 0, "Error in nanosleep");
+
+    mx_status_t rc = mx_futex_wait_pi(const_cast<int*>(&futex_value), 0,
+                                      thrd_get_mx_handle(thread), 0);
+    EXPECT_EQ(rc, ERR_INVALID_ARGS, "PI futex wait should refuse a different owner");
+    rc = mx_futex_wait_pi(const_cast<int*>(&futex_value), 0, self, 0);
+    EXPECT_EQ(rc, ERR_TIMED_OUT, "PI futex wait should accept the same owner");
+
+    EXPECT_EQ(mx_futex_wake(const_cast<int*>(&futex_value), 1), NO_ERROR, "Error in wake");
+    int result;
+    EXPECT_EQ(thrd_join(thread, &result), thrd_success, "Error joining thread");
+    EXPECT_EQ(result, NO_ERROR, "PI futex wait should have been woken");
+    END_TEST;
+}
+
 // This starts a thread which waits on a futex.  We can do futex_wake()
 // operations and then test whether or not this thread has been woken up.
 class TestThread {
@@ -502,6 +554,8 @@ RUN_TEST(test_futex_wait_value_mismatch);
 RUN_TEST(test_futex_wait_timeout);
 RUN_TEST(test_futex_wait_timeout_elapsed);
 RUN_TEST(test_futex_wait_bad_address);
+RUN_TEST(test_futex_wait_pi_args);
+RUN_TEST(test_futex_wait_pi_owner_mismatch);
 RUN_TEST(test_futex_wakeup);
 RUN_TEST(test_futex_wakeup_limit);
 RUN_TEST(test_futex_wakeup_address);
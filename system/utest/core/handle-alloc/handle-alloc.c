@@ -0,0 +1,107 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <threads.h>
+
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+// Handle create/close throughput versus thread count.
+//
+// Each thread repeatedly duplicates an event handle and closes the
+// duplicate, so every iteration allocates and frees one kernel handle slot.
+// With per-cpu handle caches the aggregate rate should scale with the
+// number of threads (up to the number of cpus) instead of flattening out on
+// a global lock.
+
+#define BENCH_ITERATIONS 20000
+#define BENCH_MAX_THREADS 16
+
+typedef struct {
+    mx_handle_t event;
+    // 0 until the threads may start, then 1 to run or -1 to give up.
+    atomic_int* start;
+    mx_status_t status;
+} bench_thread_t;
+
+static int bench_thread(void* arg) {
+    bench_thread_t* t = arg;
+    int start;
+    while ((start = atomic_load(t->start)) == 0)
+        thrd_yield();
+    if (start < 0)
+        return 0;
+
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        mx_handle_t dup;
+        mx_status_t status = mx_handle_duplicate(t->event, MX_RIGHT_SAME_RIGHTS, &dup);
+        if (status != NO_ERROR) {
+            t->status = status;
+            return 0;
+        }
+        status = mx_handle_close(dup);
+        if (status != NO_ERROR) {
+            t->status = status;
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static bool run_bench(int num_threads) {
+    BEGIN_HELPER;
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+
+    atomic_int start = ATOMIC_VAR_INIT(0);
+    bench_thread_t args[BENCH_MAX_THREADS];
+    thrd_t threads[BENCH_MAX_THREADS];
+    int created;
+    for (created = 0; created < num_threads; created++) {
+        args[created] = (bench_thread_t){.event = event, .start = &start, .status = NO_ERROR};
+        if (thrd_create(&threads[created], bench_thread, &args[created]) != thrd_success)
+            break;
+    }
+
+    // If not all of the threads could be created, the ones which were still
+    // have to be joined, but needn't run.
+    mx_time_t t = mx_time_get(MX_CLOCK_MONOTONIC);
+    atomic_store(&start, created == num_threads ? 1 : -1);
+    for (int i = 0; i < created; i++) {
+        EXPECT_EQ(thrd_join(threads[i], NULL), thrd_success, "");
+        EXPECT_EQ(args[i].status, NO_ERROR, "handle create/close failed");
+    }
+    t = mx_time_get(MX_CLOCK_MONOTONIC) - t;
+
+    EXPECT_EQ(mx_handle_close(event), NO_ERROR, "");
+    ASSERT_EQ(created, num_threads, "thread creation failed");
+
+    uint64_t ops = (uint64_t)num_threads * BENCH_ITERATIONS;
+    unittest_printf("%2d threads: %8" PRIu64 " create/close pairs in %8" PRIu64 " us, "
+                    "%10" PRIu64 " pairs/sec\n",
+                    num_threads, ops, t / 1000, t ? ops * UINT64_C(1000000000) / t : 0);
+    END_HELPER;
+}
+
+static bool handle_alloc_bench(void) {
+    BEGIN_TEST;
+    unittest_printf("\n");
+    for (int num_threads = 1; num_threads <= BENCH_MAX_THREADS; num_threads *= 2) {
+        ASSERT_TRUE(run_bench(num_threads), "");
+    }
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(handle_alloc_tests)
+RUN_TEST_PERFORMANCE(handle_alloc_bench)
+END_TEST_CASE(handle_alloc_tests)
+
+#ifndef BUILD_COMBINED_TESTS
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
+#endif
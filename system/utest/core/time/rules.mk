@@ -11,7 +11,8 @@ MODULE_TYPE := usertest
 MODULE_USERTEST_GROUP := core
 
 MODULE_SRCS += \
-    $(LOCAL_DIR)/ticks.c
+    $(LOCAL_DIR)/ticks.c \
+    $(LOCAL_DIR)/time.c
 
 MODULE_NAME := time-test
 
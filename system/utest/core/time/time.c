@@ -0,0 +1,102 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <magenta/mx-syscall-numbers.h>
+#include <magenta/syscalls.h>
+#include <unittest/unittest.h>
+
+// mx_time_get reads the clocks in user mode when it can.  This makes the
+// internal syscall the vDSO falls back to, for comparison.
+static mx_time_t time_get_via_kernel(uint32_t clock_id) {
+#if defined(__x86_64__)
+    uint64_t rdi = clock_id;
+    mx_time_t time;
+    __asm__ volatile("syscall"
+                     : "=a"(time), "+D"(rdi)
+                     : "a"(0x00ff00ff00000000ull | MX_SYS_time_get_via_kernel)
+                     : "rcx", "rdx", "rsi", "r8", "r9", "r10", "r11", "memory");
+    return time;
+#elif defined(__aarch64__)
+    register uint64_t x0 __asm__("x0") = clock_id;
+    __asm__ volatile("mov x16, %1\n"
+                     "svc #0xf0f"
+                     : "+r"(x0)
+                     : "i"(MX_SYS_time_get_via_kernel)
+                     : "x1", "x2", "x3", "x4", "x5", "x6", "x7", "x8", "x9",
+                       "x10", "x11", "x12", "x13", "x14", "x15", "x16", "x17",
+                       "memory");
+    return x0;
+#else
+#error Unsupported architecture
+#endif
+}
+
+static bool clock_matches_kernel(uint32_t clock_id) {
+    BEGIN_HELPER;
+    for (int i = 0; i < 1000; i++) {
+        mx_time_t before = time_get_via_kernel(clock_id);
+        mx_time_t now = mx_time_get(clock_id);
+        mx_time_t after = time_get_via_kernel(clock_id);
+        ASSERT_LE(before, now, "clock went backwards");
+        ASSERT_LE(now, after, "clock went backwards");
+    }
+    END_HELPER;
+}
+
+static bool monotonic_matches_kernel(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(clock_matches_kernel(MX_CLOCK_MONOTONIC), "");
+    END_TEST;
+}
+
+static bool utc_matches_kernel(void) {
+    BEGIN_TEST;
+    ASSERT_TRUE(clock_matches_kernel(MX_CLOCK_UTC), "");
+    END_TEST;
+}
+
+// Returns the average cost of a call in nanoseconds.
+static uint64_t time_calls(mx_time_t (*get)(uint32_t), uint32_t clock_id) {
+    static const uint64_t kCalls = 1000000;
+
+    uint64_t ticks_per_usec = mx_ticks_per_second() / 1000000;
+    if (ticks_per_usec == 0)
+        ticks_per_usec = 1;
+
+    uint64_t start = mx_ticks_get();
+    for (uint64_t i = 0; i < kCalls; i++)
+        get(clock_id);
+    return (mx_ticks_get() - start) * 1000 / ticks_per_usec / kCalls;
+}
+
+static bool time_get_benchmark(void) {
+    BEGIN_TEST;
+
+    static const struct {
+        const char* name;
+        uint32_t clock_id;
+    } kClocks[] = {
+        {"monotonic", MX_CLOCK_MONOTONIC},
+        {"utc", MX_CLOCK_UTC},
+    };
+
+    printf("\n");
+    for (size_t i = 0; i < countof(kClocks); i++) {
+        printf("%-10s mx_time_get %5" PRIu64 " ns/call, syscall %5" PRIu64 " ns/call\n",
+               kClocks[i].name,
+               time_calls(mx_time_get, kClocks[i].clock_id),
+               time_calls(time_get_via_kernel, kClocks[i].clock_id));
+    }
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(time_tests)
+RUN_TEST(monotonic_matches_kernel)
+RUN_TEST(utc_matches_kernel)
+RUN_TEST_PERFORMANCE(time_get_benchmark)
+END_TEST_CASE(time_tests)
@@ -4,8 +4,11 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stdalign.h>
+#include <stdio.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <magenta/process.h>
@@ -1593,6 +1596,67 @@ bool protect_over_demand_paged_test() {
     END_TEST;
 }
 
+// Keeps a cpu busy inside this process, so that TLB shootdowns for our
+// address space have to reach it.
+int unmap_bench_spinner(void* arg) {
+    volatile int* stop = static_cast<volatile int*>(arg);
+    while (!__atomic_load_n(stop, __ATOMIC_RELAXED)) {
+    }
+    return 0;
+}
+
+// Reports how long unmapping a fully populated mapping takes, for a range of
+// mapping sizes and numbers of other cpus running in the address space.
+bool unmap_bench_test() {
+    BEGIN_TEST;
+
+    const size_t kMaxSize = 64 * 1024 * 1024;
+    const int kIterations = 8;
+    const uint32_t kMaxSpinners = 31;
+    uint32_t cpus = mx_system_get_num_cpus();
+    if (cpus > kMaxSpinners + 1) {
+        cpus = kMaxSpinners + 1;
+    }
+
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_vmo_create(kMaxSize, 0, &vmo), NO_ERROR, "");
+    ASSERT_EQ(mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, kMaxSize, nullptr, 0), NO_ERROR, "");
+
+    const uint64_t ticks_per_usec = mx_ticks_per_second() / 1000000;
+    printf("\n%8s %10s %12s\n", "spinners", "size (KB)", "unmap (us)");
+    for (uint32_t spinners = 0; spinners < cpus; spinners++) {
+        int stop = 0;
+        thrd_t threads[kMaxSpinners];
+        for (uint32_t i = 0; i < spinners; i++) {
+            ASSERT_EQ(thrd_create(&threads[i], unmap_bench_spinner, &stop), thrd_success, "");
+        }
+
+        for (size_t size = 16 * PAGE_SIZE; size <= kMaxSize; size *= 4) {
+            uint64_t ticks = 0;
+            for (int i = 0; i < kIterations; i++) {
+                uintptr_t addr;
+                ASSERT_EQ(mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                                      MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE |
+                                      MX_VM_FLAG_MAP_RANGE, &addr),
+                          NO_ERROR, "");
+                uint64_t start = mx_ticks_get();
+                ASSERT_EQ(mx_vmar_unmap(mx_vmar_root_self(), addr, size), NO_ERROR, "");
+                ticks += mx_ticks_get() - start;
+            }
+            printf("%8u %10zu %12" PRIu64 "\n", spinners, size / 1024,
+                   ticks / kIterations / ticks_per_usec);
+        }
+
+        __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+        for (uint32_t i = 0; i < spinners; i++) {
+            ASSERT_EQ(thrd_join(threads[i], nullptr), thrd_success, "");
+        }
+    }
+
+    EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+    END_TEST;
+}
+
 }
 
 BEGIN_TEST_CASE(vmar_tests)
@@ -1616,6 +1680,7 @@ RUN_TEST(map_specific_overwrite_test);
 RUN_TEST(protect_split_test);
 RUN_TEST(protect_multiple_test);
 RUN_TEST(protect_over_demand_paged_test);
+RUN_TEST_PERFORMANCE(unmap_bench_test);
 END_TEST_CASE(vmar_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -11,6 +11,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <magenta/new.h>
@@ -90,6 +91,99 @@ bool benchmark_write_read(void) {
     END_TEST;
 }
 
+constexpr size_t kLargeFileOps = 1024; // 64 MiB file
+
+// The goal of this benchmark is to measure how long it takes to get the first
+// byte out of a large file which was just opened (and isn't already cached by
+// the filesystem), and then to stream the rest of the file.
+bool benchmark_first_byte(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Large file first byte + Stream\n");
+    int fd = open(MOUNT_POINT "/largefile", O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "Cannot create file");
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kDataSize]);
+    ASSERT_EQ(ac.check(), true, "");
+    memset(data.get(), kMagicByte, kDataSize);
+    for (size_t i = 0; i < kLargeFileOps; i++) {
+        ASSERT_EQ(write(fd, data.get(), kDataSize), kDataSize, "");
+    }
+    ASSERT_EQ(close(fd), 0, "");
+
+    uint64_t start, end;
+    uint64_t ticks_per_usec = mx_ticks_per_second() / 1000000;
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+
+    start = mx_ticks_get();
+    fd = open(MOUNT_POINT "/largefile", O_RDONLY);
+    ASSERT_GT(fd, 0, "Cannot open file");
+    uint8_t byte;
+    ASSERT_EQ(read(fd, &byte, 1), 1, "");
+    end = mx_ticks_get();
+    ASSERT_EQ(byte, kMagicByte, "");
+    printf("Benchmark first byte: [%10lu] usec\n", (end - start) / ticks_per_usec);
+
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kLargeFileOps; i++) {
+        ssize_t expected = (i == 0) ? kDataSize - 1 : kDataSize;
+        ASSERT_EQ(read(fd, data.get(), expected), expected, "");
+        ASSERT_EQ(data[0], kMagicByte, "");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark stream:     [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink(MOUNT_POINT "/largefile"), 0, "");
+    END_TEST;
+}
+
+constexpr size_t kRandomFileOps = 256;   // 16 MiB file
+constexpr size_t kRandomWriteSize = 512;
+constexpr size_t kNumRandomWrites = 10000;
+
+// Small writes scattered over a file which already exists, timed separately
+// from the fsync which makes them durable.
+bool benchmark_random_write(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Small Random Writes\n");
+    int fd = open(MOUNT_POINT "/randomfile", O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "Cannot create file");
+
+    AllocChecker ac;
+    mxtl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kDataSize]);
+    ASSERT_EQ(ac.check(), true, "");
+    memset(data.get(), kMagicByte, kDataSize);
+    for (size_t i = 0; i < kRandomFileOps; i++) {
+        ASSERT_EQ(write(fd, data.get(), kDataSize), kDataSize, "");
+    }
+    ASSERT_EQ(fsync(fd), 0, "");
+
+    uint64_t start, end;
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+    constexpr size_t kSlots = kRandomFileOps * kDataSize / kRandomWriteSize;
+    unsigned int seed = 0;
+
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kNumRandomWrites; i++) {
+        off_t off = static_cast<off_t>((rand_r(&seed) % kSlots) * kRandomWriteSize);
+        ASSERT_EQ(pwrite(fd, data.get(), kRandomWriteSize, off), kRandomWriteSize, "");
+    }
+    end = mx_ticks_get();
+    uint64_t write_msec = (end - start) / ticks_per_msec;
+    printf("Benchmark write: [%10lu] msec, [%10lu] writes/sec\n", write_msec,
+           (write_msec == 0) ? 0 : kNumRandomWrites * 1000 / write_msec);
+
+    start = mx_ticks_get();
+    ASSERT_EQ(fsync(fd), 0, "");
+    end = mx_ticks_get();
+    printf("Benchmark fsync: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(unlink(MOUNT_POINT "/randomfile"), 0, "");
+    END_TEST;
+}
+
 #define START_STRING "/aaa"
 
 size_t constexpr cStrlen(const char* str) {
@@ -181,7 +275,140 @@ bool benchmark_path_walk(void) {
     END_TEST;
 }
 
+constexpr size_t kNumFiles = 10000;
+constexpr size_t kAppendSize = 100;
+constexpr size_t kNumAppends = 10000;
+
+#define WIDE_DIR MOUNT_POINT "/wide"
+
+// The goal of this benchmark is to measure how creation and lookup scale with
+// the number of entries in a single directory, and how a long series of small
+// appends to one file scales with the size of that file.
+bool benchmark_wide_directory(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Wide directory + Append\n");
+    ASSERT_EQ(mkdir(WIDE_DIR, 0666), 0, "Could not make directory");
+
+    char path[PATH_MAX];
+    uint64_t start, end;
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kNumFiles; i++) {
+        snprintf(path, sizeof(path), WIDE_DIR "/file%05zu", i);
+        int fd = open(path, O_CREAT | O_RDWR | O_EXCL, 0644);
+        ASSERT_GT(fd, 0, "Cannot create file");
+        ASSERT_EQ(close(fd), 0, "");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark create: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kNumFiles; i++) {
+        // Look up the entries in a different order than they were created.
+        snprintf(path, sizeof(path), WIDE_DIR "/file%05zu", (i * 7919) % kNumFiles);
+        struct stat buf;
+        ASSERT_EQ(stat(path, &buf), 0, "Could not stat file");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark lookup: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    uint8_t data[kAppendSize];
+    memset(data, kMagicByte, sizeof(data));
+    int fd = open(WIDE_DIR "/file00000", O_RDWR | O_APPEND);
+    ASSERT_GT(fd, 0, "Cannot open file");
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kNumAppends; i++) {
+        ASSERT_EQ(write(fd, data, sizeof(data)), sizeof(data), "");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark append: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    struct stat buf;
+    ASSERT_EQ(fstat(fd, &buf), 0, "");
+    ASSERT_EQ(buf.st_size, static_cast<off_t>(kAppendSize * kNumAppends), "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    start = mx_ticks_get();
+    for (size_t i = 0; i < kNumFiles; i++) {
+        snprintf(path, sizeof(path), WIDE_DIR "/file%05zu", i);
+        ASSERT_EQ(unlink(path), 0, "Could not unlink file");
+    }
+    end = mx_ticks_get();
+    printf("Benchmark unlink: [%10lu] msec\n", (end - start) / ticks_per_msec);
+
+    ASSERT_EQ(unlink(WIDE_DIR), 0, "Could not unlink directory");
+    END_TEST;
+}
+
+constexpr size_t kMaxThreads = 8;
+constexpr size_t kFilesPerThread = 1000;
+
+// Each thread creates, stats and unlinks files in a directory of its own, so
+// the threads only contend on the filesystem itself.
+static int metadata_thread(void* arg) {
+    size_t id = reinterpret_cast<uintptr_t>(arg);
+    char dir[PATH_MAX];
+    char path[PATH_MAX];
+    snprintf(dir, sizeof(dir), MOUNT_POINT "/parallel%zu", id);
+    if (mkdir(dir, 0666) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < kFilesPerThread; i++) {
+        snprintf(path, sizeof(path), "%s/file%05zu", dir, i);
+        int fd = open(path, O_CREAT | O_RDWR | O_EXCL, 0644);
+        if ((fd < 0) || (close(fd) != 0)) {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < kFilesPerThread; i++) {
+        snprintf(path, sizeof(path), "%s/file%05zu", dir, i);
+        struct stat buf;
+        if (stat(path, &buf) != 0) {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < kFilesPerThread; i++) {
+        snprintf(path, sizeof(path), "%s/file%05zu", dir, i);
+        if (unlink(path) != 0) {
+            return -1;
+        }
+    }
+    return unlink(dir);
+}
+
+// The goal of this benchmark is to measure how metadata operations scale as
+// more clients use the filesystem at once.
+bool benchmark_parallel_metadata(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Parallel create + stat + unlink\n");
+    uint64_t start, end;
+    uint64_t ticks_per_msec = mx_ticks_per_second() / 1000;
+
+    for (size_t num_threads = 1; num_threads <= kMaxThreads; num_threads *= 2) {
+        thrd_t threads[kMaxThreads];
+        start = mx_ticks_get();
+        for (size_t i = 0; i < num_threads; i++) {
+            ASSERT_EQ(thrd_create(&threads[i], metadata_thread, reinterpret_cast<void*>(i)),
+                      thrd_success, "");
+        }
+        for (size_t i = 0; i < num_threads; i++) {
+            int rc;
+            ASSERT_EQ(thrd_join(threads[i], &rc), thrd_success, "");
+            ASSERT_EQ(rc, 0, "Metadata thread failed");
+        }
+        end = mx_ticks_get();
+        printf("Benchmark %zu thread(s): [%10lu] msec\n", num_threads,
+               (end - start) / ticks_per_msec);
+    }
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(basic_benchmarks)
 RUN_TEST_PERFORMANCE(benchmark_write_read)
+RUN_TEST_PERFORMANCE(benchmark_first_byte)
+RUN_TEST_PERFORMANCE(benchmark_random_write)
 RUN_TEST_PERFORMANCE(benchmark_path_walk)
+RUN_TEST_PERFORMANCE(benchmark_wide_directory)
+RUN_TEST_PERFORMANCE(benchmark_parallel_metadata)
 END_TEST_CASE(basic_benchmarks)
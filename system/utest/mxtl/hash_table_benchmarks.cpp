@@ -0,0 +1,115 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <magenta/new.h>
+#include <magenta/syscalls.h>
+#include <mxtl/intrusive_dynamic_hash_table.h>
+#include <mxtl/intrusive_hash_table.h>
+#include <mxtl/intrusive_single_list.h>
+#include <mxtl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+// Lookup cost of a fixed size HashTable (with its default 37 buckets) versus a
+// DynamicHashTable, at table sizes from 10^2 to 10^6 elements.  These run as
+// performance tests, so they only run when performance tests are asked for.
+
+namespace {
+
+class BenchObj : public mxtl::SinglyLinkedListable<BenchObj*> {
+public:
+    uint64_t GetKey() const { return key_; }
+    void SetKey(uint64_t key) { key_ = key; }
+
+    static uint64_t GetHash(const uint64_t& key) { return key * 0x9e3779b1u; }
+
+private:
+    uint64_t key_ = 0;
+};
+
+using FixedTable = mxtl::HashTable<uint64_t, BenchObj*>;
+using DynamicTable = mxtl::DynamicHashTable<uint64_t, BenchObj*>;
+
+constexpr size_t kMinObjs = 100;
+constexpr size_t kMaxObjs = 1000000;
+constexpr size_t kLookups = 10000;
+
+// Keys are spread out a bit rather than being 0..n-1, and lookups walk them in
+// a stride which visits every key once per pass.
+uint64_t ObjKey(size_t ndx) { return static_cast<uint64_t>(ndx) * 7919; }
+constexpr size_t kLookupStride = 7;
+
+template <typename TableType>
+uint64_t TimeLookups(TableType* table, size_t count, size_t* found_out) {
+    size_t ndx = 0;
+    size_t found = 0;
+
+    uint64_t start = mx_ticks_get();
+    for (size_t i = 0; i < kLookups; ++i) {
+        if (table->find(ObjKey(ndx)).IsValid())
+            ++found;
+        ndx = (ndx + kLookupStride) % count;
+    }
+    uint64_t end = mx_ticks_get();
+
+    *found_out = found;
+    return end - start;
+}
+
+template <typename TableType>
+bool BenchmarkTable(const char* name, BenchObj* objs, size_t count) {
+    BEGIN_HELPER;
+
+    uint64_t ticks_per_usec = mx_ticks_per_second() / 1000000;
+    if (ticks_per_usec == 0)
+        ticks_per_usec = 1;
+
+    TableType table;
+
+    uint64_t start = mx_ticks_get();
+    for (size_t i = 0; i < count; ++i)
+        table.insert(&objs[i]);
+    uint64_t insert_ticks = mx_ticks_get() - start;
+    ASSERT_EQ(count, table.size(), "");
+
+    size_t found;
+    uint64_t lookup_ticks = TimeLookups(&table, count, &found);
+    ASSERT_EQ(kLookups, found, "");
+
+    // Report the per-operation cost in nanoseconds.
+    printf("%-8s %8zu entries: insert %8" PRIu64 " ns/op, lookup %8" PRIu64 " ns/op\n",
+           name, count,
+           insert_ticks * 1000 / ticks_per_usec / count,
+           lookup_ticks * 1000 / ticks_per_usec / kLookups);
+
+    table.clear();
+
+    END_HELPER;
+}
+
+bool hash_table_lookup_benchmark() {
+    BEGIN_TEST;
+
+    AllocChecker ac;
+    mxtl::unique_ptr<BenchObj[]> objs(new (&ac) BenchObj[kMaxObjs]);
+    ASSERT_TRUE(ac.check(), "");
+    for (size_t i = 0; i < kMaxObjs; ++i)
+        objs[i].SetKey(ObjKey(i));
+
+    printf("\nBenchmarking hash table lookups\n");
+    for (size_t count = kMinObjs; count <= kMaxObjs; count *= 10) {
+        ASSERT_TRUE(BenchmarkTable<FixedTable>("fixed", objs.get(), count), "");
+        ASSERT_TRUE(BenchmarkTable<DynamicTable>("dynamic", objs.get(), count), "");
+    }
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(hash_table_benchmarks)
+RUN_TEST_PERFORMANCE(hash_table_lookup_benchmark)
+END_TEST_CASE(hash_table_benchmarks);
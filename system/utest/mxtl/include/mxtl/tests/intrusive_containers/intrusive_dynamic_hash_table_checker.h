@@ -0,0 +1,60 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <unittest/unittest.h>
+#include <mxtl/intrusive_dynamic_hash_table.h>
+#include <mxtl/tests/intrusive_containers/intrusive_doubly_linked_list_checker.h>
+#include <mxtl/tests/intrusive_containers/intrusive_singly_linked_list_checker.h>
+#include <mxtl/tests/intrusive_containers/test_environment_utils.h>
+
+namespace mxtl {
+namespace tests {
+namespace intrusive_containers {
+
+// The dynamic hash table sanity checker implementation is shared across
+// DynamicHashTables of all bucket types.
+class DynamicHashTableChecker {
+public:
+    template <typename ContainerType>
+    static bool SanityCheck(const ContainerType& container) {
+        using BucketType    = typename ContainerType::BucketType;
+        using BucketChecker = typename BucketType::CheckerType;
+        using KeyTraits     = typename ContainerType::KeyTraits;
+
+        BEGIN_TEST;
+
+        // Demand that every bucket of both bucket arrays pass its sanity
+        // check.  Keep a running total of the total size of the table in the
+        // process.
+        size_t total_size = 0;
+        for (size_t i = 0; i < container.bucket_ndx_count(); ++i) {
+            const BucketType& bucket = container.GetBucket(i);
+            ASSERT_TRUE(BucketChecker::SanityCheck(bucket), "");
+            total_size += SizeUtils<BucketType>::size(bucket);
+
+            // For every element in the bucket, make sure that the bucket index
+            // matches the one its key maps to.
+            for (const auto& obj : bucket) {
+                ASSERT_EQ(container.GetBucketNdx(KeyTraits::GetKey(obj)), i, "");
+            }
+        }
+
+        // Old buckets which have already been migrated must be empty.
+        if (container.old_buckets_ != nullptr) {
+            ASSERT_LT(container.migrate_ndx_, container.old_bucket_count(), "");
+            for (size_t i = 0; i < container.migrate_ndx_; ++i)
+                EXPECT_TRUE(container.old_buckets_[i].is_empty(), "");
+        }
+
+        EXPECT_EQ(container.size(), total_size, "");
+
+        END_TEST;
+    }
+};
+
+}  // namespace intrusive_containers
+}  // namespace tests
+}  // namespace mxtl
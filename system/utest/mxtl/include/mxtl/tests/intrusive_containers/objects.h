@@ -57,6 +57,19 @@ public:
     }
 };
 
+// The base class for objects kept in dynamically sized hash tables.  The
+// table reduces hashes to bucket indices itself, so the hash function just
+// hands back the key.
+template <typename KeyType, typename HashType>
+class DynamicHashedTestObjBase : public KeyedTestObjBase<KeyType>  {
+public:
+    explicit DynamicHashedTestObjBase(size_t val) : KeyedTestObjBase<KeyType>(val) { }
+
+    static HashType GetHash(const KeyType& key) {
+        return static_cast<HashType>(key);
+    }
+};
+
 // Container test objects are objects which...
 //
 // 1) Store a size_t value
@@ -0,0 +1,282 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <unittest/unittest.h>
+#include <magenta/new.h>
+#include <mxtl/intrusive_single_list.h>
+#include <mxtl/unique_ptr.h>
+#include <mxtl/intrusive_dynamic_hash_table.h>
+#include <mxtl/tests/intrusive_containers/associative_container_test_environment.h>
+#include <mxtl/tests/intrusive_containers/intrusive_dynamic_hash_table_checker.h>
+#include <mxtl/tests/intrusive_containers/test_thunks.h>
+
+namespace mxtl {
+namespace tests {
+namespace intrusive_containers {
+
+using OtherKeyType  = uint16_t;
+using OtherHashType = uint32_t;
+
+template <typename PtrType>
+struct OtherHashTraits {
+    using ObjType = typename ::mxtl::internal::ContainerPtrTraits<PtrType>::ValueType;
+    using BucketStateType = SinglyLinkedListNodeState<PtrType>;
+
+    // Linked List Traits
+    static BucketStateType& node_state(ObjType& obj) {
+        return obj.other_container_state_.bucket_state_;
+    }
+
+    // Keyed Object Traits
+    static OtherKeyType GetKey(const ObjType& obj) {
+        return obj.other_container_state_.key_;
+    }
+
+    static bool LessThan(const OtherKeyType& key1, const OtherKeyType& key2) {
+        return key1 <  key2;
+    }
+
+    static bool EqualTo(const OtherKeyType& key1, const OtherKeyType& key2) {
+        return key1 == key2;
+    }
+
+    // Hash Traits
+    static OtherHashType GetHash(const OtherKeyType& key) {
+        return static_cast<OtherHashType>(key * 0xaee58187);
+    }
+
+    // Set key is a trait which is only used by the tests, not by the containers
+    // themselves.
+    static void SetKey(ObjType& obj, OtherKeyType key) {
+        obj.other_container_state_.key_ = key;
+    }
+};
+
+template <typename PtrType>
+struct OtherHashState {
+private:
+    friend struct OtherHashTraits<PtrType>;
+    OtherKeyType key_;
+    typename OtherHashTraits<PtrType>::BucketStateType bucket_state_;
+};
+
+template <typename PtrType>
+class DHTSLLTraits {
+public:
+    using ObjType = typename ::mxtl::internal::ContainerPtrTraits<PtrType>::ValueType;
+
+    using ContainerType           = DynamicHashTable<size_t, PtrType>;
+    using ContainableBaseClass    = SinglyLinkedListable<PtrType>;
+    using ContainerStateType      = SinglyLinkedListNodeState<PtrType>;
+    using KeyType                 = typename ContainerType::KeyType;
+    using HashType                = typename ContainerType::HashType;
+
+    using OtherContainerTraits    = OtherHashTraits<PtrType>;
+    using OtherContainerStateType = OtherHashState<PtrType>;
+    using OtherBucketType         = SinglyLinkedList<PtrType, OtherContainerTraits>;
+    using OtherContainerType      = DynamicHashTable<OtherKeyType,
+                                                     PtrType,
+                                                     OtherBucketType,
+                                                     OtherHashType,
+                                                     OtherContainerTraits,
+                                                     OtherContainerTraits>;
+
+    using TestObjBaseType  = DynamicHashedTestObjBase<typename ContainerType::KeyType,
+                                                      typename ContainerType::HashType>;
+};
+
+DEFINE_TEST_OBJECTS(DHTSLL);
+using UMTE = DEFINE_TEST_THUNK(Associative, DHTSLL, Unmanaged);
+using UPTE = DEFINE_TEST_THUNK(Associative, DHTSLL, UniquePtr);
+using RPTE = DEFINE_TEST_THUNK(Associative, DHTSLL, RefPtr);
+
+// Push enough objects through a table to make it resize several times,
+// checking that every object can still be found (and that the table stays
+// sane) while resizes are underway.
+class GrowthTestObj : public SinglyLinkedListable<GrowthTestObj*> {
+public:
+    size_t GetKey() const { return key_; }
+    void SetKey(size_t key) { key_ = key; }
+    static size_t GetHash(const size_t& key) { return key; }
+
+private:
+    size_t key_ = 0;
+};
+
+static bool GrowthTest() {
+    BEGIN_TEST;
+
+    using ContainerType = DynamicHashTable<size_t, GrowthTestObj*>;
+    static constexpr size_t kObjCount = 4096;
+
+    AllocChecker ac;
+    unique_ptr<GrowthTestObj[]> objs(new (&ac) GrowthTestObj[kObjCount]);
+    ASSERT_TRUE(ac.check(), "");
+
+    ContainerType container;
+    EXPECT_EQ(ContainerType::kMinBuckets, container.bucket_count(), "");
+
+    size_t resizes = 0;
+    for (size_t i = 0; i < kObjCount; ++i) {
+        // Spread the keys out; the table has to cope with keys which are all
+        // multiples of a large power of two.
+        objs[i].SetKey(i << 12);
+
+        size_t buckets = container.bucket_count();
+        container.insert(&objs[i]);
+        if (container.bucket_count() != buckets) {
+            EXPECT_EQ(buckets * 2, container.bucket_count(), "");
+            EXPECT_TRUE(container.is_rehashing(), "");
+            ++resizes;
+        }
+
+        // Sanity checks walk the whole table, so only do them now and then.
+        if (container.is_rehashing() && ((i & 0x3f) == 0))
+            ASSERT_TRUE(DynamicHashTableChecker::SanityCheck(container), "");
+    }
+
+    EXPECT_EQ(kObjCount, container.size(), "");
+    EXPECT_GT(resizes, 1u, "");
+    EXPECT_LE(kObjCount, container.bucket_count() * ContainerType::kMaxLoadFactor, "");
+    ASSERT_TRUE(DynamicHashTableChecker::SanityCheck(container), "");
+
+    for (size_t i = 0; i < kObjCount; ++i) {
+        auto iter = container.find(i << 12);
+        ASSERT_TRUE(iter.IsValid(), "");
+        EXPECT_EQ(&objs[i], &(*iter), "");
+        EXPECT_FALSE(container.find((i << 12) + 1).IsValid(), "");
+    }
+
+    size_t visited = 0;
+    for (const auto& obj __UNUSED : container)
+        ++visited;
+    EXPECT_EQ(kObjCount, visited, "");
+
+    for (size_t i = 0; i < kObjCount; i += 2)
+        EXPECT_EQ(&objs[i], container.erase(i << 12), "");
+    EXPECT_EQ(kObjCount / 2, container.size(), "");
+    ASSERT_TRUE(DynamicHashTableChecker::SanityCheck(container), "");
+
+    container.clear();
+    EXPECT_TRUE(container.is_empty(), "");
+    EXPECT_FALSE(container.is_rehashing(), "");
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(dynamic_hashtable_sll_tests)
+//////////////////////////////////////////
+// General container specific tests.
+//////////////////////////////////////////
+RUN_NAMED_TEST("Clear (unmanaged)",            UMTE::ClearTest)
+RUN_NAMED_TEST("Clear (unique)",               UPTE::ClearTest)
+RUN_NAMED_TEST("Clear (RefPtr)",               RPTE::ClearTest)
+
+RUN_NAMED_TEST("ClearUnsafe (unmanaged)",      UMTE::ClearUnsafeTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("ClearUnsafe (unique)",         UPTE::ClearUnsafeTest)
+RUN_NAMED_TEST("ClearUnsafe (RefPtr)",         RPTE::ClearUnsafeTest)
+#endif
+
+RUN_NAMED_TEST("IsEmpty (unmanaged)",          UMTE::IsEmptyTest)
+RUN_NAMED_TEST("IsEmpty (unique)",             UPTE::IsEmptyTest)
+RUN_NAMED_TEST("IsEmpty (RefPtr)",             RPTE::IsEmptyTest)
+
+RUN_NAMED_TEST("Iterate (unmanaged)",          UMTE::IterateTest)
+RUN_NAMED_TEST("Iterate (unique)",             UPTE::IterateTest)
+RUN_NAMED_TEST("Iterate (RefPtr)",             RPTE::IterateTest)
+
+// Hashtables with singly linked list bucket can perform direct
+// iterator/reference erase operations, but the operations will be O(n)
+RUN_NAMED_TEST("IterErase (unmanaged)",        UMTE::IterEraseTest)
+RUN_NAMED_TEST("IterErase (unique)",           UPTE::IterEraseTest)
+RUN_NAMED_TEST("IterErase (RefPtr)",           RPTE::IterEraseTest)
+
+RUN_NAMED_TEST("DirectErase (unmanaged)",      UMTE::DirectEraseTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("DirectErase (unique)",         UPTE::DirectEraseTest)
+#endif
+RUN_NAMED_TEST("DirectErase (RefPtr)",         RPTE::DirectEraseTest)
+
+RUN_NAMED_TEST("MakeIterator (unmanaged)",     UMTE::MakeIteratorTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("MakeIterator (unique)",        UPTE::MakeIteratorTest)
+#endif
+RUN_NAMED_TEST("MakeIterator (RefPtr)",        RPTE::MakeIteratorTest)
+
+// HashTables with SinglyLinkedList buckets cannot iterate backwards (because
+// their buckets cannot iterate backwards)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("ReverseIterErase (unmanaged)", UMTE::ReverseIterEraseTest)
+RUN_NAMED_TEST("ReverseIterErase (unique)",    UPTE::ReverseIterEraseTest)
+RUN_NAMED_TEST("ReverseIterErase (RefPtr)",    RPTE::ReverseIterEraseTest)
+
+RUN_NAMED_TEST("ReverseIterate (unmanaged)",   UMTE::ReverseIterateTest)
+RUN_NAMED_TEST("ReverseIterate (unique)",      UPTE::ReverseIterateTest)
+RUN_NAMED_TEST("ReverseIterate (RefPtr)",      RPTE::ReverseIterateTest)
+#endif
+
+// Dynamic hash tables do not support swapping or Rvalue operations (Assignment
+// or construction) any more than fixed size hash tables do.
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("Swap (unmanaged)",             UMTE::SwapTest)
+RUN_NAMED_TEST("Swap (unique)",                UPTE::SwapTest)
+RUN_NAMED_TEST("Swap (RefPtr)",                RPTE::SwapTest)
+
+RUN_NAMED_TEST("Rvalue Ops (unmanaged)",       UMTE::RvalueOpsTest)
+RUN_NAMED_TEST("Rvalue Ops (unique)",          UPTE::RvalueOpsTest)
+RUN_NAMED_TEST("Rvalue Ops (RefPtr)",          RPTE::RvalueOpsTest)
+#endif
+
+RUN_NAMED_TEST("Scope (unique)",               UPTE::ScopeTest)
+RUN_NAMED_TEST("Scope (RefPtr)",               RPTE::ScopeTest)
+
+RUN_NAMED_TEST("TwoContainer (unmanaged)",     UMTE::TwoContainerTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("TwoContainer (unique)",        UPTE::TwoContainerTest)
+#endif
+RUN_NAMED_TEST("TwoContainer (RefPtr)",        RPTE::TwoContainerTest)
+
+RUN_NAMED_TEST("IterCopyPointer (unmanaged)",  UMTE::IterCopyPointerTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("IterCopyPointer (unique)",     UPTE::IterCopyPointerTest)
+#endif
+RUN_NAMED_TEST("IterCopyPointer (RefPtr)",     RPTE::IterCopyPointerTest)
+
+RUN_NAMED_TEST("EraseIf (unmanaged)",          UMTE::EraseIfTest)
+RUN_NAMED_TEST("EraseIf (unique)",             UPTE::EraseIfTest)
+RUN_NAMED_TEST("EraseIf (RefPtr)",             RPTE::EraseIfTest)
+
+RUN_NAMED_TEST("FindIf (unmanaged)",           UMTE::FindIfTest)
+RUN_NAMED_TEST("FindIf (unique)",              UPTE::FindIfTest)
+RUN_NAMED_TEST("FindIf (RefPtr)",              RPTE::FindIfTest)
+
+//////////////////////////////////////////
+// Associative container specific tests.
+//////////////////////////////////////////
+RUN_NAMED_TEST("InsertByKey (unmanaged)",      UMTE::InsertByKeyTest)
+RUN_NAMED_TEST("InsertByKey (unique)",         UPTE::InsertByKeyTest)
+RUN_NAMED_TEST("InsertByKey (RefPtr)",         RPTE::InsertByKeyTest)
+
+RUN_NAMED_TEST("FindByKey (unmanaged)",        UMTE::FindByKeyTest)
+RUN_NAMED_TEST("FindByKey (unique)",           UPTE::FindByKeyTest)
+RUN_NAMED_TEST("FindByKey (RefPtr)",           RPTE::FindByKeyTest)
+
+RUN_NAMED_TEST("EraseByKey (unmanaged)",       UMTE::EraseByKeyTest)
+RUN_NAMED_TEST("EraseByKey (unique)",          UPTE::EraseByKeyTest)
+RUN_NAMED_TEST("EraseByKey (RefPtr)",          RPTE::EraseByKeyTest)
+
+RUN_NAMED_TEST("InsertOrFind (unmanaged)",     UMTE::InsertOrFindTest)
+RUN_NAMED_TEST("InsertOrFind (unique)",        UPTE::InsertOrFindTest)
+RUN_NAMED_TEST("InsertOrFind (RefPtr)",        RPTE::InsertOrFindTest)
+
+//////////////////////////////////////////
+// Dynamic hash table specific tests.
+//////////////////////////////////////////
+RUN_NAMED_TEST("Growth (unmanaged)",           GrowthTest)
+END_TEST_CASE(dynamic_hashtable_sll_tests);
+
+}  // namespace intrusive_containers
+}  // namespace tests
+}  // namespace mxtl
@@ -56,6 +56,38 @@ static bool ref_counted_test() {
     END_TEST;
 }
 
+class UpgradeTracker : public mxtl::RefCounted<UpgradeTracker> {
+public:
+    explicit UpgradeTracker(bool* upgraded_in_destructor)
+        : upgraded_in_destructor_(upgraded_in_destructor) {}
+    ~UpgradeTracker() {
+        *upgraded_in_destructor_ =
+            (mxtl::internal::MakeRefPtrUpgradeFromRaw(this) != nullptr);
+    }
+
+private:
+    bool* upgraded_in_destructor_;
+};
+
+static bool upgrade_from_raw_test() {
+    BEGIN_TEST;
+
+    bool upgraded_in_destructor = true;
+    {
+        AllocChecker ac;
+        mxtl::RefPtr<UpgradeTracker> ptr =
+            mxtl::AdoptRef(new (&ac) UpgradeTracker(&upgraded_in_destructor));
+        EXPECT_TRUE(ac.check(), "");
+
+        mxtl::RefPtr<UpgradeTracker> upgraded =
+            mxtl::internal::MakeRefPtrUpgradeFromRaw(ptr.get());
+        EXPECT_TRUE(upgraded == ptr, "live object should upgrade");
+    }
+    EXPECT_FALSE(upgraded_in_destructor, "object being destroyed should not upgrade");
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(ref_counted_tests)
 RUN_NAMED_TEST("Ref Counted", ref_counted_test)
+RUN_NAMED_TEST("Upgrade From Raw", upgrade_from_raw_test)
 END_TEST_CASE(ref_counted_tests);
@@ -157,6 +157,46 @@ int vmo_run_benchmark() {
 
     mx_handle_close(vmo);
 
+    // commit and map vmos of increasing size in one shot, reporting throughput
+    for (size_t bulk_size = 16*1024*1024; bulk_size <= 1024*1024*1024; bulk_size *= 4) {
+        if (mx_vmo_create(bulk_size, 0, &vmo) < 0)
+            break;
+
+        mx_status_t status = NO_ERROR;
+        t = time_it([&](){
+            status = mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, bulk_size, nullptr, 0);
+            if (status == NO_ERROR) {
+                status = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, bulk_size,
+                                     MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE |
+                                     MX_VM_FLAG_MAP_RANGE, &ptr);
+            }
+        });
+        if (status < 0) {
+            printf("\tstopping commit+map at vmo of size %zu: error %d\n", bulk_size, status);
+            mx_handle_close(vmo);
+            break;
+        }
+        printf("\ttook %" PRIu64 " nsecs to commit and map vmo of size %zu (%.2f GiB/s)\n",
+               t, bulk_size, t ? (double)bulk_size / (1024.0*1024*1024) / ((double)t / 1e9) : 0.0);
+
+        mx_vmar_unmap(mx_vmar_root_self(), ptr, bulk_size);
+
+        // map the now committed vmo again, which is the map half on its own
+        t = time_it([&](){
+            status = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, bulk_size,
+                                 MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE |
+                                 MX_VM_FLAG_MAP_RANGE, &ptr);
+        });
+        if (status == NO_ERROR) {
+            printf("\ttook %" PRIu64 " nsecs to map committed vmo of size %zu (%.2f GiB/s)\n",
+                   t, bulk_size,
+                   t ? (double)bulk_size / (1024.0*1024*1024) / ((double)t / 1e9) : 0.0);
+            mx_vmar_unmap(mx_vmar_root_self(), ptr, bulk_size);
+        }
+
+        mx_handle_close(vmo);
+    }
+
     printf("done with benchmark\n");
 
     return 0;
@@ -1,7 +1,7 @@
 #include "pthread_impl.h"
 
 int pthread_mutex_timedlock(pthread_mutex_t* restrict m, const struct timespec* restrict at) {
-    if ((m->_m_type & PTHREAD_MUTEX_MASK) == PTHREAD_MUTEX_NORMAL &&
+    if (m->_m_type == PTHREAD_MUTEX_NORMAL &&
         !a_cas_shim(&m->_m_lock, 0, EBUSY))
         return 0;
 
@@ -25,7 +25,11 @@ int pthread_mutex_timedlock(pthread_mutex_t* restrict m, const struct timespec*
         atomic_fetch_add(&m->_m_waiters, 1);
         t = r | PTHREAD_MUTEX_OWNED_LOCK_BIT;
         a_cas_shim(&m->_m_lock, r, t);
-        r = __timedwait(&m->_m_lock, t, CLOCK_REALTIME, at);
+        if (m->_m_type & PTHREAD_MUTEX_PRIO_INHERIT_BIT)
+            r = __timedwait_pi(&m->_m_lock, t, t & PTHREAD_MUTEX_OWNED_LOCK_MASK,
+                               CLOCK_REALTIME, at);
+        else
+            r = __timedwait(&m->_m_lock, t, CLOCK_REALTIME, at);
         atomic_fetch_sub(&m->_m_waiters, 1);
         if (r)
             break;
@@ -1,7 +1,16 @@
 #include "pthread_impl.h"
 
 int pthread_mutexattr_setprotocol(pthread_mutexattr_t* a, int protocol) {
-    if (protocol)
+    switch (protocol) {
+    case PTHREAD_PRIO_NONE:
+        a->__attr &= ~PTHREAD_MUTEX_PRIO_INHERIT_BIT;
+        return 0;
+    case PTHREAD_PRIO_INHERIT:
+        a->__attr |= PTHREAD_MUTEX_PRIO_INHERIT_BIT;
+        return 0;
+    case PTHREAD_PRIO_PROTECT:
         return ENOTSUP;
-    return 0;
+    default:
+        return EINVAL;
+    }
 }